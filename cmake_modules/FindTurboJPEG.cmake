@@ -0,0 +1,24 @@
+# - Find TurboJPEG
+# Find the libjpeg-turbo TurboJPEG API includes and library
+# This module defines
+#  TurboJPEG_INCLUDE_DIR, where to find turbojpeg.h.
+#  TurboJPEG_LIBRARY, the turbojpeg library.
+#  TurboJPEG_FOUND, If false, do not try to use TurboJPEG.
+
+find_path(TurboJPEG_INCLUDE_DIR
+  NAMES turbojpeg.h
+)
+
+find_library(TurboJPEG_LIBRARY
+  NAMES turbojpeg libturbojpeg
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(TurboJPEG
+  FOUND_VAR TurboJPEG_FOUND
+  REQUIRED_VARS
+    TurboJPEG_LIBRARY
+    TurboJPEG_INCLUDE_DIR
+)
+
+mark_as_advanced(TurboJPEG_INCLUDE_DIR TurboJPEG_LIBRARY)
@@ -173,6 +173,13 @@ bool V4L2_Driver::initProperties()
     IUFillTextVector(&PortTP, PortT, NARRAY(PortT), getDeviceName(), INDI::SP::DEVICE_PORT, "Ports", OPTIONS_TAB, IP_RW, 0,
                      IPS_IDLE);
 
+    /* Capture memory, user pointer buffers are cached memory read faster than the memory mapped buffers of some devices */
+    CaptureMemorySP[CAPTURE_MEMORY_MMAP].fill("MMAP", "Memory Mapped", ISS_ON);
+    CaptureMemorySP[CAPTURE_MEMORY_USERPTR].fill("USERPTR", "User Pointer", ISS_OFF);
+    CaptureMemorySP.fill(getDeviceName(), "V4L2_CAPTURE_MEMORY", "Capture Memory", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0,
+                         IPS_IDLE);
+    CaptureMemorySP.load();
+
 
     // Capture format.
     CaptureFormat mono = {"INDI_MONO", "Mono", 8};
@@ -271,6 +278,7 @@ void V4L2_Driver::ISGetProperties(const char * dev)
     INDI::CCD::ISGetProperties(dev);
 
     defineProperty(&PortTP);
+    defineProperty(CaptureMemorySP);
 
     if (isConnected())
     {
@@ -625,6 +633,18 @@ bool V4L2_Driver::ISNewSwitch(const char * dev, const char * name, ISState * sta
         return true;
     }
 
+    /* Capture Memory */
+    if (CaptureMemorySP.isNameMatch(name))
+    {
+        CaptureMemorySP.update(states, names, n);
+        CaptureMemorySP.setState(IPS_OK);
+        CaptureMemorySP.apply();
+        if (isConnected())
+            LOG_INFO("Capture memory change takes effect on the next connection.");
+        saveConfig(true, CaptureMemorySP.getName());
+        return true;
+    }
+
     /* Stacking Mode */
     if (StackModeSP.isNameMatch(name))
     {
@@ -1461,6 +1481,35 @@ void V4L2_Driver::newFrame()
         int totalBytes        = 0;
         unsigned char * buffer = nullptr;
 
+        // Mono frames needing no decoding are cropped and downscaled from the capture buffer straight into the stream
+        // frame pool, skipping the decoder and CCD buffers
+        V4L2_FrameView view;
+        if (CaptureFormatSP[IMAGE_MONO].getState() == ISS_ON && PrimaryCCD.getBinX() == 1 && v4l_base->getFrameView(view))
+        {
+            unsigned char * dest = Streamer->acquireFrame(view.width * view.height);
+            if (dest == nullptr)
+                return;
+
+            const unsigned char * row = view.data;
+            for (unsigned int y = 0; y < view.height; y++, row += view.stride)
+            {
+                if (view.bpp == 8)
+                {
+                    memcpy(dest, row, view.width);
+                    dest += view.width;
+                }
+                else
+                {
+                    const unsigned char * src = row + 1; // Y16 is little endian
+                    for (unsigned int x = 0; x < view.width; x++, src += 2)
+                        *dest++ = *src;
+                }
+            }
+
+            Streamer->publishFrame();
+            return;
+        }
+
         std::unique_lock<std::mutex> guard(ccdBufferLock);
 
         if (v4l_base->getFormat() == V4L2_PIX_FMT_MJPEG)
@@ -1823,6 +1872,9 @@ bool V4L2_Driver::Connect()
     char errmsg[ERRMSGSIZ];
     if (!isConnected())
     {
+        v4l_base->setIOMethod(CaptureMemorySP[CAPTURE_MEMORY_USERPTR].getState() == ISS_ON ?
+                              INDI::V4L2_Base::IO_METHOD_USERPTR : INDI::V4L2_Base::IO_METHOD_MMAP);
+
         if (v4l_base->connectCam(PortT[0].text, errmsg) < 0)
         {
             LOGF_ERROR("Error: unable to open device %s: %s", PortT[0].text, errmsg);
@@ -2082,6 +2134,7 @@ bool V4L2_Driver::saveConfigItems(FILE * fp)
     INDI::CCD::saveConfigItems(fp);
 
     IUSaveConfigText(fp, &PortTP);
+    CaptureMemorySP.save(fp);
     StackModeSP.save(fp);
 
     if (ImageAdjustNP.nnp > 0)
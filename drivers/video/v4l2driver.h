@@ -119,6 +119,12 @@ public:
             IMAGE_RGB
         };
 
+        enum
+        {
+            CAPTURE_MEMORY_MMAP = 0,
+            CAPTURE_MEMORY_USERPTR
+        };
+
         enum stackmodes
         {
             STACK_NONE       = 0,
@@ -146,6 +152,7 @@ public:
         /* Switch vectors */
         ISwitchVectorProperty ImageDepthSP;     /* 8 bits or 16 bits switch */
         INDI::PropertySwitch  StackModeSP {5};  /* StackMode switch */
+        INDI::PropertySwitch  CaptureMemorySP {2}; /* Memory of the capture buffers */
         ISwitchVectorProperty InputsSP;         /* Select input switch */
         ISwitchVectorProperty CaptureFormatsSP; /* Select Capture format switch */
         ISwitchVectorProperty CaptureSizesSP;   /* Select Capture size switch (Discrete)*/
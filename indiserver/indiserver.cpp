@@ -33,6 +33,11 @@
  * 2017-01-29 JM: Added option to drop stream blobs if client blob queue is
  * higher than maxstreamsiz bytes
  *
+ * Stream blobs are also rate controlled per client: a queued frame that did not
+ * start to be sent is replaced by the next frame of the same property, and new
+ * frames are dropped while the client is more than maxstreamlag seconds behind,
+ * estimated from the rate it drains its queue.
+ *
  * Implementation notes:
  *
  * We fork each driver and open a server socket listening for INDI clients.
@@ -49,6 +54,8 @@
 #endif
 
 #include "config.h"
+#include <algorithm>
+#include <chrono>
 #include <set>
 #include <string>
 #include <list>
@@ -87,6 +94,7 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/un.h>
@@ -99,11 +107,17 @@
 #define INDIPORT      7624    /* default TCP/IP port to listen */
 #define INDIUNIXSOCK "/tmp/indiserver" /* default unix socket path (local connections) */
 #define MAXSBUF       512
-#define MAXRBUF       49152 /* max read buffering here */
-#define MAXWSIZ       49152 /* max bytes/write */
+#define MAXRBUF       49152 /* initial read buffering here */
+#define MAXRBUFGROW   (1024 * 1024) /* read buffer grows up to this for connections sending large messages */
+#define MAXRBURST     16    /* max reads per wakeup, if the fd keeps providing data */
+#define MAXWSIZ       (1024 * 1024) /* max bytes gathered per write */
+#define MAXWIOV       64    /* max chunks gathered per write */
+#define MAXWBURST     8     /* max writes per wakeup, if the fd keeps accepting data */
 #define SHORTMSGSIZ   2048  /* buf size for most messages */
 #define DEFMAXQSIZ    128   /* default max q behind, MB */
 #define DEFMAXSSIZ    5     /* default max stream behind, MB */
+#define DEFMAXSLAG    2     /* default max stream behind, seconds */
+#define DRAINWINDOW   0.5   /* seconds of writing per drain rate sample */
 #define DEFMAXRESTART 10    /* default max restarts */
 #define MAXFD_PER_MESSAGE 16 /* No more than 16 buffer attached to a message */
 #ifdef OSX_EMBEDED_MODE
@@ -251,6 +265,76 @@ class Collectable
         {
             return HeartBeat(id, current);
         }
+
+        /* id in the current ConcurrentSet, 0 if none */
+        unsigned long collectableId() const
+        {
+            return id;
+        }
+};
+
+/* Optional pool of I/O threads (-t). Each thread runs its own event loop and
+ * serves a share of the client and driver connections. All event loops invoke
+ * their callbacks while holding serverLock, so routing messages between
+ * connections served by different threads needs no further synchronization.
+ * The lock is only released while a loop waits for events and around the
+ * socket I/O and XML parsing of a connection, which is where time goes under load.
+ */
+class IoThread
+{
+        ev::dynamic_loop ioLoop;
+        ev::async wakeup;
+        std::thread thread;
+
+        void run();
+
+        static std::vector<IoThread *> threads;
+        static unsigned long nextThread;
+        static thread_local struct ev_loop * currentLoop;
+
+        static void releaseLock(struct ev_loop *) noexcept;
+        static void acquireLock(struct ev_loop *) noexcept;
+        static void onWakeup(ev::async &, int) {}
+
+        /* Register an async watcher that allows other threads to wake the loop up */
+        static void initWakeup(struct ev_loop * l, ev::async &wakeup);
+
+        IoThread();
+    public:
+        /* Guards all server state when I/O threads are used */
+        static std::mutex serverLock;
+
+        /* Start count I/O threads. Called once from main, before any connection exists.
+         * The calling thread holds serverLock until the main loop waits for events. */
+        static void startAll(int count);
+
+        /* Pick the loop that will serve a new connection. Main loop if no I/O threads */
+        static struct ev_loop * assignLoop();
+
+        /* Make loop l aware of watcher changes done from another thread */
+        static void wake(struct ev_loop * l);
+
+        static bool enabled()
+        {
+            return !threads.empty();
+        }
+};
+
+/* Release serverLock during the lifetime of the object, when I/O threads are used */
+class ServerUnlock
+{
+    public:
+        ServerUnlock()
+        {
+            if (IoThread::enabled())
+                IoThread::serverLock.unlock();
+        }
+
+        ~ServerUnlock()
+        {
+            if (IoThread::enabled())
+                IoThread::serverLock.lock();
+        }
 };
 
 /**
@@ -278,6 +362,46 @@ class Msg;
 class MsgQueue;
 class MsgChunckIterator;
 
+/* Chunks of queued messages, gathered for a single writev/sendmsg */
+class WriteBatch
+{
+    public:
+        struct iovec iov[MAXWIOV];
+        int iovCount = 0;
+        size_t size = 0;
+        std::vector<int> sharedBuffers;
+
+        void clear()
+        {
+            iovCount = 0;
+            size = 0;
+            sharedBuffers.clear();
+        }
+
+        bool full() const
+        {
+            return iovCount == MAXWIOV || size >= MAXWSIZ;
+        }
+
+        void add(char * data, size_t len)
+        {
+            iov[iovCount].iov_base = data;
+            iov[iovCount].iov_len = len;
+            iovCount++;
+            size += len;
+        }
+
+        /* Attach fds to the batch. They travel with the first byte written, so only the first chunk
+         * of a batch may carry some: otherwise a partial write would send them twice */
+        bool addSharedBuffers(const std::vector<int> &fds)
+        {
+            if (iovCount > 0)
+                return false;
+            sharedBuffers = fds;
+            return true;
+        }
+};
+
 class SerializationRequirement
 {
         friend class Msg;
@@ -382,7 +506,13 @@ class SerializedMsg
         // It is possible to have 0 to send, meaning end was actually reached
         bool getContent(MsgChunckIterator &position, void * &data, ssize_t &nsend, std::vector<int> &sharedBuffers);
 
-        void advance(MsgChunckIterator &position, ssize_t s);
+        // Append the content available from position to batch.
+        // Return true if the end of the message was reached (the next message can be gathered as well)
+        bool gatherContent(const MsgChunckIterator &position, WriteBatch &batch);
+
+        // Move position forward by up to s bytes. Return the number of bytes actually consumed,
+        // less than s when the end of the available content is reached
+        ssize_t advance(MsgChunckIterator &position, ssize_t s);
 
         // When a queue is done with sending this message
         void release(MsgQueue * from);
@@ -408,9 +538,13 @@ class SerializedMsgWithSharedBuffer: public SerializedMsg
 
 class SerializedMsgWithoutSharedBuffer: public SerializedMsg
 {
+        // Send blobs as raw bytes announced by a rawlen attribute instead of base64
+        bool binary;
+        // Shared buffers sent as is, mapped until the message is released
+        std::vector<std::pair<void*, size_t>> mappedBlobs;
 
     public:
-        SerializedMsgWithoutSharedBuffer(Msg * parent);
+        SerializedMsgWithoutSharedBuffer(Msg * parent, bool binary = false);
         virtual ~SerializedMsgWithoutSharedBuffer();
 
         virtual bool generateContentAsync() const;
@@ -466,9 +600,11 @@ class Msg
         // Convertion task and resultat of the task
         SerializedMsg* convertionToSharedBuffer;
         SerializedMsg* convertionToInline;
+        SerializedMsg* convertionToBinary;
 
         SerializedMsg * buildConvertionToSharedBuffer();
         SerializedMsg * buildConvertionToInline();
+        SerializedMsg * buildConvertionToBinary();
 
         bool fetchBlobs(std::list<int> &incomingSharedBuffers);
 
@@ -507,6 +643,9 @@ class Msg
          *  - attached => inline
          * Frequent. The convertion will be made during write. The convert/write must be offshored to a dedicated thread.
          *
+         *  - attached/inline => binary
+         * For clients that asked for binary blobs. Attached buffers are sent as is, inline ones are decoded once.
+         *
          * The returned AsyncTask will be ready once "to" can write the message
          */
         SerializedMsg * serialize(MsgQueue * from);
@@ -516,9 +655,17 @@ class MsgQueue: public Collectable
 {
         int rFd, wFd;
         LilXML * lp;         /* XML parsing context */
+        struct ev_loop * ioLoop; /* Event loop serving this connection */
         ev::io   rio, wio;   /* Event loop io events */
         void ioCb(ev::io &watcher, int revents);
 
+        /* Set while I/O is performed without serverLock. close() is then postponed until it completes */
+        bool ioBusy = false;
+        bool closePending = false;
+
+        /* Leave an unlocked I/O section. Return true if the connection was closed meanwhile (this is deleted) */
+        bool closeIfPending();
+
         // Update the status of FD read/write ability
         void updateIos();
 
@@ -530,13 +677,39 @@ class MsgQueue: public Collectable
         // Position in the head message
         MsgChunckIterator nsent;
 
+        /* Last message queued for each key of pushLatestMsg, while it is in msgq */
+        std::map<std::string, SerializedMsg*> latestMsgs;
+        void forgetLatestMsg(const SerializedMsg * msg);
+
+        /* Write throughput, measured only while messages are waiting */
+        double drainRate = 0;                               /* bytes per second, 0 until measured */
+        size_t drainBytes = 0;                              /* written since drainStart */
+        std::chrono::steady_clock::time_point drainStart;   /* start of the current sample */
+        void updateDrainRate(size_t written);
+
         // Handle fifo or socket case
-        size_t doRead(char * buff, size_t len);
+        ssize_t doRead(char * buff, size_t len);
         void readFromFd();
 
-        /* write the next chunk of the current message in the queue to the given
-         * client. pop message from queue when complete and free the message if we are
-         * the last one to use it. shut down this client if trouble.
+        /* Read buffer, doubled while reads fill it up to MAXRBUFGROW, and the elements parsed in a wakeup.
+         * Reused between reads */
+        std::vector<char> rbuf;
+        std::vector<XMLEle *> rnodes;
+
+        /* Chunks gathered for the current write and room for the fds to attach. Reused between writes */
+        WriteBatch wbatch;
+        union
+        {
+            size_t align;
+            char control[CMSG_SPACE(MAXFD_PER_MESSAGE * sizeof(int))];
+        } wcontrol;
+
+        /* gather the ready content of the queued messages into wbatch */
+        void gatherWriteBatch();
+
+        /* write the ready content of the messages in the queue to the given
+         * client. pop messages from queue when complete and free them if we are
+         * the last one to use them. shut down this client if trouble.
          */
         void writeToFd();
 
@@ -557,6 +730,9 @@ class MsgQueue: public Collectable
         /* Close the connection. (May be restarted later depending on driver logic) */
         virtual void close() = 0;
 
+        /* Return true if the connection is doing I/O from another thread. The close is then done when it completes */
+        bool deferClose();
+
         /* Close the writing part of the connection. By default, shutdown the write part, but keep on reading. May delete this */
         virtual void closeWritePart();
 
@@ -572,11 +748,30 @@ class MsgQueue: public Collectable
     public:
         virtual ~MsgQueue();
 
-        void pushMsg(Msg * msg);
+        /* Queue msg. Return its serialization for this queue, or nullptr if the queue is closed */
+        SerializedMsg * pushMsg(Msg * msg);
+
+        /* Queue msg. It can be replaced by the next message pushed with the same key, until it starts to be sent */
+        void pushLatestMsg(Msg * msg, const std::string &key);
+
+        /* Remove the message pushed with key if it did not start to be sent yet. Return true if removed */
+        bool dropLatestMsg(const std::string &key);
 
         /* return storage size of all Msqs on the given q */
         unsigned long msgQSize() const;
 
+        /* return the number of messages on the queue */
+        size_t msgQCount() const
+        {
+            return msgq.size();
+        }
+
+        /* return the bytes per second written while messages were waiting, 0 if not measured yet */
+        double getDrainRate() const
+        {
+            return drainRate;
+        }
+
         SerializedMsg * headMsg() const;
         void consumeHeadMsg();
 
@@ -592,6 +787,12 @@ class MsgQueue: public Collectable
             return useSharedBuffer;
         }
 
+        /* Blobs may be sent as raw bytes instead of base64 */
+        virtual bool acceptBinaryBlobs() const
+        {
+            return false;
+        }
+
         virtual void log(const std::string &log) const;
 };
 
@@ -606,6 +807,40 @@ class Property
         Property(const std::string &dev, const std::string &name): dev(dev), name(name) {}
 };
 
+/* Connections interested in each device and property, to route a message without
+ * visiting every connection and its property list. Connections are recorded by
+ * their id in their ConcurrentSet, so that routes can be checked for connections
+ * closed meanwhile.
+ */
+class Subscriptions
+{
+    public:
+        struct Route
+        {
+            unsigned long id;
+            Property *prop;     /* registration for the property, else for the device, else nullptr */
+        };
+
+        /* register connection id for prop, for all properties of prop->dev if prop->name is empty */
+        void add(unsigned long id, Property *prop);
+
+        /* register connection id for all devices */
+        void addAll(unsigned long id);
+
+        /* forget connection id, registered for props */
+        void remove(unsigned long id, const std::list<Property*> &props);
+
+        /* return the routes of dev/name, by increasing id */
+        std::vector<Route> find(const std::string &dev, const std::string &name) const;
+
+    private:
+        typedef std::map<unsigned long, Property*> Subscribers;
+
+        /* dev -> name, empty for the whole device -> subscribers */
+        std::unordered_map<std::string, std::unordered_map<std::string, Subscribers>> index;
+        std::set<unsigned long> all;
+};
+
 
 class Fifo
 {
@@ -655,6 +890,11 @@ class ClInfo: public MsgQueue
         std::list<Property*> props;     /* props we want */
         int allprops = 0;               /* saw getProperties w/o device */
         BLOBHandling blob = B_NEVER;    /* when to send setBLOBs */
+        bool binaryBlobs = false;       /* enableBLOB binary='true' seen, send raw blob bytes */
+
+        unsigned long streamQueued = 0;     /* stream blobs queued */
+        unsigned long streamReplaced = 0;   /* stream blobs replaced by a newer frame before being sent */
+        unsigned long streamDropped = 0;    /* stream blobs not queued because the client is behind */
 
         ClInfo(bool useSharedBuffer);
         virtual ~ClInfo();
@@ -667,6 +907,11 @@ class ClInfo: public MsgQueue
          */
         void addDevice(const std::string &dev, const std::string &name, int isblob);
 
+        virtual bool acceptBinaryBlobs() const
+        {
+            return binaryBlobs;
+        }
+
         virtual void log(const std::string &log) const;
 
         /* put Msg mp on queue of each chained server client, except notme.
@@ -678,8 +923,14 @@ class ClInfo: public MsgQueue
          */
         static void q2Clients(ClInfo *notme, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root);
 
+        /* log the queue depth, drain rate and stream counters of the client */
+        void logStatus() const;
+
         /* Reference to all active clients */
         static ConcurrentSet<ClInfo> clients;
+
+        /* Clients by device and property they want */
+        static Subscriptions routes;
 };
 
 /* info for each connected driver */
@@ -748,6 +999,9 @@ class DvrInfo: public MsgQueue
         /* Reference to all active drivers */
         static ConcurrentSet<DvrInfo> drivers;
 
+        /* Drivers by device and property they snoop */
+        static Subscriptions snoops;
+
         // decoding of attached blobs from driver is not supported ATM. Be conservative here
         virtual bool acceptSharedBuffers() const
         {
@@ -879,7 +1133,9 @@ static int verbose;                                    /* chattiness */
 static char *ldir;                                     /* where to log driver messages */
 static unsigned int maxqsiz  = (DEFMAXQSIZ * 1024 * 1024); /* kill if these bytes behind */
 static unsigned int maxstreamsiz  = (DEFMAXSSIZ * 1024 * 1024); /* drop blobs if these bytes behind while streaming*/
+static double maxstreamlag = DEFMAXSLAG; /* drop blobs if these seconds behind while streaming */
 static int maxrestarts   = DEFMAXRESTART;
+static int ioThreads     = 0;                          /* I/O threads, 0 to serve everything from main loop */
 
 static std::vector<XMLEle *> findBlobElements(XMLEle * root);
 
@@ -961,6 +1217,15 @@ int main(int ac, char *av[])
                     maxstreamsiz = 1024 * 1024 * atoi(*++av);
                     ac--;
                     break;
+                case 's':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-s requires max stream seconds behind\n");
+                        usage();
+                    }
+                    maxstreamlag = atof(*++av);
+                    ac--;
+                    break;
 #ifdef ENABLE_INDI_SHARED_MEMORY
                 case 'u':
                     if (ac < 2)
@@ -992,6 +1257,17 @@ int main(int ac, char *av[])
                         maxrestarts = 0;
                     ac--;
                     break;
+                case 't':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-t requires number of I/O threads\n");
+                        usage();
+                    }
+                    ioThreads = atoi(*++av);
+                    if (ioThreads < 0)
+                        ioThreads = 0;
+                    ac--;
+                    break;
                 case 'v':
                     verbose++;
                     break;
@@ -1008,6 +1284,10 @@ int main(int ac, char *av[])
     /* take care of some unixisms */
     noSIGPIPE();
 
+    /* spread connections over I/O threads, if requested */
+    if (ioThreads > 0)
+        IoThread::startAll(ioThreads);
+
     /* start each driver */
     while (ac-- > 0)
     {
@@ -1077,12 +1357,17 @@ static void usage(void)
     fprintf(stderr,
             " -d m     : drop streaming blobs if client gets more than this many MB behind, default %d. 0 to disable\n",
             DEFMAXSSIZ);
+    fprintf(stderr,
+            " -s s     : drop streaming blobs if client gets more than this many seconds behind, default %d. 0 to disable\n",
+            DEFMAXSLAG);
 #ifdef ENABLE_INDI_SHARED_MEMORY
     fprintf(stderr, " -u path  : Path for the local connection socket (abstract), default %s\n", INDIUNIXSOCK);
 #endif
     fprintf(stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
     fprintf(stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
+    fprintf(stderr, " -t n     : serve clients and drivers from n I/O threads, default 0 (main loop only)\n");
     fprintf(stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+    fprintf(stderr, "            'status' written to the fifo logs the queue and stream drops of each client.\n");
     fprintf(stderr, " -v       : show key events, no traffic\n");
     fprintf(stderr, " -vv      : -v + key message content\n");
     fprintf(stderr, " -vvv     : -vv + complete xml\n");
@@ -1257,6 +1542,9 @@ void LocalDvrInfo::start()
     fcntl(this->efd, F_SETFL, fcntl(this->efd, F_GETFL, 0) | O_NONBLOCK);
     this->eio.start(this->efd, ev::READ);
 
+    // Restarts may happen from an I/O thread
+    IoThread::wake(loop);
+
     /* first message primes driver to report its properties -- dev known
      * if restarting
      */
@@ -1702,6 +1990,16 @@ void Fifo::processLine(const char * line)
                    tDriver, arg[0], var[0], arg[1], var[1], arg[2], var[2], arg[3], var[3]);
     }
 
+    if (n >= 1 && !strcmp(cmd, "status"))
+    {
+        for (auto cp : ClInfo::clients)
+        {
+            if (cp != nullptr)
+                cp->logStatus();
+        }
+        return;
+    }
+
     int n_args = (n - 2) / 2;
 
     int j = 0;
@@ -1876,17 +2174,33 @@ void ClInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
         // Signature for CHAINED SERVER
         // Not a regular client.
         if (dev[0] == '*' && !this->props.size())
+        {
             this->allprops = 2;
+            routes.addAll(collectableId());
+        }
         else
             addDevice(dev, name, isblob);
     }
     else if (!strcmp(roottag, "getProperties") && !this->props.size() && this->allprops != 2)
+    {
         this->allprops = 1;
+        routes.addAll(collectableId());
+    }
 
     /* snag enableBLOB -- send to remote drivers too */
     if (!strcmp(roottag, "enableBLOB"))
+    {
         crackBLOBHandling(dev, name, pcdataXMLEle(root));
 
+        /* the framing is between this client and us, remote drivers keep base64 */
+        XMLAtt *binary = findXMLAtt(root, "binary");
+        if (binary)
+        {
+            binaryBlobs = !strcmp(valuXMLAtt(binary), "true");
+            rmXMLAtt(root, "binary");
+        }
+    }
+
     if (!strcmp(roottag, "pingRequest"))
     {
         setXMLEleTag(root, "pingReply");
@@ -2019,8 +2333,15 @@ void DvrInfo::closeWritePart()
 
 void ClInfo::close()
 {
+    if (deferClose())
+        return;
+
     if (verbose > 0)
+    {
+        if (streamQueued || streamDropped)
+            logStatus();
         log("shut down complete - bye!\n");
+    }
 
     delete(this);
 
@@ -2032,6 +2353,9 @@ void ClInfo::close()
 
 void DvrInfo::close()
 {
+    if (deferClose())
+        return;
+
     // Tell client driver is dead.
     for (auto dev : dev)
     {
@@ -2139,16 +2463,14 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
 void DvrInfo::q2SDrivers(DvrInfo *me, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
     std::string meRemoteServerUid = me ? me->remoteServerUid() : "";
-    for (auto dpId : drivers.ids())
+    for (auto route : snoops.find(dev, name))
     {
-        auto dp = drivers[dpId];
+        auto dp = drivers[route.id];
         if (dp == nullptr) continue;
 
-        Property *sp = dp->findSDevice(dev, name);
+        Property *sp = route.prop;
 
-        /* nothing for dp if not snooping for dev/name or wrong BLOB mode */
-        if (!sp)
-            continue;
+        /* nothing for dp if wrong BLOB mode */
         if ((isblob && sp->blob == B_NEVER) || (!isblob && sp->blob == B_ONLY))
             continue;
 
@@ -2182,6 +2504,7 @@ void DvrInfo::addSDevice(const std::string &dev, const std::string &name)
     sp = new Property(dev, name);
     sp->blob = B_NEVER;
     sprops.push_back(sp);
+    snoops.add(collectableId(), sp);
 
     if (verbose)
         log(fmt("snooping on %s.%s\n", dev.c_str(), name.c_str()));
@@ -2198,70 +2521,158 @@ Property * DvrInfo::findSDevice(const std::string &dev, const std::string &name)
     return nullptr;
 }
 
+void Subscriptions::add(unsigned long id, Property *prop)
+{
+    index[prop->dev][prop->name][id] = prop;
+}
+
+void Subscriptions::addAll(unsigned long id)
+{
+    all.insert(id);
+}
+
+void Subscriptions::remove(unsigned long id, const std::list<Property*> &props)
+{
+    all.erase(id);
+
+    for (auto prop : props)
+    {
+        auto device = index.find(prop->dev);
+        if (device == index.end())
+            continue;
+
+        auto property = device->second.find(prop->name);
+        if (property == device->second.end())
+            continue;
+
+        property->second.erase(id);
+        if (property->second.empty())
+        {
+            device->second.erase(property);
+            if (device->second.empty())
+                index.erase(device);
+        }
+    }
+}
+
+std::vector<Subscriptions::Route> Subscriptions::find(const std::string &dev, const std::string &name) const
+{
+    std::vector<Route> routes;
+
+    auto device = index.find(dev);
+    if (device != index.end())
+    {
+        // Registrations for the property first: they take precedence over the ones for the whole device
+        if (!name.empty())
+        {
+            auto property = device->second.find(name);
+            if (property != device->second.end())
+            {
+                for (auto sub : property->second)
+                    routes.push_back({sub.first, sub.second});
+            }
+        }
+
+        auto whole = device->second.find("");
+        if (whole != device->second.end())
+        {
+            for (auto sub : whole->second)
+                routes.push_back({sub.first, sub.second});
+        }
+    }
+
+    for (auto id : all)
+        routes.push_back({id, nullptr});
+
+    // Keep the first route of each connection
+    std::stable_sort(routes.begin(), routes.end(), [](const Route & a, const Route & b)
+    {
+        return a.id < b.id;
+    });
+    routes.erase(std::unique(routes.begin(), routes.end(), [](const Route & a, const Route & b)
+    {
+        return a.id == b.id;
+    }), routes.end());
+
+    return routes;
+}
+
+/* return whether any BLOB of a setBLOBVector is a stream frame */
+static bool isStreamBlob(XMLEle *root)
+{
+    for (XMLEle *ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
+        {
+            XMLAtt *fa = findXMLAtt(ep, "format");
+
+            if (fa && strstr(valuXMLAtt(fa), "stream"))
+                return true;
+        }
+    }
+    return false;
+}
+
 void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
+    /* the frames of a stream are rate controlled, look for them once for all clients */
+    bool isStream = isblob && isStreamBlob(root);
+    std::string streamKey = dev + '.' + name;
+
+    /* every client wants messages of no device */
+    std::vector<Subscriptions::Route> interested;
+    if (dev.empty())
+    {
+        for (auto cpId : clients.ids())
+            interested.push_back({cpId, nullptr});
+    }
+    else
+        interested = routes.find(dev, name);
+
     /* queue message to each interested client */
-    for (auto cpId : clients.ids())
+    for (auto route : interested)
     {
-        auto cp = clients[cpId];
+        auto cp = clients[route.id];
         if (cp == nullptr) continue;
 
-        /* cp in use? notme? want this dev/name? blob? */
+        /* cp in use? notme? blob? */
         if (cp == notme)
             continue;
-        if (cp->findDevice(dev, name) < 0)
-            continue;
 
         //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
         if (!isblob && cp->blob == B_ONLY)
             continue;
 
+        /* a BLOB policy set for the property overrides the one of the client */
         if (isblob)
         {
-            if (cp->props.size() > 0)
-            {
-                Property *blobp = nullptr;
-                for (auto pp : cp->props)
-                {
-                    if (pp->dev == dev && pp->name == name)
-                    {
-                        blobp = pp;
-                        break;
-                    }
-                }
+            Property *blobp = route.prop && route.prop->name == name ? route.prop : nullptr;
 
-                if ((blobp && blobp->blob == B_NEVER) || (!blobp && cp->blob == B_NEVER))
-                    continue;
-            }
-            else if (cp->blob == B_NEVER)
+            if ((blobp && blobp->blob == B_NEVER) || (!blobp && cp->blob == B_NEVER))
                 continue;
         }
 
         /* shut down this client if its q is already too large */
         unsigned long ql = cp->msgQSize();
-        if (isblob && maxstreamsiz > 0 && ql > maxstreamsiz)
+        if (isStream && cp->dropLatestMsg(streamKey))
         {
-            // Drop frames for streaming blobs
-            /* pull out each name/BLOB pair, decode */
-            XMLEle *ep      = NULL;
-            int streamFound = 0;
-            for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
-            {
-                if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
-                {
-                    XMLAtt *fa = findXMLAtt(ep, "format");
-
-                    if (fa && strstr(valuXMLAtt(fa), "stream"))
-                    {
-                        streamFound = 1;
-                        break;
-                    }
-                }
-            }
-            if (streamFound)
+            // Latest wins: the frame still waiting in the queue is outdated by this one, which takes its place
+            cp->streamReplaced++;
+            ql = cp->msgQSize();
+            if (verbose > 1)
+                cp->log(fmt("replacing pending stream BLOB of %s\n", streamKey.c_str()));
+        }
+        else if (isStream)
+        {
+            // Drop frames for streaming blobs when the client is too far behind, in bytes or in time
+            double drainRate = cp->getDrainRate();
+            bool tooLarge = maxstreamsiz > 0 && ql > maxstreamsiz;
+            bool tooLate = maxstreamlag > 0 && drainRate > 0 && ql > maxstreamlag * drainRate;
+            if (tooLarge || tooLate)
             {
+                cp->streamDropped++;
                 if (verbose > 1)
-                    cp->log(fmt("%ld bytes behind. Dropping stream BLOB...\n", ql));
+                    cp->log(fmt("%ld bytes behind, draining %.0f bytes/s. Dropping stream BLOB...\n", ql, drainRate));
                 continue;
             }
         }
@@ -2278,7 +2689,13 @@ void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const
                         tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name")));
 
         // pushmsg can kill cp. do at end
-        cp->pushMsg(mp);
+        if (isStream)
+        {
+            cp->streamQueued++;
+            cp->pushLatestMsg(mp, streamKey);
+        }
+        else
+            cp->pushMsg(mp);
     }
 
     return;
@@ -2342,6 +2759,25 @@ void ClInfo::q2Servers(DvrInfo *me, Msg *mp, XMLEle *root)
     }
 }
 
+void MsgQueue::gatherWriteBatch()
+{
+    wbatch.clear();
+
+    bool head = true;
+    for (auto mp : msgq)
+    {
+        MsgChunckIterator start;
+        // Following messages must be produced before they can join the batch
+        if (!head && !mp->requestContent(start))
+            break;
+        if (!mp->gatherContent(head ? nsent : start, wbatch))
+            break;
+        if (wbatch.full())
+            break;
+        head = false;
+    }
+}
+
 void MsgQueue::writeToFd()
 {
     ssize_t nw;
@@ -2357,120 +2793,134 @@ void MsgQueue::writeToFd()
         return;
     }
 
-
-    do
+    for (int burst = 0; burst < MAXWBURST; ++burst)
     {
-        if (!mp->getContent(nsent, data, nsend, sharedBuffers))
-        {
-            wio.stop();
-            return;
-        }
-
-        if (nsend == 0)
+        /* skip messages completely sent */
+        do
         {
-            consumeHeadMsg();
-            mp = headMsg();
-            if (mp == nullptr)
+            if (!mp->getContent(nsent, data, nsend, sharedBuffers))
             {
+                wio.stop();
                 return;
             }
+
+            if (nsend == 0)
+            {
+                consumeHeadMsg();
+                mp = headMsg();
+                if (mp == nullptr)
+                {
+                    return;
+                }
+            }
         }
-    }
-    while(nsend == 0);
+        while(nsend == 0);
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
+        /* send everything ready, from as many messages as possible, in one call */
+        gatherWriteBatch();
 
-    if (!useSharedBuffer)
-    {
-        nw = write(wFd, data, nsend);
-    }
-    else
-    {
-        struct msghdr msgh;
-        struct iovec iov[1];
-        int cmsghdrlength;
-        struct cmsghdr * cmsgh;
+        int writeErrno = 0;
+        ioBusy = true;
 
-        int fdCount = sharedBuffers.size();
-        if (fdCount > 0)
+        if (!useSharedBuffer)
         {
-            if (fdCount > MAXFD_PER_MESSAGE)
-            {
-                log(fmt("attempt to send too many FD\n"));
-                close();
-                return;
-            }
-
-            cmsghdrlength = CMSG_SPACE((fdCount * sizeof(int)));
-            // FIXME: abort on alloc error here
-            cmsgh = (struct cmsghdr*)malloc(cmsghdrlength);
-            memset(cmsgh, 0, cmsghdrlength);
-
-            /* Write the fd as ancillary data */
-            cmsgh->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
-            cmsgh->cmsg_level = SOL_SOCKET;
-            cmsgh->cmsg_type = SCM_RIGHTS;
-            msgh.msg_control = cmsgh;
-            msgh.msg_controllen = cmsghdrlength;
-            for(int i = 0; i < fdCount; ++i)
-            {
-                ((int *) CMSG_DATA(CMSG_FIRSTHDR(&msgh)))[i] = sharedBuffers[i];
-            }
+            ServerUnlock unlock;
+            nw = writev(wFd, wbatch.iov, wbatch.iovCount);
+            writeErrno = errno;
         }
         else
         {
-            cmsgh = NULL;
-            cmsghdrlength = 0;
-            msgh.msg_control = cmsgh;
-            msgh.msg_controllen = cmsghdrlength;
+            struct msghdr msgh;
+            memset(&msgh, 0, sizeof(msgh));
+
+            int fdCount = wbatch.sharedBuffers.size();
+            if (fdCount > 0)
+            {
+                if (fdCount > MAXFD_PER_MESSAGE)
+                {
+                    log(fmt("attempt to send too many FD\n"));
+                    ioBusy = false;
+                    close();
+                    return;
+                }
+
+                /* Write the fd as ancillary data */
+                msgh.msg_control = wcontrol.control;
+                msgh.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+                memset(wcontrol.control, 0, msgh.msg_controllen);
+
+                struct cmsghdr * cmsgh = CMSG_FIRSTHDR(&msgh);
+                cmsgh->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+                cmsgh->cmsg_level = SOL_SOCKET;
+                cmsgh->cmsg_type = SCM_RIGHTS;
+                memcpy(CMSG_DATA(cmsgh), wbatch.sharedBuffers.data(), fdCount * sizeof(int));
+            }
+
+            msgh.msg_iov = wbatch.iov;
+            msgh.msg_iovlen = wbatch.iovCount;
+
+            ServerUnlock unlock;
+            nw = sendmsg(wFd, &msgh,  MSG_NOSIGNAL);
+            writeErrno = errno;
         }
 
-        iov[0].iov_base = data;
-        iov[0].iov_len = nsend;
+        if (closeIfPending())
+            return;
 
-        msgh.msg_flags = 0;
-        msgh.msg_name = NULL;
-        msgh.msg_namelen = 0;
-        msgh.msg_iov = iov;
-        msgh.msg_iovlen = 1;
+        /* fd is full, wait for next write notification */
+        if (nw < 0 && (writeErrno == EAGAIN || writeErrno == EWOULDBLOCK))
+            return;
 
-        nw = sendmsg(wFd, &msgh,  MSG_NOSIGNAL);
+        /* shut down if trouble */
+        if (nw <= 0)
+        {
+            if (nw == 0)
+                log("write returned 0\n");
+            else
+                log(fmt("write: %s\n", strerror(writeErrno)));
 
-        free(cmsgh);
-    }
+            // Keep the read part open
+            closeWritePart();
+            return;
+        }
 
-    /* shut down if trouble */
-    if (nw <= 0)
-    {
-        if (nw == 0)
-            log("write returned 0\n");
-        else
-            log(fmt("write: %s\n", strerror(errno)));
+        /* trace */
+        if (verbose > 1)
+        {
+            size_t left = nw;
+            for (int i = 0; i < wbatch.iovCount && left > 0; ++i)
+            {
+                int len = std::min(left, wbatch.iov[i].iov_len);
+                if (verbose > 2)
+                    log(fmt("sending msg nq %ld:\n%.*s\n", msgq.size(), len, (char *)wbatch.iov[i].iov_base));
+                else
+                    log(fmt("sending %.*s\n", len, (char *)wbatch.iov[i].iov_base));
+                left -= len;
+            }
+        }
 
-        // Keep the read part open
-        closeWritePart();
-        return;
-    }
+        /* update amount sent. when complete: free messages if we are the last
+         * to use them and pop them from our queue.
+         */
+        ssize_t left = nw;
+        while (mp != nullptr)
+        {
+            left -= mp->advance(nsent, left);
+            if (!nsent.done())
+                break;
 
-    /* trace */
-    if (verbose > 2)
-    {
-        log(fmt("sending msg nq %ld:\n%.*s\n",
-                msgq.size(), (int)nw, data));
-    }
-    else if (verbose > 1)
-    {
-        log(fmt("sending %.*s\n", (int)nw, data));
-    }
+            consumeHeadMsg();
+            mp = headMsg();
+            if (left == 0)
+                break;
+        }
 
-    /* update amount sent. when complete: free message if we are the last
-     * to use it and pop from our queue.
-     */
-    mp->advance(nsent, nw);
-    if (nsent.done())
-        consumeHeadMsg();
+        updateDrainRate(nw);
+
+        /* stop when the fd did not take everything, or nothing is left to send */
+        if ((size_t)nw < wbatch.size || mp == nullptr)
+            return;
+    }
 }
 
 void MsgQueue::log(const std::string &str) const
@@ -2511,6 +2961,7 @@ void ClInfo::addDevice(const std::string &dev, const std::string &name, int isbl
     /* add */
     Property *pp = new Property(dev, name);
     props.push_back(pp);
+    routes.add(collectableId(), pp);
 }
 
 void MsgQueue::crackBLOB(const char *enableBLOB, BLOBHandling *bp)
@@ -2654,6 +3105,7 @@ DvrInfo::DvrInfo(const DvrInfo &model):
 
 DvrInfo::~DvrInfo()
 {
+    snoops.remove(collectableId(), sprops);
     drivers.erase(this);
     for(auto prop : sprops)
     {
@@ -2676,6 +3128,7 @@ void DvrInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<DvrInfo> DvrInfo::drivers;
+Subscriptions DvrInfo::snoops;
 
 LocalDvrInfo::LocalDvrInfo(): DvrInfo(true)
 {
@@ -2813,6 +3266,8 @@ ClInfo::ClInfo(bool useSharedBuffer) : MsgQueue(useSharedBuffer)
 
 ClInfo::~ClInfo()
 {
+    routes.remove(collectableId(), props);
+
     for(auto prop : props)
     {
         delete prop;
@@ -2821,6 +3276,12 @@ ClInfo::~ClInfo()
     clients.erase(this);
 }
 
+void ClInfo::logStatus() const
+{
+    log(fmt("%lu messages, %lu bytes queued, draining %.0f bytes/s, stream BLOBs: %lu queued, %lu replaced, %lu dropped\n",
+            (unsigned long)msgQCount(), msgQSize(), getDrainRate(), streamQueued, streamReplaced, streamDropped));
+}
+
 void ClInfo::log(const std::string &str) const
 {
     std::string logLine = fmt("Client %d: ", this->getRFd());
@@ -2829,6 +3290,85 @@ void ClInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<ClInfo> ClInfo::clients;
+Subscriptions ClInfo::routes;
+
+std::vector<IoThread *> IoThread::threads;
+unsigned long IoThread::nextThread = 0;
+thread_local struct ev_loop * IoThread::currentLoop = nullptr;
+std::mutex IoThread::serverLock;
+
+IoThread::IoThread() : ioLoop(ev::AUTO), wakeup(ioLoop)
+{
+    ev_set_loop_release_cb(ioLoop, &IoThread::releaseLock, &IoThread::acquireLock);
+    initWakeup(ioLoop, wakeup);
+}
+
+void IoThread::initWakeup(struct ev_loop * l, ev::async &wakeup)
+{
+    wakeup.set<&IoThread::onWakeup>();
+    wakeup.start();
+    ev_set_userdata(l, &wakeup);
+}
+
+void IoThread::releaseLock(struct ev_loop *) noexcept
+{
+    serverLock.unlock();
+}
+
+void IoThread::acquireLock(struct ev_loop *) noexcept
+{
+    serverLock.lock();
+}
+
+void IoThread::run()
+{
+    currentLoop = ioLoop;
+
+    serverLock.lock();
+    ioLoop.run(0);
+    serverLock.unlock();
+
+    log("unexpected return from I/O thread event loop\n");
+}
+
+void IoThread::startAll(int count)
+{
+    static ev::async mainWakeup(loop);
+
+    serverLock.lock();
+    currentLoop = loop;
+    ev_set_loop_release_cb(loop, &IoThread::releaseLock, &IoThread::acquireLock);
+    initWakeup(loop, mainWakeup);
+
+    for (int i = 0; i < count; ++i)
+    {
+        IoThread * t = new IoThread();
+        threads.push_back(t);
+        t->thread = std::thread([t]()
+        {
+            t->run();
+        });
+    }
+
+    if (verbose > 0)
+        ::log(fmt("serving connections from %d I/O threads\n", count));
+}
+
+struct ev_loop * IoThread::assignLoop()
+{
+    if (threads.empty())
+        return loop;
+
+    return threads[nextThread++ % threads.size()]->ioLoop;
+}
+
+void IoThread::wake(struct ev_loop * l)
+{
+    if (threads.empty() || l == currentLoop)
+        return;
+
+    static_cast<ev::async *>(ev_userdata(l))->send();
+}
 
 SerializedMsg::SerializedMsg(Msg * parent) : asyncProgress(), owner(parent), awaiters(), chuncks(), ownBuffers()
 {
@@ -2999,21 +3539,52 @@ bool SerializedMsg::getContent(MsgChunckIterator &from, void* &data, ssize_t &si
     return true;
 }
 
-void SerializedMsg::advance(MsgChunckIterator &iter, ssize_t s)
+bool SerializedMsg::gatherContent(const MsgChunckIterator &from, WriteBatch &batch)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    unsigned long offset = from.chunckOffset;
+    for (std::size_t chunckId = from.chunckId; chunckId < chuncks.size(); ++chunckId)
+    {
+        const MsgChunck &ck = chuncks[chunckId];
+
+        if (batch.full())
+            return false;
+
+        if (offset == 0 && !ck.sharedBufferIdsToAttach.empty() && !batch.addSharedBuffers(ck.sharedBufferIdsToAttach))
+            return false;
+
+        batch.add(ck.content + offset, ck.contentLength - offset);
+        offset = 0;
+    }
+
+    return asyncStatus == TERMINATED;
+}
+
+ssize_t SerializedMsg::advance(MsgChunckIterator &iter, ssize_t s)
 {
     std::lock_guard<std::recursive_mutex> guard(lock);
 
-    MsgChunck &cur = chuncks[iter.chunckId];
-    iter.chunckOffset += s;
-    if (iter.chunckOffset >= cur.contentLength)
+    ssize_t consumed = 0;
+    while (consumed < s && iter.chunckId < chuncks.size())
     {
-        iter.chunckId ++ ;
-        iter.chunckOffset = 0;
-        if (iter.chunckId >= chuncks.size() && asyncStatus == TERMINATED)
+        MsgChunck &cur = chuncks[iter.chunckId];
+        unsigned long step = std::min((unsigned long)(s - consumed), cur.contentLength - iter.chunckOffset);
+
+        iter.chunckOffset += step;
+        consumed += step;
+        if (iter.chunckOffset >= cur.contentLength)
         {
-            iter.endReached = true;
+            iter.chunckId ++ ;
+            iter.chunckOffset = 0;
         }
     }
+
+    if (iter.chunckId >= chuncks.size() && asyncStatus == TERMINATED)
+    {
+        iter.endReached = true;
+    }
+    return consumed;
 }
 
 void SerializedMsg::addAwaiter(MsgQueue * q)
@@ -3047,12 +3618,17 @@ ssize_t SerializedMsg::queueSize()
     return owner->queueSize;
 }
 
-SerializedMsgWithoutSharedBuffer::SerializedMsgWithoutSharedBuffer(Msg * parent): SerializedMsg(parent)
+SerializedMsgWithoutSharedBuffer::SerializedMsgWithoutSharedBuffer(Msg * parent, bool binary): SerializedMsg(parent),
+    binary(binary)
 {
 }
 
 SerializedMsgWithoutSharedBuffer::~SerializedMsgWithoutSharedBuffer()
 {
+    for(auto &blob : mappedBlobs)
+    {
+        dettachSharedBuffer(-1, blob.first, blob.second);
+    }
 }
 
 SerializedMsgWithSharedBuffer::SerializedMsgWithSharedBuffer(Msg * parent): SerializedMsg(parent), ownSharedBuffers()
@@ -3089,6 +3665,7 @@ Msg::Msg(MsgQueue * from, XMLEle * ele): sharedBuffers()
 
     convertionToSharedBuffer = nullptr;
     convertionToInline = nullptr;
+    convertionToBinary = nullptr;
 
     queueSize = sprlXMLEle(xmlContent, 0);
     for(auto blobContent : findBlobElements(xmlContent))
@@ -3110,6 +3687,7 @@ Msg::~Msg()
     // Assume convertionToSharedBlob and convertionToInlineBlob were already dropped
     assert(convertionToSharedBuffer == nullptr);
     assert(convertionToInline == nullptr);
+    assert(convertionToBinary == nullptr);
 
     releaseXmlContent();
     releaseSharedBuffers(std::set<int>());
@@ -3127,6 +3705,11 @@ void Msg::releaseSerialization(SerializedMsg * msg)
         convertionToInline = nullptr;
     }
 
+    if (msg == convertionToBinary)
+    {
+        convertionToBinary = nullptr;
+    }
+
     delete(msg);
     prune();
 }
@@ -3168,6 +3751,10 @@ void Msg::prune()
     {
         convertionToInline->collectRequirements(req);
     }
+    if (convertionToBinary)
+    {
+        convertionToBinary->collectRequirements(req);
+    }
     // Free the resources.
     if (!req.xml)
     {
@@ -3177,15 +3764,15 @@ void Msg::prune()
     releaseSharedBuffers(req.sharedBuffers);
 
     // Nobody cares anymore ?
-    if (convertionToSharedBuffer == nullptr && convertionToInline == nullptr)
+    if (convertionToSharedBuffer == nullptr && convertionToInline == nullptr && convertionToBinary == nullptr)
     {
         delete(this);
     }
 }
 
-bool parseBlobSize(XMLEle * blobWithAttachedBuffer, ssize_t &size)
+bool parseBlobSize(XMLEle * blobWithAttachedBuffer, ssize_t &size, const char * attribute = "size")
 {
-    std::string sizeStr = findXMLAttValu(blobWithAttachedBuffer, "size");
+    std::string sizeStr = findXMLAttValu(blobWithAttachedBuffer, attribute);
     if (sizeStr == "")
     {
         return false;
@@ -3278,6 +3865,16 @@ SerializedMsg * Msg::buildConvertionToInline()
     return convertionToInline = new SerializedMsgWithoutSharedBuffer(this);
 }
 
+SerializedMsg * Msg::buildConvertionToBinary()
+{
+    if (convertionToBinary)
+    {
+        return convertionToBinary;
+    }
+
+    return convertionToBinary = new SerializedMsgWithoutSharedBuffer(this, true);
+}
+
 SerializedMsg * Msg::serialize(MsgQueue * to)
 {
     if (hasSharedBufferBlobs || hasInlineBlobs)
@@ -3286,6 +3883,10 @@ SerializedMsg * Msg::serialize(MsgQueue * to)
         {
             return buildConvertionToSharedBuffer();
         }
+        else if (to->acceptBinaryBlobs())
+        {
+            return buildConvertionToBinary();
+        }
         else
         {
             return buildConvertionToInline();
@@ -3408,23 +4009,6 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
     }
     else
     {
-        // Create a replacement that shares original CData buffers
-        xmlContent = cloneXMLEleWithReplacementMap(xmlContent, replacement);
-
-        std::vector<size_t> modelCdataOffset(cdata.size());
-
-        char * model = (char*)malloc(sprlXMLEle(xmlContent, 0) + 1);
-        int modelSize = sprXMLEle(model, xmlContent, 0);
-
-        ownBuffers.push_back(model);
-
-        // Get the element offset
-        for(std::size_t i = 0; i < cdata.size(); ++i)
-        {
-            modelCdataOffset[i] = sprXMLCDataOffset(xmlContent, cdata[i], 0);
-        }
-        delXMLEle(xmlContent);
-
         std::vector<int> fds(cdata.size());
         std::vector<void*> blobs(cdata.size());
         std::vector<size_t> sizes(cdata.size());
@@ -3447,31 +4031,89 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
                 {
                     dataSize = xmlSizes[i];
                 }
+
+                // Raw bytes go out as they are, so stop at the actual data length (compressed blobs)
+                ssize_t len;
+                if (binary && parseBlobSize(cdata[i], len, "len") && len >= 0 && (size_t)len <= dataSize)
+                {
+                    dataSize = len;
+                }
                 sizes[i] = dataSize;
             }
             else
             {
                 fds[i] = -1;
+
+                if (binary)
+                {
+                    // Decode once here rather than in every binary client
+                    int base64Len = pcdatalenXMLEle(sharedCData[i]);
+                    char * decoded = (char*) malloc(3 * (base64Len / 4) + 4);
+                    ownBuffers.push_back(decoded);
+                    int decodedLen = from64tobits_fast(decoded, pcdataXMLEle(sharedCData[i]), base64Len);
+
+                    blobs[i] = decoded;
+                    sizes[i] = decodedLen > 0 ? decodedLen : 0;
+                }
             }
+
+            if (binary)
+            {
+                rmXMLAtt(cdata[i], "enclen");
+                addXMLAtt(cdata[i], "rawlen", std::to_string(sizes[i]).c_str());
+            }
+        }
+
+        // Create a replacement that shares original CData buffers
+        xmlContent = cloneXMLEleWithReplacementMap(xmlContent, replacement);
+
+        std::vector<size_t> modelCdataOffset(cdata.size());
+
+        char * model = (char*)malloc(sprlXMLEle(xmlContent, 0) + 1);
+        int modelSize = sprXMLEle(model, xmlContent, 0);
+
+        ownBuffers.push_back(model);
+
+        // Get the element offset
+        for(std::size_t i = 0; i < cdata.size(); ++i)
+        {
+            modelCdataOffset[i] = sprXMLCDataOffset(xmlContent, cdata[i], 0);
         }
+        delXMLEle(xmlContent);
 
         // Copy from model or blob (streaming base64 encode)
         int modelOffset = 0;
         for(std::size_t i = 0; i < cdata.size(); ++i)
         {
             int cdataOffset = modelCdataOffset[i];
-            if (cdataOffset > modelOffset)
+            // Raw bytes start right after '>', drop the newline the printer puts before cdata
+            int modelEnd = (binary && cdataOffset > modelOffset && model[cdataOffset - 1] == '\n') ? cdataOffset - 1 : cdataOffset;
+            if (modelEnd > modelOffset)
             {
-                async_pushChunck(MsgChunck(model + modelOffset, cdataOffset - modelOffset));
+                async_pushChunck(MsgChunck(model + modelOffset, modelEnd - modelOffset));
             }
             // Skip the dummy cdata completely
             modelOffset = cdataOffset + 1;
 
-            // Perform inplace base64
-            // FIXME: could be streamed/splitted
+            if (binary)
+            {
+                // The blob bytes themselves, no conversion
+                if (sizes[i] > 0)
+                {
+                    async_pushChunck(MsgChunck((char*)blobs[i], sizes[i]));
+                }
 
-            if (fds[i] != -1)
+                // Keep the mapping until the chuncks are written
+                if (fds[i] != -1)
+                {
+                    mappedBlobs.push_back(std::make_pair(blobs[i], attachedSizes[i]));
+                }
+            }
+            else if (fds[i] != -1)
             {
+                // Perform inplace base64
+                // FIXME: could be streamed/splitted
+
                 // Add a binary chunck. This needs base64 convertion
                 // FIXME: the size here should be the size of the blob element
                 unsigned long buffSze = sizes[i];
@@ -3613,6 +4255,10 @@ void SerializedMsgWithSharedBuffer::generateContent()
 MsgQueue::MsgQueue(bool useSharedBuffer): useSharedBuffer(useSharedBuffer)
 {
     lp = newLilXML();
+    setLilXMLArena(lp, 1);
+    ioLoop = IoThread::assignLoop();
+    rio.set(ioLoop);
+    wio.set(ioLoop);
     rio.set<MsgQueue, &MsgQueue::ioCb>(this);
     wio.set<MsgQueue, &MsgQueue::ioCb>(this);
     rFd = -1;
@@ -3720,27 +4366,94 @@ void MsgQueue::consumeHeadMsg()
 {
     auto msg = headMsg();
     msgq.pop_front();
+    forgetLatestMsg(msg);
     msg->release(this);
     nsent.reset();
 
     updateIos();
 }
 
-void MsgQueue::pushMsg(Msg * mp)
+SerializedMsg * MsgQueue::pushMsg(Msg * mp)
 {
     // Don't write messages to client that have been disconnected
     if (wFd == -1)
     {
-        return;
+        return nullptr;
     }
 
     auto serialized = mp->serialize(this);
 
+    // The drain rate is measured from the time messages start waiting
+    if (msgq.empty())
+    {
+        drainStart = std::chrono::steady_clock::now();
+        drainBytes = 0;
+    }
+
     msgq.push_back(serialized);
     serialized->addAwaiter(this);
 
     // Register for client write
     updateIos();
+
+    return serialized;
+}
+
+void MsgQueue::pushLatestMsg(Msg * mp, const std::string &key)
+{
+    auto serialized = pushMsg(mp);
+    if (serialized != nullptr)
+        latestMsgs[key] = serialized;
+}
+
+bool MsgQueue::dropLatestMsg(const std::string &key)
+{
+    auto latest = latestMsgs.find(key);
+    if (latest == latestMsgs.end())
+        return false;
+
+    // The head may be partially sent, and a write in progress reads the messages after it
+    auto msg = latest->second;
+    if (ioBusy || msg == headMsg())
+        return false;
+
+    auto pos = std::find(msgq.rbegin(), msgq.rend(), msg);
+    if (pos == msgq.rend())
+        return false;
+
+    msgq.erase(std::next(pos).base());
+    latestMsgs.erase(latest);
+    msg->release(this);
+    return true;
+}
+
+void MsgQueue::forgetLatestMsg(const SerializedMsg * msg)
+{
+    for (auto it = latestMsgs.begin(); it != latestMsgs.end(); ++it)
+    {
+        if (it->second == msg)
+        {
+            latestMsgs.erase(it);
+            return;
+        }
+    }
+}
+
+void MsgQueue::updateDrainRate(size_t written)
+{
+    auto now = std::chrono::steady_clock::now();
+    drainBytes += written;
+
+    // Sample over a window, or until the queue is empty. A queue emptied at once does not tell how fast it could go
+    double elapsed = std::chrono::duration<double>(now - drainStart).count();
+    if (elapsed < DRAINWINDOW && (!msgq.empty() || elapsed < DRAINWINDOW / 50))
+        return;
+
+    double rate = drainBytes / elapsed;
+    drainRate = drainRate > 0 ? 0.75 * drainRate + 0.25 * rate : rate;
+
+    drainStart = now;
+    drainBytes = 0;
 }
 
 void MsgQueue::updateIos()
@@ -3760,6 +4473,28 @@ void MsgQueue::updateIos()
     {
         rio.start();
     }
+
+    IoThread::wake(ioLoop);
+}
+
+bool MsgQueue::deferClose()
+{
+    if (!ioBusy)
+        return false;
+
+    closePending = true;
+    return true;
+}
+
+bool MsgQueue::closeIfPending()
+{
+    ioBusy = false;
+    if (!closePending)
+        return false;
+
+    closePending = false;
+    close();
+    return true;
 }
 
 void MsgQueue::messageMayHaveProgressed(const SerializedMsg * msg)
@@ -3773,6 +4508,7 @@ void MsgQueue::messageMayHaveProgressed(const SerializedMsg * msg)
 void MsgQueue::clearMsgQueue()
 {
     nsent.reset();
+    latestMsgs.clear();
 
     auto queueCopy = msgq;
     for(auto mp : queueCopy)
@@ -3824,12 +4560,12 @@ void MsgQueue::ioCb(ev::io &, int revents)
         writeToFd();
 }
 
-size_t MsgQueue::doRead(char * buf, size_t nr)
+ssize_t MsgQueue::doRead(char * buf, size_t nr)
 {
     if (!useSharedBuffer)
     {
         /* read client - works for all kinds of fds incl pipe*/
-        return read(rFd, buf, sizeof(buf));
+        return read(rFd, buf, nr);
     }
     else
     {
@@ -3897,40 +4633,67 @@ size_t MsgQueue::doRead(char * buf, size_t nr)
 
 void MsgQueue::readFromFd()
 {
-    char buf[MAXRBUF];
-    ssize_t nr;
+    ssize_t nr = 0;
+    int readErrno = 0;
+    char err[1024];
+    bool xmlError = false;
 
-    /* read client */
-    nr = doRead(buf, sizeof(buf));
-    if (nr <= 0)
+    if (rbuf.empty())
+        rbuf.resize(MAXRBUF);
+
+    // This may be deleted while dispatching, work on a local list
+    std::vector<XMLEle *> nodes;
+    nodes.swap(rnodes);
+
+    /* read client and process XML chunks until the fd is drained. Only this thread uses lp and rbuf */
+    ioBusy = true;
     {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        ServerUnlock unlock;
+        for (int burst = 0; burst < MAXRBURST; ++burst)
+        {
+            nr = doRead(rbuf.data(), rbuf.size());
+            readErrno = errno;
+            if (nr <= 0)
+                break;
 
-        if (nr < 0)
-            log(fmt("read: %s\n", strerror(errno)));
-        else if (verbose > 0)
-            log(fmt("read EOF\n"));
-        close();
-        return;
+            XMLEle **chunkNodes = parseXMLChunk(lp, rbuf.data(), nr, err);
+            if (!chunkNodes)
+            {
+                xmlError = true;
+                break;
+            }
+            for (int i = 0; chunkNodes[i]; ++i)
+                nodes.push_back(chunkNodes[i]);
+            free(chunkNodes);
+
+            /* a short read drained the fd. A full one means more is waiting: read bigger chunks */
+            if ((size_t)nr < rbuf.size())
+                break;
+            if (rbuf.size() < MAXRBUFGROW)
+                rbuf.resize(std::min(rbuf.size() * 2, (size_t)MAXRBUFGROW));
+        }
     }
 
-    /* process XML chunk */
-    char err[1024];
-    XMLEle **nodes = parseXMLChunk(lp, buf, nr, err);
-    if (!nodes)
+    if (closePending || xmlError)
+    {
+        for (auto root : nodes)
+            delXMLEle(root);
+        nodes.clear();
+    }
+    if (closeIfPending())
+        return;
+
+    if (xmlError)
     {
         log(fmt("XML error: %s\n", err));
-        log(fmt("XML read: %.*s\n", (int)nr, buf));
+        log(fmt("XML read: %.*s\n", (int)nr, rbuf.data()));
         close();
         return;
     }
 
-    int inode = 0;
-
-    XMLEle *root = nodes[inode];
     // Stop processing message in case of deletion...
     auto hb = heartBeat();
-    while (root)
+    for (auto root : nodes)
     {
         if (hb.alive())
         {
@@ -3949,11 +4712,25 @@ void MsgQueue::readFromFd()
             // Otherwise, client got killed. Just release pending messages
             delXMLEle(root);
         }
-        inode++;
-        root = nodes[inode];
     }
 
-    free(nodes);
+    if (!hb.alive())
+        return;
+
+    nodes.clear();
+    rnodes.swap(nodes);
+
+    /* messages read before the end of the connection were dispatched, now close it */
+    if (nr <= 0)
+    {
+        if (nr < 0 && (readErrno == EAGAIN || readErrno == EWOULDBLOCK)) return;
+
+        if (nr < 0)
+            log(fmt("read: %s\n", strerror(readErrno)));
+        else if (verbose > 0)
+            log(fmt("read EOF\n"));
+        close();
+    }
 }
 
 static std::vector<XMLEle *> findBlobElements(XMLEle * root)
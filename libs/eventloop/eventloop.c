@@ -32,6 +32,7 @@
  #define MAIN_TEST for a stand-alone test program.
  */
 
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,6 +46,12 @@
 #include <sys/select.h>
 #endif
 
+#ifdef __linux__
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 #include "eventloop.h"
 
 /* info about one registered callback.
@@ -53,33 +60,60 @@
  */
 typedef struct
 {
-    int in_use; /* flag to mark this record is active */
-    int fd;     /* fd descriptor to watch for read */
-    void *ud;   /* user's data handle */
-    CBF *fp;    /* callback function */
+    int in_use;        /* flag to mark this record is active */
+    int fd;            /* fd descriptor to watch for read */
+    void *ud;          /* user's data handle */
+    CBF *fp;           /* callback function */
+    unsigned gen;      /* incremented each time the slot is reused */
+    int always;        /* fd can not be polled, eg a regular file, and is always ready like select reports it */
+    int next;          /* next callback watching the same fd, or next always ready one, -1 if none */
+    int head;          /* epoll reports fd with this callback, the first of those chained by next */
 } CB;
 static CB *cback;    /* malloced list of callbacks */
 static int ncback;   /* n entries in cback[] */
 static int ncbinuse; /* n entries in cback[] marked in_use */
-static int lastcb;   /* cback index of last cb called */
+static int ncbalways; /* n entries in cback[] in_use and always ready */
+static int cbalways = -1; /* first always ready callback, the others are chained by next */
+
+/* a callback found ready, called if its slot was not reused meanwhile */
+typedef struct
+{
+    int cid;
+    unsigned gen;
+} READYCB;
+#define MAXREADY 64 /* max callbacks dispatched per loop, the others stay ready for the next one */
+
+#ifdef USE_EPOLL
+static int epollfd = -1;   /* epoll instance watching the fd of each callback, tagged with its head, and timerfd */
+static int timerfd = -1;   /* expires when the soonest timer is due, more precise than epoll_wait's ms */
+static double timerfdgo;   /* tgo timerfd is armed for, 0 if disarmed */
+#define TIMERFD_TAG UINT64_MAX /* epoll data of timerfd, the callback fds carry the id of their head */
+#endif
 
 /* info about one registered timer function.
- * the entries are kept sorted by increasing time from epoch, ie,
- *   the next entry to fire is at the begin of the list.
+ * the timers waiting to fire are kept in a binary min-heap ordered by trigger
+ *   time, then by order of arming, ie, the next entry to fire is timers[0].
+ * all timers are also hashed by id for rmTimer() and remainingTimer().
  */
 typedef struct TF
 {
-    double tgo;       /* trigger time, ms from epoch */
-    int interval;     /* repeat timer if interval > 0, ms */
-    void *ud;         /* user's data handle */
-    TCF *fp;          /* timer function */
-    int tid;          /* unique id for this timer */
-    struct TF *next;  /* pointer to next item */
+    double tgo;         /* trigger time, ms of the monotonic clock */
+    int interval;       /* repeat timer if interval > 0, ms */
+    void *ud;           /* user's data handle */
+    TCF *fp;            /* timer function, NULL once removed while it runs */
+    int tid;            /* unique id for this timer */
+    unsigned long seq;  /* order of arming, timers due at the same time fire in this order */
+    int heapi;          /* index in timers[], -1 while it runs */
+    struct TF *hnext;   /* next timer in the same hash bucket */
 } TF;
-static TF  timefunc_null = {0, 0, NULL, NULL, 0, NULL};
-static TF *timefunc = &timefunc_null;  /* list of timer functions */
+static TF **timers;          /* malloced min-heap of armed timers */
+static int ntimers;          /* n entries in timers[] */
+static int mtimers;          /* n entries allocated in timers[] */
+static TF **timerids;        /* malloced hash table of all timers by id, chained by hnext */
+static int ntimerids;        /* n buckets in timerids[], power of 2 */
+static int nalltimers;       /* n timers in timerids[] */
+static unsigned long timerseq; /* source of arming order */
 static int tid = 0;    /* source of unique timer ids */
-#define EPOCHDT(tp) /* ms from epoch to timeval *tp */ (((tp)->tv_usec) / 1000.0 + ((tp)->tv_sec) * 1000.0)
 
 /* info about one registered work procedure.
  * the malloced array wproc is never shrunk, entries are reused. new id's are
@@ -97,8 +131,8 @@ static int nwpinuse; /* n entries in wproc[] marked in-use */
 static int lastwp;   /* wproc index of last workproc called*/
 
 static void runWorkProc(void);
-static void callCallback(fd_set *rfdp);
-static void checkTimer();
+static void callCallbacks(const READYCB *ready, int nready);
+static void checkTimers();
 static void oneLoop(void);
 static void deferTO(void *p);
 static void runImmediates();
@@ -159,6 +193,79 @@ int deferLoop0(int maxms, int *flagp)
     return (0);
 }
 
+#ifdef USE_EPOLL
+/* create the epoll instance on first use */
+static void initEpoll()
+{
+    struct epoll_event ev;
+
+    if (epollfd != -1)
+        return;
+
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.u64 = TIMERFD_TAG;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, timerfd, &ev);
+}
+
+/* arm timerfd to expire at tgo, ms of the monotonic clock, or disarm it if tgo is 0 */
+static void armTimerfd(double tgo)
+{
+    struct itimerspec its;
+
+    if (tgo == timerfdgo)
+        return;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = (time_t)(tgo / 1000);
+    its.it_value.tv_nsec = (long)((tgo - its.it_value.tv_sec * 1000.0) * 1000000.0);
+    /* an expiry time of 0 disarms */
+    if (tgo > 0 && its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;
+    timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    timerfdgo = tgo;
+}
+
+/* tag fd with the callback id epoll reports it with */
+static int tagFd(int op, int fd, int cid)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.u64 = cid;
+    return epoll_ctl(epollfd, op, fd, &ev);
+}
+
+/* return the head of the callbacks watching fd, -1 if none */
+static int fdHead(int fd)
+{
+    for (int i = 0; i < ncback; i++)
+        if (cback[i].in_use && cback[i].head && cback[i].fd == fd)
+            return i;
+    return -1;
+}
+
+/* append callback cid to the chain starting at *first */
+static void chainCallback(int *first, int cid)
+{
+    while (*first != -1)
+        first = &cback[*first].next;
+    *first = cid;
+}
+
+/* remove callback cid from the chain starting at *first */
+static void unchainCallback(int *first, int cid)
+{
+    while (*first != -1 && *first != cid)
+        first = &cback[*first].next;
+    if (*first == cid)
+        *first = cback[cid].next;
+}
+#endif
+
 /* register a new callback, fp, to be called with ud as arg when fd is ready.
  * return a unique callback id for use with rmCallback().
  */
@@ -174,6 +281,7 @@ int addCallback(int fd, CBF *fp, void *ud)
     {
         cback = realloc(cback, (ncback + 1) * sizeof(CB));
         cp    = &cback[ncback++];
+        cp->gen = 0;
     }
 
     /* init new entry */
@@ -181,8 +289,44 @@ int addCallback(int fd, CBF *fp, void *ud)
     cp->fp     = fp;
     cp->ud     = ud;
     cp->fd     = fd;
+    cp->gen++;
+    cp->always = 0;
+    cp->next   = -1;
+    cp->head   = 0;
     ncbinuse++;
 
+#ifdef USE_EPOLL
+    int cid  = cp - cback;
+    int head = fdHead(fd);
+
+    initEpoll();
+
+    if (tagFd(EPOLL_CTL_ADD, fd, cid) == 0)
+    {
+        /* callbacks left on a closed fd of the same number run for the new one too */
+        cp->head = 1;
+        cp->next = head;
+        if (head != -1)
+            cback[head].head = 0;
+    }
+    else if (errno == EEXIST && head != -1)
+    {
+        /* the fd is already watched for another callback */
+        chainCallback(&cback[head].next, cid);
+    }
+    else if (errno == EEXIST)
+    {
+        cp->head = 1;
+        tagFd(EPOLL_CTL_MOD, fd, cid);
+    }
+    else if (errno == EPERM)
+    {
+        cp->always = 1;
+        ncbalways++;
+        chainCallback(&cbalways, cid);
+    }
+#endif
+
     /* id is index into array */
     return (cp - cback);
 }
@@ -201,39 +345,171 @@ void rmCallback(int cid)
     if (!cp->in_use)
         return;
 
+#ifdef USE_EPOLL
+    /* the fd may be closed already, then epoll forgot it */
+    if (cp->always)
+    {
+        ncbalways--;
+        unchainCallback(&cbalways, cid);
+    }
+    else if (cp->head && cp->next != -1)
+    {
+        cback[cp->next].head = 1;
+        tagFd(EPOLL_CTL_MOD, cp->fd, cp->next);
+    }
+    else if (cp->head)
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, cp->fd, NULL);
+    else
+    {
+        int head = fdHead(cp->fd);
+        if (head != -1)
+            unchainCallback(&cback[head].next, cid);
+    }
+    cp->head = 0;
+#endif
+
     /* mark for reuse */
     cp->in_use = 0;
     ncbinuse--;
 }
 
-/* insert maintaining sort */
-static void insertTimer(TF *node)
+/* ms of the monotonic clock */
+static double nowMs()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+#else
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+#endif
+}
+
+/* return whether timer a fires before timer b */
+static int timerBefore(const TF *a, const TF *b)
+{
+    return a->tgo < b->tgo || (a->tgo == b->tgo && a->seq < b->seq);
+}
+
+static void heapSet(int i, TF *node)
+{
+    timers[i]   = node;
+    node->heapi = i;
+}
+
+static void siftUp(int i)
 {
-    TF *it = timefunc;
+    TF *node = timers[i];
 
-    for(; ; it = it->next)
+    while (i > 0 && timerBefore(node, timers[(i - 1) / 2]))
     {
-        if (it->next == NULL || node->tgo < it->next->tgo)
-        {
-            node->next = it->next;
-            it->next = node;
+        heapSet(i, timers[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heapSet(i, node);
+}
+
+static void siftDown(int i)
+{
+    TF *node = timers[i];
+
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= ntimers)
+            break;
+        if (child + 1 < ntimers && timerBefore(timers[child + 1], timers[child]))
+            child++;
+        if (!timerBefore(timers[child], node))
             break;
+        heapSet(i, timers[child]);
+        i = child;
+    }
+    heapSet(i, node);
+}
+
+/* arm node at node->tgo */
+static void pushTimer(TF *node)
+{
+    if (ntimers == mtimers)
+    {
+        mtimers = mtimers ? mtimers * 2 : 16;
+        timers  = (TF **)realloc(timers, mtimers * sizeof(TF *));
+    }
+
+    node->seq = ++timerseq;
+    heapSet(ntimers++, node);
+    siftUp(ntimers - 1);
+}
+
+/* disarm the timer at index i of the heap */
+static void removeTimerAt(int i)
+{
+    TF *last = timers[--ntimers];
+
+    timers[i]->heapi = -1;
+    if (i < ntimers)
+    {
+        heapSet(i, last);
+        siftDown(i);
+        siftUp(last->heapi);
+    }
+}
+
+/* add node to the id hash table, doubling it to keep about one timer per bucket */
+static void hashTimer(TF *node)
+{
+    if (nalltimers >= ntimerids)
+    {
+        int nbuckets = ntimerids ? ntimerids * 2 : 16;
+        TF **buckets = (TF **)calloc(nbuckets, sizeof(TF *));
+
+        for (int i = 0; i < ntimerids; i++)
+        {
+            TF *it = timerids[i];
+            while (it != NULL)
+            {
+                TF *next  = it->hnext;
+                it->hnext = buckets[it->tid & (nbuckets - 1)];
+                buckets[it->tid & (nbuckets - 1)] = it;
+                it = next;
+            }
+        }
+
+        free(timerids);
+        timerids  = buckets;
+        ntimerids = nbuckets;
+    }
+
+    node->hnext = timerids[node->tid & (ntimerids - 1)];
+    timerids[node->tid & (ntimerids - 1)] = node;
+    nalltimers++;
+}
+
+static void unhashTimer(TF *node)
+{
+    TF **it = &timerids[node->tid & (ntimerids - 1)];
+
+    for (; *it != NULL; it = &(*it)->hnext)
+    {
+        if (*it == node)
+        {
+            *it = node->hnext;
+            nalltimers--;
+            return;
         }
     }
 }
 
 /* register a new timer function, fp, to be called with ud as arg after ms
- * milliseconds. add to list in order of increasing time from epoch, ie,
- * first entry runs soonest. return id for use with rmTimer().
+ * milliseconds. return id for use with rmTimer().
  */
 static int addTimerImpl(int delay, int interval, TCF *fp, void *ud)
 {
-    struct timeval t;
     TF *node;
 
-    /* get time now */
-    gettimeofday(&t, NULL);
-
     /* create entry */
     node = (TF*)malloc(sizeof(TF));
 
@@ -241,10 +517,11 @@ static int addTimerImpl(int delay, int interval, TCF *fp, void *ud)
     node->ud  = ud;
     node->fp  = fp;
     node->tid = ++tid; /* store new unique id */
-    node->tgo = EPOCHDT(&t) + delay;
+    node->tgo = nowMs() + delay;
     node->interval = interval;
 
-    insertTimer(node);
+    hashTimer(node);
+    pushTimer(node);
 
     return node->tid;
 }
@@ -259,26 +536,14 @@ int addPeriodicTimer(int ms, TCF *fp, void *ud)
     return addTimerImpl(ms, ms, fp, ud);
 }
 
-/* find the timer and remove from list */
-static TF *dettachTimer(TF *node)
-{
-    TF *it = timefunc;
-    for(; it->next != NULL; it = it->next)
-    {
-        if (it->next == node)
-        {
-            it->next = node->next;
-            return node;
-        }
-    }
-    return NULL;
-}
-
 /* find the timer by id */
 static TF *findTimer(int timer_id)
 {
-    TF *it = timefunc->next;
-    for(; it != NULL; it = it->next)
+    if (ntimerids == 0)
+        return NULL;
+
+    TF *it = timerids[timer_id & (ntimerids - 1)];
+    for(; it != NULL; it = it->hnext)
         if (it->tid == timer_id)
             return it;
     return NULL;
@@ -289,24 +554,27 @@ static TF *findTimer(int timer_id)
  */
 void rmTimer(int timer_id)
 {
-    TF *node, *it = timefunc;
-    for(; (node = it->next) != NULL; it = it->next)
+    TF *node = findTimer(timer_id);
+    if (node == NULL)
+        return;
+
+    unhashTimer(node);
+
+    /* a running timer is released once its function returns */
+    if (node->heapi < 0)
     {
-        if (node->tid == timer_id)
-        {
-            it->next = node->next;
-            free(node);
-            break;
-        }
+        node->fp = NULL;
+        return;
     }
+
+    removeTimerAt(node->heapi);
+    free(node);
 }
 
 /* Returns the timer's remaining value in milliseconds left until the timeout. */
 static double remainingTimerNode(TF *node)
 {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return (node->tgo - EPOCHDT(&now));
+    return (node->tgo - nowMs());
 }
 
 /* Returns the timer's remaining value in milliseconds left until the timeout.
@@ -393,59 +661,118 @@ static void runWorkProc()
     (*wp->fp)(wp->ud);
 }
 
-/* run next callback whose fd is listed as ready to go in rfdp */
-static void callCallback(fd_set *rfdp)
+/* add the callbacks chained from cid to ready */
+static int readyCallbacks(int cid, READYCB *ready, int nready)
 {
-    CB *cp;
-
-    /* skip if list is empty */
-    if (!ncbinuse)
-        return;
-
-    /* find next */
-    do
+    for (; cid != -1 && nready < MAXREADY; cid = cback[cid].next)
     {
-        lastcb = (lastcb + 1) % ncback;
-        cp     = &cback[lastcb];
-    } while (!cp->in_use || !FD_ISSET(cp->fd, rfdp));
+        ready[nready].cid = cid;
+        ready[nready].gen = cback[cid].gen;
+        nready++;
+    }
+    return nready;
+}
 
-    /* run */
-    (*cp->fp)(cp->fd, cp->ud);
+/* run the ready callbacks, unless removed by a previous one */
+static void callCallbacks(const READYCB *ready, int nready)
+{
+    for (int i = 0; i < nready; i++)
+    {
+        /* cback may be reallocated by the callbacks */
+        CB *cp = &cback[ready[i].cid];
+        if (cp->in_use && cp->gen == ready[i].gen)
+            (*cp->fp)(cp->fd, cp->ud);
+    }
 }
 
-/* run the next timer callback whose time has come, if any. all we have to do
- * is is check the first entry in timefunc because it is sorted in increasing
- * order of time from epoch to run, ie, first entry runs soonest.
+/* run all the timer functions whose time has come. the soonest timers are at
+ * the top of the heap. timers armed while dispatching, including the periodic
+ * ones that run now, wait for the next loop.
  */
-static void checkTimer()
+static void checkTimers()
 {
-    TF *node = timefunc->next;
+    double now = nowMs();
+    unsigned long lastseq = timerseq;
 
-    if (node == NULL || remainingTimerNode(node) > 0)
-        return;
+    while (ntimers > 0 && timers[0]->tgo <= now && timers[0]->seq <= lastseq)
+    {
+        TF *node = timers[0];
+        removeTimerAt(0);
 
-    (*node->fp)(node->ud);
+        (*node->fp)(node->ud);
+
+        /* removed by its function */
+        if (node->fp == NULL)
+        {
+            free(node);
+            continue;
+        }
 
-    node = dettachTimer(node);
+        if (node->interval > 0)
+        {
+            node->tgo += node->interval;
+            pushTimer(node);
+        }
+        else
+        {
+            unhashTimer(node);
+            free(node);
+        }
+    }
+}
 
-    if (node == NULL)
-        return;
+/* ms until the soonest timer expires, 0 if there are work procs or fds always ready, -1 if nothing to wait for */
+static double waitMs()
+{
+    if (nwpinuse > 0 || ncbalways > 0)
+        return 0;
 
-    if (node->interval > 0)
+    if (ntimers > 0)
     {
-        node->tgo += node->interval;
-        insertTimer(node);
-    } else {
-        free(node);
+        double late = remainingTimerNode(timers[0]);
+        return late < 0 ? 0 : late;
     }
+
+    return -1;
 }
 
-/* check fd's from each active callback.
- * if any ready, call their callbacks else call each registered work procedure.
+/* wait for fd's from each active callback, timeout depending on pending work.
+ * if any ready, call all their callbacks else call next registered work procedure.
  */
 static void oneLoop()
 {
-    struct timeval tv, *tvp;
+    READYCB ready[MAXREADY];
+    int nready = 0;
+    double wait = waitMs();
+
+#ifdef USE_EPOLL
+    struct epoll_event events[MAXREADY];
+    int ns = 0;
+
+    /* timerfd wakes us for the soonest timer */
+    initEpoll();
+    armTimerfd(ntimers > 0 ? timers[0]->tgo : 0);
+    ns = epoll_wait(epollfd, events, MAXREADY, wait == 0 ? 0 : -1);
+    if (ns < 0)
+    {
+        if (errno != EINTR)
+            perror("epoll_wait");
+        return;
+    }
+
+    for (int i = 0; i < ns; i++)
+    {
+        if (events[i].data.u64 == TIMERFD_TAG)
+        {
+            uint64_t expirations;
+            if (read(timerfd, &expirations, sizeof(expirations)) > 0)
+                timerfdgo = 0;
+        }
+        else
+            nready = readyCallbacks((int)events[i].data.u64, ready, nready);
+    }
+#else
+    struct timeval tv, *tvp = NULL;
     fd_set rfd;
     CB *cp;
     int maxfd, ns;
@@ -463,33 +790,14 @@ static void oneLoop()
         }
     }
 
-    /* determine timeout:
-	 * if there are work procs
-	 *   set delay = 0
-	 * else if there is at least one timer func
-	 *   set delay = time until soonest timer func expires
-	 * else
-	 *   set delay = forever
-	 */
-    if (nwpinuse > 0)
-    {
-        tvp         = &tv;
-        tvp->tv_sec = tvp->tv_usec = 0;
-    }
-    else if (timefunc->next != NULL)
+    if (wait >= 0)
     {
-        double late = remainingTimerNode(timefunc->next); /* ms late */
-        if (late < 0)
-            late = 0;
-        late /= 1000.0; /* secs late */
+        wait /= 1000.0; /* secs */
         tvp          = &tv;
-        tvp->tv_sec  = (long)floor(late);
-        tvp->tv_usec = (long)floor((late - tvp->tv_sec) * 1000000.0);
+        tvp->tv_sec  = (long)floor(wait);
+        tvp->tv_usec = (long)floor((wait - tvp->tv_sec) * 1000000.0);
     }
-    else
-        tvp = NULL;
 
-    /* check file descriptors, timeout depending on pending work */
     ns = select(maxfd + 1, &rfd, NULL, NULL, tvp);
     if (ns < 0)
     {
@@ -497,12 +805,24 @@ static void oneLoop()
         return;
     }
 
+    for (int i = 0; i < ncback && nready < MAXREADY; i++)
+    {
+        if (cback[i].in_use && FD_ISSET(cback[i].fd, &rfd))
+        {
+            ready[nready].cid = i;
+            ready[nready].gen = cback[i].gen;
+            nready++;
+        }
+    }
+#endif
+    nready = readyCallbacks(cbalways, ready, nready);
+
     /* dispatch */
-    checkTimer();
-    if (ns == 0)
+    checkTimers();
+    if (nready == 0)
         runWorkProc();
     else
-        callCallback(&rfd);
+        callCallbacks(ready, nready);
 
     runImmediates();
 }
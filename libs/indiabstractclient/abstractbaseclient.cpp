@@ -441,7 +441,10 @@ void AbstractBaseClient::setBLOBMode(BLOBHandling blobH, const char *dev, const
         bMode->blobMode = blobH;
     }
 
-    IUUserIOEnableBLOB(&d->io, d, dev, prop, blobH);
+    if (d->binaryBlobs)
+        IUUserIOEnableBLOBBinary(&d->io, d, dev, prop, blobH);
+    else
+        IUUserIOEnableBLOB(&d->io, d, dev, prop, blobH);
 }
 
 BLOBHandling AbstractBaseClient::getBLOBMode(const char *dev, const char *prop)
@@ -93,6 +93,9 @@ class AbstractBaseClientPrivate
 
         bool verbose {false};
 
+        /** The parser of this client accepts raw BLOB contents, see setLilXMLRawContent */
+        bool binaryBlobs {false};
+
         uint32_t timeout_sec {3}, timeout_us {0};
 
         WatchDeviceProperty watchDevice;
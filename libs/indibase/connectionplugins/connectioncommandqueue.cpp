@@ -0,0 +1,296 @@
+/*******************************************************************************
+ Connection Command Queue
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "connectioncommandqueue.h"
+
+#include "indicom.h"
+#include "indidevapi.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace Connection
+{
+
+CommandQueue::CommandQueue(std::function<int()> portFD) : m_PortFD(std::move(portFD))
+{
+}
+
+CommandQueue::~CommandQueue()
+{
+    // The owner is going away, nobody is left to notify
+    disarmTimer();
+    watch(false);
+}
+
+void CommandQueue::enqueue(const std::string &request, char terminator, int timeout, Callback callback)
+{
+    Command command;
+    command.request    = request;
+    command.terminator = terminator;
+    command.timeout    = timeout;
+    command.callback   = std::move(callback);
+    enqueue(std::move(command));
+}
+
+void CommandQueue::enqueue(Command command)
+{
+    m_Queued.push_back(std::move(command));
+    pump();
+}
+
+void CommandQueue::setPipelineDepth(size_t depth)
+{
+    m_Depth = std::max<size_t>(1, depth);
+    pump();
+}
+
+void CommandQueue::setDrainTime(int ms)
+{
+    m_DrainTime = std::max(0, ms);
+}
+
+void CommandQueue::cancel()
+{
+    fail(COMMAND_CANCELLED);
+}
+
+void CommandQueue::pump()
+{
+    // Callbacks completing commands below may enqueue more, the loop picks them up
+    if (m_Pumping)
+        return;
+
+    m_Pumping = true;
+
+    while (!m_Draining && !m_Queued.empty() && m_InFlight.size() < m_Depth)
+    {
+        int fd = m_PortFD();
+        if (fd < 0)
+        {
+            fail(COMMAND_ERROR);
+            break;
+        }
+
+        Command command = std::move(m_Queued.front());
+        m_Queued.pop_front();
+
+        int nbytes_written = 0;
+        if (tty_write(fd, command.request.data(), static_cast<int>(command.request.size()), &nbytes_written) != TTY_OK)
+        {
+            if (command.callback)
+                command.callback(COMMAND_ERROR, std::string());
+            fail(COMMAND_ERROR);
+            break;
+        }
+
+        if (command.noResponse)
+        {
+            if (command.callback)
+                command.callback(COMMAND_OK, std::string());
+            continue;
+        }
+
+        m_InFlight.push_back(std::move(command));
+        if (m_InFlight.size() == 1)
+            armTimer();
+    }
+
+    watch(!m_InFlight.empty() || m_Draining);
+    m_Pumping = false;
+}
+
+void CommandQueue::readResponses(int fd)
+{
+    char buffer[512];
+    int bytesRead = ::read(fd, buffer, sizeof(buffer));
+    if (bytesRead <= 0)
+    {
+        fail(COMMAND_ERROR);
+        return;
+    }
+
+    // Late responses of timed out commands, wait until the device is quiet
+    if (m_Draining)
+    {
+        armDrainTimer();
+        return;
+    }
+
+    m_Input.append(buffer, bytesRead);
+
+    while (!m_InFlight.empty())
+    {
+        const Command &head = m_InFlight.front();
+        size_t end = 0;
+
+        if (head.length > 0)
+        {
+            if (m_Input.size() < head.length)
+                break;
+            end = head.length;
+        }
+        else
+        {
+            size_t stop = m_Input.find(head.terminator);
+            if (stop == std::string::npos)
+                break;
+            end = stop + 1;
+        }
+
+        std::string response = m_Input.substr(0, end);
+        m_Input.erase(0, end);
+
+        Callback callback = std::move(m_InFlight.front().callback);
+        m_InFlight.pop_front();
+        armTimer();
+
+        if (callback)
+            callback(COMMAND_OK, response);
+    }
+
+    // Nothing is waiting for these bytes
+    if (m_InFlight.empty())
+        m_Input.clear();
+
+    pump();
+}
+
+void CommandQueue::onTimeout()
+{
+    m_TimerID = -1;
+
+    // The device was quiet long enough, resume sending
+    if (m_Draining)
+    {
+        m_Draining = false;
+        pump();
+        return;
+    }
+
+    if (m_InFlight.empty())
+        return;
+
+    // The late response of the head would be matched to the next command, so none of the commands sent so far can be
+    // trusted. A partial response would prefix the response of the next command.
+    std::deque<Command> failed;
+    failed.swap(m_InFlight);
+    m_Input.clear();
+    flush();
+
+    for (auto &command : failed)
+    {
+        if (command.callback)
+            command.callback(COMMAND_TIMEOUT, std::string());
+    }
+
+    pump();
+}
+
+void CommandQueue::flush()
+{
+    int fd = m_PortFD();
+    if (fd >= 0 && tcflush(fd, TCIFLUSH) != 0)
+    {
+        // Not a serial port
+        char buffer[512];
+        while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0);
+    }
+
+    m_Draining = true;
+    watch(true);
+    armDrainTimer();
+}
+
+void CommandQueue::fail(Status status)
+{
+    disarmTimer();
+    m_Draining = false;
+    watch(false);
+    m_Input.clear();
+
+    std::deque<Command> failed;
+    failed.swap(m_InFlight);
+    std::move(m_Queued.begin(), m_Queued.end(), std::back_inserter(failed));
+    m_Queued.clear();
+
+    for (auto &command : failed)
+    {
+        if (command.callback)
+            command.callback(status, std::string());
+    }
+}
+
+void CommandQueue::watch(bool enabled)
+{
+    if (enabled && m_CallbackID == -1)
+    {
+        int fd = m_PortFD();
+        if (fd >= 0)
+        {
+            m_CallbackID = IEAddCallback(fd, [](int fd, void *userpointer)
+            {
+                static_cast<CommandQueue *>(userpointer)->readResponses(fd);
+            }, this);
+        }
+    }
+    else if (!enabled && m_CallbackID != -1)
+    {
+        IERmCallback(m_CallbackID);
+        m_CallbackID = -1;
+    }
+}
+
+void CommandQueue::armTimer()
+{
+    disarmTimer();
+
+    if (m_InFlight.empty())
+        return;
+
+    m_TimerID = IEAddTimer(m_InFlight.front().timeout, [](void *userpointer)
+    {
+        static_cast<CommandQueue *>(userpointer)->onTimeout();
+    }, this);
+}
+
+void CommandQueue::armDrainTimer()
+{
+    disarmTimer();
+
+    m_TimerID = IEAddTimer(m_DrainTime, [](void *userpointer)
+    {
+        static_cast<CommandQueue *>(userpointer)->onTimeout();
+    }, this);
+}
+
+void CommandQueue::disarmTimer()
+{
+    if (m_TimerID != -1)
+    {
+        IERmTimer(m_TimerID);
+        m_TimerID = -1;
+    }
+}
+
+}
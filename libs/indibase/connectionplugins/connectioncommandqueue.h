@@ -0,0 +1,146 @@
+/*******************************************************************************
+ Connection Command Queue
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace Connection
+{
+/**
+ * @brief The CommandQueue class sends request/response commands to a device without blocking the driver.
+ *
+ * Commands are written as soon as they are enqueued, up to the pipeline depth, so several requests are on the wire
+ * while the device answers the first one. Responses are read from the event loop as they arrive, matched to the
+ * commands in order and delivered to each command callback.
+ *
+ * A poll that used to be a series of tty_write/tty_read_section pairs becomes:
+ * @code
+ *   auto &queue = serialConnection->commandQueue();
+ *   queue.enqueue(":GR#", '#', 1000, [this](auto status, const std::string &ra) { ... });
+ *   queue.enqueue(":GD#", '#', 1000, [this](auto status, const std::string &de) { ... });
+ * @endcode
+ *
+ * The queue uses the event loop of the driver, enqueue() must be called from the driver main thread, for example from
+ * TimerHit() or ISNewXXX(). While commands are pending, the queue owns the port: do not read the port directly until
+ * pending() drops to zero. Disconnecting the connection cancels all pending commands.
+ *
+ * When a command times out, its late response would be taken for the response of the next one. All the commands
+ * written so far fail with COMMAND_TIMEOUT, the port input is flushed and discarded until the device stays quiet for
+ * the drain time, then the queued commands are written.
+ */
+class CommandQueue
+{
+    public:
+        typedef enum
+        {
+            COMMAND_OK,        /** Response received */
+            COMMAND_TIMEOUT,   /** No complete response within the command timeout, or written before one that timed out */
+            COMMAND_ERROR,     /** Port is closed or failed to read or write */
+            COMMAND_CANCELLED, /** Queue was cancelled before the response arrived */
+        } Status;
+
+        /**
+         * @brief Called once per command with the response, including the terminator, or an empty response on failure.
+         */
+        typedef std::function<void(Status status, const std::string &response)> Callback;
+
+        struct Command
+        {
+            /** Bytes sent to the device */
+            std::string request;
+            /** Last byte of the response */
+            char terminator {'#'};
+            /** Fixed response length, used instead of the terminator when not zero */
+            size_t length {0};
+            /** The device does not answer, the command completes once written */
+            bool noResponse {false};
+            /** Milliseconds to wait for the response once the previous command completed */
+            int timeout {1000};
+            Callback callback;
+        };
+
+        /**
+         * @param portFD returns the file descriptor of the port, or -1 when not connected.
+         */
+        explicit CommandQueue(std::function<int()> portFD);
+        ~CommandQueue();
+
+        CommandQueue(const CommandQueue &) = delete;
+        CommandQueue &operator=(const CommandQueue &) = delete;
+
+        /**
+         * @brief enqueue Add a command answered by a response ending with terminator.
+         */
+        void enqueue(const std::string &request, char terminator, int timeout, Callback callback);
+
+        /**
+         * @brief enqueue Add a command with a fixed length or no response.
+         */
+        void enqueue(Command command);
+
+        /**
+         * @brief setPipelineDepth Maximum number of commands written before their response is received.
+         * Use 1 for devices that drop commands sent while they are busy. Default is 4.
+         */
+        void setPipelineDepth(size_t depth);
+
+        /**
+         * @brief setDrainTime Milliseconds without input after a timeout before writing commands again. Default is 100.
+         */
+        void setDrainTime(int ms);
+
+        /**
+         * @return Number of commands not completed yet.
+         */
+        size_t pending() const
+        {
+            return m_Queued.size() + m_InFlight.size();
+        }
+
+        /**
+         * @brief cancel Complete all pending commands with COMMAND_CANCELLED and forget any partial response.
+         */
+        void cancel();
+
+    private:
+        void pump();
+        void readResponses(int fd);
+        void onTimeout();
+        void flush();
+        void fail(Status status);
+        void watch(bool enabled);
+        void armTimer();
+        void armDrainTimer();
+        void disarmTimer();
+
+        std::function<int()> m_PortFD;
+        std::deque<Command> m_Queued;
+        std::deque<Command> m_InFlight;
+        std::string m_Input;
+        size_t m_Depth {4};
+        int m_DrainTime {100};
+        int m_CallbackID {-1};
+        int m_TimerID {-1};
+        bool m_Pumping {false};
+        bool m_Draining {false};
+};
+}
@@ -320,6 +320,9 @@ bool Serial::Connect(const char *port, uint32_t baud)
 
 bool Serial::Disconnect()
 {
+    if (m_CommandQueue)
+        m_CommandQueue->cancel();
+
     if (PortFD > 0)
     {
         tty_disconnect(PortFD);
@@ -355,6 +358,16 @@ void Serial::Deactivated()
     }
 }
 
+CommandQueue &Serial::commandQueue()
+{
+    if (!m_CommandQueue)
+        m_CommandQueue.reset(new CommandQueue([this]()
+        {
+            return PortFD;
+        }));
+    return *m_CommandQueue;
+}
+
 bool Serial::saveConfigItems(FILE *fp)
 {
     if (m_Permission != IP_RO)
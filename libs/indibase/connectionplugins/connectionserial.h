@@ -21,7 +21,9 @@
 #pragma once
 
 #include "connectioninterface.h"
+#include "connectioncommandqueue.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -103,6 +105,12 @@ class Serial : public Interface
             return PortFD;
         }
 
+        /**
+         * @brief commandQueue Queue to send pipelined commands on this connection without blocking the driver.
+         * @note Disconnect() cancels the pending commands.
+         */
+        CommandQueue &commandQueue();
+
         virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n) override;
         virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n) override;
         virtual bool saveConfigItems(FILE *fp) override;
@@ -186,6 +194,7 @@ class Serial : public Interface
         ISwitchVectorProperty RefreshSP;
 
         int PortFD = -1;
+        std::unique_ptr<CommandQueue> m_CommandQueue;
 
         // Default 8N1 parameters
         uint8_t wordSize = 8;
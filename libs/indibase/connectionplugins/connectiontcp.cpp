@@ -344,6 +344,9 @@ bool TCP::Connect()
 //////////////////////////////////////////////////////////////////////////////////////////////////
 bool TCP::Disconnect()
 {
+    if (m_CommandQueue)
+        m_CommandQueue->cancel();
+
     if (m_SockFD > 0)
     {
         close(m_SockFD);
@@ -353,6 +356,19 @@ bool TCP::Disconnect()
     return true;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////
+///
+//////////////////////////////////////////////////////////////////////////////////////////////////
+CommandQueue &TCP::commandQueue()
+{
+    if (!m_CommandQueue)
+        m_CommandQueue.reset(new CommandQueue([this]()
+        {
+            return PortFD;
+        }));
+    return *m_CommandQueue;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 ///
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -21,9 +21,11 @@
 #pragma once
 
 #include "connectioninterface.h"
+#include "connectioncommandqueue.h"
 
 #include <stdint.h>
 #include <cstdlib>
+#include <memory>
 #include <string>
 
 namespace Connection
@@ -85,6 +87,12 @@ class TCP : public Interface
         {
             return PortFD;
         }
+
+        /**
+         * @brief commandQueue Queue to send pipelined commands on this connection without blocking the driver.
+         * @note Disconnect() cancels the pending commands.
+         */
+        CommandQueue &commandQueue();
         void setDefaultHost(const char *addressHost);
         void setDefaultPort(uint32_t addressPort);
         void setConnectionType(int type);
@@ -121,6 +129,7 @@ class TCP : public Interface
         int m_ConfigConnectionType {-1};
         int m_SockFD {-1};
         int PortFD = -1;
+        std::unique_ptr<CommandQueue> m_CommandQueue;
         static constexpr uint8_t SOCKET_TIMEOUT {5};
 };
 }
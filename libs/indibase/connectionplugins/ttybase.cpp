@@ -30,6 +30,8 @@
 
 #include "locale_compat.h"
 
+#include <algorithm>
+
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
@@ -118,6 +120,32 @@ TTYBase::TTY_RESPONSE TTYBase::checkTimeout(uint8_t timeout)
 #endif
 }
 
+TTYBase::TTY_RESPONSE TTYBase::fillReadBuffer(uint8_t timeout)
+{
+#ifdef _WIN32
+    INDI_UNUSED(timeout);
+    return TTY_ERRNO;
+#else
+    TTY_RESPONSE timeoutResponse = checkTimeout(timeout);
+    if (timeoutResponse != TTY_OK)
+        return timeoutResponse;
+
+    if (m_ReadBuffer.empty())
+        m_ReadBuffer.resize(4096);
+
+    // Everything available in one call instead of one call per byte
+    int bytesRead = ::read(m_PortFD, m_ReadBuffer.data(), m_ReadBuffer.size());
+
+    // A closed socket stays readable, report it instead of polling it forever
+    if (bytesRead <= 0)
+        return TTY_READ_ERROR;
+
+    m_ReadStart = 0;
+    m_ReadEnd   = bytesRead;
+    return TTY_OK;
+#endif
+}
+
 TTYBase::TTY_RESPONSE TTYBase::write(const uint8_t *buffer, uint32_t nbytes, uint32_t *nbytes_written)
 {
 #ifdef _WIN32
@@ -127,6 +155,9 @@ TTYBase::TTY_RESPONSE TTYBase::write(const uint8_t *buffer, uint32_t nbytes, uin
     if (m_PortFD == -1)
         return TTY_ERRNO;
 
+    // Whatever was read ahead belongs to the previous exchange, drop it like tcflush would
+    m_ReadStart = m_ReadEnd = 0;
+
     int bytes_w     = 0;
     *nbytes_written = 0;
 
@@ -177,13 +208,23 @@ TTYBase::TTY_RESPONSE TTYBase::read(uint8_t *buffer, uint32_t nbytes, uint8_t ti
 
     while (numBytesToRead > 0)
     {
-        if ((timeoutResponse = checkTimeout(timeout)))
-            return timeoutResponse;
-
-        bytesRead = ::read(m_PortFD, buffer + (*nbytes_read), numBytesToRead);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
+        if (m_ReadStart < m_ReadEnd)
+        {
+            // Serve what a section read left behind first
+            bytesRead = std::min(m_ReadEnd - m_ReadStart, numBytesToRead);
+            memcpy(buffer + (*nbytes_read), m_ReadBuffer.data() + m_ReadStart, bytesRead);
+            m_ReadStart += bytesRead;
+        }
+        else
+        {
+            if ((timeoutResponse = checkTimeout(timeout)))
+                return timeoutResponse;
+
+            bytesRead = ::read(m_PortFD, buffer + (*nbytes_read), numBytesToRead);
+
+            if (bytesRead < 0)
+                return TTY_READ_ERROR;
+        }
 
         DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%d bytes read and %d bytes remaining...", bytesRead,
                      numBytesToRead - bytesRead);
@@ -209,32 +250,37 @@ TTYBase::TTY_RESPONSE TTYBase::readSection(uint8_t *buffer, uint32_t nsize, uint
     if (m_PortFD == -1)
         return TTY_ERRNO;
 
-    int bytesRead = 0;
     TTY_RESPONSE timeoutResponse = TTY_OK;
     *nbytes_read  = 0;
     memset(buffer, 0, nsize);
 
-    uint8_t *read_char = nullptr;
+    if (nsize == 0)
+        return TTY_PARAM_ERROR;
 
     DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: Request to read until stop char '%#02X' with %d timeout for m_PortFD %d",
                  __FUNCTION__, stop_byte, timeout, m_PortFD);
 
     for (;;)
     {
-        if ((timeoutResponse = checkTimeout(timeout)))
+        if (m_ReadStart == m_ReadEnd && (timeoutResponse = fillReadBuffer(timeout)))
             return timeoutResponse;
 
-        read_char = reinterpret_cast<uint8_t*>(buffer + *nbytes_read);
-        bytesRead = ::read(m_PortFD, read_char, 1);
+        const uint8_t *data = m_ReadBuffer.data() + m_ReadStart;
+        uint32_t count = std::min(m_ReadEnd - m_ReadStart, nsize - *nbytes_read);
 
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
+        auto stop = static_cast<const uint8_t *>(memchr(data, stop_byte, count));
+        if (stop)
+            count = stop - data + 1;
 
-        DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
+        memcpy(buffer + *nbytes_read, data, count);
+        m_ReadStart += count;
+
+        for (uint32_t i = *nbytes_read; i < *nbytes_read + count; i++)
+            DEBUGFDEVICE(m_DriverName, m_DebugChannel, "%s: buffer[%d]=%#X (%c)", __FUNCTION__, i, buffer[i], buffer[i]);
 
-        (*nbytes_read)++;
+        *nbytes_read += count;
 
-        if (*read_char == stop_byte)
+        if (stop)
             return TTY_OK;
         else if (*nbytes_read >= nsize)
             return TTY_OVERFLOW;
@@ -483,6 +529,7 @@ TTYBase::TTY_RESPONSE TTYBase::connect(const char *device, uint32_t bit_rate, ui
 #endif
 
     m_PortFD = t_fd;
+    m_ReadStart = m_ReadEnd = 0;
     /* return success */
     return TTY_OK;
 
@@ -677,6 +724,7 @@ TTYBase::TTY_RESPONSE TTYBase::connect(const char *device, uint32_t bit_rate, ui
     }
 
     m_PortFD = t_fd;
+    m_ReadStart = m_ReadEnd = 0;
     /* return success */
     return TTY_OK;
 #endif
@@ -693,6 +741,7 @@ TTYBase::TTY_RESPONSE TTYBase::disconnect()
 #ifdef _WIN32
     return TTY_ERRNO;
 #else
+    m_ReadStart = m_ReadEnd = 0;
     tcflush(m_PortFD, TCIOFLUSH);
     int err = close(m_PortFD);
 
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <indilogger.h>
 
 /** \class TTYBase
@@ -69,6 +70,8 @@ class TTYBase
         TTY_RESPONSE read(uint8_t *buffer, uint32_t nbytes, uint8_t timeout, uint32_t *nbytes_read);
 
         /** \brief read buffer from terminal with a delimiter
+            \note Bytes received past \e stop_char are kept for the next read() or readSection() and dropped by
+            write(), so do not read or flush getPortFD() directly after a section read.
             \param fd file descriptor
             \param buf pointer to store data. Must be initialized and big enough to hold data.
             \param stop_char if the function encounters \e stop_char then it stops reading and returns the buffer.
@@ -135,8 +138,13 @@ class TTYBase
     private:
 
         TTY_RESPONSE checkTimeout(uint8_t timeout);
+        TTY_RESPONSE fillReadBuffer(uint8_t timeout);
 
         int m_PortFD { -1 };
+        // Bytes read past the stop byte of a section, served to the next read until a write drops them
+        std::vector<uint8_t> m_ReadBuffer;
+        uint32_t m_ReadStart { 0 };
+        uint32_t m_ReadEnd { 0 };
         bool m_Debug { false };
         INDI::Logger::VerbosityLevel m_DebugChannel { INDI::Logger::DBG_IGNORE };
         const char *m_DriverName;
@@ -33,6 +33,7 @@
 #include "indicom.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "sharedblob.h"
 
 #ifdef HAVE_XISF
 #include <libxisf.h>
@@ -52,8 +53,10 @@
 #include <regex>
 #include <iterator>
 #include <variant>
+#include <algorithm>
+#include <future>
+#include <thread>
 
-#include <dirent.h>
 #include <cerrno>
 #include <cstdlib>
 #include <zlib.h>
@@ -76,6 +79,155 @@ std::string join(std::vector<std::string> const &strings, std::string delim)
     return ss.str();
 }
 
+namespace
+{
+// Holds a place in the upload order of INDI::CCD, released on destruction.
+class UploadTicket
+{
+    public:
+        UploadTicket(std::mutex &mutex, std::condition_variable &turn, uint64_t &next, uint64_t &serving)
+            : m_Mutex(mutex), m_Turn(turn), m_Serving(serving)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Ticket = next++;
+        }
+
+        ~UploadTicket()
+        {
+            wait();
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            ++m_Serving;
+            m_Turn.notify_all();
+        }
+
+        // Wait until all frames encoded before this one are uploaded
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Turn.wait(lock, [this] { return m_Serving == m_Ticket; });
+        }
+
+    private:
+        std::mutex &m_Mutex;
+        std::condition_variable &m_Turn;
+        uint64_t &m_Serving;
+        uint64_t m_Ticket {0};
+};
+
+// cfitsio keeps global state unless it was built reentrant. The FITS file of a frame is written while
+// fpack compresses the previous one on another thread, so both hold this lock when it is not.
+std::mutex cfitsioMutex;
+
+std::unique_lock<std::mutex> lockCFITSIO()
+{
+    static const bool reentrant = fits_is_reentrant() != 0;
+    if (reentrant)
+        return std::unique_lock<std::mutex>(cfitsioMutex, std::defer_lock);
+    return std::unique_lock<std::mutex>(cfitsioMutex);
+}
+
+// Compress to a zlib stream using all cores, like pigz does. Every chunk is deflated on its own thread,
+// primed with the last 32KB of the previous chunk and ended with a sync flush, so the concatenation is
+// a single stream that uncompress() reads as before. The result must be released with free().
+bool compressParallel(const void *data, size_t size, int level, uint8_t **compressed, size_t *compressedSize)
+{
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    const size_t minChunk = 4 * 1024 * 1024;
+    const size_t maxChunk = 1024 * 1024 * 1024; // zlib counts in uInt
+
+    size_t chunks = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), size / minChunk);
+    chunks = std::max(chunks, (size + maxChunk - 1) / maxChunk);
+    chunks = std::max<size_t>(chunks, 1);
+    size_t chunkSize = (size + chunks - 1) / chunks;
+
+    std::vector<std::vector<uint8_t>> output(chunks);
+    std::vector<uLong> checksums(chunks);
+    std::vector<char> failed(chunks, 0);
+
+    auto deflateChunk = [&](size_t i)
+    {
+        size_t begin = std::min(i * chunkSize, size);
+        size_t length = std::min(chunkSize, size - begin);
+
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            failed[i] = 1;
+            return;
+        }
+
+        if (begin > 0)
+        {
+            size_t dictionary = std::min<size_t>(begin, 32768);
+            deflateSetDictionary(&strm, source + begin - dictionary, dictionary);
+        }
+
+        // a sync flush adds an empty stored block
+        output[i].resize(deflateBound(&strm, length) + 16);
+
+        strm.next_in   = const_cast<Bytef *>(source + begin);
+        strm.avail_in  = length;
+        strm.next_out  = output[i].data();
+        strm.avail_out = output[i].size();
+
+        int r = deflate(&strm, i + 1 < chunks ? Z_SYNC_FLUSH : Z_FINISH);
+        if ((r != Z_OK && r != Z_STREAM_END) || strm.avail_in != 0 || strm.avail_out == 0)
+            failed[i] = 1;
+
+        output[i].resize(strm.total_out);
+        checksums[i] = adler32(adler32(0L, Z_NULL, 0), source + begin, length);
+        deflateEnd(&strm);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks; ++i)
+        threads.emplace_back(deflateChunk, i);
+    deflateChunk(0);
+    for (auto &thread : threads)
+        thread.join();
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+        return false;
+
+    size_t total = 2 + 4;
+    uLong checksum = checksums[0];
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        total += output[i].size();
+        if (i > 0)
+            checksum = adler32_combine(checksum, checksums[i], std::min(chunkSize, size - std::min(i * chunkSize, size)));
+    }
+
+    uint8_t *result = static_cast<uint8_t *>(malloc(total));
+    if (result == nullptr)
+        return false;
+
+    // zlib header, deflate with 32K window
+    int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    result[0] = 0x78;
+    result[1] = flevel << 6;
+    result[1] += 31 - (result[0] * 256 + result[1]) % 31;
+
+    uint8_t *p = result + 2;
+    for (auto &chunk : output)
+    {
+        memcpy(p, chunk.data(), chunk.size());
+        p += chunk.size();
+    }
+
+    // adler32 trailer, big endian
+    p[0] = checksum >> 24;
+    p[1] = checksum >> 16;
+    p[2] = checksum >> 8;
+    p[3] = checksum;
+
+    *compressed     = result;
+    *compressedSize = total;
+    return true;
+}
+}
+
 namespace INDI
 {
 
@@ -426,6 +578,25 @@ bool CCD::initProperties()
     IUFillNumberVector(&FastExposureCountNP, FastExposureCountN, 1, getDeviceName(), "CCD_FAST_COUNT", "Fast Count",
                        OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
 
+    /**********************************************/
+    /**************** Frame Statistics ************/
+    /***************** Primary CCD Only ***********/
+    int statisticsIndex = INDI_DISABLED;
+    IUGetConfigOnSwitchIndex(getDeviceName(), "CCD_STATISTICS_TOGGLE", &statisticsIndex);
+    FrameStatisticsToggleSP[INDI_ENABLED].fill("INDI_ENABLED", "Enabled",
+                                                statisticsIndex == INDI_ENABLED ? ISS_ON : ISS_OFF);
+    FrameStatisticsToggleSP[INDI_DISABLED].fill("INDI_DISABLED", "Disabled",
+                                                 statisticsIndex == INDI_ENABLED ? ISS_OFF : ISS_ON);
+    FrameStatisticsToggleSP.fill(getDeviceName(), "CCD_STATISTICS_TOGGLE", "Statistics", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0,
+                                 IPS_IDLE);
+
+    FrameStatisticsNP[STATISTICS_MIN].fill("STATISTICS_MIN", "Minimum", "%.f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATISTICS_MAX].fill("STATISTICS_MAX", "Maximum", "%.f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATISTICS_MEAN].fill("STATISTICS_MEAN", "Mean", "%.2f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATISTICS_STDDEV].fill("STATISTICS_STDDEV", "Std. Deviation", "%.2f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATISTICS_MEDIAN].fill("STATISTICS_MEDIAN", "Median", "%.1f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP.fill(getDeviceName(), "CCD_STATISTICS", "Statistics", IMAGE_INFO_TAB, IP_RO, 60, IPS_IDLE);
+
     /**********************************************/
     /**************** Web Socket ******************/
     /**********************************************/
@@ -625,6 +796,10 @@ bool CCD::updateProperties()
 
         defineProperty(&FastExposureToggleSP);
         defineProperty(&FastExposureCountNP);
+
+        defineProperty(FrameStatisticsToggleSP);
+        if (FrameStatisticsToggleSP[INDI_ENABLED].getState() == ISS_ON)
+            defineProperty(FrameStatisticsNP);
     }
     else
     {
@@ -712,6 +887,10 @@ bool CCD::updateProperties()
 #endif
         deleteProperty(FastExposureToggleSP.name);
         deleteProperty(FastExposureCountNP.name);
+
+        deleteProperty(FrameStatisticsToggleSP);
+        if (FrameStatisticsToggleSP[INDI_ENABLED].getState() == ISS_ON)
+            deleteProperty(FrameStatisticsNP);
     }
 
     // Streamer
@@ -1530,6 +1709,26 @@ bool CCD::ISNewSwitch(const char * dev, const char * name, ISState * states, cha
             return true;
         }
 
+        // Frame Statistics Toggle
+        if (FrameStatisticsToggleSP.isNameMatch(name))
+        {
+            int previousIndex = FrameStatisticsToggleSP.findOnSwitchIndex();
+            FrameStatisticsToggleSP.update(states, names, n);
+            FrameStatisticsToggleSP.setState(IPS_OK);
+            FrameStatisticsToggleSP.apply();
+
+            int currentIndex = FrameStatisticsToggleSP.findOnSwitchIndex();
+            if (previousIndex != currentIndex)
+            {
+                if (currentIndex == INDI_ENABLED)
+                    defineProperty(FrameStatisticsNP);
+                else
+                    deleteProperty(FrameStatisticsNP);
+                saveConfig(true, FrameStatisticsToggleSP.getName());
+            }
+            return true;
+        }
+
 
 #ifdef HAVE_WEBSOCKET
         // Websocket Enable/Disable
@@ -2035,17 +2234,6 @@ void CCD::addFITSKeywords(CCDChip * targetChip, std::vector<FITSRecord> &fitsKey
         fitsKeywords.push_back({"FILTER", FilterNames.at(CurrentFilterSlot - 1).c_str(), "Filter"});
     }
 
-#ifdef WITH_MINMAX
-    if (targetChip->getNAxis() == 2)
-    {
-        double min_val, max_val;
-        getMinMax(&min_val, &max_val, targetChip);
-
-        fitsKeywords.push_back({"DATAMIN", min_val, 6, "Minimum value"});
-        fitsKeywords.push_back({"DATAMAX", max_val, 6, "Maximum value"});
-    }
-#endif
-
     if (HasBayer() && targetChip->getNAxis() == 2)
     {
         fitsKeywords.push_back({"XBAYROFF", atoi(BayerT[0].text), "X offset of Bayer array"});
@@ -2274,6 +2462,15 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     if (processFastExposure(targetChip) == false)
         return false;
 
+    // One pass over the frame serves both the statistics property and the FITS/XISF header.
+    // It runs under the buffer lock right before the frame is encoded, so both describe the encoded frame.
+    bool withStatistics = FrameStatisticsToggleSP[INDI_ENABLED].getState() == ISS_ON && targetChip == &PrimaryCCD;
+#ifdef WITH_MINMAX
+    withStatistics = true;
+#endif
+    FrameStatistics statistics;
+    bool hasStatistics = false;
+
     bool sendImage = (UploadS[UPLOAD_CLIENT].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
     bool saveImage = (UploadS[UPLOAD_LOCAL].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
 
@@ -2332,6 +2529,10 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 
             std::unique_lock<std::mutex> guard(ccdBufferLock);
 
+            hasStatistics = withStatistics && computeFrameStatistics(targetChip, statistics);
+
+            auto fitsGuard = lockCFITSIO();
+
             // 8640 = 2880 * 3 which is sufficient for most cases.
             uint32_t size = 8640 + nelements * (targetChip->getBPP() / 8);
             //  Initialize FITS file.
@@ -2359,6 +2560,8 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
             std::vector<FITSRecord> fitsKeywords;
 
             addFITSKeywords(targetChip, fitsKeywords);
+            if (hasStatistics)
+                addFITSStatistics(statistics, fitsKeywords);
 
             // Add all custom keywords next
             for (auto &record : m_CustomFITSKeywords)
@@ -2403,14 +2606,24 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
                 return false;
             }
 
-
-            bool rc = uploadFile(targetChip, *(targetChip->fitsMemoryBlockPointer()), *(targetChip->fitsMemorySizePointer()), sendImage,
-                                 saveImage);
-
+            // Take over the FITS memory, the driver may download the next frame while this one is uploaded.
+            void *fitsData  = *targetChip->fitsMemoryBlockPointer();
+            size_t fitsSize = *targetChip->fitsMemorySizePointer();
+            *targetChip->fitsMemoryBlockPointer() = nullptr;
             targetChip->closeFITSFile();
+            if (fitsGuard.owns_lock())
+                fitsGuard.unlock();
 
+            UploadTicket ticket(m_UploadMutex, m_UploadTurn, m_UploadNext, m_UploadServing);
             guard.unlock();
 
+            if (hasStatistics)
+                setFrameStatistics(statistics);
+
+            ticket.wait();
+            bool rc = uploadFile(targetChip, fitsData, fitsSize, sendImage, saveImage);
+            IDSharedBlobFree(fitsData);
+
             if (rc == false)
             {
                 targetChip->setExposureFailed();
@@ -2420,8 +2633,6 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 #ifdef HAVE_XISF
         else if (EncodeFormatSP[FORMAT_XISF].getState() == ISS_ON)
         {
-            std::vector<FITSRecord> fitsKeywords;
-            addFITSKeywords(targetChip, fitsKeywords);
             targetChip->setImageExtension("xisf");
 
             try
@@ -2430,6 +2641,15 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
                 LibXISF::Image image;
                 LibXISF::XISFWriter xisfWriter;
 
+                std::unique_lock<std::mutex> guard(ccdBufferLock);
+
+                hasStatistics = withStatistics && computeFrameStatistics(targetChip, statistics);
+
+                std::vector<FITSRecord> fitsKeywords;
+                addFITSKeywords(targetChip, fitsKeywords);
+                if (hasStatistics)
+                    addFITSStatistics(statistics, fitsKeywords);
+
                 for (auto &keyword : fitsKeywords)
                 {
                     image.addFITSKeyword({keyword.key().c_str(), keyword.valueString().c_str(), keyword.comment().c_str()});
@@ -2488,12 +2708,20 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
                     image.setColorSpace(LibXISF::Image::RGB);
                 }
 
-                std::unique_lock<std::mutex> guard(ccdBufferLock);
                 std::memcpy(image.imageData(), targetChip->getFrameBuffer(), image.imageDataSize());
+                UploadTicket ticket(m_UploadMutex, m_UploadTurn, m_UploadNext, m_UploadServing);
+                guard.unlock();
+
+                if (hasStatistics)
+                    setFrameStatistics(statistics);
+
+                // Compression happens here, outside of the buffer lock
                 xisfWriter.writeImage(image);
 
                 LibXISF::ByteArray xisfFile;
                 xisfWriter.save(xisfFile);
+
+                ticket.wait();
                 bool rc = uploadFile(targetChip, xisfFile.data(), xisfFile.size(), sendImage, saveImage);
                 if (rc == false)
                 {
@@ -2514,10 +2742,18 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
             if (!strcmp(targetChip->getImageExtension(), "fits"))
                 targetChip->setImageExtension("bin");
             std::unique_lock<std::mutex> guard(ccdBufferLock);
-            bool rc = uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage,
-                                 saveImage);
+            hasStatistics = withStatistics && computeFrameStatistics(targetChip, statistics);
+            std::vector<uint8_t> rawData(targetChip->getFrameBuffer(),
+                                         targetChip->getFrameBuffer() + targetChip->getFrameBufferSize());
+            UploadTicket ticket(m_UploadMutex, m_UploadTurn, m_UploadNext, m_UploadServing);
             guard.unlock();
 
+            if (hasStatistics)
+                setFrameStatistics(statistics);
+
+            ticket.wait();
+            bool rc = uploadFile(targetChip, rawData.data(), rawData.size(), sendImage, saveImage);
+
             if (rc == false)
             {
                 targetChip->setExposureFailed();
@@ -2525,6 +2761,16 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
             }
         }
     }
+    else if (withStatistics)
+    {
+        {
+            std::lock_guard<std::mutex> guard(ccdBufferLock);
+            hasStatistics = computeFrameStatistics(targetChip, statistics);
+        }
+
+        if (hasStatistics)
+            setFrameStatistics(statistics);
+    }
 
     if (FastExposureToggleS[INDI_ENABLED].s != ISS_ON)
         targetChip->setExposureComplete();
@@ -2537,68 +2783,124 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
                      bool saveImage)
 {
     uint8_t * compressedData = nullptr;
+    size_t compressedBytes = 0;
+    const char * compressedExtension = nullptr;
 
     DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %d, sendImage? %s, saveImage? %s",
            targetChip->getImageExtension(), totalBytes, sendImage ? "Yes" : "No", saveImage ? "Yes" : "No");
 
-    if (saveImage)
+    snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+
+    // Compress for the client while the image is written to disk.
+    std::future<bool> compression;
+    if (sendImage && targetChip->SendCompressed && EncodeFormatSP[FORMAT_XISF].getState() != ISS_ON)
     {
-        targetChip->FitsB.blob    = const_cast<void *>(fitsData);
-        targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON && !strcmp(targetChip->getImageExtension(), "fits"))
+        {
+            compressedExtension = "fz";
+            compression = std::async(std::launch::async, [&]()
+            {
+                auto fitsGuard = lockCFITSIO();
+                fpstate	fpvar;
+                fp_init (&fpvar);
+                int islossless = 0;
+                if (fp_pack_data_to_data(reinterpret_cast<const char *>(fitsData), totalBytes, &compressedData, &compressedBytes, fpvar,
+                                         &islossless) < 0)
+                {
+                    LOG_ERROR("Error: Ran out of memory compressing image");
+                    return false;
+                }
+                return true;
+            });
+        }
+        else
+        {
+            compressedExtension = "z";
+            compression = std::async(std::launch::async, [&]()
+            {
+                if (fitsData == nullptr || compressParallel(fitsData, totalBytes, 9, &compressedData, &compressedBytes) == false)
+                {
+                    LOG_ERROR("Error: Failed to compress image");
+                    return false;
+                }
+                return true;
+            });
+        }
+    }
 
+    if (saveImage)
+    {
         FILE * fp = nullptr;
         char imageFileName[MAXRBUF];
 
-        std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
-        int maxIndex       = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
-                                          targetChip->FitsB.format);
+        std::string prefix;
+        // Indexed names must not overwrite a file another writer created since the directory was listed
+        bool indexed = strstr(UploadSettingsT[UPLOAD_PREFIX].text, "XXX") != nullptr;
 
-        if (maxIndex < 0)
+        for (int attempt = 0; ; attempt++)
         {
-            LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
-                       strerror(errno));
-            return false;
-        }
+            prefix       = UploadSettingsT[UPLOAD_PREFIX].text;
+            int maxIndex = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
+                                        targetChip->FitsB.format);
 
-        if (maxIndex > 0)
-        {
-            auto now = std::chrono::system_clock::now();
-            std::time_t time = std::chrono::system_clock::to_time_t(now);
-            std::tm* now_tm = std::localtime(&time);
-            long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+            if (maxIndex < 0)
+            {
+                LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
+                           strerror(errno));
+                if (compression.valid())
+                    compression.wait();
+                free(compressedData);
+                return false;
+            }
 
-            std::stringstream stream;
-            // JM 2023.08.31 Make timestamps OS friendly (Windows)
-            stream    << std::setfill('0')
-                      << std::put_time(now_tm, "%FT%H-%M-")
-                      << std::setw(2) << (timestamp / 1000) % 60 << '.'
-                      << std::setw(3) << timestamp % 1000;
+            if (maxIndex > 0)
+            {
+                auto now = std::chrono::system_clock::now();
+                std::time_t time = std::chrono::system_clock::to_time_t(now);
+                std::tm* now_tm = std::localtime(&time);
+                long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
 
-            prefix = std::regex_replace(prefix, std::regex("ISO8601"), stream.str());
+                std::stringstream stream;
+                // JM 2023.08.31 Make timestamps OS friendly (Windows)
+                stream    << std::setfill('0')
+                          << std::put_time(now_tm, "%FT%H-%M-")
+                          << std::setw(2) << (timestamp / 1000) % 60 << '.'
+                          << std::setw(3) << timestamp % 1000;
 
-            char indexString[8];
-            snprintf(indexString, 8, "%03d", maxIndex);
-            std::string prefixIndex = indexString;
-            //prefix.replace(prefix.find("XXX"), std::string::npos, prefixIndex);
-            prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
-        }
+                prefix = FileIndex::expand(prefix, stream.str(), maxIndex);
+            }
+
+            snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
+
+            fp = fopen(imageFileName, indexed ? "wx" : "w");
+            if (fp != nullptr || errno != EEXIST || attempt >= FileIndex::MAX_RETRIES)
+                break;
 
-        snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
+            m_FileIndex.invalidate(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text);
+        }
 
-        fp = fopen(imageFileName, "w");
         if (fp == nullptr)
         {
             LOGF_ERROR("Unable to save image file (%s). %s", imageFileName, strerror(errno));
+            if (compression.valid())
+                compression.wait();
+            free(compressedData);
             return false;
         }
 
-        int n = 0;
-        for (int nr = 0; nr < targetChip->FitsB.bloblen; nr += n)
-            n = fwrite((static_cast<char *>(targetChip->FitsB.blob) + nr), 1, targetChip->FitsB.bloblen - nr, fp);
+        size_t n = 0;
+        for (size_t nr = 0; nr < totalBytes; nr += n)
+        {
+            n = fwrite((static_cast<const char *>(fitsData) + nr), 1, totalBytes - nr, fp);
+            if (n == 0)
+                break;
+        }
 
         fclose(fp);
 
+        m_FileIndex.saved(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
+                          prefix + targetChip->FitsB.format);
+
         // Save image file path
         IUSaveText(&FileNameT[0], imageFileName);
 
@@ -2607,58 +2909,22 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
         IDSetText(&FileNameTP, nullptr);
     }
 
-    if (targetChip->SendCompressed && EncodeFormatSP[FORMAT_XISF].getState() != ISS_ON)
+    if (compression.valid())
     {
-        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON && !strcmp(targetChip->getImageExtension(), "fits"))
+        if (compression.get() == false)
         {
-            fpstate	fpvar;
-            fp_init (&fpvar);
-            size_t compressedBytes = 0;
-            int islossless = 0;
-            if (fp_pack_data_to_data(reinterpret_cast<const char *>(fitsData), totalBytes, &compressedData, &compressedBytes, fpvar,
-                                     &islossless) < 0)
-            {
-                free(compressedData);
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
-
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.fz", targetChip->getImageExtension());
+            free(compressedData);
+            return false;
         }
-        else
-        {
-            uLong compressedBytes = sizeof(char) * totalBytes + totalBytes / 64 + 16 + 3;
-            compressedData  = new uint8_t[compressedBytes];
-
-            if (fitsData == nullptr || compressedData == nullptr)
-            {
-                if (compressedData)
-                    delete [] compressedData;
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
 
-            int r = compress2(compressedData, &compressedBytes, (const Bytef *)fitsData, totalBytes, 9);
-            if (r != Z_OK)
-            {
-                /* this should NEVER happen */
-                LOG_ERROR("Error: Failed to compress image");
-                delete [] compressedData;
-                return false;
-            }
-
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", targetChip->getImageExtension());
-        }
+        targetChip->FitsB.blob    = compressedData;
+        targetChip->FitsB.bloblen = compressedBytes;
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.%s", targetChip->getImageExtension(), compressedExtension);
     }
     else
     {
         targetChip->FitsB.blob    = const_cast<void *>(fitsData);
         targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
     }
 
     targetChip->FitsB.size = totalBytes;
@@ -2690,8 +2956,7 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
         }
     }
 
-    if (compressedData)
-        delete [] compressedData;
+    free(compressedData);
 
     DEBUG(Logger::DBG_DEBUG, "Upload complete");
 
@@ -2793,6 +3058,7 @@ bool CCD::saveConfigItems(FILE * fp)
     IUSaveConfigSwitch(fp, &UploadSP);
     IUSaveConfigText(fp, &UploadSettingsTP);
     IUSaveConfigSwitch(fp, &FastExposureToggleSP);
+    FrameStatisticsToggleSP.save(fp);
 
     IUSaveConfigSwitch(fp, &PrimaryCCD.CompressSP);
 
@@ -2859,89 +3125,53 @@ IPState CCD::GuideWest(uint32_t ms)
     return IPS_ALERT;
 }
 
-void CCD::getMinMax(double * min, double * max, CCDChip * targetChip)
+void CCD::addFITSStatistics(const FrameStatistics &statistics, std::vector<FITSRecord> &fitsKeywords)
 {
-    int ind         = 0, i, j;
-    int imageHeight = targetChip->getSubH() / targetChip->getBinY();
-    int imageWidth  = targetChip->getSubW() / targetChip->getBinX();
-    double lmin = 0, lmax = 0;
-
-    switch (targetChip->getBPP())
-    {
-        case 8:
-        {
-            uint8_t * imageBuffer = targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
-
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
-
-        case 16:
-        {
-            uint16_t * imageBuffer = reinterpret_cast<uint16_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
+    fitsKeywords.push_back({"DATAMIN", statistics.min, 6, "Minimum value"});
+    fitsKeywords.push_back({"DATAMAX", statistics.max, 6, "Maximum value"});
+    fitsKeywords.push_back({"DATAMEAN", statistics.mean, 6, "Mean value"});
+    fitsKeywords.push_back({"DATASTD", statistics.stddev, 6, "Standard deviation"});
+    fitsKeywords.push_back({"DATAMED", statistics.median, 6, "Median value"});
+}
 
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
+void CCD::setFrameStatistics(const FrameStatistics &statistics)
+{
+    // With INDI_CALCULATE_MINMAX statistics are computed for the header only
+    if (FrameStatisticsToggleSP[INDI_ENABLED].getState() != ISS_ON)
+        return;
 
-        case 32:
-        {
-            uint32_t * imageBuffer = reinterpret_cast<uint32_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
+    FrameStatisticsNP[STATISTICS_MIN].setValue(statistics.min);
+    FrameStatisticsNP[STATISTICS_MAX].setValue(statistics.max);
+    FrameStatisticsNP[STATISTICS_MEAN].setValue(statistics.mean);
+    FrameStatisticsNP[STATISTICS_STDDEV].setValue(statistics.stddev);
+    FrameStatisticsNP[STATISTICS_MEDIAN].setValue(statistics.median);
+    FrameStatisticsNP.setState(IPS_OK);
+    FrameStatisticsNP.apply();
+}
 
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
-    }
-    *min = lmin;
-    *max = lmax;
+void CCD::getMinMax(double * min, double * max, CCDChip * targetChip)
+{
+    FrameStatistics statistics;
+    computeFrameStatistics(targetChip, statistics);
+    *min = statistics.min;
+    *max = statistics.max;
 }
 
-std::string regex_replace_compat(const std::string &input, const std::string &pattern, const std::string &replace)
+bool CCD::computeFrameStatistics(CCDChip * targetChip, FrameStatistics &statistics)
 {
-    std::stringstream s;
-    std::regex_replace(std::ostreambuf_iterator<char>(s), input.begin(), input.end(), std::regex(pattern), replace);
-    return s.str();
+    if (targetChip->getNAxis() != 2)
+        return false;
+
+    size_t imageHeight = targetChip->getSubH() / targetChip->getBinY();
+    size_t imageWidth  = targetChip->getSubW() / targetChip->getBinX();
+
+    return statistics.compute(targetChip->getFrameBuffer(), imageWidth * imageHeight, targetChip->getBPP());
 }
 
 int CCD::getFileIndex(const char * dir, const char * prefix, const char * ext)
 {
     INDI_UNUSED(ext);
 
-    DIR * dpdf = nullptr;
-    struct dirent * epdf = nullptr;
-    std::vector<std::string> files = std::vector<std::string>();
-
-    std::string prefixIndex = prefix;
-    prefixIndex             = regex_replace_compat(prefixIndex, "_ISO8601", "");
-    prefixIndex             = regex_replace_compat(prefixIndex, "_XXX", "");
-
     // Create directory if does not exist
     struct stat st;
 
@@ -2960,39 +3190,7 @@ int CCD::getFileIndex(const char * dir, const char * prefix, const char * ext)
         }
     }
 
-    dpdf = opendir(dir);
-    if (dpdf != nullptr)
-    {
-        while ((epdf = readdir(dpdf)))
-        {
-            if (strstr(epdf->d_name, prefixIndex.c_str()))
-                files.push_back(epdf->d_name);
-        }
-    }
-    else
-    {
-        closedir(dpdf);
-        return -1;
-    }
-    int maxIndex = 0;
-
-    for (uint32_t i = 0; i < files.size(); i++)
-    {
-        int index = -1;
-
-        std::string file  = files.at(i);
-        std::size_t start = file.find_last_of("_");
-        std::size_t end   = file.find_last_of(".");
-        if (start != std::string::npos)
-        {
-            index = atoi(file.substr(start + 1, end).c_str());
-            if (index > maxIndex)
-                maxIndex = index;
-        }
-    }
-
-    closedir(dpdf);
-    return (maxIndex + 1);
+    return m_FileIndex.next(dir, prefix);
 }
 
 void CCD::GuideComplete(INDI_EQ_AXIS axis)
@@ -34,6 +34,8 @@
 #include "inditimer.h"
 #include "indielapsedtimer.h"
 #include "fitskeyword.h"
+#include "indifileindex.h"
+#include "indiframestatistics.h"
 #include "dsp/manager.h"
 #include "stream/streammanager.h"
 
@@ -48,6 +50,7 @@
 #include <chrono>
 #include <stdint.h>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 
 extern const char * IMAGE_SETTINGS_TAB;
@@ -94,7 +97,8 @@ class XISFWrapper;
  * INDI::CCD and INDI::StreamManager both upload frames asynchronously in a worker thread.
  * The CCD Buffer data is protected by the ccdBufferLock mutex. When reading the camera data
  * and writing to the buffer, it must be first locked by the mutex. After the write is complete
- * release the lock. For example:
+ * release the lock. INDI::CCD only holds the lock while the frame is encoded, saving, compression
+ * and upload run afterwards so the next frame can be downloaded in the meantime. For example:
  *
  * \code{.cpp}
  * std::unique_lock<std::mutex> guard(ccdBufferLock);
@@ -762,6 +766,20 @@ class CCD : public DefaultDevice, GuiderInterface
         // Fast Exposure Frame Count
         INumber FastExposureCountN[1];
         INumberVectorProperty FastExposureCountNP;
+
+        // Frame Statistics Toggle
+        INDI::PropertySwitch FrameStatisticsToggleSP {2};
+
+        // Statistics of the last primary CCD frame
+        INDI::PropertyNumber FrameStatisticsNP {5};
+        enum
+        {
+            STATISTICS_MIN,
+            STATISTICS_MAX,
+            STATISTICS_MEAN,
+            STATISTICS_STDDEV,
+            STATISTICS_MEDIAN
+        };
         double m_UploadTime = { 0 };
         std::chrono::system_clock::time_point FastExposureToggleStartup;
 
@@ -788,9 +806,22 @@ class CCD : public DefaultDevice, GuiderInterface
         ///////////////////////////////////////////////////////////////////////////////
         bool uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage, bool saveImage);
         void getMinMax(double * min, double * max, CCDChip * targetChip);
+        bool computeFrameStatistics(CCDChip * targetChip, FrameStatistics &statistics);
+        void addFITSStatistics(const FrameStatistics &statistics, std::vector<FITSRecord> &fitsKeywords);
+        void setFrameStatistics(const FrameStatistics &statistics);
         int getFileIndex(const char * dir, const char * prefix, const char * ext);
         bool ExposureCompletePrivate(CCDChip * targetChip);
 
+        // Highest file index in use per upload directory and prefix
+        FileIndex m_FileIndex;
+
+        // Upload pipeline. Frames are encoded while ccdBufferLock is held, then saved, compressed and
+        // sent without it, one at a time and in the order they were encoded.
+        std::mutex m_UploadMutex;
+        std::condition_variable m_UploadTurn;
+        uint64_t m_UploadNext {0};
+        uint64_t m_UploadServing {0};
+
         // Threading for Websocket
 #ifdef HAVE_WEBSOCKET
         std::thread wsThread;
@@ -22,6 +22,321 @@
 
 #include <cstring>
 #include <ctime>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define BIN_SSE2
+#if defined(__GNUC__)
+#define BIN_AVX2
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BIN_NEON
+#endif
+
+namespace
+{
+// Software binning kernels.
+// Every binned row is computed by summing its source rows column by column into a 32 bit
+// accumulator row, which is vectorized, and then summing the accumulator columns of each bin.
+// The results are identical to the per pixel loops, saturation included, since all terms are positive.
+
+// acc[j] += src[j]
+template <typename T>
+void accumulateRowScalar(uint32_t *acc, const T *src, size_t j, size_t n)
+{
+    for (; j < n; ++j)
+        acc[j] += src[j];
+}
+
+// acc[j] += src[j] / factor, where (x * mul) >> 16 == x / factor for all 8 bit x with mul = ceil(65536 / factor)
+void accumulateDividedScalar(uint32_t *acc, const uint8_t *src, uint16_t mul, size_t j, size_t n)
+{
+    for (; j < n; ++j)
+        acc[j] += (src[j] * uint32_t(mul)) >> 16;
+}
+
+#ifdef BIN_AVX2
+__attribute__((target("avx2")))
+size_t accumulateRowAVX2(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j)));
+        __m256i *a = reinterpret_cast<__m256i *>(acc + j);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), v));
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+size_t accumulateRowAVX2(uint32_t *acc, const uint8_t *src, size_t n)
+{
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + j)));
+        __m256i *a = reinterpret_cast<__m256i *>(acc + j);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), v));
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+size_t accumulateDividedAVX2(uint32_t *acc, const uint8_t *src, uint16_t mul, size_t n)
+{
+    const __m256i m = _mm256_set1_epi16(mul);
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m256i q = _mm256_mulhi_epu16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j))), m);
+        __m256i *a = reinterpret_cast<__m256i *>(acc + j);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(q))));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(q, 1))));
+    }
+    return j;
+}
+
+bool hasAVX2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+#ifdef BIN_SSE2
+size_t accumulateRowSSE2(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + j);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+    }
+    return j;
+}
+
+void accumulateWordsSSE2(__m128i *a, __m128i v)
+{
+    const __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+    _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+}
+
+size_t accumulateRowSSE2(uint32_t *acc, const uint8_t *src, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + j);
+        accumulateWordsSSE2(a, _mm_unpacklo_epi8(v, zero));
+        accumulateWordsSSE2(a + 2, _mm_unpackhi_epi8(v, zero));
+    }
+    return j;
+}
+
+size_t accumulateDividedSSE2(uint32_t *acc, const uint8_t *src, uint16_t mul, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i m = _mm_set1_epi16(mul);
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j));
+        __m128i *a = reinterpret_cast<__m128i *>(acc + j);
+        accumulateWordsSSE2(a, _mm_mulhi_epu16(_mm_unpacklo_epi8(v, zero), m));
+        accumulateWordsSSE2(a + 2, _mm_mulhi_epu16(_mm_unpackhi_epi8(v, zero), m));
+    }
+    return j;
+}
+#endif
+
+#ifdef BIN_NEON
+size_t accumulateRowNEON(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        uint16x8_t v = vld1q_u16(src + j);
+        vst1q_u32(acc + j, vaddw_u16(vld1q_u32(acc + j), vget_low_u16(v)));
+        vst1q_u32(acc + j + 4, vaddw_u16(vld1q_u32(acc + j + 4), vget_high_u16(v)));
+    }
+    return j;
+}
+
+size_t accumulateRowNEON(uint32_t *acc, const uint8_t *src, size_t n)
+{
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        uint16x8_t v = vmovl_u8(vld1_u8(src + j));
+        vst1q_u32(acc + j, vaddw_u16(vld1q_u32(acc + j), vget_low_u16(v)));
+        vst1q_u32(acc + j + 4, vaddw_u16(vld1q_u32(acc + j + 4), vget_high_u16(v)));
+    }
+    return j;
+}
+
+size_t accumulateDividedNEON(uint32_t *acc, const uint8_t *src, uint16_t mul, size_t n)
+{
+    const uint16x4_t m = vdup_n_u16(mul);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        uint16x8_t v = vmovl_u8(vld1_u8(src + j));
+        uint32x4_t lo = vshrq_n_u32(vmull_u16(vget_low_u16(v), m), 16);
+        uint32x4_t hi = vshrq_n_u32(vmull_u16(vget_high_u16(v), m), 16);
+        vst1q_u32(acc + j, vaddq_u32(vld1q_u32(acc + j), lo));
+        vst1q_u32(acc + j + 4, vaddq_u32(vld1q_u32(acc + j + 4), hi));
+    }
+    return j;
+}
+#endif
+
+template <typename T>
+void accumulateRow(uint32_t *acc, const T *src, size_t n)
+{
+    size_t j = 0;
+#if defined(BIN_AVX2)
+    if (hasAVX2())
+        j = accumulateRowAVX2(acc, src, n);
+    else
+        j = accumulateRowSSE2(acc, src, n);
+#elif defined(BIN_SSE2)
+    j = accumulateRowSSE2(acc, src, n);
+#elif defined(BIN_NEON)
+    j = accumulateRowNEON(acc, src, n);
+#endif
+    accumulateRowScalar(acc, src, j, n);
+}
+
+void accumulateDivided(uint32_t *acc, const uint8_t *src, uint16_t mul, size_t n)
+{
+    size_t j = 0;
+#if defined(BIN_AVX2)
+    if (hasAVX2())
+        j = accumulateDividedAVX2(acc, src, mul, n);
+    else
+        j = accumulateDividedSSE2(acc, src, mul, n);
+#elif defined(BIN_SSE2)
+    j = accumulateDividedSSE2(acc, src, mul, n);
+#elif defined(BIN_NEON)
+    j = accumulateDividedNEON(acc, src, mul, n);
+#endif
+    accumulateDividedScalar(acc, src, mul, j, n);
+}
+
+// Sum 'bins' groups of 'binX' accumulator columns. Bayer bins take every other column,
+// 'step' is 1 for mono and 2 for Bayer frames. Constant bin sizes let the compiler unroll.
+template <int BINX, typename T, typename Store>
+void sumColumns(const uint32_t *acc, T *dst, size_t bins, int binX, int step, Store store)
+{
+    const int n = BINX ? BINX : binX;
+    for (size_t c = 0; c < bins; ++c)
+    {
+        // first column of the bin in the accumulator row
+        size_t first = step == 1 ? c * n : (c / 2) * 2 * n + (c & 1);
+        uint32_t sum = 0;
+        for (int l = 0; l < n; ++l)
+            sum += acc[first + l * step];
+        dst[c] = store(sum);
+    }
+}
+
+template <typename T, typename Store>
+void sumColumns(const uint32_t *acc, T *dst, size_t bins, int binX, int step, Store store)
+{
+    switch (binX)
+    {
+        case 2:
+            sumColumns<2>(acc, dst, bins, binX, step, store);
+            break;
+        case 3:
+            sumColumns<3>(acc, dst, bins, binX, step, store);
+            break;
+        case 4:
+            sumColumns<4>(acc, dst, bins, binX, step, store);
+            break;
+        default:
+            sumColumns<0>(acc, dst, bins, binX, step, store);
+            break;
+    }
+}
+
+// Run rowFunction(first, last, acc) over [0, rows) on all cores for large frames
+template <typename RowFunction>
+void forEachRows(size_t rows, size_t pixels, size_t width, RowFunction rowFunction)
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (pixels < 1024 * 1024)
+        threads = 1;
+    threads = std::min(threads, rows);
+
+    auto run = [&](size_t index)
+    {
+        std::vector<uint32_t> acc(width);
+        rowFunction(rows * index / threads, rows * (index + 1) / threads, acc.data());
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(run, i);
+    if (threads > 0)
+        run(0);
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Mono binning of whole binX x binX bins, returns the binned size in bytes
+template <typename T, typename Store>
+size_t binMono(const T *src, T *dst, size_t width, size_t height, int binX, Store store)
+{
+    size_t binW = width / binX, binH = height / binX;
+
+    forEachRows(binH, width * height, width, [&](size_t first, size_t last, uint32_t *acc)
+    {
+        for (size_t r = first; r < last; ++r)
+        {
+            std::fill(acc, acc + width, 0);
+            for (int k = 0; k < binX; ++k)
+                accumulateRow(acc, src + (r * binX + k) * width, width);
+            sumColumns(acc, dst + r * binW, binW, binX, 1, store);
+        }
+    });
+
+    return binW * binH * sizeof(T);
+}
+
+// Bayer binning of whole 2*binX x 2*binY cells, returns the binned size in bytes.
+// Binned row 2b + p sums the source rows 2*binY*b + p + 2m of the same color.
+template <typename T, typename Accumulate, typename Store>
+size_t binBayer(const T *src, T *dst, size_t width, size_t height, int binX, int binY, Accumulate accumulate, Store store)
+{
+    size_t binW = width / binX, binH = height / binY;
+
+    forEachRows(binH, width * height, width, [&](size_t first, size_t last, uint32_t *acc)
+    {
+        for (size_t r = first; r < last; ++r)
+        {
+            size_t sourceRow = (r / 2) * 2 * binY + (r & 1);
+            std::fill(acc, acc + width, 0);
+            for (int m = 0; m < binY; ++m)
+                accumulate(acc, src + (sourceRow + 2 * m) * width, width);
+            sumColumns(acc, dst + r * binW, binW, binX, 2, store);
+        }
+    });
+
+    return binW * binH * sizeof(T);
+}
+}
 
 namespace INDI
 {
@@ -297,8 +612,48 @@ void CCDChip::binFrame()
             BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
     }
 
-    memset(BinFrame, 0, RawFrameSize);
+    // Whole bins are binned row parallel with vectorized kernels, partial bins at the right or
+    // bottom edge keep the per pixel loops below.
+    if (SubW % BinX == 0 && SubH % BinX == 0 && (getBPP() == 8 || getBPP() == 16))
+    {
+        size_t binnedSize;
+        if (getBPP() == 8)
+        {
+            // Try to average pixels since in 8bit they get saturated pretty quickly
+            uint32_t factor = (BinX * BinX) / 2;
+            binnedSize = binMono(RawFrame, BinFrame, SubW, SubH, BinX, [factor](uint32_t sum)
+            {
+                return static_cast<uint8_t>(std::min<uint32_t>(sum / factor, UINT8_MAX));
+            });
+        }
+        else
+        {
+            binnedSize = binMono(reinterpret_cast<uint16_t *>(RawFrame), reinterpret_cast<uint16_t *>(BinFrame), SubW, SubH, BinX,
+                                 [](uint32_t sum)
+            {
+                return static_cast<uint16_t>(std::min<uint32_t>(sum, UINT16_MAX));
+            });
+        }
+
+        if (binnedSize < RawFrameSize)
+            memset(BinFrame + binnedSize, 0, RawFrameSize - binnedSize);
+    }
+    else
+    {
+        memset(BinFrame, 0, RawFrameSize);
+        if (binFramePerPixel() == false)
+            return;
+    }
+
+    // Swap frame pointers
+    uint8_t *rawFramePointer = RawFrame;
+    RawFrame                 = BinFrame;
+    // We just memset it next time we use it
+    BinFrame = rawFramePointer;
+}
 
+bool CCDChip::binFramePerPixel()
+{
     switch (getBPP())
     {
         case 8:
@@ -356,14 +711,10 @@ void CCDChip::binFrame()
         break;
 
         default:
-            return;
+            return false;
     }
 
-    // Swap frame pointers
-    uint8_t *rawFramePointer = RawFrame;
-    RawFrame                 = BinFrame;
-    // We just memset it next time we use it
-    BinFrame = rawFramePointer;
+    return true;
 }
 
 
@@ -390,8 +741,58 @@ void CCDChip::binBayerFrame()
             BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
     }
 
-    memset(BinFrame, 0, RawFrameSize);
+    uint8_t BinFactor = BinX * BinY;
+
+    // Whole 2x2 Bayer cells of bins are binned row parallel with vectorized kernels, partial cells
+    // at the right or bottom edge keep the per pixel loops below.
+    if (SubW % (2 * BinX) == 0 && SubH % (2 * BinY) == 0 && BinFactor != 0 && (getBPP() == 8 || getBPP() == 16))
+    {
+        size_t binnedSize;
+        if (getBPP() == 8)
+        {
+            // each pixel is averaged before it is added
+            uint16_t mul = (65536 + BinFactor - 1) / BinFactor;
+            binnedSize = binBayer(RawFrame, BinFrame, SubW, SubH, BinX, BinY, [mul](uint32_t *acc, const uint8_t *src, size_t n)
+            {
+                accumulateDivided(acc, src, mul, n);
+            },
+            [](uint32_t sum)
+            {
+                return static_cast<uint8_t>(std::min<uint32_t>(sum, UINT8_MAX));
+            });
+        }
+        else
+        {
+            binnedSize = binBayer(reinterpret_cast<uint16_t *>(RawFrame), reinterpret_cast<uint16_t *>(BinFrame), SubW, SubH, BinX, BinY,
+                                  [](uint32_t *acc, const uint16_t *src, size_t n)
+            {
+                accumulateRow(acc, src, n);
+            },
+            [](uint32_t sum)
+            {
+                return static_cast<uint16_t>(std::min<uint32_t>(sum, UINT16_MAX));
+            });
+        }
 
+        if (binnedSize < RawFrameSize)
+            memset(BinFrame + binnedSize, 0, RawFrameSize - binnedSize);
+    }
+    else
+    {
+        memset(BinFrame, 0, RawFrameSize);
+        if (binBayerFramePerPixel() == false)
+            return;
+    }
+
+    // Swap frame pointers
+    uint8_t *rawFramePointer = RawFrame;
+    RawFrame                 = BinFrame;
+    // We just memset it next time we use it
+    BinFrame = rawFramePointer;
+}
+
+bool CCDChip::binBayerFramePerPixel()
+{
     switch (getBPP())
     {
         // 8 bpp frame
@@ -461,14 +862,10 @@ void CCDChip::binBayerFrame()
         break;
 
         default:
-            return;
+            return false;
     }
 
-    // Swap frame pointers
-    uint8_t *rawFramePointer = RawFrame;
-    RawFrame                 = BinFrame;
-    // We just memset it next time we use it
-    BinFrame = rawFramePointer;
+    return true;
 }
 
 }
@@ -429,6 +429,10 @@ class CCDChip
         }
 
     private:
+        // Per pixel binning of frames with partial bins into the cleared BinFrame, false if the depth is not supported
+        bool binFramePerPixel();
+        bool binBayerFramePerPixel();
+
         /////////////////////////////////////////////////////////////////////////////////////////
         /// Chip Variables
         /////////////////////////////////////////////////////////////////////////////////////////
@@ -538,6 +542,8 @@ class CCDChip
 
         friend class CCD;
         friend class StreamRecoder;
+        // Compares the binning kernels with the per pixel loops
+        friend class CCDChipBinningTest;
 
 #if 0
         ISwitch RapidGuideS[2];
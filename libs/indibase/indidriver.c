@@ -45,6 +45,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include "userio.h"
 #include "indiuserio.h"
 #include "indidriverio.h"
+#include "indiconfigcache.h"
 
 int verbose;      /* chatty */
 char *me = "";  /* a.out name */
@@ -64,9 +65,12 @@ INDI_UNKNOWN
 
 extern void waitPingReply(const char *);
 
-// TODO use fast map
-/* insure RO properties are never modified. RO Sanity Check */
-typedef struct {
+/* Registry of the defined properties, hashed by device and property name. Used to find the property asked
+ * by getProperties and to insure RO properties are never modified. RO Sanity Check */
+typedef struct ROSC
+{
+    struct ROSC *next; /* in the same bucket */
+    unsigned int hash;
     char propName[MAXINDINAME];
     char devName[MAXINDIDEVICE];
     IPerm perm;
@@ -74,45 +78,141 @@ typedef struct {
     int type;
 } ROSC;
 
-static pthread_mutex_t rosc_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* New messages are dispatched while other threads define properties */
+static pthread_rwlock_t rosc_lock = PTHREAD_RWLOCK_INITIALIZER;
 
-static ROSC *propCache = NULL;
-static int nPropCache = 0; /* # of elements in roCheck */
+static ROSC **propCache = NULL;
+static unsigned int nPropBuckets = 0; /* power of 2 */
+static unsigned int nPropCache = 0;   /* # of elements in propCache */
 
-static ROSC *rosc_new()
+/* FNV-1a of device and property name */
+static unsigned int rosc_hash(const char *propName, const char *devName)
 {
-    assert_mem(propCache = (ROSC *)(realloc(propCache, (nPropCache + 1) * sizeof *propCache)));
-    return &propCache[nPropCache++];
+    unsigned int hash = 2166136261u;
+
+    for (const char *c = devName; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    hash *= 16777619u;
+    for (const char *c = propName; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+    return hash;
+}
+
+/* Double the number of buckets, to keep about one element per bucket */
+static void rosc_grow()
+{
+    unsigned int nBuckets = nPropBuckets ? nPropBuckets * 2 : 64;
+    ROSC **buckets;
+
+    assert_mem(buckets = (ROSC **)calloc(nBuckets, sizeof *buckets));
+
+    for (unsigned int i = 0; i < nPropBuckets; i++)
+    {
+        ROSC *SC = propCache[i];
+        while (SC)
+        {
+            ROSC *next = SC->next;
+            SC->next = buckets[SC->hash & (nBuckets - 1)];
+            buckets[SC->hash & (nBuckets - 1)] = SC;
+            SC = next;
+        }
+    }
+
+    free(propCache);
+    propCache    = buckets;
+    nPropBuckets = nBuckets;
 }
 
-static void rosc_add(const char *propName, const char *devName, IPerm perm, const void *ptr, int type)
+static void rosc_add(const char *propName, const char *devName, IPerm perm, const void *ptr, int type, unsigned int hash)
 {
-    ROSC *SC = rosc_new();
-    strcpy(SC->propName, propName);
-    strcpy(SC->devName, devName);
+    ROSC *SC;
+
+    if (nPropCache >= nPropBuckets)
+        rosc_grow();
+
+    assert_mem(SC = (ROSC *)calloc(1, sizeof *SC));
+    strncpy(SC->propName, propName, MAXINDINAME - 1);
+    strncpy(SC->devName, devName, MAXINDIDEVICE - 1);
+    SC->hash = hash;
     SC->perm = perm;
     SC->ptr  = ptr;
     SC->type = type;
+
+    SC->next = propCache[hash & (nPropBuckets - 1)];
+    propCache[hash & (nPropBuckets - 1)] = SC;
+    nPropCache++;
 }
 
-/* Return pointer of property if already cached, NULL otherwise */
-static ROSC *rosc_find(const char *propName, const char *devName)
+/* Return pointer of property if already cached, NULL otherwise. Call with rosc_lock held */
+static ROSC *rosc_find_hashed(const char *propName, const char *devName, unsigned int hash)
 {
-    for (int i = 0; i < nPropCache; i++)
-        if (!strcmp(propName, propCache[i].propName) && !strcmp(devName, propCache[i].devName))
-            return &propCache[i];
+    if (nPropBuckets == 0)
+        return NULL;
+
+    for (ROSC *SC = propCache[hash & (nPropBuckets - 1)]; SC; SC = SC->next)
+        if (SC->hash == hash && !strcmp(propName, SC->propName) && !strcmp(devName, SC->devName))
+            return SC;
 
     return NULL;
 }
 
+/* Copy the cached property to *prop and return 0, or return -1 if not cached */
+static int rosc_find(const char *propName, const char *devName, ROSC *prop)
+{
+    unsigned int hash = rosc_hash(propName, devName);
+
+    pthread_rwlock_rdlock(&rosc_lock);
+    ROSC *SC = rosc_find_hashed(propName, devName, hash);
+    if (SC)
+        *prop = *SC;
+    pthread_rwlock_unlock(&rosc_lock);
+
+    return SC ? 0 : -1;
+}
+
 static void rosc_add_unique(const char *propName, const char *devName, IPerm perm, const void *ptr, int type)
 {
-    pthread_mutex_lock(&rosc_mutex);
+    unsigned int hash = rosc_hash(propName, devName);
 
-    if (rosc_find(propName, devName) == NULL)
-        rosc_add(propName, devName, perm, ptr, type);
+    pthread_rwlock_wrlock(&rosc_lock);
 
-    pthread_mutex_unlock(&rosc_mutex);
+    if (rosc_find_hashed(propName, devName, hash) == NULL)
+        rosc_add(propName, devName, perm, ptr, type, hash);
+
+    pthread_rwlock_unlock(&rosc_lock);
+}
+
+/* Forget property propName of devName, or all properties of devName if propName is NULL or empty */
+static void rosc_remove(const char *propName, const char *devName)
+{
+    int wholeDevice   = !propName || !propName[0];
+    unsigned int hash = wholeDevice ? 0 : rosc_hash(propName, devName);
+
+    pthread_rwlock_wrlock(&rosc_lock);
+
+    for (unsigned int i = 0; i < nPropBuckets; i++)
+    {
+        /* a single property can only be in its own bucket */
+        if (!wholeDevice && i != (hash & (nPropBuckets - 1)))
+            continue;
+
+        ROSC **link = &propCache[i];
+        while (*link)
+        {
+            ROSC *SC = *link;
+            if (!strcmp(devName, SC->devName) && (wholeDevice || !strcmp(propName, SC->propName)))
+            {
+                *link = SC->next;
+                free(SC);
+                nPropCache--;
+            }
+            else
+                link = &SC->next;
+        }
+    }
+
+    pthread_rwlock_unlock(&rosc_lock);
 }
 
 /* tell Client to delete the property with given name on given device, or
@@ -127,6 +227,10 @@ void IDDeleteVA(const char *dev, const char *name, const char *fmt, va_list ap)
     IUUserIODeleteVA(&io.userio, io.user, dev, name, fmt, ap);
 
     driverio_finish(&io);
+
+    /* clients can no longer change the deleted properties */
+    if (dev)
+        rosc_remove(name, dev);
 }
 
 void IDDelete(const char *dev, const char *name, const char *fmt, ...)
@@ -213,35 +317,31 @@ int dispatch(XMLEle *root, char msg[])
 
         if (name && dev)
         {
-            pthread_mutex_lock(&rosc_mutex);
-            ROSC *prop = rosc_find(valuXMLAtt(name), valuXMLAtt(dev));
-            // This is unsafe... prop may be modified concurrently here
-            pthread_mutex_unlock(&rosc_mutex);
-
-            if (prop == NULL)
+            ROSC prop;
+            if (rosc_find(valuXMLAtt(name), valuXMLAtt(dev), &prop) < 0)
                 return 0;
 
-            switch (prop->type)
+            switch (prop.type)
             {
                 /* JM 2019-07-18: Why are we using setXXX here? should be defXXX */
                 case INDI_NUMBER:
-                    //IDSetNumber((INumberVectorProperty *)(prop->ptr), NULL);
-                    IDDefNumber((INumberVectorProperty *)(prop->ptr), NULL);
+                    //IDSetNumber((INumberVectorProperty *)(prop.ptr), NULL);
+                    IDDefNumber((INumberVectorProperty *)(prop.ptr), NULL);
                     return 0;
 
                 case INDI_SWITCH:
-                    //IDSetSwitch((ISwitchVectorProperty *)(prop->ptr), NULL);
-                    IDDefSwitch((ISwitchVectorProperty *)(prop->ptr), NULL);
+                    //IDSetSwitch((ISwitchVectorProperty *)(prop.ptr), NULL);
+                    IDDefSwitch((ISwitchVectorProperty *)(prop.ptr), NULL);
                     return 0;
 
                 case INDI_TEXT:
-                    //IDSetText((ITextVectorProperty *)(prop->ptr), NULL);
-                    IDDefText((ITextVectorProperty *)(prop->ptr), NULL);
+                    //IDSetText((ITextVectorProperty *)(prop.ptr), NULL);
+                    IDDefText((ITextVectorProperty *)(prop.ptr), NULL);
                     return 0;
 
                 case INDI_BLOB:
-                    //IDSetBLOB((IBLOBVectorProperty *)(prop->ptr), NULL);
-                    IDDefBLOB((IBLOBVectorProperty *)(prop->ptr), NULL);
+                    //IDSetBLOB((IBLOBVectorProperty *)(prop.ptr), NULL);
+                    IDDefBLOB((IBLOBVectorProperty *)(prop.ptr), NULL);
                     return 0;
                 default:
                     return 0;
@@ -270,28 +370,18 @@ int dispatch(XMLEle *root, char msg[])
     if (crackDN(root, &dev, &name, msg) < 0)
         return (-1);
 
-    pthread_mutex_lock(&rosc_mutex);
-    if (rosc_find(name, dev) == NULL)
+    ROSC prop;
+    if (rosc_find(name, dev, &prop) < 0)
     {
-        pthread_mutex_unlock(&rosc_mutex);
         snprintf(msg, MAXRBUF, "Property %s is not defined in %s.", name, dev);
         return -1;
     }
-    pthread_mutex_unlock(&rosc_mutex);
 
     /* ensure property is not RO */
-    for (int i = 0; i < nPropCache; i++)
+    if (prop.perm == IP_RO)
     {
-        if (!strcmp(propCache[i].propName, name) && !strcmp(propCache[i].devName, dev))
-        {
-            if (propCache[i].perm == IP_RO)
-            {
-                snprintf(msg, MAXRBUF, "Cannot set read-only property %s", name);
-                return -1;
-            }
-            else
-                break;
-        }
+        snprintf(msg, MAXRBUF, "Cannot set read-only property %s", name);
+        return -1;
     }
 
     /* check tag in surmised decreasing order of likelihood */
@@ -486,34 +576,39 @@ int IUReadConfig(const char *filename, const char *dev, const char *property, in
 {
     char *rname, *rdev;
     XMLEle *root = NULL, *fproot = NULL;
-    LilXML *lp = newLilXML();
 
-    FILE *fp = IUGetConfigFP(filename, dev, "r", errmsg);
+    ConfigCacheFile *file = configCacheAcquire(filename, dev, errmsg);
 
-    if (fp == NULL)
+    if (file == NULL)
         return -1;
 
-    char whynot[MAXRBUF];
-    fproot = readXMLFile(fp, lp, whynot);
-
-    delLilXML(lp);
-
-    if (fproot == NULL)
+    // Handlers may read or save the configuration again, dispatch a copy
+    int nelements = nXMLEle(configCacheRoot(file));
+    if (property)
     {
-        snprintf(errmsg, MAXRBUF, "Unable to parse config XML: %s", whynot);
-        fclose(fp);
-        return -1;
+        root = configCacheFind(file, dev, property);
+        if (root)
+            root = cloneXMLEle(root, NULL, NULL);
     }
+    else
+        fproot = cloneXMLEle(configCacheRoot(file), NULL, NULL);
+
+    configCacheRelease(file);
 
-    if (nXMLEle(fproot) > 0 && silent != 1)
+    if (nelements > 0 && silent != 1)
         IDMessage(dev, "[INFO] Loading device configuration...");
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    if (root)
+    {
+        dispatch(root, errmsg);
+        delXMLEle(root);
+    }
+
+    for (root = fproot ? nextXMLEle(fproot, 1) : NULL; root != NULL; root = nextXMLEle(fproot, 0))
     {
         /* pull out device and name */
         if (crackDN(root, &rdev, &rname, errmsg) < 0)
         {
-            fclose(fp);
             delXMLEle(fproot);
             return -1;
         }
@@ -522,18 +617,12 @@ int IUReadConfig(const char *filename, const char *dev, const char *property, in
         if (strcmp(dev, rdev))
             continue;
 
-        if ((property && !strcmp(property, rname)) || property == NULL)
-        {
-            dispatch(root, errmsg);
-            if (property)
-                break;
-        }
+        dispatch(root, errmsg);
     }
 
-    if (nXMLEle(fproot) > 0 && silent != 1)
+    if (nelements > 0 && silent != 1)
         IDMessage(dev, "[INFO] Device configuration applied.");
 
-    fclose(fp);
     delXMLEle(fproot);
 
     return (0);
@@ -591,379 +680,192 @@ int IUSaveDefaultConfig(const char *source_config, const char *dest_config, cons
 
 int IUGetConfigOnSwitch(const ISwitchVectorProperty *property, int *index)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int propertyFound = 0;
     *index = -1;
 
-    FILE *fp = IUGetConfigFP(NULL, property->device, "r", errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, property->device, errmsg);
 
-    if (fp == NULL)
-    {
-        delLilXML(lp);
+    if (file == NULL)
         return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
 
-    if (fproot == NULL)
+    root = configCacheFind(file, property->device, property->name);
+    if (root)
     {
-        delLilXML(lp);
-        fclose(fp);
-        return -1;
-    }
-
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
-    {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
+        propertyFound = 1;
+        XMLEle *oneSwitch = NULL;
+        int oneSwitchIndex = 0;
+        ISState oneSwitchState;
+        for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0), oneSwitchIndex++)
         {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(property->device, rdev))
-            continue;
-
-        if (!strcmp(property->name, rname))
-        {
-            propertyFound = 1;
-            XMLEle *oneSwitch = NULL;
-            int oneSwitchIndex = 0;
-            ISState oneSwitchState;
-            for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0), oneSwitchIndex++)
+            if (crackISState(pcdataXMLEle(oneSwitch), &oneSwitchState) == 0 && oneSwitchState == ISS_ON)
             {
-                if (crackISState(pcdataXMLEle(oneSwitch), &oneSwitchState) == 0 && oneSwitchState == ISS_ON)
-                {
-                    *index = oneSwitchIndex;
-                    break;
-                }
+                *index = oneSwitchIndex;
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return (propertyFound ? 0 : -1);
 }
 
 int IUGetConfigSwitch(const char *dev, const char *property, const char *member, ISState *value)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int valueFound = 0;
 
-    FILE *fp = IUGetConfigFP(NULL, dev, "r", errmsg);
-
-    if (fp == NULL)
-    {
-        delLilXML(lp);
-        return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, dev, errmsg);
 
-    if (fproot == NULL)
-    {
-        fclose(fp);
-        delLilXML(lp);
+    if (file == NULL)
         return -1;
-    }
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    root = configCacheFind(file, dev, property);
+    if (root)
     {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
+        XMLEle *oneSwitch = NULL;
+        for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0))
         {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(dev, rdev))
-            continue;
-
-        if ((property && !strcmp(property, rname)) || property == NULL)
-        {
-            XMLEle *oneSwitch = NULL;
-            for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0))
+            if (!strcmp(member, findXMLAttValu(oneSwitch, "name")))
             {
-                if (!strcmp(member, findXMLAttValu(oneSwitch, "name")))
-                {
-                    if (crackISState(pcdataXMLEle(oneSwitch), value) == 0)
-                        valueFound = 1;
-                    break;
-                }
+                if (crackISState(pcdataXMLEle(oneSwitch), value) == 0)
+                    valueFound = 1;
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return (valueFound == 1 ? 0 : -1);
 }
 
 int IUGetConfigOnSwitchIndex(const char *dev, const char *property, int *index)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int valueFound = 0;
 
-    FILE *fp = IUGetConfigFP(NULL, dev, "r", errmsg);
-
-    if (fp == NULL)
-    {
-        delLilXML(lp);
-        return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, dev, errmsg);
 
-    if (fproot == NULL)
-    {
-        delLilXML(lp);
-        fclose(fp);
+    if (file == NULL)
         return -1;
-    }
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    root = configCacheFind(file, dev, property);
+    if (root)
     {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
-        {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(dev, rdev))
-            continue;
-
-        if ((property && !strcmp(property, rname)) || property == NULL)
+        XMLEle *oneSwitch = NULL;
+        int currentIndex = 0;
+        for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0), currentIndex++)
         {
-            XMLEle *oneSwitch = NULL;
-            int currentIndex = 0;
-            for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0), currentIndex++)
+            ISState s = ISS_OFF;
+            if (crackISState(pcdataXMLEle(oneSwitch), &s) == 0 && s == ISS_ON)
             {
-                ISState s = ISS_OFF;
-                if (crackISState(pcdataXMLEle(oneSwitch), &s) == 0 && s == ISS_ON)
-                {
-                    *index = currentIndex;
-                    valueFound = 1;
-                    break;
-                }
+                *index = currentIndex;
+                valueFound = 1;
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return (valueFound == 1 ? 0 : -1);
 }
 
 int IUGetConfigOnSwitchName(const char *dev, const char *property, char *name, size_t size)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int found = -1;
 
-    FILE *fp = IUGetConfigFP(NULL, dev, "r", errmsg);
-
-    if (fp == NULL)
-    {
-        delLilXML(lp);
-        return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, dev, errmsg);
 
-    if (fproot == NULL)
-    {
-        delLilXML(lp);
-        fclose(fp);
+    if (file == NULL)
         return -1;
-    }
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    root = configCacheFind(file, dev, property);
+    if (root)
     {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
+        XMLEle *oneSwitch = NULL;
+        for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0))
         {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(dev, rdev))
-            continue;
-
-        if ((property && !strcmp(property, rname)) || property == NULL)
-        {
-            XMLEle *oneSwitch = NULL;
-            int currentIndex = 0;
-            for (oneSwitch = nextXMLEle(root, 1); oneSwitch != NULL; oneSwitch = nextXMLEle(root, 0), currentIndex++)
+            ISState s = ISS_OFF;
+            if (crackISState(pcdataXMLEle(oneSwitch), &s) == 0 && s == ISS_ON)
             {
-                ISState s = ISS_OFF;
-                if (crackISState(pcdataXMLEle(oneSwitch), &s) == 0 && s == ISS_ON)
-                {
-                    found = 0;
-                    strncpy(name, findXMLAttValu(oneSwitch, "name"), size);
-                    break;
-                }
+                found = 0;
+                strncpy(name, findXMLAttValu(oneSwitch, "name"), size);
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return found;
 }
 
 int IUGetConfigNumber(const char *dev, const char *property, const char *member, double *value)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int valueFound = 0;
 
-    FILE *fp = IUGetConfigFP(NULL, dev, "r", errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, dev, errmsg);
 
-    if (fp == NULL)
-    {
-        delLilXML(lp);
+    if (file == NULL)
         return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
-
-    if (fproot == NULL)
-    {
-        fclose(fp);
-        delLilXML(lp);
-        return -1;
-    }
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    root = configCacheFind(file, dev, property);
+    if (root)
     {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
+        XMLEle *oneNumber = NULL;
+        for (oneNumber = nextXMLEle(root, 1); oneNumber != NULL; oneNumber = nextXMLEle(root, 0))
         {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(dev, rdev))
-            continue;
-
-        if ((property && !strcmp(property, rname)) || property == NULL)
-        {
-            XMLEle *oneNumber = NULL;
-            for (oneNumber = nextXMLEle(root, 1); oneNumber != NULL; oneNumber = nextXMLEle(root, 0))
+            if (!strcmp(member, findXMLAttValu(oneNumber, "name")))
             {
-                if (!strcmp(member, findXMLAttValu(oneNumber, "name")))
-                {
-                    *value = atof(pcdataXMLEle(oneNumber));
-                    valueFound = 1;
-                    break;
-                }
+                *value = atof(pcdataXMLEle(oneNumber));
+                valueFound = 1;
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return (valueFound == 1 ? 0 : -1);
 }
 
 int IUGetConfigText(const char *dev, const char *property, const char *member, char *value, int len)
 {
-    char *rname, *rdev;
-    XMLEle *root = NULL, *fproot = NULL;
+    XMLEle *root = NULL;
     char errmsg[MAXRBUF];
-    LilXML *lp = newLilXML();
     int valueFound = 0;
 
-    FILE *fp = IUGetConfigFP(NULL, dev, "r", errmsg);
-
-    if (fp == NULL)
-    {
-        delLilXML(lp);
-        return -1;
-    }
-
-    fproot = readXMLFile(fp, lp, errmsg);
+    ConfigCacheFile *file = configCacheAcquire(NULL, dev, errmsg);
 
-    if (fproot == NULL)
-    {
-        delLilXML(lp);
-        fclose(fp);
+    if (file == NULL)
         return -1;
-    }
 
-    for (root = nextXMLEle(fproot, 1); root != NULL; root = nextXMLEle(fproot, 0))
+    root = configCacheFind(file, dev, property);
+    if (root)
     {
-        /* pull out device and name */
-        if (crackDN(root, &rdev, &rname, errmsg) < 0)
+        XMLEle *oneText = NULL;
+        for (oneText = nextXMLEle(root, 1); oneText != NULL; oneText = nextXMLEle(root, 0))
         {
-            fclose(fp);
-            delXMLEle(fproot);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(dev, rdev))
-            continue;
-
-        if ((property && !strcmp(property, rname)) || property == NULL)
-        {
-            XMLEle *oneText = NULL;
-            for (oneText = nextXMLEle(root, 1); oneText != NULL; oneText = nextXMLEle(root, 0))
+            if (!strcmp(member, findXMLAttValu(oneText, "name")))
             {
-                if (!strcmp(member, findXMLAttValu(oneText, "name")))
-                {
-                    strncpy(value, pcdataXMLEle(oneText), len);
-                    valueFound = 1;
-                    break;
-                }
+                strncpy(value, pcdataXMLEle(oneText), len);
+                valueFound = 1;
+                break;
             }
-            break;
         }
     }
 
-    fclose(fp);
-    delXMLEle(fproot);
-    delLilXML(lp);
+    configCacheRelease(file);
 
     return (valueFound == 1 ? 0 : -1);
 }
@@ -1006,6 +908,8 @@ int IUPurgeConfig(const char *filename, const char *dev, char errmsg[])
             snprintf(configFileName, MAXRBUF, "%s%s_config.xml", configDir, dev);
     }
 
+    configCacheInvalidate(configFileName);
+
     if (remove(configFileName) != 0)
     {
         snprintf(errmsg, MAXRBUF, "Unable to purge configuration file %s. Error %s", configFileName, strerror(errno));
@@ -1053,6 +957,10 @@ FILE *IUGetConfigFP(const char *filename, const char *dev, const char *mode, cha
         return NULL;
     }
 
+    // Readers parse the file again once it is written
+    if (strcmp(mode, "r"))
+        configCacheInvalidate(configFileName);
+
     fp = fopen(configFileName, mode);
     if (fp == NULL)
     {
@@ -1071,6 +979,14 @@ void IUSaveConfigTag(FILE *fp, int ctag, const char *dev, int silent)
 
     IUUserIOConfigTag(userio_file(), fp, ctag);
 
+    /* The file pointer does not tell which file is saved, flush it and drop all cached files
+       so a reader running meanwhile does not keep the partial file */
+    if (ctag != 0)
+    {
+        fflush(fp);
+        configCacheInvalidate(NULL);
+    }
+
     if (silent != 1)
     {
         /* Opening tag */
@@ -0,0 +1,141 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "indifileindex.h"
+#include "indiutility.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace INDI
+{
+
+static bool modificationTime(const std::string &dir, struct timespec &mtime)
+{
+    struct stat st;
+    if (stat(dir.c_str(), &st) == -1)
+        return false;
+
+#ifdef __APPLE__
+    mtime = st.st_mtimespec;
+#else
+    mtime = st.st_mtim;
+#endif
+    return true;
+}
+
+std::string FileIndex::pattern(const std::string &prefix)
+{
+    std::string result = prefix;
+    replace_all(result, "_ISO8601", "");
+    replace_all(result, "_XXX", "");
+    return result;
+}
+
+int FileIndex::fileIndex(const std::string &fileName)
+{
+    std::size_t start = fileName.find_last_of("_");
+    if (start == std::string::npos)
+        return -1;
+
+    return atoi(fileName.c_str() + start + 1);
+}
+
+int FileIndex::next(const std::string &dir, const std::string &prefix)
+{
+    std::string filePattern = pattern(prefix);
+
+    struct timespec mtime;
+    if (modificationTime(dir, mtime) == false)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    auto key = std::make_pair(dir, filePattern);
+    auto it  = m_Entries.find(key);
+    if (it != m_Entries.end() && it->second.mtime.tv_sec == mtime.tv_sec && it->second.mtime.tv_nsec == mtime.tv_nsec)
+        return it->second.maxIndex + 1;
+
+    DIR *dpdf = opendir(dir.c_str());
+    if (dpdf == nullptr)
+        return -1;
+
+    // Files added while listing change the mtime again, so they are picked up by the next call at the latest
+    Entry entry;
+    entry.mtime = mtime;
+
+    struct dirent *epdf = nullptr;
+    while ((epdf = readdir(dpdf)))
+    {
+        if (strstr(epdf->d_name, filePattern.c_str()))
+        {
+            int index = fileIndex(epdf->d_name);
+            if (index > entry.maxIndex)
+                entry.maxIndex = index;
+        }
+    }
+    closedir(dpdf);
+
+    m_Entries[key] = entry;
+    return entry.maxIndex + 1;
+}
+
+void FileIndex::saved(const std::string &dir, const std::string &prefix, const std::string &fileName)
+{
+    std::string filePattern = pattern(prefix);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    auto it = m_Entries.find(std::make_pair(dir, filePattern));
+    if (it == m_Entries.end())
+        return;
+
+    Entry &entry = it->second;
+
+    if (fileName.find(filePattern) != std::string::npos)
+    {
+        int index = fileIndex(fileName);
+        if (index > entry.maxIndex)
+            entry.maxIndex = index;
+    }
+
+    // Saving the file changed the directory, there is nothing new to find there.
+    // Other prefixes sharing this directory still rescan once.
+    if (modificationTime(dir, entry.mtime) == false)
+        m_Entries.erase(it);
+}
+
+void FileIndex::invalidate(const std::string &dir, const std::string &prefix)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Entries.erase(std::make_pair(dir, pattern(prefix)));
+}
+
+std::string FileIndex::expand(const std::string &prefix, const std::string &timestamp, int index)
+{
+    char indexString[16];
+    snprintf(indexString, sizeof(indexString), "%03d", index);
+
+    std::string result = prefix;
+    replace_all(result, "ISO8601", timestamp);
+    replace_all(result, "XXX", indexString);
+    return result;
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <ctime>
+
+namespace INDI
+{
+
+/**
+ * @brief The FileIndex class allocates the index of the next file saved in an upload directory.
+ *
+ * Files are named after an upload prefix like IMAGE_XXX or IMAGE_ISO8601_XXX, the index is the
+ * number after the last underscore. The highest index in use is cached per directory and prefix,
+ * the directory is only listed again when its modification time changes, and files saved through
+ * saved() update the cache without a rescan.
+ *
+ * A file created by another writer between the listing and saved() is not seen until the directory
+ * changes again, so indexed files must be created exclusively. When the file already exists, call
+ * invalidate() and ask for the next index again.
+ */
+class FileIndex
+{
+    public:
+        /** Number of times a caller asks for a new index when the file it tried to create already exists. */
+        static const int MAX_RETRIES = 8;
+
+        /**
+         * @brief Return the next free index for files named after prefix in dir.
+         * @param dir upload directory, it must exist.
+         * @param prefix upload prefix, ISO8601 and XXX placeholders are ignored.
+         * @return the highest index in use plus one or -1 if the directory can't be read, errno is set.
+         */
+        int next(const std::string &dir, const std::string &prefix);
+
+        /**
+         * @brief Record a file that was just saved to dir, so the next call to next() does not need to rescan.
+         * @param dir upload directory.
+         * @param prefix upload prefix used to allocate the index.
+         * @param fileName name of the saved file, without the directory.
+         */
+        void saved(const std::string &dir, const std::string &prefix, const std::string &fileName);
+
+        /**
+         * @brief Drop the cached index of prefix in dir, the next call to next() lists the directory again.
+         * @param dir upload directory.
+         * @param prefix upload prefix.
+         */
+        void invalidate(const std::string &dir, const std::string &prefix);
+
+        /**
+         * @brief Replace the ISO8601 and XXX placeholders of an upload prefix.
+         * @param prefix upload prefix.
+         * @param timestamp replacement of ISO8601.
+         * @param index replacement of XXX, printed with at least 3 digits.
+         * @return the file name without extension.
+         */
+        static std::string expand(const std::string &prefix, const std::string &timestamp, int index);
+
+    private:
+        struct Entry
+        {
+            struct timespec mtime {0, 0};
+            int maxIndex {0};
+        };
+
+        static std::string pattern(const std::string &prefix);
+        static int fileIndex(const std::string &fileName);
+
+        std::map<std::pair<std::string, std::string>, Entry> m_Entries;
+        std::mutex m_Lock;
+};
+
+}
@@ -0,0 +1,270 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "indiframestatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace INDI
+{
+
+namespace
+{
+
+// Pixels counted into 32 bit bins before they are flushed to the 64 bit histogram
+constexpr size_t BLOCK_PIXELS = size_t(1) << 30;
+
+struct Partial
+{
+    std::vector<uint64_t> histogram;
+    uint32_t min {std::numeric_limits<uint32_t>::max()};
+    uint32_t max {0};
+    double sum {0};
+    double sumsq {0};
+};
+
+// 8 bit pixels go to 4 interleaved histograms, so consecutive equal values do not wait on the same counter
+void histogram8(const uint8_t *data, size_t count, Partial &partial)
+{
+    std::vector<uint32_t> bins(4 * 256);
+
+    for (size_t start = 0; start < count; start += BLOCK_PIXELS)
+    {
+        size_t end = std::min(count, start + BLOCK_PIXELS);
+        std::fill(bins.begin(), bins.end(), 0);
+
+        size_t i = start;
+        for (; i + 4 <= end; i += 4)
+        {
+            ++bins[data[i]];
+            ++bins[256 + data[i + 1]];
+            ++bins[512 + data[i + 2]];
+            ++bins[768 + data[i + 3]];
+        }
+        for (; i < end; ++i)
+            ++bins[data[i]];
+
+        for (size_t v = 0; v < 256; ++v)
+            partial.histogram[v] += uint64_t(bins[v]) + bins[256 + v] + bins[512 + v] + bins[768 + v];
+    }
+}
+
+void histogram16(const uint16_t *data, size_t count, Partial &partial)
+{
+    std::vector<uint32_t> bins(65536);
+
+    for (size_t start = 0; start < count; start += BLOCK_PIXELS)
+    {
+        size_t end = std::min(count, start + BLOCK_PIXELS);
+        std::fill(bins.begin(), bins.end(), 0);
+
+        size_t i = start;
+        for (; i + 2 <= end; i += 2)
+        {
+            ++bins[data[i]];
+            ++bins[data[i + 1]];
+        }
+        for (; i < end; ++i)
+            ++bins[data[i]];
+
+        for (size_t v = 0; v < bins.size(); ++v)
+            partial.histogram[v] += bins[v];
+    }
+}
+
+// 32 bit pixels are binned on their upper 16 bits, the moments are accumulated per block of rows
+void histogram32(const uint32_t *data, size_t count, Partial &partial)
+{
+    constexpr size_t ROW = 4096;
+    std::vector<uint32_t> bins(65536);
+
+    for (size_t start = 0; start < count; start += BLOCK_PIXELS)
+    {
+        size_t end = std::min(count, start + BLOCK_PIXELS);
+        std::fill(bins.begin(), bins.end(), 0);
+
+        for (size_t row = start; row < end; row += ROW)
+        {
+            size_t rowEnd = std::min(end, row + ROW);
+            uint32_t lmin = partial.min, lmax = partial.max;
+            uint64_t sum = 0;
+            double sumsq = 0;
+
+            // Branchless min/max and the integer sum vectorize, keep the scatter and doubles out of that loop
+            for (size_t i = row; i < rowEnd; ++i)
+            {
+                uint32_t v = data[i];
+                lmin = v < lmin ? v : lmin;
+                lmax = v > lmax ? v : lmax;
+                sum += v;
+            }
+            for (size_t i = row; i < rowEnd; ++i)
+            {
+                sumsq += double(data[i]) * data[i];
+                ++bins[data[i] >> 16];
+            }
+
+            partial.min = lmin;
+            partial.max = lmax;
+            partial.sum += sum;
+            partial.sumsq += sumsq;
+        }
+
+        for (size_t v = 0; v < bins.size(); ++v)
+            partial.histogram[v] += bins[v];
+    }
+}
+
+}
+
+void FrameStatistics::reset()
+{
+    min = max = mean = stddev = median = 0;
+    count = 0;
+    histogram.clear();
+    histogramShift = 0;
+}
+
+bool FrameStatistics::compute(const void *buffer, size_t pixels, int bpp)
+{
+    reset();
+
+    if (buffer == nullptr || pixels == 0 || (bpp != 8 && bpp != 16 && bpp != 32))
+        return false;
+
+    size_t bins = bpp == 8 ? 256 : 65536;
+    histogramShift = bpp == 32 ? 16 : 0;
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (pixels < 1024 * 1024)
+        threads = 1;
+
+    std::vector<Partial> partials(threads);
+    auto run = [&](size_t index)
+    {
+        Partial &partial = partials[index];
+        partial.histogram.assign(bins, 0);
+
+        size_t first = pixels * index / threads;
+        size_t last  = pixels * (index + 1) / threads;
+
+        switch (bpp)
+        {
+            case 8:
+                histogram8(static_cast<const uint8_t *>(buffer) + first, last - first, partial);
+                break;
+            case 16:
+                histogram16(static_cast<const uint16_t *>(buffer) + first, last - first, partial);
+                break;
+            default:
+                histogram32(static_cast<const uint32_t *>(buffer) + first, last - first, partial);
+                break;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(run, i);
+    run(0);
+    for (auto &worker : workers)
+        worker.join();
+
+    count = pixels;
+    histogram = std::move(partials[0].histogram);
+    for (size_t i = 1; i < threads; ++i)
+        for (size_t v = 0; v < bins; ++v)
+            histogram[v] += partials[i].histogram[v];
+
+    if (bpp != 32)
+    {
+        fromHistogram();
+        return true;
+    }
+
+    uint32_t lmin = std::numeric_limits<uint32_t>::max(), lmax = 0;
+    double sum = 0, sumsq = 0;
+    for (const auto &partial : partials)
+    {
+        lmin = std::min(lmin, partial.min);
+        lmax = std::max(lmax, partial.max);
+        sum += partial.sum;
+        sumsq += partial.sumsq;
+    }
+
+    min    = lmin;
+    max    = lmax;
+    mean   = sum / count;
+    stddev = std::sqrt(std::max(0.0, sumsq / count - mean * mean));
+
+    // Middle of the bins holding the two middle values, clamped to the actual range
+    uint64_t lower = (count + 1) / 2, upper = count / 2 + 1, seen = 0;
+    double lowerValue = -1;
+    for (size_t v = 0; v < bins; ++v)
+    {
+        seen += histogram[v];
+        if (lowerValue < 0 && seen >= lower)
+            lowerValue = (v + 0.5) * 65536;
+        if (seen >= upper)
+        {
+            median = std::min(max, std::max(min, (lowerValue + (v + 0.5) * 65536) / 2));
+            break;
+        }
+    }
+
+    return true;
+}
+
+void FrameStatistics::fromHistogram()
+{
+    size_t first = 0, last = histogram.size() - 1;
+    while (histogram[first] == 0)
+        ++first;
+    while (histogram[last] == 0)
+        --last;
+
+    min = first;
+    max = last;
+
+    double sum = 0;
+    for (size_t v = first; v <= last; ++v)
+        sum += double(v) * histogram[v];
+    mean = sum / count;
+
+    double variance = 0;
+    for (size_t v = first; v <= last; ++v)
+        variance += (v - mean) * (v - mean) * histogram[v];
+    stddev = std::sqrt(variance / count);
+
+    // Average of the two middle values for an even count
+    uint64_t lower = (count + 1) / 2, upper = count / 2 + 1, seen = 0;
+    double lowerValue = -1;
+    for (size_t v = first; v <= last; ++v)
+    {
+        seen += histogram[v];
+        if (lowerValue < 0 && seen >= lower)
+            lowerValue = v;
+        if (seen >= upper)
+        {
+            median = (lowerValue + v) / 2;
+            break;
+        }
+    }
+}
+
+}
@@ -0,0 +1,63 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief The FrameStatistics class computes the statistics of an unsigned 8, 16 or 32 bit frame in one pass.
+ *
+ * The frame is split between threads, each thread fills its own histogram and the histograms are merged.
+ * For 8 and 16 bit frames the histogram has one bin per value, so minimum, maximum, mean, standard deviation
+ * and median are exact and derived from the histogram alone. 32 bit frames are binned on their upper 16 bits,
+ * minimum, maximum, mean and standard deviation are accumulated directly and the median is an estimate
+ * within one bin.
+ */
+class FrameStatistics
+{
+    public:
+        /**
+         * @brief Compute the statistics of a frame.
+         * @param buffer first pixel of the frame.
+         * @param pixels number of pixels.
+         * @param bpp bits per pixel, 8, 16 or 32.
+         * @return false if bpp is not supported or the frame is empty, the statistics are reset.
+         */
+        bool compute(const void *buffer, size_t pixels, int bpp);
+
+        double min {0};
+        double max {0};
+        double mean {0};
+        double stddev {0};
+        double median {0};
+        size_t count {0};
+
+        /** Histogram of the last frame, bin i counts the pixels with value >> histogramShift equal to i. */
+        std::vector<uint64_t> histogram;
+        int histogramShift {0};
+
+    private:
+        void reset();
+        void fromHistogram();
+};
+
+}
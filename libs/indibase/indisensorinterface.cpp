@@ -27,6 +27,7 @@
 #include "stream/streammanager.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "indiframestatistics.h"
 
 #include <fitsio.h>
 
@@ -34,9 +35,6 @@
 #include <libnova/ln_types.h>
 #include <libnova/precession.h>
 
-#include <regex>
-
-#include <dirent.h>
 #include <cerrno>
 #include <locale.h>
 #include <cstdlib>
@@ -954,38 +952,44 @@ bool SensorInterface::uploadFile(const void *fitsData, size_t totalBytes, bool s
         FILE *fp = nullptr;
         char integrationFileName[MAXRBUF];
 
-        std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
-        int maxIndex       = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
-                                          FitsB.format);
+        std::string prefix;
+        // Indexed names must not overwrite a file another writer created since the directory was listed
+        bool indexed = strstr(UploadSettingsT[UPLOAD_PREFIX].text, "XXX") != nullptr;
 
-        if (maxIndex < 0)
+        for (int attempt = 0; ; attempt++)
         {
-            DEBUGF(Logger::DBG_ERROR, "Error iterating directory %s. %s", UploadSettingsT[0].text,
-                   strerror(errno));
-            return false;
-        }
+            prefix       = UploadSettingsT[UPLOAD_PREFIX].text;
+            int maxIndex = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
+                                        FitsB.format);
 
-        if (maxIndex > 0)
-        {
-            char ts[32];
-            struct tm *tp;
-            time_t t;
-            time(&t);
-            tp = localtime(&t);
-            strftime(ts, sizeof(ts), "%Y-%m-%dT%H-%M-%S", tp);
-            std::string filets(ts);
-            prefix = std::regex_replace(prefix, std::regex("ISO8601"), filets);
-
-            char indexString[8];
-            snprintf(indexString, 8, "%03d", maxIndex);
-            std::string prefixIndex = indexString;
-            //prefix.replace(prefix.find("XXX"), std::string::npos, prefixIndex);
-            prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
-        }
+            if (maxIndex < 0)
+            {
+                DEBUGF(Logger::DBG_ERROR, "Error iterating directory %s. %s", UploadSettingsT[0].text,
+                       strerror(errno));
+                return false;
+            }
 
-        snprintf(integrationFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), FitsB.format);
+            if (maxIndex > 0)
+            {
+                char ts[32];
+                struct tm *tp;
+                time_t t;
+                time(&t);
+                tp = localtime(&t);
+                strftime(ts, sizeof(ts), "%Y-%m-%dT%H-%M-%S", tp);
+                std::string filets(ts);
+                prefix = FileIndex::expand(prefix, filets, maxIndex);
+            }
+
+            snprintf(integrationFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), FitsB.format);
+
+            fp = fopen(integrationFileName, indexed ? "wx" : "w");
+            if (fp != nullptr || errno != EEXIST || attempt >= FileIndex::MAX_RETRIES)
+                break;
+
+            m_FileIndex.invalidate(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text);
+        }
 
-        fp = fopen(integrationFileName, "w");
         if (fp == nullptr)
         {
             DEBUGF(Logger::DBG_ERROR, "Unable to save image file (%s). %s", integrationFileName, strerror(errno));
@@ -998,6 +1002,8 @@ bool SensorInterface::uploadFile(const void *fitsData, size_t totalBytes, bool s
 
         fclose(fp);
 
+        m_FileIndex.saved(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text, prefix + FitsB.format);
+
         // Save image file path
         IUSaveText(&FileNameT[0], integrationFileName);
 
@@ -1061,53 +1067,15 @@ void SensorInterface::getMinMax(double *min, double *max, uint8_t *buf, int len,
     switch (bpp)
     {
         case 8:
-        {
-            uint8_t *integrationBuffer = static_cast<uint8_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
-        }
-        break;
-
         case 16:
-        {
-            uint16_t *integrationBuffer = reinterpret_cast<uint16_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
-        }
-        break;
-
         case 32:
         {
-            uint32_t *integrationBuffer = reinterpret_cast<uint32_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
+            FrameStatistics statistics;
+            if (len > 0 && statistics.compute(buf, len, bpp))
+            {
+                lmin = statistics.min;
+                lmax = statistics.max;
+            }
         }
         break;
 
@@ -1166,25 +1134,10 @@ void SensorInterface::getMinMax(double *min, double *max, uint8_t *buf, int len,
     *max = lmax;
 }
 
-std::string regex_replace_compat2(const std::string &input, const std::string &pattern, const std::string &replace)
-{
-    std::stringstream s;
-    std::regex_replace(std::ostreambuf_iterator<char>(s), input.begin(), input.end(), std::regex(pattern), replace);
-    return s.str();
-}
-
 int SensorInterface::getFileIndex(const char *dir, const char *prefix, const char *ext)
 {
     INDI_UNUSED(ext);
 
-    DIR *dpdf = nullptr;
-    struct dirent *epdf = nullptr;
-    std::vector<std::string> files = std::vector<std::string>();
-
-    std::string prefixIndex = prefix;
-    prefixIndex             = regex_replace_compat2(prefixIndex, "_ISO8601", "");
-    prefixIndex             = regex_replace_compat2(prefixIndex, "_XXX", "");
-
     // Create directory if does not exist
     struct stat st;
 
@@ -1195,37 +1148,7 @@ int SensorInterface::getFileIndex(const char *dir, const char *prefix, const cha
             LOGF_ERROR("Error creating directory %s (%s)", dir, strerror(errno));
     }
 
-    dpdf = opendir(dir);
-    if (dpdf != nullptr)
-    {
-        while ((epdf = readdir(dpdf)))
-        {
-            if (strstr(epdf->d_name, prefixIndex.c_str()))
-                files.push_back(epdf->d_name);
-        }
-        closedir(dpdf);
-    }
-    else
-        return -1;
-
-    int maxIndex = 0;
-
-    for (int i = 0; i < static_cast<int>(files.size()); i++)
-    {
-        int index = -1;
-
-        std::string file  = files.at(i);
-        std::size_t start = file.find_last_of("_");
-        std::size_t end   = file.find_last_of(".");
-        if (start != std::string::npos)
-        {
-            index = atoi(file.substr(start + 1, end).c_str());
-            if (index > maxIndex)
-                maxIndex = index;
-        }
-    }
-
-    return (maxIndex + 1);
+    return m_FileIndex.next(dir, prefix);
 }
 
 void SensorInterface::setBPS(int bps)
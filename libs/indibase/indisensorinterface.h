@@ -22,6 +22,7 @@
 #include "dsp.h"
 #include "dsp/manager.h"
 #include "stream/streammanager.h"
+#include "indifileindex.h"
 #include <fitsio.h>
 
 #ifdef HAVE_WEBSOCKET
@@ -556,6 +557,9 @@ class SensorInterface : public DefaultDevice
         void getMinMax(double *min, double *max, uint8_t *buf, int len, int bpp);
         int getFileIndex(const char *dir, const char *prefix, const char *ext);
 
+        // Highest file index in use per upload directory and prefix
+        FileIndex m_FileIndex;
+
         bool IntegrationCompletePrivate();
         void* sendFITS(uint8_t* buf, int len);
 };
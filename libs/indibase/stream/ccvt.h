@@ -189,6 +189,28 @@ void bayer_grbg_to_rgb24(unsigned char *dst, unsigned char *srcc, long int WIDTH
 // void convert_border_bayer_line_to_bgr24( uint8_t* bayer, uint8_t* adjacent_bayer, uint8_t *bgr, int width, uint8_t start_with_green, uint8_t blue_line);
 // void bayer_to_rgbbgr24(uint8_t *bayer, uint8_t *bgr, int width, int height, uint8_t start_with_green, uint8_t blue_line);
 
+/** Instruction sets of the vectorized conversions */
+enum
+{
+    CCVT_SIMD_NONE = 0, /*!< Scalar code only */
+    CCVT_SIMD_SSSE3,    /*!< x86 SSSE3 */
+    CCVT_SIMD_AVX2,     /*!< x86 AVX2 */
+    CCVT_SIMD_NEON      /*!< ARM NEON */
+};
+
+/**
+ * @short ccvt_get_simd Instruction set used by the YUYV, 4:2:0 planar and RGB to YUV conversions and the 8 bits
+ * Bayer interpolations. The best one supported by the processor is selected on first use.
+ */
+int ccvt_get_simd(void);
+
+/**
+ * @short ccvt_set_simd Select the instruction set of the conversions, for tests and benchmarks.
+ * @param level one of the CCVT_SIMD values, a level the processor does not support or -1 selects the best one.
+ * @return the instruction set selected.
+ */
+int ccvt_set_simd(int level);
+
 /*@}*/
 
 #ifdef __cplusplus
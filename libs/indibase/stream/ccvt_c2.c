@@ -21,6 +21,7 @@
 */
 
 #include "ccvt.h"
+#include "ccvt_simd.h"
 #include "ccvt_types.h"
 
 /* by suitable definition of PIXTYPE, can do yuv to rgb or bgr, with or
@@ -28,10 +29,13 @@ without word alignment */
 
 /* This doesn't exactly earn a prize in a programming beauty contest. */
 
-#define WHOLE_FUNC2RGB(type)                                        \
+/* bgr24 is 0 for RGB24, 1 for BGR24, and -1 for the formats without SIMD kernel */
+
+#define WHOLE_FUNC2RGB(type, bgr24)                                 \
+    const ccvt_simd_kernels *simd = ccvt_simd();                    \
     const unsigned char *y1, *y2, *u, *v;                           \
     PIXTYPE_##type *l1, *l2;                                        \
-    int r, g, b, cr, cg, cb, yp, j, i;                              \
+    int r, g, b, cr, cg, cb, yp, j, i, n;                           \
                                                                     \
     if ((width & 1) || (height & 1))                                \
         return;                                                     \
@@ -46,6 +50,19 @@ without word alignment */
     while (j--)                                                     \
     {                                                               \
         i = width / 2;                                              \
+        if (bgr24 >= 0)                                             \
+        {                                                           \
+            /* both lines share the chroma */                       \
+            n = simd->yuv420_rgb24(y1, u, v, (uint8_t *)l1, width, bgr24); \
+            simd->yuv420_rgb24(y2, u, v, (uint8_t *)l2, n, bgr24);  \
+            y1 += n;                                                \
+            y2 += n;                                                \
+            l1 += n;                                                \
+            l2 += n;                                                \
+            u += n / 2;                                             \
+            v += n / 2;                                             \
+            i -= n / 2;                                             \
+        }                                                           \
         while (i--)                                                 \
         {                                                           \
             /* Since U & V are valid for 4 pixels, repeat code 4 	\
@@ -113,20 +130,20 @@ without word alignment */
 
 void ccvt_420p_bgr32(int width, int height, const void *src, void *dst)
 {
-    WHOLE_FUNC2RGB(bgr32)
+    WHOLE_FUNC2RGB(bgr32, -1)
 }
 
 void ccvt_420p_bgr24(int width, int height, const void *src, void *dst)
 {
-    WHOLE_FUNC2RGB(bgr24)
+    WHOLE_FUNC2RGB(bgr24, 1)
 }
 
 void ccvt_420p_rgb32(int width, int height, const void *src, void *dst)
 {
-    WHOLE_FUNC2RGB(rgb32)
+    WHOLE_FUNC2RGB(rgb32, -1)
 }
 
 void ccvt_420p_rgb24(int width, int height, const void *src, void *dst)
 {
-    WHOLE_FUNC2RGB(rgb24)
+    WHOLE_FUNC2RGB(rgb24, 0)
 }
@@ -58,6 +58,7 @@
  */
 
 #include "ccvt.h"
+#include "ccvt_simd.h"
 #include "ccvt_types.h"
 //#include "indidevapi.h"
 #include "jpegutils.h"
@@ -126,9 +127,10 @@ void ccvt_yuyv_bgr32(int width, int height, const void *src, void *dst)
 
 void ccvt_yuyv_bgr24(int width, int height, const void *src, void *dst)
 {
+    const ccvt_simd_kernels *simd = ccvt_simd();
     const unsigned char *s;
     PIXTYPE_bgr24 *d;
-    int l, c;
+    int l, c, n;
     int r, g, b, cr, cg, cb, y1, y2;
 
     l = height;
@@ -137,6 +139,10 @@ void ccvt_yuyv_bgr24(int width, int height, const void *src, void *dst)
     while (l--)
     {
         c = width >> 1;
+        n = simd->yuyv_rgb24(s, (uint8_t *)d, c * 2, 1);
+        s += n * 2;
+        d += n;
+        c -= n / 2;
         while (c--)
         {
             y1 = *s++;
@@ -172,9 +178,10 @@ void ccvt_yuyv_bgr24(int width, int height, const void *src, void *dst)
 
 void ccvt_yuyv_rgb24(int width, int height, const void *src, void *dst)
 {
+    const ccvt_simd_kernels *simd = ccvt_simd();
     const unsigned char *s;
     PIXTYPE_rgb24 *d;
-    int l, c;
+    int l, c, n;
     int r, g, b, cr, cg, cb, y1, y2;
 
     l = height;
@@ -183,6 +190,10 @@ void ccvt_yuyv_rgb24(int width, int height, const void *src, void *dst)
     while (l--)
     {
         c = width >> 1;
+        n = simd->yuyv_rgb24(s, (uint8_t *)d, c * 2, 0);
+        s += n * 2;
+        d += n;
+        c -= n / 2;
         while (c--)
         {
             y1 = *s++;
@@ -260,9 +271,27 @@ void ccvt_yuyv_420p(int width, int height, const void *src, void *dsty, void *ds
     }
 }
 
+/* Sources of R, G and B of the pixels of the Bayer patterns away from the borders, by row and column parity */
+static const uint8_t bayer_bggr[2][2][3] =
+{
+    { { BAYER_D, BAYER_X, BAYER_C }, { BAYER_V, BAYER_C, BAYER_H } },
+    { { BAYER_H, BAYER_C, BAYER_V }, { BAYER_C, BAYER_X, BAYER_D } }
+};
+static const uint8_t bayer_rggb[2][2][3] =
+{
+    { { BAYER_C, BAYER_X, BAYER_D }, { BAYER_H, BAYER_C, BAYER_V } },
+    { { BAYER_V, BAYER_C, BAYER_H }, { BAYER_D, BAYER_X, BAYER_C } }
+};
+static const uint8_t bayer_grbg[2][2][3] =
+{
+    { { BAYER_H, BAYER_C, BAYER_V }, { BAYER_C, BAYER_X, BAYER_D } },
+    { { BAYER_D, BAYER_X, BAYER_C }, { BAYER_V, BAYER_C, BAYER_H } }
+};
+
 void bayer2rgb24(unsigned char *dst, unsigned char *src, long int WIDTH, long int HEIGHT)
 {
-    long int i;
+    const ccvt_simd_kernels *simd = ccvt_simd();
+    long int i, n;
     unsigned char *rawpt, *scanpt;
     long int size;
 
@@ -272,6 +301,16 @@ void bayer2rgb24(unsigned char *dst, unsigned char *src, long int WIDTH, long in
 
     for (i = 0; i < size; i++)
     {
+        /* the inside of the rows between the first and the last line */
+        if ((i % WIDTH) == 1 && i > WIDTH && i < WIDTH * (HEIGHT - 1))
+        {
+            n = simd->bayer_rgb24(rawpt, WIDTH, scanpt, WIDTH - 2, bayer_bggr[(i / WIDTH) % 2][i % 2],
+                                  bayer_bggr[(i / WIDTH) % 2][(i + 1) % 2]);
+            i += n;
+            rawpt += n;
+            scanpt += 3 * n;
+        }
+
         if ((i / WIDTH) % 2 == 0)
         {
             if ((i % 2) == 0)
@@ -450,7 +489,8 @@ void bayer16_2_rgb24(unsigned short *dst, unsigned short *src, long int WIDTH, l
 
 void bayer_rggb_2rgb24(unsigned char *dst, unsigned char *src, long int WIDTH, long int HEIGHT)
 {
-    long int i;
+    const ccvt_simd_kernels *simd = ccvt_simd();
+    long int i, n;
     unsigned char *rawpt, *scanpt;
     long int size;
 
@@ -460,6 +500,16 @@ void bayer_rggb_2rgb24(unsigned char *dst, unsigned char *src, long int WIDTH, l
 
     for (i = 0; i < size; i++)
     {
+        /* the inside of the rows between the first and the last line */
+        if ((i % WIDTH) == 1 && i > WIDTH && i < WIDTH * (HEIGHT - 1))
+        {
+            n = simd->bayer_rgb24(rawpt, WIDTH, scanpt, WIDTH - 2, bayer_rggb[(i / WIDTH) % 2][i % 2],
+                                  bayer_rggb[(i / WIDTH) % 2][(i + 1) % 2]);
+            i += n;
+            rawpt += n;
+            scanpt += 3 * n;
+        }
+
         if ((i / WIDTH) % 2 == 0) //wenn zeile grade
         {
             if ((i % 2) == 0) //spalte gerade
@@ -560,8 +610,14 @@ void bayer_grbg_to_rgb24(unsigned char *dst, unsigned char *src, long int WIDTH,
 	int RED = 0;
 	int GREEN = 1;
 	int BLUE = 2;
+	const ccvt_simd_kernels *simd = ccvt_simd();
 	for (row = 0; row < HEIGHT; row++) {
 		for (col = 0; col < WIDTH; col++) {
+			//Inside of the rows between the first and the last one
+			if (col == 1 && row != 0 && row < HEIGHT - 1) {
+				col += simd->bayer_rgb24(src + row * width + col, width, dst + (row * width + col) * 3, WIDTH - 2,
+				                         bayer_grbg[row % 2][1], bayer_grbg[row % 2][0]);
+			}
 			//General case:
 			if(row % 2 == 0) { //GRGRGR Row
 				if(col % 2 == 0) {//Over Green
@@ -786,7 +842,8 @@ int RGB2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
 {
     static int init_done = 0;
 
-    long i, j, size;
+    const ccvt_simd_kernels *simd = ccvt_simd();
+    long i, j, n, size;
     unsigned char *r, *g, *b;
     unsigned char *y, *u, *v;
     unsigned char *pu1, *pu2, *pv1, *pv2, *psu, *psv;
@@ -833,7 +890,13 @@ int RGB2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
             u = u_buffer + (y_dim - j - 1) * x_dim;
             v = v_buffer + (y_dim - j - 1) * x_dim;
 
-            for (i = 0; i < x_dim; i++)
+            n = simd->rgb24_yuv444(b, y, u, v, x_dim, 0);
+            b += 3 * n;
+            y += n;
+            u += n;
+            v += n;
+
+            for (i = n; i < x_dim; i++)
             {
                 g  = b + 1;
                 r  = b + 2;
@@ -849,7 +912,13 @@ int RGB2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
     }
     else
     {
-        for (i = 0; i < size; i++)
+        n = simd->rgb24_yuv444(b, y, u, v, (int)size, 0);
+        b += 3 * n;
+        y += n;
+        u += n;
+        v += n;
+
+        for (i = n; i < size; i++)
         {
             g  = b + 1;
             r  = b + 2;
@@ -895,7 +964,8 @@ int BGR2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
 {
     static int init_done = 0;
 
-    long i, j, size;
+    const ccvt_simd_kernels *simd = ccvt_simd();
+    long i, j, n, size;
     unsigned char *r, *g, *b;
     unsigned char *y, *u, *v;
     unsigned char *pu1, *pu2, *pv1, *pv2, *psu, *psv;
@@ -942,7 +1012,13 @@ int BGR2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
             u = u_buffer + (y_dim - j - 1) * x_dim;
             v = v_buffer + (y_dim - j - 1) * x_dim;
 
-            for (i = 0; i < x_dim; i++)
+            n = simd->rgb24_yuv444(r, y, u, v, x_dim, 1);
+            r += 3 * n;
+            y += n;
+            u += n;
+            v += n;
+
+            for (i = n; i < x_dim; i++)
             {
                 g  = r + 1;
                 b  = r + 2;
@@ -958,7 +1034,13 @@ int BGR2YUV(int x_dim, int y_dim, void *bmp, void *y_out, void *u_out, void *v_o
     }
     else
     {
-        for (i = 0; i < size; i++)
+        n = simd->rgb24_yuv444(r, y, u, v, (int)size, 1);
+        r += 3 * n;
+        y += n;
+        u += n;
+        v += n;
+
+        for (i = n; i < size; i++)
         {
             g  = r + 1;
             b  = r + 2;
@@ -0,0 +1,778 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+ * SIMD kernels of the colour conversions, selected at runtime on x86 (SSSE3 or AVX2) and always used on 64-bit
+ * ARM (NEON).
+ *
+ * The kernels compute exactly what the scalar code computes: the YUV to RGB conversions use the same fixed point
+ * arithmetic in 16 or 32 bits integers, the Bayer interpolation the same truncated averages, and RGB to YUV the same
+ * single precision products and sums as the lookup tables of RGB2YUV.
+ */
+
+#include "ccvt.h"
+#include "ccvt_simd.h"
+
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CCVT_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define CCVT_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef CCVT_X86
+
+/* 16 pixels of 3 planes to 48 bytes of packed pixels */
+__attribute__((target("ssse3")))
+static void store_rgb24_ssse3(uint8_t *dst, __m128i c0, __m128i c1, __m128i c2)
+{
+    __m128i out0 = _mm_or_si128(
+                       _mm_or_si128(
+                           _mm_shuffle_epi8(c0, _mm_setr_epi8(0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128, 5)),
+                           _mm_shuffle_epi8(c1, _mm_setr_epi8(-128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128))),
+                       _mm_shuffle_epi8(c2, _mm_setr_epi8(-128, -128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128)));
+    __m128i out1 = _mm_or_si128(
+                       _mm_or_si128(
+                           _mm_shuffle_epi8(c0, _mm_setr_epi8(-128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10, -128)),
+                           _mm_shuffle_epi8(c1, _mm_setr_epi8(5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10))),
+                       _mm_shuffle_epi8(c2, _mm_setr_epi8(-128, 5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128)));
+    __m128i out2 = _mm_or_si128(
+                       _mm_or_si128(
+                           _mm_shuffle_epi8(c0, _mm_setr_epi8(-128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128, -128)),
+                           _mm_shuffle_epi8(c1, _mm_setr_epi8(-128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128))),
+                       _mm_shuffle_epi8(c2, _mm_setr_epi8(10, -128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15)));
+
+    _mm_storeu_si128((__m128i *)dst, out0);
+    _mm_storeu_si128((__m128i *)(dst + 16), out1);
+    _mm_storeu_si128((__m128i *)(dst + 32), out2);
+}
+
+/* 48 bytes of packed pixels to 16 pixels of 3 planes */
+__attribute__((target("ssse3")))
+static void load_rgb24_ssse3(const uint8_t *src, __m128i *c0, __m128i *c1, __m128i *c2)
+{
+    __m128i in0 = _mm_loadu_si128((const __m128i *)src);
+    __m128i in1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i in2 = _mm_loadu_si128((const __m128i *)(src + 32));
+
+    *c0 = _mm_or_si128(
+              _mm_or_si128(
+                  _mm_shuffle_epi8(in0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128)),
+                  _mm_shuffle_epi8(in1, _mm_setr_epi8(-128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14, -128, -128, -128, -128, -128))),
+              _mm_shuffle_epi8(in2, _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1, 4, 7, 10, 13)));
+    *c1 = _mm_or_si128(
+              _mm_or_si128(
+                  _mm_shuffle_epi8(in0, _mm_setr_epi8(1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128)),
+                  _mm_shuffle_epi8(in1, _mm_setr_epi8(-128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128))),
+              _mm_shuffle_epi8(in2, _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14)));
+    *c2 = _mm_or_si128(
+              _mm_or_si128(
+                  _mm_shuffle_epi8(in0, _mm_setr_epi8(2, 5, 8, 11, 14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128)),
+                  _mm_shuffle_epi8(in1, _mm_setr_epi8(-128, -128, -128, -128, -128, 1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128))),
+              _mm_shuffle_epi8(in2, _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15)));
+}
+
+/*
+ * 16 pixels of YUV to RGB. ylo and yhi hold the luma of pixels 0-7 and 8-15, uvlo and uvhi the chroma of the pixel
+ * pairs 0-3 and 4-7 as U,V pairs, all 16 bits. The chroma is offset by -128 here, madd computes the products in
+ * 32 bits like the scalar code.
+ */
+__attribute__((target("ssse3")))
+static void yuv_rgb_ssse3(__m128i ylo, __m128i yhi, __m128i uvlo, __m128i uvhi, __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i offset = _mm_set1_epi16(128);
+    const __m128i kb     = _mm_setr_epi16(454, 0, 454, 0, 454, 0, 454, 0);
+    const __m128i kr     = _mm_setr_epi16(0, 359, 0, 359, 0, 359, 0, 359);
+    const __m128i kg     = _mm_setr_epi16(88, 183, 88, 183, 88, 183, 88, 183);
+
+    uvlo = _mm_sub_epi16(uvlo, offset);
+    uvhi = _mm_sub_epi16(uvhi, offset);
+
+    /* one value per pair, then duplicated for both pixels of the pair */
+    __m128i cb = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(uvlo, kb), 8), _mm_srai_epi32(_mm_madd_epi16(uvhi, kb), 8));
+    __m128i cr = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(uvlo, kr), 8), _mm_srai_epi32(_mm_madd_epi16(uvhi, kr), 8));
+    __m128i cg = _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(uvlo, kg), 8), _mm_srai_epi32(_mm_madd_epi16(uvhi, kg), 8));
+
+    /* packus saturates like SAT */
+    *r = _mm_packus_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(cr, cr)), _mm_add_epi16(yhi, _mm_unpackhi_epi16(cr, cr)));
+    *g = _mm_packus_epi16(_mm_sub_epi16(ylo, _mm_unpacklo_epi16(cg, cg)), _mm_sub_epi16(yhi, _mm_unpackhi_epi16(cg, cg)));
+    *b = _mm_packus_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(cb, cb)), _mm_add_epi16(yhi, _mm_unpackhi_epi16(cb, cb)));
+}
+
+__attribute__((target("ssse3")))
+static int yuyv_rgb24_ssse3(const uint8_t *src, uint8_t *dst, int npixels, int bgr)
+{
+    const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, src += 32, dst += 48)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)src);
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i r, g, b;
+
+        yuv_rgb_ssse3(_mm_and_si128(lo, lowbytes), _mm_and_si128(hi, lowbytes),
+                      _mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8), &r, &g, &b);
+
+        if (bgr)
+            store_rgb24_ssse3(dst, b, g, r);
+        else
+            store_rgb24_ssse3(dst, r, g, b);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static int yuv420_rgb24_ssse3(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int npixels, int bgr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, dst += 48)
+    {
+        __m128i yy = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + i / 2)),
+                                       _mm_loadl_epi64((const __m128i *)(v + i / 2)));
+        __m128i r, g, b;
+
+        yuv_rgb_ssse3(_mm_unpacklo_epi8(yy, zero), _mm_unpackhi_epi8(yy, zero),
+                      _mm_unpacklo_epi8(uv, zero), _mm_unpackhi_epi8(uv, zero), &r, &g, &b);
+
+        if (bgr)
+            store_rgb24_ssse3(dst, b, g, r);
+        else
+            store_rgb24_ssse3(dst, r, g, b);
+    }
+    return i;
+}
+
+/* 4 pixels of RGB2YUV, in single precision like its lookup tables */
+__attribute__((target("ssse3")))
+static void rgb_yuv_ssse3(__m128i ri, __m128i gi, __m128i bi, __m128i *y, __m128i *u, __m128i *v)
+{
+    __m128 r = _mm_cvtepi32_ps(ri);
+    __m128 g = _mm_cvtepi32_ps(gi);
+    __m128 b = _mm_cvtepi32_ps(bi);
+    __m128 half_r = _mm_cvtepi32_ps(_mm_srli_epi32(ri, 1));
+    __m128 half_b = _mm_cvtepi32_ps(_mm_srli_epi32(bi, 1));
+    __m128 offset = _mm_set1_ps(128.0f);
+
+    *y = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2990f)), _mm_mul_ps(g, _mm_set1_ps(0.5870f))),
+                                     _mm_mul_ps(b, _mm_set1_ps(0.1140f))));
+    *u = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(r, _mm_set1_ps(0.1684f))),
+                                                           _mm_mul_ps(g, _mm_set1_ps(0.3316f))), half_b), offset));
+    *v = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(_mm_sub_ps(half_r, _mm_mul_ps(g, _mm_set1_ps(0.4187f))),
+                                                _mm_mul_ps(b, _mm_set1_ps(0.0813f))), offset));
+}
+
+__attribute__((target("ssse3")))
+static int rgb24_yuv444_ssse3(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int npixels, int redfirst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, src += 48)
+    {
+        __m128i c0, c1, c2, r8, g8, b8;
+        __m128i yq[4], uq[4], vq[4];
+        int q;
+
+        load_rgb24_ssse3(src, &c0, &c1, &c2);
+        r8 = redfirst ? c0 : c2;
+        g8 = c1;
+        b8 = redfirst ? c2 : c0;
+
+        for (q = 0; q < 4; q++)
+        {
+            /* pixels 4q to 4q+3 as 32 bits integers */
+            __m128i r16 = (q < 2) ? _mm_unpacklo_epi8(r8, zero) : _mm_unpackhi_epi8(r8, zero);
+            __m128i g16 = (q < 2) ? _mm_unpacklo_epi8(g8, zero) : _mm_unpackhi_epi8(g8, zero);
+            __m128i b16 = (q < 2) ? _mm_unpacklo_epi8(b8, zero) : _mm_unpackhi_epi8(b8, zero);
+            __m128i r32 = (q & 1) ? _mm_unpackhi_epi16(r16, zero) : _mm_unpacklo_epi16(r16, zero);
+            __m128i g32 = (q & 1) ? _mm_unpackhi_epi16(g16, zero) : _mm_unpacklo_epi16(g16, zero);
+            __m128i b32 = (q & 1) ? _mm_unpackhi_epi16(b16, zero) : _mm_unpacklo_epi16(b16, zero);
+
+            rgb_yuv_ssse3(r32, g32, b32, &yq[q], &uq[q], &vq[q]);
+        }
+
+        _mm_storeu_si128((__m128i *)(y + i), _mm_packus_epi16(_mm_packs_epi32(yq[0], yq[1]), _mm_packs_epi32(yq[2], yq[3])));
+        _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm_packs_epi32(uq[0], uq[1]), _mm_packs_epi32(uq[2], uq[3])));
+        _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_packs_epi32(vq[0], vq[1]), _mm_packs_epi32(vq[2], vq[3])));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static int bayer_rgb24_ssse3(const uint8_t *src, long stride, uint8_t *dst, int npixels,
+                             const uint8_t first[3], const uint8_t second[3])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i odd  = _mm_set1_epi16((short)0xff00);
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, dst += 48)
+    {
+        const uint8_t *p = src + i, *a = p - stride, *b = p + stride;
+        __m128i l  = _mm_loadu_si128((const __m128i *)(p - 1));
+        __m128i r  = _mm_loadu_si128((const __m128i *)(p + 1));
+        __m128i u  = _mm_loadu_si128((const __m128i *)a);
+        __m128i d  = _mm_loadu_si128((const __m128i *)b);
+        __m128i ul = _mm_loadu_si128((const __m128i *)(a - 1));
+        __m128i ur = _mm_loadu_si128((const __m128i *)(a + 1));
+        __m128i dl = _mm_loadu_si128((const __m128i *)(b - 1));
+        __m128i dr = _mm_loadu_si128((const __m128i *)(b + 1));
+        __m128i src16[5], ch[3];
+        int k;
+
+        /* sums in 16 bits for pixels 0-7 and 8-15 */
+        __m128i hlo = _mm_add_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(r, zero));
+        __m128i hhi = _mm_add_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(r, zero));
+        __m128i vlo = _mm_add_epi16(_mm_unpacklo_epi8(u, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i vhi = _mm_add_epi16(_mm_unpackhi_epi8(u, zero), _mm_unpackhi_epi8(d, zero));
+        __m128i dlo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(ul, zero), _mm_unpacklo_epi8(ur, zero)),
+                                    _mm_add_epi16(_mm_unpacklo_epi8(dl, zero), _mm_unpacklo_epi8(dr, zero)));
+        __m128i dhi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(ul, zero), _mm_unpackhi_epi8(ur, zero)),
+                                    _mm_add_epi16(_mm_unpackhi_epi8(dl, zero), _mm_unpackhi_epi8(dr, zero)));
+
+        src16[BAYER_C] = _mm_loadu_si128((const __m128i *)p);
+        src16[BAYER_H] = _mm_packus_epi16(_mm_srli_epi16(hlo, 1), _mm_srli_epi16(hhi, 1));
+        src16[BAYER_V] = _mm_packus_epi16(_mm_srli_epi16(vlo, 1), _mm_srli_epi16(vhi, 1));
+        src16[BAYER_X] = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(hlo, vlo), 2), _mm_srli_epi16(_mm_add_epi16(hhi, vhi), 2));
+        src16[BAYER_D] = _mm_packus_epi16(_mm_srli_epi16(dlo, 2), _mm_srli_epi16(dhi, 2));
+
+        for (k = 0; k < 3; k++)
+            ch[k] = _mm_or_si128(_mm_andnot_si128(odd, src16[first[k]]), _mm_and_si128(odd, src16[second[k]]));
+
+        store_rgb24_ssse3(dst, ch[0], ch[1], ch[2]);
+    }
+    return i;
+}
+
+/* 32 pixels of 3 planes, in pixel order, to 96 bytes of packed pixels */
+__attribute__((target("avx2")))
+static void store_rgb24_avx2(uint8_t *dst, __m256i c0, __m256i c1, __m256i c2)
+{
+#define LANES(...) _mm256_broadcastsi128_si256(_mm_setr_epi8(__VA_ARGS__))
+    /* each 128 bits lane packs its 16 pixels like store_rgb24_ssse3 */
+    __m256i out0 = _mm256_or_si256(
+                       _mm256_or_si256(
+                           _mm256_shuffle_epi8(c0, LANES(0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128, 5)),
+                           _mm256_shuffle_epi8(c1, LANES(-128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128))),
+                       _mm256_shuffle_epi8(c2, LANES(-128, -128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128)));
+    __m256i out1 = _mm256_or_si256(
+                       _mm256_or_si256(
+                           _mm256_shuffle_epi8(c0, LANES(-128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10, -128)),
+                           _mm256_shuffle_epi8(c1, LANES(5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10))),
+                       _mm256_shuffle_epi8(c2, LANES(-128, 5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128)));
+    __m256i out2 = _mm256_or_si256(
+                       _mm256_or_si256(
+                           _mm256_shuffle_epi8(c0, LANES(-128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128, -128)),
+                           _mm256_shuffle_epi8(c1, LANES(-128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128))),
+                       _mm256_shuffle_epi8(c2, LANES(10, -128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15)));
+#undef LANES
+
+    _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(out0, out1, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(out2, out0, 0x30));
+    _mm256_storeu_si256((__m256i *)(dst + 64), _mm256_permute2x128_si256(out1, out2, 0x31));
+}
+
+/* yuv_rgb_ssse3 on two sets of 16 pixels, one per 128 bits lane, results in pixel order */
+__attribute__((target("avx2")))
+static void yuv_rgb_avx2(__m256i ylo, __m256i yhi, __m256i uvlo, __m256i uvhi, __m256i *r, __m256i *g, __m256i *b)
+{
+    const __m256i offset = _mm256_set1_epi16(128);
+    const __m256i kb     = _mm256_set1_epi32(454);
+    const __m256i kr     = _mm256_set1_epi32(359 << 16);
+    const __m256i kg     = _mm256_set1_epi32(88 | (183 << 16));
+
+    uvlo = _mm256_sub_epi16(uvlo, offset);
+    uvhi = _mm256_sub_epi16(uvhi, offset);
+
+    __m256i cb = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(uvlo, kb), 8), _mm256_srai_epi32(_mm256_madd_epi16(uvhi, kb), 8));
+    __m256i cr = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(uvlo, kr), 8), _mm256_srai_epi32(_mm256_madd_epi16(uvhi, kr), 8));
+    __m256i cg = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_madd_epi16(uvlo, kg), 8), _mm256_srai_epi32(_mm256_madd_epi16(uvhi, kg), 8));
+
+    /* lanes hold pixels 0-7 and 16-23, then 8-15 and 24-31 */
+    *r = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_add_epi16(ylo, _mm256_unpacklo_epi16(cr, cr)),
+                                  _mm256_add_epi16(yhi, _mm256_unpackhi_epi16(cr, cr))), 0xd8);
+    *g = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_sub_epi16(ylo, _mm256_unpacklo_epi16(cg, cg)),
+                                  _mm256_sub_epi16(yhi, _mm256_unpackhi_epi16(cg, cg))), 0xd8);
+    *b = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_add_epi16(ylo, _mm256_unpacklo_epi16(cb, cb)),
+                                  _mm256_add_epi16(yhi, _mm256_unpackhi_epi16(cb, cb))), 0xd8);
+}
+
+__attribute__((target("avx2")))
+static int yuyv_rgb24_avx2(const uint8_t *src, uint8_t *dst, int npixels, int bgr)
+{
+    const __m256i lowbytes = _mm256_set1_epi16(0x00ff);
+    int i;
+
+    for (i = 0; i + 32 <= npixels; i += 32, src += 64, dst += 96)
+    {
+        /* lanes of lo hold pixels 0-7 and 8-15, lanes of hi 16-23 and 24-31 */
+        __m256i lo = _mm256_loadu_si256((const __m256i *)src);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i r, g, b;
+
+        yuv_rgb_avx2(_mm256_and_si256(lo, lowbytes), _mm256_and_si256(hi, lowbytes),
+                     _mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8), &r, &g, &b);
+
+        if (bgr)
+            store_rgb24_avx2(dst, b, g, r);
+        else
+            store_rgb24_avx2(dst, r, g, b);
+    }
+    return i + yuyv_rgb24_ssse3(src, dst, npixels - i, bgr);
+}
+
+__attribute__((target("avx2")))
+static int yuv420_rgb24_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int npixels, int bgr)
+{
+    int i;
+
+    for (i = 0; i + 32 <= npixels; i += 32, dst += 96)
+    {
+        __m128i y0 = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i y1 = _mm_loadu_si128((const __m128i *)(y + i + 16));
+        __m128i uu = _mm_loadu_si128((const __m128i *)(u + i / 2));
+        __m128i vv = _mm_loadu_si128((const __m128i *)(v + i / 2));
+        __m256i r, g, b;
+
+        /* same lanes as yuyv_rgb24_avx2 */
+        yuv_rgb_avx2(_mm256_cvtepu8_epi16(y0), _mm256_cvtepu8_epi16(y1),
+                     _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(uu, vv)), _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(uu, vv)),
+                     &r, &g, &b);
+
+        if (bgr)
+            store_rgb24_avx2(dst, b, g, r);
+        else
+            store_rgb24_avx2(dst, r, g, b);
+    }
+    return i + yuv420_rgb24_ssse3(y + i, u + i / 2, v + i / 2, dst, npixels - i, bgr);
+}
+
+/* rgb_yuv_ssse3 on 8 pixels */
+__attribute__((target("avx2")))
+static void rgb_yuv_avx2(__m256i ri, __m256i gi, __m256i bi, __m256i *y, __m256i *u, __m256i *v)
+{
+    __m256 r = _mm256_cvtepi32_ps(ri);
+    __m256 g = _mm256_cvtepi32_ps(gi);
+    __m256 b = _mm256_cvtepi32_ps(bi);
+    __m256 half_r = _mm256_cvtepi32_ps(_mm256_srli_epi32(ri, 1));
+    __m256 half_b = _mm256_cvtepi32_ps(_mm256_srli_epi32(bi, 1));
+    __m256 offset = _mm256_set1_ps(128.0f);
+
+    *y = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.2990f)),
+                                           _mm256_mul_ps(g, _mm256_set1_ps(0.5870f))),
+                                           _mm256_mul_ps(b, _mm256_set1_ps(0.1140f))));
+    *u = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(),
+                                           _mm256_mul_ps(r, _mm256_set1_ps(0.1684f))),
+                                           _mm256_mul_ps(g, _mm256_set1_ps(0.3316f))), half_b), offset));
+    *v = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(half_r, _mm256_mul_ps(g, _mm256_set1_ps(0.4187f))),
+                                           _mm256_mul_ps(b, _mm256_set1_ps(0.0813f))), offset));
+}
+
+/* 4 vectors of 8 32 bits values to 32 bytes, in order */
+__attribute__((target("avx2")))
+static __m256i pack_avx2(const __m256i q[4])
+{
+    __m256i p01 = _mm256_permute4x64_epi64(_mm256_packs_epi32(q[0], q[1]), 0xd8);
+    __m256i p23 = _mm256_permute4x64_epi64(_mm256_packs_epi32(q[2], q[3]), 0xd8);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(p01, p23), 0xd8);
+}
+
+__attribute__((target("avx2")))
+static int rgb24_yuv444_avx2(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int npixels, int redfirst)
+{
+    int i;
+
+    for (i = 0; i + 32 <= npixels; i += 32, src += 96)
+    {
+        __m128i c[2][3];
+        __m256i yq[4], uq[4], vq[4];
+        int q;
+
+        load_rgb24_ssse3(src, &c[0][0], &c[0][1], &c[0][2]);
+        load_rgb24_ssse3(src + 48, &c[1][0], &c[1][1], &c[1][2]);
+
+        for (q = 0; q < 4; q++)
+        {
+            /* pixels 8q to 8q+7 */
+            __m128i r8 = c[q / 2][redfirst ? 0 : 2];
+            __m128i g8 = c[q / 2][1];
+            __m128i b8 = c[q / 2][redfirst ? 2 : 0];
+
+            if (q & 1)
+            {
+                r8 = _mm_srli_si128(r8, 8);
+                g8 = _mm_srli_si128(g8, 8);
+                b8 = _mm_srli_si128(b8, 8);
+            }
+
+            rgb_yuv_avx2(_mm256_cvtepu8_epi32(r8), _mm256_cvtepu8_epi32(g8), _mm256_cvtepu8_epi32(b8),
+                         &yq[q], &uq[q], &vq[q]);
+        }
+
+        _mm256_storeu_si256((__m256i *)(y + i), pack_avx2(yq));
+        _mm256_storeu_si256((__m256i *)(u + i), pack_avx2(uq));
+        _mm256_storeu_si256((__m256i *)(v + i), pack_avx2(vq));
+    }
+    return i + rgb24_yuv444_ssse3(src, y + i, u + i, v + i, npixels - i, redfirst);
+}
+
+__attribute__((target("avx2")))
+static int bayer_rgb24_avx2(const uint8_t *src, long stride, uint8_t *dst, int npixels,
+                            const uint8_t first[3], const uint8_t second[3])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i odd  = _mm256_set1_epi16((short)0xff00);
+    int i;
+
+    /* unpack and pack work within 128 bits lanes, the pixels keep their order */
+    for (i = 0; i + 32 <= npixels; i += 32, dst += 96)
+    {
+        const uint8_t *p = src + i, *a = p - stride, *b = p + stride;
+        __m256i l  = _mm256_loadu_si256((const __m256i *)(p - 1));
+        __m256i r  = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i u  = _mm256_loadu_si256((const __m256i *)a);
+        __m256i d  = _mm256_loadu_si256((const __m256i *)b);
+        __m256i ul = _mm256_loadu_si256((const __m256i *)(a - 1));
+        __m256i ur = _mm256_loadu_si256((const __m256i *)(a + 1));
+        __m256i dl = _mm256_loadu_si256((const __m256i *)(b - 1));
+        __m256i dr = _mm256_loadu_si256((const __m256i *)(b + 1));
+        __m256i src32[5], ch[3];
+        int k;
+
+        __m256i hlo = _mm256_add_epi16(_mm256_unpacklo_epi8(l, zero), _mm256_unpacklo_epi8(r, zero));
+        __m256i hhi = _mm256_add_epi16(_mm256_unpackhi_epi8(l, zero), _mm256_unpackhi_epi8(r, zero));
+        __m256i vlo = _mm256_add_epi16(_mm256_unpacklo_epi8(u, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i vhi = _mm256_add_epi16(_mm256_unpackhi_epi8(u, zero), _mm256_unpackhi_epi8(d, zero));
+        __m256i dlo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(ul, zero), _mm256_unpacklo_epi8(ur, zero)),
+                                       _mm256_add_epi16(_mm256_unpacklo_epi8(dl, zero), _mm256_unpacklo_epi8(dr, zero)));
+        __m256i dhi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(ul, zero), _mm256_unpackhi_epi8(ur, zero)),
+                                       _mm256_add_epi16(_mm256_unpackhi_epi8(dl, zero), _mm256_unpackhi_epi8(dr, zero)));
+
+        src32[BAYER_C] = _mm256_loadu_si256((const __m256i *)p);
+        src32[BAYER_H] = _mm256_packus_epi16(_mm256_srli_epi16(hlo, 1), _mm256_srli_epi16(hhi, 1));
+        src32[BAYER_V] = _mm256_packus_epi16(_mm256_srli_epi16(vlo, 1), _mm256_srli_epi16(vhi, 1));
+        src32[BAYER_X] = _mm256_packus_epi16(_mm256_srli_epi16(_mm256_add_epi16(hlo, vlo), 2),
+                                             _mm256_srli_epi16(_mm256_add_epi16(hhi, vhi), 2));
+        src32[BAYER_D] = _mm256_packus_epi16(_mm256_srli_epi16(dlo, 2), _mm256_srli_epi16(dhi, 2));
+
+        for (k = 0; k < 3; k++)
+            ch[k] = _mm256_blendv_epi8(src32[first[k]], src32[second[k]], odd);
+
+        store_rgb24_avx2(dst, ch[0], ch[1], ch[2]);
+    }
+    return i + bayer_rgb24_ssse3(src + i, stride, dst, npixels - i, first, second);
+}
+
+static const ccvt_simd_kernels kernels_ssse3 =
+{
+    yuyv_rgb24_ssse3, yuv420_rgb24_ssse3, rgb24_yuv444_ssse3, bayer_rgb24_ssse3
+};
+
+static const ccvt_simd_kernels kernels_avx2 =
+{
+    yuyv_rgb24_avx2, yuv420_rgb24_avx2, rgb24_yuv444_avx2, bayer_rgb24_avx2
+};
+
+#endif /* CCVT_X86 */
+
+#ifdef CCVT_NEON
+
+/* 8 pixel pairs of YUV to RGB, y0 and y1 hold the first and second pixel of each pair */
+static void yuv_rgb_neon(uint8x8_t y0, uint8x8_t y1, uint8x8_t u8, uint8x8_t v8, uint8x16_t *r, uint8x16_t *g,
+                         uint8x16_t *b)
+{
+    const int16x8_t offset = vdupq_n_s16(128);
+    int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), offset);
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), offset);
+
+    /* products in 32 bits like the scalar code, shrn shifts arithmetically */
+    int16x8_t cb = vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(u), 454), 8),
+                                vshrn_n_s32(vmull_n_s16(vget_high_s16(u), 454), 8));
+    int16x8_t cr = vcombine_s16(vshrn_n_s32(vmull_n_s16(vget_low_s16(v), 359), 8),
+                                vshrn_n_s32(vmull_n_s16(vget_high_s16(v), 359), 8));
+    int16x8_t cg = vcombine_s16(vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_low_s16(u), 88), vget_low_s16(v), 183), 8),
+                                vshrn_n_s32(vmlal_n_s16(vmull_n_s16(vget_high_s16(u), 88), vget_high_s16(v), 183), 8));
+
+    int16x8_t ya = vreinterpretq_s16_u16(vmovl_u8(y0));
+    int16x8_t yb = vreinterpretq_s16_u16(vmovl_u8(y1));
+
+    /* qmovun saturates like SAT, zip puts the pixels of each pair back in order */
+    uint8x8x2_t rr = vzip_u8(vqmovun_s16(vaddq_s16(ya, cr)), vqmovun_s16(vaddq_s16(yb, cr)));
+    uint8x8x2_t gg = vzip_u8(vqmovun_s16(vsubq_s16(ya, cg)), vqmovun_s16(vsubq_s16(yb, cg)));
+    uint8x8x2_t bb = vzip_u8(vqmovun_s16(vaddq_s16(ya, cb)), vqmovun_s16(vaddq_s16(yb, cb)));
+
+    *r = vcombine_u8(rr.val[0], rr.val[1]);
+    *g = vcombine_u8(gg.val[0], gg.val[1]);
+    *b = vcombine_u8(bb.val[0], bb.val[1]);
+}
+
+static void store_rgb24_neon(uint8_t *dst, uint8x16_t r, uint8x16_t g, uint8x16_t b, int bgr)
+{
+    uint8x16x3_t out;
+
+    out.val[0] = bgr ? b : r;
+    out.val[1] = g;
+    out.val[2] = bgr ? r : b;
+    vst3q_u8(dst, out);
+}
+
+static int yuyv_rgb24_neon(const uint8_t *src, uint8_t *dst, int npixels, int bgr)
+{
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, src += 32, dst += 48)
+    {
+        uint8x8x4_t yuyv = vld4_u8(src);
+        uint8x16_t r, g, b;
+
+        yuv_rgb_neon(yuyv.val[0], yuyv.val[2], yuyv.val[1], yuyv.val[3], &r, &g, &b);
+        store_rgb24_neon(dst, r, g, b, bgr);
+    }
+    return i;
+}
+
+static int yuv420_rgb24_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int npixels, int bgr)
+{
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, dst += 48)
+    {
+        uint8x8x2_t yy = vld2_u8(y + i);
+        uint8x16_t r, g, b;
+
+        yuv_rgb_neon(yy.val[0], yy.val[1], vld1_u8(u + i / 2), vld1_u8(v + i / 2), &r, &g, &b);
+        store_rgb24_neon(dst, r, g, b, bgr);
+    }
+    return i;
+}
+
+/* 4 pixels of RGB2YUV in single precision, vcvtq truncates like the scalar cast */
+static void rgb_yuv_neon(uint32x4_t ri, uint32x4_t gi, uint32x4_t bi, uint32x4_t *y, uint32x4_t *u, uint32x4_t *v)
+{
+    float32x4_t r = vcvtq_f32_u32(ri);
+    float32x4_t g = vcvtq_f32_u32(gi);
+    float32x4_t b = vcvtq_f32_u32(bi);
+    float32x4_t half_r = vcvtq_f32_u32(vshrq_n_u32(ri, 1));
+    float32x4_t half_b = vcvtq_f32_u32(vshrq_n_u32(bi, 1));
+    float32x4_t offset = vdupq_n_f32(128.0f);
+
+    *y = vcvtq_u32_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(r, 0.2990f), vmulq_n_f32(g, 0.5870f)), vmulq_n_f32(b, 0.1140f)));
+    *u = vcvtq_u32_f32(vaddq_f32(vaddq_f32(vsubq_f32(vnegq_f32(vmulq_n_f32(r, 0.1684f)), vmulq_n_f32(g, 0.3316f)),
+                                           half_b), offset));
+    *v = vcvtq_u32_f32(vaddq_f32(vsubq_f32(vsubq_f32(half_r, vmulq_n_f32(g, 0.4187f)), vmulq_n_f32(b, 0.0813f)), offset));
+}
+
+static int rgb24_yuv444_neon(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int npixels, int redfirst)
+{
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, src += 48)
+    {
+        uint8x16x3_t in = vld3q_u8(src);
+        uint8x16_t r8 = redfirst ? in.val[0] : in.val[2];
+        uint8x16_t b8 = redfirst ? in.val[2] : in.val[0];
+        uint16x8_t r16[2] = { vmovl_u8(vget_low_u8(r8)), vmovl_u8(vget_high_u8(r8)) };
+        uint16x8_t g16[2] = { vmovl_u8(vget_low_u8(in.val[1])), vmovl_u8(vget_high_u8(in.val[1])) };
+        uint16x8_t b16[2] = { vmovl_u8(vget_low_u8(b8)), vmovl_u8(vget_high_u8(b8)) };
+        uint16x4_t yq[4], uq[4], vq[4];
+        int q;
+
+        for (q = 0; q < 4; q++)
+        {
+            uint16x4_t rq = (q & 1) ? vget_high_u16(r16[q / 2]) : vget_low_u16(r16[q / 2]);
+            uint16x4_t gq = (q & 1) ? vget_high_u16(g16[q / 2]) : vget_low_u16(g16[q / 2]);
+            uint16x4_t bq = (q & 1) ? vget_high_u16(b16[q / 2]) : vget_low_u16(b16[q / 2]);
+            uint32x4_t y32, u32, v32;
+
+            rgb_yuv_neon(vmovl_u16(rq), vmovl_u16(gq), vmovl_u16(bq), &y32, &u32, &v32);
+            yq[q] = vmovn_u32(y32);
+            uq[q] = vmovn_u32(u32);
+            vq[q] = vmovn_u32(v32);
+        }
+
+        vst1q_u8(y + i, vcombine_u8(vmovn_u16(vcombine_u16(yq[0], yq[1])), vmovn_u16(vcombine_u16(yq[2], yq[3]))));
+        vst1q_u8(u + i, vcombine_u8(vmovn_u16(vcombine_u16(uq[0], uq[1])), vmovn_u16(vcombine_u16(uq[2], uq[3]))));
+        vst1q_u8(v + i, vcombine_u8(vmovn_u16(vcombine_u16(vq[0], vq[1])), vmovn_u16(vcombine_u16(vq[2], vq[3]))));
+    }
+    return i;
+}
+
+static int bayer_rgb24_neon(const uint8_t *src, long stride, uint8_t *dst, int npixels,
+                            const uint8_t first[3], const uint8_t second[3])
+{
+    static const uint8_t odd_mask[16] = { 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff, 0, 0xff };
+    const uint8x16_t odd = vld1q_u8(odd_mask);
+    int i;
+
+    for (i = 0; i + 16 <= npixels; i += 16, dst += 48)
+    {
+        const uint8_t *p = src + i, *a = p - stride, *b = p + stride;
+        uint8x16_t l  = vld1q_u8(p - 1);
+        uint8x16_t r  = vld1q_u8(p + 1);
+        uint8x16_t u  = vld1q_u8(a);
+        uint8x16_t d  = vld1q_u8(b);
+        uint8x16_t ul = vld1q_u8(a - 1);
+        uint8x16_t ur = vld1q_u8(a + 1);
+        uint8x16_t dl = vld1q_u8(b - 1);
+        uint8x16_t dr = vld1q_u8(b + 1);
+        uint8x16_t src16[5];
+        uint8x16x3_t out;
+        int k;
+
+        /* halving adds truncate like the scalar averages */
+        src16[BAYER_C] = vld1q_u8(p);
+        src16[BAYER_H] = vhaddq_u8(l, r);
+        src16[BAYER_V] = vhaddq_u8(u, d);
+        src16[BAYER_X] = vcombine_u8(
+                             vshrn_n_u16(vaddq_u16(vaddl_u8(vget_low_u8(l), vget_low_u8(r)), vaddl_u8(vget_low_u8(u), vget_low_u8(d))), 2),
+                             vshrn_n_u16(vaddq_u16(vaddl_u8(vget_high_u8(l), vget_high_u8(r)), vaddl_u8(vget_high_u8(u), vget_high_u8(d))), 2));
+        src16[BAYER_D] = vcombine_u8(
+                             vshrn_n_u16(vaddq_u16(vaddl_u8(vget_low_u8(ul), vget_low_u8(ur)), vaddl_u8(vget_low_u8(dl), vget_low_u8(dr))), 2),
+                             vshrn_n_u16(vaddq_u16(vaddl_u8(vget_high_u8(ul), vget_high_u8(ur)), vaddl_u8(vget_high_u8(dl), vget_high_u8(dr))), 2));
+
+        for (k = 0; k < 3; k++)
+            out.val[k] = vbslq_u8(odd, src16[second[k]], src16[first[k]]);
+
+        vst3q_u8(dst, out);
+    }
+    return i;
+}
+
+static const ccvt_simd_kernels kernels_neon =
+{
+    yuyv_rgb24_neon, yuv420_rgb24_neon, rgb24_yuv444_neon, bayer_rgb24_neon
+};
+
+#endif /* CCVT_NEON */
+
+static int yuyv_rgb24_none(const uint8_t *src, uint8_t *dst, int npixels, int bgr)
+{
+    (void)src;
+    (void)dst;
+    (void)npixels;
+    (void)bgr;
+    return 0;
+}
+
+static int yuv420_rgb24_none(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int npixels, int bgr)
+{
+    (void)y;
+    (void)u;
+    (void)v;
+    (void)dst;
+    (void)npixels;
+    (void)bgr;
+    return 0;
+}
+
+static int rgb24_yuv444_none(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int npixels, int redfirst)
+{
+    (void)src;
+    (void)y;
+    (void)u;
+    (void)v;
+    (void)npixels;
+    (void)redfirst;
+    return 0;
+}
+
+static int bayer_rgb24_none(const uint8_t *src, long stride, uint8_t *dst, int npixels,
+                            const uint8_t first[3], const uint8_t second[3])
+{
+    (void)src;
+    (void)stride;
+    (void)dst;
+    (void)npixels;
+    (void)first;
+    (void)second;
+    return 0;
+}
+
+static const ccvt_simd_kernels kernels_none =
+{
+    yuyv_rgb24_none, yuv420_rgb24_none, rgb24_yuv444_none, bayer_rgb24_none
+};
+
+static const ccvt_simd_kernels *kernels = NULL;
+static int kernels_level = CCVT_SIMD_NONE;
+
+/* best instruction set of this cpu */
+static int best_level()
+{
+#if defined(CCVT_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CCVT_SIMD_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return CCVT_SIMD_SSSE3;
+#elif defined(CCVT_NEON)
+    return CCVT_SIMD_NEON;
+#endif
+    return CCVT_SIMD_NONE;
+}
+
+int ccvt_set_simd(int level)
+{
+    int best = best_level();
+    const ccvt_simd_kernels *k = &kernels_none;
+
+    if (level < 0 || level > best)
+        level = best;
+
+    switch (level)
+    {
+#if defined(CCVT_X86)
+        case CCVT_SIMD_AVX2:
+            k = &kernels_avx2;
+            break;
+        case CCVT_SIMD_SSSE3:
+            k = &kernels_ssse3;
+            break;
+#elif defined(CCVT_NEON)
+        case CCVT_SIMD_NEON:
+            k = &kernels_neon;
+            break;
+#endif
+        default:
+            level = CCVT_SIMD_NONE;
+            break;
+    }
+
+    kernels_level = level;
+    kernels       = k;
+    return level;
+}
+
+int ccvt_get_simd(void)
+{
+    if (!kernels)
+        ccvt_set_simd(-1);
+    return kernels_level;
+}
+
+const ccvt_simd_kernels *ccvt_simd(void)
+{
+    if (!kernels)
+        ccvt_set_simd(-1);
+    return kernels;
+}
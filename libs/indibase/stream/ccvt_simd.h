@@ -0,0 +1,51 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+/* SIMD kernels of the ccvt conversions, private to ccvt.
+ *
+ * Each kernel converts the longest run of pixels it can from the start of a row, and returns the number of pixels
+ * converted. The scalar code converts the rest of the row, so that both produce the same image. */
+
+#include <stdint.h>
+
+/* Source of a channel of an interpolated Bayer pixel */
+enum
+{
+    BAYER_C, /* the pixel itself */
+    BAYER_H, /* (left + right) / 2 */
+    BAYER_V, /* (up + down) / 2 */
+    BAYER_X, /* (left + right + up + down) / 4 */
+    BAYER_D  /* sum of the 4 diagonal neighbours / 4 */
+};
+
+typedef struct
+{
+    /* YUYV 4:2:2 to RGB24, or BGR24 if bgr, npixels is even */
+    int (*yuyv_rgb24)(const uint8_t *src, uint8_t *dst, int npixels, int bgr);
+    /* a row of 4:2:0 planar to RGB24, or BGR24 if bgr, u and v are the chroma of the row */
+    int (*yuv420_rgb24)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int npixels, int bgr);
+    /* 3 bytes per pixel to Y, U and V per pixel, with the RGB2YUV formula, red is the first or the last byte */
+    int (*rgb24_yuv444)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int npixels, int redfirst);
+    /* bilinear Bayer to RGB24 away from the borders: src has pixels above, below, left and right, first and second
+     * give the sources of R, G and B for the first pixel and the next one, the pattern repeats every 2 pixels */
+    int (*bayer_rgb24)(const uint8_t *src, long stride, uint8_t *dst, int npixels,
+                       const uint8_t first[3], const uint8_t second[3]);
+} ccvt_simd_kernels;
+
+/* kernels of the instruction set in use */
+const ccvt_simd_kernels *ccvt_simd(void);
@@ -22,21 +22,41 @@
 #include "mjpegencoder.h"
 #include "stream/streammanager.h"
 #include "indiccd.h"
+
+#include <algorithm>
 #include <cmath>
+#include <thread>
 #include <zlib.h>
 #include <jpeglib.h>
 #include <jerror.h>
 
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+// Destination growing a vector, a strip never overflows its buffer
+struct VectorDestination
+{
+    struct jpeg_destination_mgr pub;
+    std::vector<uint8_t> *buffer;
+};
+
 static void init_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto dest = reinterpret_cast<VectorDestination *>(cinfo->dest);
+    if (dest->buffer->size() < 4096)
+        dest->buffer->resize(4096);
+    dest->pub.next_output_byte = dest->buffer->data();
+    dest->pub.free_in_buffer = dest->buffer->size();
 }
 
 static boolean empty_output_buffer(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto dest = reinterpret_cast<VectorDestination *>(cinfo->dest);
+    size_t used = dest->buffer->size();
+    dest->buffer->resize(used * 2);
+    dest->pub.next_output_byte = dest->buffer->data() + used;
+    dest->pub.free_in_buffer = dest->buffer->size() - used;
     return TRUE;
 }
 
@@ -46,6 +66,73 @@ static void term_destination(j_compress_ptr cinfo)
     /* no work necessary here */
 }
 
+// Average of scale x scale source pixels for each destination pixel
+static void areaDownscale(const uint8_t *src, int srcStride, uint8_t *dst, uint16_t width, uint16_t rows, int components,
+                          int scale, std::vector<uint32_t> &sums)
+{
+    size_t rowSize = static_cast<size_t>(width) * components;
+    size_t srcRowSize = rowSize * scale;
+    uint32_t area = scale * scale;
+    sums.resize(srcRowSize);
+
+    for (uint16_t y = 0; y < rows; ++y)
+    {
+        // Columns first, contiguous adds over whole rows
+        const uint8_t *in = src + static_cast<size_t>(y) * scale * srcStride;
+        std::copy(in, in + srcRowSize, sums.begin());
+        for (int sy = 1; sy < scale; ++sy)
+        {
+            in += srcStride;
+            for (size_t i = 0; i < srcRowSize; ++i)
+                sums[i] += in[i];
+        }
+
+        uint8_t *out = dst + y * rowSize;
+        for (size_t x = 0; x < width; ++x)
+        {
+            const uint32_t *block = sums.data() + x * scale * components;
+            for (int c = 0; c < components; ++c)
+            {
+                uint32_t sum = 0;
+                for (int sx = 0; sx < scale; ++sx)
+                    sum += block[sx * components + c];
+                out[x * components + c] = static_cast<uint8_t>((sum + area / 2) / area);
+            }
+        }
+    }
+}
+
+// Locate the frame header and the start of the entropy coded data of a baseline JPEG
+static bool findScan(const uint8_t *jpeg, size_t size, size_t &sof, size_t &sos, size_t &data)
+{
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 || jpeg[size - 2] != 0xFF || jpeg[size - 1] != 0xD9)
+        return false;
+
+    sof = 0;
+    for (size_t pos = 2; pos + 4 <= size;)
+    {
+        if (jpeg[pos] != 0xFF)
+            return false;
+
+        uint8_t marker = jpeg[pos + 1];
+        size_t length = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+
+        if (marker == 0xC0 || marker == 0xC1)
+            sof = pos;
+
+        if (marker == 0xDA)
+        {
+            sos  = pos;
+            data = pos + 2 + length;
+            return sof != 0 && data <= size - 2;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
+
 namespace INDI
 {
 
@@ -56,7 +143,18 @@ MJPEGEncoder::MJPEGEncoder()
 
 MJPEGEncoder::~MJPEGEncoder()
 {
-    delete [] jpegBuffer;
+#ifdef HAVE_TURBOJPEG
+    for (auto &strip : strips)
+    {
+        if (strip.handle)
+            tjDestroy(strip.handle);
+    }
+#endif
+}
+
+void MJPEGEncoder::setQuality(int value)
+{
+    quality = std::max(1, std::min(100, value));
 }
 
 const char *MJPEGEncoder::getDeviceName()
@@ -74,30 +172,150 @@ bool MJPEGEncoder::upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint3
     }
 
     INDI_UNUSED(nbytes);
-    int bufsize = rawWidth * rawHeight * ((pixelFormat == INDI_RGB) ? 3 : 1);
-    if (bufsize != jpegBufferSize)
-    {
-        delete [] jpegBuffer;
-        jpegBuffer = new uint8_t[bufsize];
-        jpegBufferSize = bufsize;
-    }
+    int components = (pixelFormat == INDI_RGB) ? 3 : 1;
 
     // Scale image DOWN by this factor
     // 640 is now selected arbitrary to test mpeg streaming performance
-    int scale = std::max(1, static_cast<int>(std::floor(rawWidth / SCALE_WIDTH)));
-    if (pixelFormat == INDI_RGB)
-        jpeg_compress_8u_rgb(buffer, rawWidth, rawHeight, rawWidth * 3, scale, jpegBuffer, &bufsize, 85);
+    int scale = std::max(1, rawWidth / SCALE_WIDTH);
+    uint16_t width  = rawWidth / scale;
+    uint16_t height = rawHeight / scale;
+    if (width == 0 || height == 0)
+        return false;
+
+    // Strips are whole MCU rows, 4:2:0 for color. The restart interval is 16 bits wide.
+    uint32_t mcuSize    = (components == 3) ? 16 : 8;
+    uint32_t mcuColumns = (width + mcuSize - 1) / mcuSize;
+    uint32_t mcuRows    = (height + mcuSize - 1) / mcuSize;
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min<size_t>(threads, mcuRows / 4));
+
+    uint32_t stripMcuRows = (mcuRows + threads - 1) / threads;
+    stripMcuRows = std::min(stripMcuRows, std::max<uint32_t>(1, 65535 / mcuColumns));
+    uint32_t stripRows = stripMcuRows * mcuSize;
+    size_t count = (height + stripRows - 1) / stripRows;
+    threads = std::min(threads, count);
+
+    if (strips.size() < count)
+        strips.resize(count);
+
+    std::vector<char> encoded(count, 0);
+    auto run = [&](size_t first)
+    {
+        for (size_t i = first; i < count; i += threads)
+        {
+            Strip &strip = strips[i];
+            uint32_t top = i * stripRows;
+            uint16_t rows = std::min(stripRows, height - top);
+            int srcStride = rawWidth * components;
+            const uint8_t *src = buffer + static_cast<size_t>(top) * scale * srcStride;
+
+            if (scale > 1)
+            {
+                strip.pixels.resize(static_cast<size_t>(width) * rows * components);
+                areaDownscale(src, srcStride, strip.pixels.data(), width, rows, components, scale, strip.sums);
+                encoded[i] = encodeStrip(strip, strip.pixels.data(), width, rows, width * components, components, quality);
+            }
+            else
+                encoded[i] = encodeStrip(strip, src, width, rows, srcStride, components, quality);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(run, i);
+    run(0);
+    for (auto &worker : workers)
+        worker.join();
+
+    if (std::find(encoded.begin(), encoded.end(), 0) != encoded.end())
+    {
+        LOG_ERROR("Failed to encode MJPEG frame.");
+        return false;
+    }
+
+    if (count == 1)
+    {
+        bp->setBlob(strips[0].jpeg.data());
+        bp->setBlobLen(strips[0].jpegSize);
+        bp->setSize(strips[0].jpegSize);
+    }
     else
-        jpeg_compress_8u_gray(buffer, rawWidth, rawHeight, rawWidth, scale, jpegBuffer, &bufsize, 85);
+    {
+        if (joinStrips(count, height, stripMcuRows * mcuColumns) == false)
+        {
+            LOG_ERROR("Failed to join MJPEG strips.");
+            return false;
+        }
+
+        bp->setBlob(jpegBuffer.data());
+        bp->setBlobLen(jpegBuffer.size());
+        bp->setSize(jpegBuffer.size());
+    }
 
-    bp->setBlob(jpegBuffer);
-    bp->setBlobLen(bufsize);
-    bp->setSize(bufsize);
     bp->setFormat(".stream_jpg");
 
     return true;
 }
 
+bool MJPEGEncoder::joinStrips(size_t count, uint32_t height, uint32_t restartInterval)
+{
+    size_t sof = 0, sos = 0, data = 0;
+    const uint8_t *first = strips[0].jpeg.data();
+    if (findScan(first, strips[0].jpegSize, sof, sos, data) == false)
+        return false;
+
+    // Headers of the first strip with the full height, and a restart interval of one strip
+    jpegBuffer.assign(first, first + sos);
+    jpegBuffer[sof + 5] = height >> 8;
+    jpegBuffer[sof + 6] = height & 0xFF;
+
+    const uint8_t dri[] = { 0xFF, 0xDD, 0x00, 0x04, static_cast<uint8_t>(restartInterval >> 8), static_cast<uint8_t>(restartInterval & 0xFF) };
+    jpegBuffer.insert(jpegBuffer.end(), dri, dri + sizeof(dri));
+    jpegBuffer.insert(jpegBuffer.end(), first + sos, first + strips[0].jpegSize - 2);
+
+    // Entropy coded data of the other strips, each one after a restart marker
+    for (size_t i = 1; i < count; ++i)
+    {
+        const uint8_t *jpeg = strips[i].jpeg.data();
+        if (findScan(jpeg, strips[i].jpegSize, sof, sos, data) == false)
+            return false;
+
+        jpegBuffer.push_back(0xFF);
+        jpegBuffer.push_back(0xD0 + ((i - 1) & 7));
+        jpegBuffer.insert(jpegBuffer.end(), jpeg + data, jpeg + strips[i].jpegSize - 2);
+    }
+
+    jpegBuffer.push_back(0xFF);
+    jpegBuffer.push_back(0xD9);
+    return true;
+}
+
+#ifdef HAVE_TURBOJPEG
+
+bool MJPEGEncoder::encodeStrip(Strip &strip, const uint8_t *src, uint16_t width, uint16_t height, int stride,
+                               int components, int quality)
+{
+    if (strip.handle == nullptr && (strip.handle = tjInitCompress()) == nullptr)
+        return false;
+
+    int subsampling = (components == 3) ? TJSAMP_420 : TJSAMP_GRAY;
+    unsigned long size = tjBufSize(width, height, subsampling);
+    if (strip.jpeg.size() < size)
+        strip.jpeg.resize(size);
+
+    unsigned char *dest = strip.jpeg.data();
+    size = strip.jpeg.size();
+    if (tjCompress2(strip.handle, src, width, stride, height, (components == 3) ? TJPF_RGB : TJPF_GRAY, &dest, &size,
+                    subsampling, quality, TJFLAG_NOREALLOC) != 0)
+        return false;
+
+    strip.jpegSize = size;
+    return true;
+}
+
+#else
+
 /*
 FROM: https://svn.csail.mit.edu/rrg_pods/jpeg-utils/
 
@@ -119,33 +337,25 @@ Requirements:
   library that is ABI compatible with libjpeg62.
 */
 
-int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-        uint8_t * dest,
-        int * destsize, int quality)
+bool MJPEGEncoder::encodeStrip(Strip &strip, const uint8_t *src, uint16_t width, uint16_t height, int stride,
+                               int components, int quality)
 {
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
+    VectorDestination jdest;
 
     cinfo.err = jpeg_std_error (&jerr);
     jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
+    jdest.buffer = &strip.jpeg;
+    jdest.pub.init_destination = init_destination;
+    jdest.pub.empty_output_buffer = empty_output_buffer;
+    jdest.pub.term_destination = term_destination;
+    cinfo.dest = &jdest.pub;
 
     cinfo.image_width = width;
     cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
-#else
-    INDI_UNUSED(scale);
-#endif
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
+    cinfo.input_components = components;
+    cinfo.in_color_space = (components == 3) ? JCS_RGB : JCS_GRAYSCALE;
     jpeg_set_defaults (&cinfo);
     jpeg_set_quality (&cinfo, quality, TRUE);
 
@@ -157,50 +367,11 @@ int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, ui
     }
 
     jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
+    strip.jpegSize = strip.jpeg.size() - jdest.pub.free_in_buffer;
     jpeg_destroy_compress (&cinfo);
-    return 0;
+    return true;
 }
 
-int MJPEGEncoder::jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-                                        uint8_t * dest, int * destsize, int quality)
-{
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
-#else
-    INDI_UNUSED(scale);
 #endif
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
-    {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
-    }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
-}
 
 }
@@ -23,13 +23,18 @@
 
 #include "encoderinterface.h"
 
+#include <cstddef>
+#include <vector>
+
 namespace INDI
 {
 
 /**
  * @brief The MJPEGEncoder class encodes frames in JPEG format before transmitting them to the client.
  *
- * The quality is now hard-coded at 70 when encoding the JPEG image. Further compression is not supported.
+ * Frames wider than SCALE_WIDTH are reduced by an integer factor with an area filter while they are encoded.
+ * Large frames are split in horizontal strips encoded in parallel and joined with restart markers into one
+ * baseline JPEG. All buffers are kept between frames. The quality is hard-coded at 85.
  */
 class MJPEGEncoder : public EncoderInterface
 {
@@ -39,17 +44,36 @@ class MJPEGEncoder : public EncoderInterface
 
         virtual bool upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed = false) override;
 
+        /**
+         * @brief setQuality JPEG quality of the preview frames, from 1 to 100. Lower values give smaller frames that
+         * encode faster. Default is 85.
+         */
+        void setQuality(int value);
+
     private:
+        struct Strip
+        {
+            // Downscaled pixels of the strip, unused at full scale
+            std::vector<uint8_t> pixels;
+            std::vector<uint32_t> sums;
+            // Complete JPEG of the strip
+            std::vector<uint8_t> jpeg;
+            size_t jpegSize = 0;
+            // TurboJPEG compressor, when available
+            void *handle = nullptr;
+        };
+
         const char *getDeviceName();
-        int jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                   int * destsize, int quality);
-        int jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                  int * destsize, int quality);
-        uint8_t *jpegBuffer = nullptr;
-        uint16_t jpegBufferSize = 1;
+        bool encodeStrip(Strip &strip, const uint8_t *src, uint16_t width, uint16_t height, int stride, int components,
+                         int quality);
+        bool joinStrips(size_t count, uint32_t height, uint32_t restartInterval);
 
-        static const int SCALE_WIDTH = 640;
+        std::vector<Strip> strips;
+        std::vector<uint8_t> jpegBuffer;
 
+        static const int SCALE_WIDTH = 640;
+        static const int DEFAULT_QUALITY = 85;
+        int quality = DEFAULT_QUALITY;
 };
 
 }
@@ -0,0 +1,245 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * \class FrameRing template
+ * \brief The FrameRing class is a fixed size single producer / single consumer ring of reusable slots.
+ *
+ * Slots are allocated once and handed back and forth between one producer thread and one consumer thread,
+ * so the storage kept inside a slot (e.g. the capacity of a std::vector) is reused by the next frame.
+ * The producer never waits for the consumer: when the ring is full, acquire returns nullptr.
+ * The consumer may sleep while the ring is empty, the producer only touches the mutex to wake it up.
+ */
+template <typename T>
+class FrameRing
+{
+    public:
+        explicit FrameRing(size_t capacity);
+
+    public:
+        /**
+         * @brief Producer: get the next free slot
+         * @return pointer to the slot or nullptr if the ring is full
+         */
+        T *acquire();
+
+        /**
+         * @brief Producer: make the slot returned by acquire visible to the consumer
+         */
+        void publish();
+
+        /**
+         * @brief Producer: wait until the consumer has released all slots
+         */
+        void waitForEmpty() const;
+
+        /**
+         * @brief Consumer: get the oldest published slot
+         * @param msecs timeout in milliseconds
+         * @return pointer to the slot or nullptr if timeout or the abort function was called while waiting
+         */
+        T *front(uint32_t msecs);
+
+        /**
+         * @brief Consumer: give the slot returned by front back to the producer
+         */
+        void release();
+
+        /**
+         * @brief Wake up all waiting threads, front returns nullptr from now on
+         */
+        void abort();
+
+        /**
+         * @brief Return the number of published slots
+         * @return count of elements
+         */
+        size_t size() const;
+
+    protected:
+        std::vector<T> slots;
+
+        // monotonic counters, the slot index is the counter modulo slots.size()
+        std::atomic<size_t> head {0}; // written by the consumer
+        std::atomic<size_t> tail {0}; // written by the producer
+
+        std::atomic<bool>   aborted  {false};
+        std::atomic<bool>   sleeping {false};         // consumer waits for data
+        mutable std::atomic<bool> draining {false};   // producer waits for an empty ring
+
+        mutable std::mutex  mutex;
+        std::condition_variable         increase;
+        mutable std::condition_variable decrease;
+};
+
+/**
+ * \class FrameBufferPool
+ * \brief The FrameBufferPool class hands the frame buffers of a FrameRing consumer back to its producer.
+ *
+ * Slots of a FrameRing are used in turn, so buffers kept inside the slots would add up to one frame per slot.
+ * Instead the consumer gives the buffer of each processed slot to the pool and the producer takes it for the next
+ * frame. The pool keeps a few spare buffers and frees the others, so the memory held is the frames in flight plus the
+ * spares.
+ */
+class FrameBufferPool
+{
+    public:
+        explicit FrameBufferPool(size_t spares);
+
+    public:
+        /**
+         * @brief Producer: move a spare buffer into an empty buffer. Spares much larger than size are freed.
+         */
+        void take(std::vector<uint8_t> &buffer, size_t size);
+
+        /**
+         * @brief Consumer: move the buffer to the pool, or free it if the pool is full. buffer is empty afterwards.
+         */
+        void give(std::vector<uint8_t> &buffer);
+
+    protected:
+        FrameRing<std::vector<uint8_t>> spares;
+};
+
+// implementation
+template <typename T>
+inline FrameRing<T>::FrameRing(size_t capacity)
+    : slots(capacity)
+{ }
+
+template <typename T>
+inline T *FrameRing<T>::acquire()
+{
+    size_t index = tail.load(std::memory_order_relaxed);
+    if (index - head.load(std::memory_order_acquire) >= slots.size())
+        return nullptr;
+
+    return &slots[index % slots.size()];
+}
+
+template <typename T>
+inline void FrameRing<T>::publish()
+{
+    tail.fetch_add(1);
+
+    // pairs with the sleeping store/tail load in front
+    if (sleeping.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        increase.notify_one();
+    }
+}
+
+template <typename T>
+inline void FrameRing<T>::waitForEmpty() const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    draining = true;
+    decrease.wait(lock, [this]()
+    {
+        return aborted || head.load() == tail.load(std::memory_order_relaxed);
+    });
+    draining = false;
+}
+
+template <typename T>
+inline T *FrameRing<T>::front(uint32_t msecs)
+{
+    size_t index = head.load(std::memory_order_relaxed);
+
+    if (index == tail.load(std::memory_order_acquire))
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping = true;
+        if (!aborted && index == tail.load())
+            increase.wait_for(lock, std::chrono::milliseconds(msecs));
+        sleeping = false;
+
+        if (aborted || index == tail.load(std::memory_order_acquire))
+            return nullptr; // timeout or abort
+    }
+
+    if (aborted)
+        return nullptr;
+
+    return &slots[index % slots.size()];
+}
+
+template <typename T>
+inline void FrameRing<T>::release()
+{
+    head.fetch_add(1);
+
+    // pairs with the draining store/head load in waitForEmpty
+    if (draining.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decrease.notify_all();
+    }
+}
+
+template <typename T>
+inline void FrameRing<T>::abort()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+    increase.notify_all();
+    decrease.notify_all();
+}
+
+template <typename T>
+inline size_t FrameRing<T>::size() const
+{
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+inline FrameBufferPool::FrameBufferPool(size_t spares)
+    : spares(spares)
+{ }
+
+inline void FrameBufferPool::take(std::vector<uint8_t> &buffer, size_t size)
+{
+    if (buffer.capacity() != 0 || spares.size() == 0)
+        return;
+
+    std::vector<uint8_t> *spare = spares.front(0);
+    if (spare == nullptr)
+        return;
+
+    // the frame size changed a lot, do not hold the larger buffer
+    if (spare->capacity() <= 2 * size)
+        buffer.swap(*spare);
+    std::vector<uint8_t>().swap(*spare);
+    spares.release();
+}
+
+inline void FrameBufferPool::give(std::vector<uint8_t> &buffer)
+{
+    std::vector<uint8_t> *spare = spares.acquire();
+    if (spare != nullptr)
+    {
+        spare->swap(buffer);
+        spares.publish();
+    }
+    std::vector<uint8_t>().swap(buffer);
+}
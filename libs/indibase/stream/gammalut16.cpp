@@ -21,7 +21,135 @@
 
 */
 #include "gammalut16.h"
+#include <algorithm>
 #include <cmath>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define GAMMA_SSE2
+#if defined(__GNUC__)
+#define GAMMA_AVX2
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GAMMA_NEON
+#endif
+
+namespace
+{
+// Frames smaller than this number of samples are converted on the calling thread only
+constexpr size_t PARALLEL_SAMPLES = 1 << 20;
+
+// Run convert(firstRow, rowCount) on strips of rows, on all cores for large frames
+template <typename Convert>
+void forEachStrip(size_t width, size_t height, Convert convert)
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max<size_t>(1, width * height / (PARALLEL_SAMPLES / 4)));
+    threads = std::min(threads, height);
+
+    if (width * height < PARALLEL_SAMPLES || threads < 2)
+    {
+        convert(0, height);
+        return;
+    }
+
+    size_t stripRows = (height + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t first = stripRows; first < height; first += stripRows)
+        workers.emplace_back(convert, first, std::min(stripRows, height - first));
+    convert(0, std::min(stripRows, height));
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void shiftScalar(const uint16_t *src, size_t j, size_t n, uint8_t *dst, int bits)
+{
+    for (; j < n; ++j)
+        dst[j] = std::min(src[j] >> bits, 255);
+}
+
+#ifdef GAMMA_AVX2
+// 8 outputs of the step table, see mSteps
+__attribute__((target("avx2")))
+__m256i stepsAVX2(const uint16_t *steps, __m256i x)
+{
+    const __m256i low = _mm256_set1_epi32(0xff);
+    // the gather reads 32 bits, the entry is in the low half
+    __m256i entry = _mm256_i32gather_epi32(reinterpret_cast<const int *>(steps), _mm256_srli_epi32(x, 4), 2);
+    __m256i offset = _mm256_and_si256(entry, low);
+    __m256i base = _mm256_and_si256(_mm256_srli_epi32(entry, 8), low);
+    // base + 1 where (x & 15) >= offset, the comparison is -1 when true
+    __m256i above = _mm256_cmpgt_epi32(_mm256_and_si256(x, _mm256_set1_epi32(15)), _mm256_sub_epi32(offset, _mm256_set1_epi32(1)));
+    return _mm256_sub_epi32(base, above);
+}
+
+__attribute__((target("avx2")))
+size_t applyStepsAVX2(const uint16_t *steps, const uint16_t *src, size_t n, uint8_t *dst)
+{
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + j));
+        __m256i lo = stepsAVX2(steps, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(x)));
+        __m256i hi = stepsAVX2(steps, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1)));
+        // packs work within 128 bits lanes
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + j), bytes);
+    }
+    return j;
+}
+
+bool hasAVX2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+#ifdef GAMMA_SSE2
+size_t shiftSSE2(const uint16_t *src, size_t n, uint8_t *dst, int bits)
+{
+    const __m128i count = _mm_cvtsi32_si128(bits);
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m128i lo = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j)), count);
+        __m128i hi = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + j + 8)), count);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + j), _mm_packus_epi16(lo, hi));
+    }
+    return j;
+}
+#endif
+
+#ifdef GAMMA_NEON
+size_t shiftNEON(const uint16_t *src, size_t n, uint8_t *dst, int bits)
+{
+    const int16x8_t count = vdupq_n_s16(-bits);
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        uint8x8_t lo = vqmovn_u16(vshlq_u16(vld1q_u16(src + j), count));
+        uint8x8_t hi = vqmovn_u16(vshlq_u16(vld1q_u16(src + j + 8), count));
+        vst1q_u8(dst + j, vcombine_u8(lo, hi));
+    }
+    return j;
+}
+#endif
+
+void shiftRow(const uint16_t *src, size_t n, uint8_t *dst, int bits)
+{
+    size_t j = 0;
+#if defined(GAMMA_SSE2)
+    j = shiftSSE2(src, n, dst, bits);
+#elif defined(GAMMA_NEON)
+    j = shiftNEON(src, n, dst, bits);
+#endif
+    shiftScalar(src, j, n, dst, bits);
+}
+}
 
 GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
 {
@@ -38,6 +166,28 @@ GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
             p = (1 + b) * powf(I, 1.0 / gamma) - b;
         value = round(255.0 * p);
     }
+
+    // One more entry for the 32 bits reads of the last one
+    mSteps.resize(65536 / 16 + 1);
+    for (size_t n = 0; n < 65536 / 16; ++n)
+    {
+        const uint8_t *block = &mLookUpTable[n * 16];
+        uint8_t offset = 16;
+
+        for (uint8_t j = 1; j < 16; ++j)
+        {
+            if (block[j] == block[j - 1])
+                continue;
+
+            if (offset != 16 || block[j] != block[0] + 1)
+            {
+                mSteps.clear();
+                return;
+            }
+            offset = j;
+        }
+        mSteps[n] = block[0] << 8 | offset;
+    }
 }
 
 void GammaLut16::apply(const uint16_t *source, size_t count, uint8_t *destination) const
@@ -48,8 +198,40 @@ void GammaLut16::apply(const uint16_t *source, size_t count, uint8_t *destinatio
 
 void GammaLut16::apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const
 {
-    const uint8_t *lookUpTable = mLookUpTable.data();
+    applyRow(first, last - first, destination);
+}
+
+void GammaLut16::apply(const uint16_t *source, size_t width, size_t height, size_t sourceStride, uint8_t *destination) const
+{
+    forEachStrip(width, height, [&](size_t row, size_t rows)
+    {
+        for (size_t end = row + rows; row < end; ++row)
+            applyRow(source + row * sourceStride, width, destination + row * width);
+    });
+}
+
+void GammaLut16::shift(const uint16_t *source, size_t width, size_t height, size_t sourceStride, uint8_t *destination,
+                       uint8_t bitDepth)
+{
+    int bits = std::max(0, std::min<int>(bitDepth, 16) - 8);
+
+    forEachStrip(width, height, [&](size_t row, size_t rows)
+    {
+        for (size_t end = row + rows; row < end; ++row)
+            shiftRow(source + row * sourceStride, width, destination + row * width, bits);
+    });
+}
 
-    while (first != last)
-        *destination++ = lookUpTable[*first++];
+void GammaLut16::applyRow(const uint16_t *source, size_t count, uint8_t *destination) const
+{
+    size_t j = 0;
+#ifdef GAMMA_AVX2
+    // The step table stays in L1, the full table does not
+    if (!mSteps.empty() && hasAVX2())
+        j = applyStepsAVX2(mSteps.data(), source, count, destination);
+#endif
+
+    const uint8_t *lookUpTable = mLookUpTable.data();
+    for (; j < count; ++j)
+        destination[j] = lookUpTable[source[j]];
 }
@@ -35,6 +35,27 @@ class GammaLut16
         void apply(const uint16_t *source, size_t count, uint8_t *destination) const;
         void apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const;
 
+        /**
+         * @brief apply Convert height rows of width samples, sourceStride samples apart, to packed 8 bit rows.
+         * Large frames are converted on several threads.
+         */
+        void apply(const uint16_t *source, size_t width, size_t height, size_t sourceStride, uint8_t *destination) const;
+
+        /**
+         * @brief shift Linear conversion of samples of bitDepth significant bits to their 8 most significant bits,
+         * larger values saturate. Same layout as apply.
+         */
+        static void shift(const uint16_t *source, size_t width, size_t height, size_t sourceStride, uint8_t *destination,
+                          uint8_t bitDepth = 16);
+
+    protected:
+        void applyRow(const uint16_t *source, size_t count, uint8_t *destination) const;
+
     protected:
         std::vector<uint8_t> mLookUpTable;
+
+        // Same curve in 8KB: the output changes at most once every 16 inputs. Entry n is the output of input 16n
+        // in the high byte and the offset from 16n where it increases by one, or 16, in the low byte.
+        // Empty if the curve is too steep.
+        std::vector<uint16_t> mSteps;
 };
@@ -71,6 +71,11 @@ class RecorderInterface
             m_FPS = FPS;
             return true;
         }
+        // Number of frames the record is expected to hold, 0 if unknown. Set before open.
+        virtual void setExpectedFrames(uint32_t frames)
+        {
+            m_ExpectedFrames = frames;
+        }
         virtual bool open(const char *filename, char *errmsg)                          = 0;
         virtual bool close()                                                           = 0;
         // when frame is in known encoding format
@@ -80,9 +85,22 @@ class RecorderInterface
         // This is to reduce process time and save memory for a dedicated subframe buffer
         virtual void setStreamEnabled(bool enable) = 0;
 
+        struct Statistics
+        {
+            uint64_t bytesWritten = 0;      // Bytes stored in the file since open
+            uint64_t bytesQueued = 0;       // Bytes accepted but not written yet
+            double maxWriteLatency = 0;     // Longest write in milliseconds since the previous call
+        };
+        // I/O counters of the current or last record
+        virtual Statistics getStatistics()
+        {
+            return Statistics();
+        }
+
     protected:
         const char *name;
         float m_FPS = 1;
+        uint32_t m_ExpectedFrames = 0;
 };
 
 }
@@ -28,10 +28,15 @@
 #include "serrecorder.h"
 #include "jpegutils.h"
 
+#include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/statvfs.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 
 #define ERRMSGSIZ 1024
@@ -53,13 +58,13 @@ SER_Recorder::SER_Recorder()
     // always default to. LITTLE_ENDIAN appears to be ignored by them leading to garbled data.
     serh.LittleEndian = SER_BIG_ENDIAN;
     isRecordingActive = false;
-    f = nullptr;
 
     jpegBuffer = static_cast<uint8_t*>(malloc(1));
 }
 
 SER_Recorder::~SER_Recorder()
 {
+    close();
     free(jpegBuffer);
 }
 
@@ -70,49 +75,35 @@ bool SER_Recorder::is_little_endian()
     return black_magic == 0x01;
 }
 
-void SER_Recorder::write_int_le(uint32_t *i)
+void SER_Recorder::write_int_le(uint8_t *out, uint32_t i)
 {
-    if (is_little_endian())
-        fwrite((i), sizeof(uint32_t), 1, f);
-    else
-    {
-        unsigned char *c = (unsigned char *)i;
-        fwrite((c + 3), sizeof(char), 1, f);
-        fwrite((c + 2), sizeof(char), 1, f);
-        fwrite((c + 1), sizeof(char), 1, f);
-        fwrite((c), sizeof(char), 1, f);
-    }
+    out[0] = i & 0xFF;
+    out[1] = (i >> 8) & 0xFF;
+    out[2] = (i >> 16) & 0xFF;
+    out[3] = (i >> 24) & 0xFF;
 }
 
-void SER_Recorder::write_long_int_le(uint64_t *i)
+void SER_Recorder::write_long_int_le(uint8_t *out, uint64_t i)
 {
-    if (is_little_endian())
-    {
-        fwrite(((uint32_t *)i), sizeof(int), 1, f);
-        fwrite(((uint32_t *)(i) + 1), sizeof(int), 1, f);
-    }
-    else
-    {
-        write_int_le((uint32_t *)(i) + 1);
-        write_int_le((uint32_t *)(i));
-    }
+    write_int_le(out, static_cast<uint32_t>(i));
+    write_int_le(out + 4, static_cast<uint32_t>(i >> 32));
 }
 
-void SER_Recorder::write_header(ser_header *s)
+void SER_Recorder::write_header(const ser_header *s, uint8_t *out)
 {
-    fwrite((s->FileID), sizeof(char), 14, f);
-    write_int_le(&(s->LuID));
-    write_int_le(&(s->ColorID));
-    write_int_le(&(s->LittleEndian));
-    write_int_le(&(s->ImageWidth));
-    write_int_le(&(s->ImageHeight));
-    write_int_le(&(s->PixelDepth));
-    write_int_le(&(s->FrameCount));
-    fwrite((s->Observer), sizeof(char), 40, f);
-    fwrite((s->Instrume), sizeof(char), 40, f);
-    fwrite((s->Telescope), sizeof(char), 40, f);
-    write_long_int_le(&(s->DateTime));
-    write_long_int_le(&(s->DateTime_UTC));
+    memcpy(out, s->FileID, 14);
+    write_int_le(out + 14, s->LuID);
+    write_int_le(out + 18, s->ColorID);
+    write_int_le(out + 22, s->LittleEndian);
+    write_int_le(out + 26, s->ImageWidth);
+    write_int_le(out + 30, s->ImageHeight);
+    write_int_le(out + 34, s->PixelDepth);
+    write_int_le(out + 38, s->FrameCount);
+    memcpy(out + 42, s->Observer, 40);
+    memcpy(out + 82, s->Instrume, 40);
+    memcpy(out + 122, s->Telescope, 40);
+    write_long_int_le(out + 162, s->DateTime);
+    write_long_int_le(out + 170, s->DateTime_UTC);
 }
 
 bool SER_Recorder::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth)
@@ -175,7 +166,7 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
     if (isRecordingActive)
         return false;
     serh.FrameCount = 0;
-    if ((f = fopen(filename, "w")) == nullptr)
+    if ((fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
     {
         snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
         return false;
@@ -183,33 +174,87 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
 
     serh.DateTime     = getLocalTimeStamp();
     serh.DateTime_UTC = getUTCTimeStamp();
-    write_header(&serh);
     frame_size        = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
-    isRecordingActive = true;
+
+    uint8_t header[SER_HEADER_SIZE];
+    write_header(&serh, header);
+    if (!writeAt(header, SER_HEADER_SIZE, 0))
+    {
+        snprintf(errmsg, ERRMSGSIZ, "recorder write error %d, %s\n", errno, strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
 
     frameStamps.clear();
 
+    // Reserve the whole record at once, the file keeps its size until close. The expected frame count
+    // may come from a frame rate estimate, so never take more than 90% of the free space.
+    if (m_ExpectedFrames > 0)
+    {
+        uint64_t reserve = SER_HEADER_SIZE + static_cast<uint64_t>(m_ExpectedFrames) * (frame_size + 8);
+        struct statvfs fs;
+        if (fstatvfs(fd, &fs) == 0)
+            reserve = std::min<uint64_t>(reserve, static_cast<uint64_t>(fs.f_bavail) * fs.f_frsize / 10 * 9);
+#ifdef __linux__
+        if (reserve > SER_HEADER_SIZE)
+            fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, reserve);
+#endif
+        frameStamps.reserve((reserve - std::min<uint64_t>(reserve, SER_HEADER_SIZE)) / (frame_size + 8));
+    }
+
+    dataOffset = SER_HEADER_SIZE;
+    currentBatch.size = 0;
+    currentBatch.frames = 0;
+    if (spareBatches.size() < BATCH_COUNT - 1)
+        spareBatches.resize(BATCH_COUNT - 1);
+
+    pendingBatches.clear();
+    writerQuit = false;
+    writerFailed = false;
+    framesWritten = 0;
+    writtenEnd = SER_HEADER_SIZE;
+    lastWriteOffset = lastWriteSize = 0;
+    bytesWritten = 0;
+    bytesQueued = 0;
+    maxWriteLatency = 0;
+
+    writerThread = std::thread(&SER_Recorder::writerLoop, this);
+    isRecordingActive = true;
+
     return true;
 }
 
 bool SER_Recorder::close()
 {
-    if (f)
+    bool result = true;
+
+    if (fd >= 0)
     {
-        // Write all timestamps
-        for (auto value : frameStamps)
-            write_long_int_le(&value);
+        if (currentBatch.size > 0)
+            submitBatch(false);
 
-        frameStamps.clear();
+        {
+            std::lock_guard<std::mutex> lock(writerMutex);
+            writerQuit = true;
+        }
+        writerCondition.notify_all();
+        writerThread.join();
+
+        // Header and timestamps of all frames that made it to the file
+        result = writeTrailer(writtenEnd, framesWritten) && !writerFailed;
+
+        // Release the preallocated space past the trailer
+        if (ftruncate(fd, writtenEnd + static_cast<uint64_t>(framesWritten) * 8) != 0)
+            result = false;
 
-        fseek(f, 0L, SEEK_SET);
-        write_header(&serh);
-        fclose(f);
-        f = nullptr;
+        frameStamps.clear();
+        ::close(fd);
+        fd = -1;
     }
 
     isRecordingActive = false;
-    return true;
+    return result;
 }
 
 bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t timestamp)
@@ -253,30 +298,188 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t ti
     }
 #endif
 
-    if(timestamp)
-        frameStamps.push_back(timestamp * m_sepaseconds_per_microsecond);
-    else
-        frameStamps.push_back(getUTCTimeStamp());
+    uint64_t frameStamp = timestamp ? timestamp * m_sepaseconds_per_microsecond : getUTCTimeStamp();
+
+    const uint8_t *data = frame;
+    size_t size = nbytes;
+    int w = 0, h = 0, naxis = 1;
 
     // Not technically pixel format, but let's use this for now.
     if (m_PixelFormat == INDI_JPG)
     {
-        int w = 0, h = 0, naxis = 1;
         size_t memsize = 0;
         if (decode_jpeg_rgb(const_cast<uint8_t *>(frame), nbytes, &jpegBuffer, &memsize, &naxis, &w, &h) < 0)
             return false;
 
+        data = jpegBuffer;
+        size = memsize;
+    }
+
+    // Hand the batch over when the frame does not fit
+    if (currentBatch.size > 0 && currentBatch.size + size > currentBatch.data.size())
+    {
+        if (!submitBatch(true))
+            return false;
+    }
+
+    if (currentBatch.data.size() < size)
+        currentBatch.data.resize(std::max(size, BATCH_SIZE));
+
+    memcpy(currentBatch.data.data() + currentBatch.size, data, size);
+    currentBatch.size += size;
+    currentBatch.frames += 1;
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    if (m_PixelFormat == INDI_JPG)
+    {
         serh.ImageWidth = w;
         serh.ImageHeight = h;
         serh.ColorID = (naxis == 3) ? SER_RGB : SER_MONO;
-        fwrite(jpegBuffer, 1, memsize, f);
     }
-    else
-        fwrite(frame, 1, nbytes, f);
+    frameStamps.push_back(frameStamp);
     serh.FrameCount += 1;
+    return !writerFailed;
+}
+
+SER_Recorder::Statistics SER_Recorder::getStatistics()
+{
+    Statistics stats;
+    stats.bytesWritten    = bytesWritten;
+    stats.bytesQueued     = bytesQueued + (isRecordingActive ? currentBatch.size : 0);
+    stats.maxWriteLatency = maxWriteLatency.exchange(0);
+    return stats;
+}
+
+bool SER_Recorder::submitBatch(bool waitForSpare)
+{
+    std::unique_lock<std::mutex> lock(writerMutex);
+    if (writerFailed)
+        return false;
+
+    currentBatch.offset = dataOffset;
+    dataOffset  += currentBatch.size;
+    bytesQueued += currentBatch.size;
+    pendingBatches.push_back(std::move(currentBatch));
+    currentBatch = Batch();
+    writerCondition.notify_all();
+
+    if (!waitForSpare)
+        return true;
+
+    // All batches are queued, the storage is slower than the stream
+    writerCondition.wait(lock, [this] { return !spareBatches.empty() || writerFailed; });
+    if (writerFailed)
+        return false;
+
+    currentBatch = std::move(spareBatches.back());
+    spareBatches.pop_back();
+    return true;
+}
+
+void SER_Recorder::writerLoop()
+{
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    for (;;)
+    {
+        writerCondition.wait(lock, [this] { return !pendingBatches.empty() || writerQuit; });
+        if (pendingBatches.empty())
+            break;
+
+        Batch batch = std::move(pendingBatches.front());
+        pendingBatches.pop_front();
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = writeAt(batch.data.data(), batch.size, batch.offset);
+#ifdef __linux__
+        // Start writeback now and wait for the previous batch, dirty pages do not pile up into one long flush
+        if (ok)
+        {
+            sync_file_range(fd, batch.offset, batch.size, SYNC_FILE_RANGE_WRITE);
+            if (lastWriteSize > 0)
+            {
+                sync_file_range(fd, lastWriteOffset, lastWriteSize,
+                                SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                posix_fadvise(fd, lastWriteOffset, lastWriteSize, POSIX_FADV_DONTNEED);
+            }
+            lastWriteOffset = batch.offset;
+            lastWriteSize   = batch.size;
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        int64_t latency = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+        int64_t previous = maxWriteLatency;
+        while (latency > previous && !maxWriteLatency.compare_exchange_weak(previous, latency));
+
+        bytesQueued -= batch.size;
+        if (ok)
+            bytesWritten += batch.size;
+
+        lock.lock();
+        if (ok)
+        {
+            framesWritten += batch.frames;
+            writtenEnd = batch.offset + batch.size;
+        }
+        else
+            writerFailed = true;
+
+        batch.size = 0;
+        batch.frames = 0;
+        spareBatches.push_back(std::move(batch));
+        writerCondition.notify_all();
+
+        if (ok && now - lastCheckpoint >= std::chrono::seconds(CHECKPOINT_INTERVAL))
+        {
+            uint64_t end = writtenEnd;
+            uint32_t frames = framesWritten;
+            lock.unlock();
+            // The file is complete until the next batch overwrites this trailer with frames. After that the
+            // header still counts only intact frames, but a reader finds frame data where the timestamps were.
+            writeTrailer(end, frames);
+            lastCheckpoint = now;
+            lock.lock();
+        }
+    }
+}
+
+bool SER_Recorder::writeAt(const uint8_t *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data   += written;
+        size   -= written;
+        offset += written;
+    }
     return true;
 }
 
+bool SER_Recorder::writeTrailer(uint64_t dataEnd, uint32_t frames)
+{
+    uint8_t header[SER_HEADER_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        ser_header checkpoint = serh;
+        checkpoint.FrameCount = frames;
+        write_header(&checkpoint, header);
+
+        trailerBuffer.resize(static_cast<size_t>(frames) * 8);
+        for (uint32_t i = 0; i < frames; ++i)
+            write_long_int_le(trailerBuffer.data() + i * 8, frameStamps[i]);
+    }
+
+    return writeAt(trailerBuffer.data(), trailerBuffer.size(), dataEnd) && writeAt(header, SER_HEADER_SIZE, 0);
+}
+
 // Copyright (C) 2015 Chris Garry
 //
 
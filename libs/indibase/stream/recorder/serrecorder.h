@@ -23,8 +23,14 @@
 
 #include "recorderinterface.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <mutex>
 #include <stdio.h>
+#include <thread>
+#include <vector>
 
 typedef struct ser_header
 {
@@ -66,6 +72,10 @@ namespace INDI
 
 /**
  * @brief The SER_Recorder class implements recording of video streams in SER format.
+ *
+ * Frames are copied into large batches written by a background thread, so a slow storage flush does not stall the
+ * stream thread until all batches are in use. The header and the timestamps trailer are rewritten periodically,
+ * a record interrupted by a crash keeps the frames written before the last checkpoint.
  */
 class SER_Recorder : public RecorderInterface
 {
@@ -83,6 +93,7 @@ class SER_Recorder : public RecorderInterface
         virtual bool close();
         /** timestamp is microseconds from SER epoch Jan 1, 1 AD. If it is zero then system time is used. */
         virtual bool writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t timestamp);
+        virtual Statistics getStatistics();
         virtual void setStreamEnabled(bool enable)
         {
             isStreamingActive = enable;
@@ -94,17 +105,62 @@ class SER_Recorder : public RecorderInterface
     protected:
         uint64_t utcTo64BitTS();
         bool is_little_endian();
-        void write_int_le(uint32_t *i);
-        void write_long_int_le(uint64_t *i);
-        void write_header(ser_header *s);
+        void write_int_le(uint8_t *out, uint32_t i);
+        void write_long_int_le(uint8_t *out, uint64_t i);
+        void write_header(const ser_header *s, uint8_t *out);
         ser_header serh;
         bool isRecordingActive = false, isStreamingActive = false;
-        FILE *f;
+        int fd = -1;
         uint32_t frame_size;
         uint32_t number_of_planes;
         uint16_t rawWidth = 0, rawHeight = 0;
         std::vector<uint64_t> frameStamps;
 
+        // Size of the header on disk
+        static constexpr uint32_t SER_HEADER_SIZE = 178;
+
+    private:
+        // Consecutive frames written at once
+        struct Batch
+        {
+            std::vector<uint8_t> data;
+            size_t size = 0;
+            uint32_t frames = 0;
+            uint64_t offset = 0;
+        };
+
+        bool submitBatch(bool waitForSpare);
+        void writerLoop();
+        bool writeAt(const uint8_t *data, size_t size, uint64_t offset);
+        bool writeTrailer(uint64_t dataEnd, uint32_t frames);
+
+        Batch currentBatch;
+        uint64_t dataOffset = 0;
+
+        // Shared with the writer thread
+        std::thread writerThread;
+        std::mutex writerMutex;
+        std::condition_variable writerCondition;
+        std::deque<Batch> pendingBatches;
+        std::vector<Batch> spareBatches;
+        bool writerQuit = false;
+        bool writerFailed = false;
+        uint32_t framesWritten = 0;
+        uint64_t writtenEnd = 0;
+        // Writer thread only
+        uint64_t lastWriteOffset = 0, lastWriteSize = 0;
+        std::vector<uint8_t> trailerBuffer;
+
+        std::atomic<uint64_t> bytesWritten {0};
+        std::atomic<uint64_t> bytesQueued {0};
+        std::atomic<int64_t> maxWriteLatency {0};
+
+        // 4 batches of 16 MB unless frames are larger
+        static constexpr size_t BATCH_SIZE = 16 * 1024 * 1024;
+        static constexpr size_t BATCH_COUNT = 4;
+        // Header and trailer rewrite interval in seconds, the trailer is only valid until the next batch
+        static constexpr int CHECKPOINT_INTERVAL = 5;
+
     private:
         // From pipp_timestamp.h
         // Copyright (C) 2015 Chris Garry
@@ -29,7 +29,6 @@
 #include "indilogger.h"
 #include "indiutility.h"
 #include "indisinglethreadpool.h"
-#include "indielapsedtimer.h"
 
 #include <cerrno>
 #include <sys/stat.h>
@@ -130,6 +129,13 @@ bool StreamManagerPrivate::initProperties()
     RecordOptionsNP.fill(getDeviceName(), "RECORD_OPTIONS",
                          "Record Options", STREAM_TAB, IP_RW, 60, IPS_IDLE);
 
+    /* Record I/O */
+    RecordStatsNP[RECORD_STATS_WRITTEN].fill("RECORD_WRITTEN", "Written (MB)",   "%.1f", 0, 1e9, 0, 0);
+    RecordStatsNP[RECORD_STATS_RATE   ].fill("RECORD_RATE",    "Rate (MB/s)",    "%.1f", 0, 1e6, 0, 0);
+    RecordStatsNP[RECORD_STATS_QUEUED ].fill("RECORD_QUEUED",  "Queued (MB)",    "%.1f", 0, 1e6, 0, 0);
+    RecordStatsNP[RECORD_STATS_LATENCY].fill("RECORD_LATENCY", "Max write (ms)", "%.0f", 0, 1e6, 0, 0);
+    RecordStatsNP.fill(getDeviceName(), "RECORD_STATISTICS", "Record I/O", STREAM_TAB, IP_RO, 60, IPS_IDLE);
+
     /* Record Switch */
     RecordStreamSP[RECORD_ON   ].fill("RECORD_ON",          "Record On",         ISS_OFF);
     RecordStreamSP[RECORD_TIME ].fill("RECORD_DURATION_ON", "Record (Duration)", ISS_OFF);
@@ -173,6 +179,11 @@ bool StreamManagerPrivate::initProperties()
     LimitsNP[LIMITS_BUFFER_MAX ].fill("LIMITS_BUFFER_MAX",  "Maximum Buffer Size (MB)", "%.0f", 1, 1024 * 64, 1, 512);
     LimitsNP[LIMITS_PREVIEW_FPS].fill("LIMITS_PREVIEW_FPS", "Maximum Preview FPS",      "%.0f", 1, 120,     1,  10);
     LimitsNP.fill(getDeviceName(), "LIMITS", "Limits", STREAM_TAB, IP_RW, 0, IPS_IDLE);
+
+    // Preview of frames deeper than 8 bits
+    PreviewCurveSP[PREVIEW_CURVE_GAMMA ].fill("GAMMA",  "Gamma",  ISS_ON);
+    PreviewCurveSP[PREVIEW_CURVE_LINEAR].fill("LINEAR", "Linear", ISS_OFF);
+    PreviewCurveSP.fill(getDeviceName(), "STREAM_PREVIEW_CURVE", "Preview Curve", STREAM_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
     return true;
 }
 
@@ -196,10 +207,12 @@ void StreamManagerPrivate::ISGetProperties(const char *dev)
         currentDevice->defineProperty(RecordStreamSP);
         currentDevice->defineProperty(RecordFileTP);
         currentDevice->defineProperty(RecordOptionsNP);
+        currentDevice->defineProperty(RecordStatsNP);
         currentDevice->defineProperty(StreamFrameNP);
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(PreviewCurveSP);
     }
 }
 
@@ -230,10 +243,12 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->defineProperty(RecordStreamSP);
         currentDevice->defineProperty(RecordFileTP);
         currentDevice->defineProperty(RecordOptionsNP);
+        currentDevice->defineProperty(RecordStatsNP);
         currentDevice->defineProperty(StreamFrameNP);
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(PreviewCurveSP);
     }
     else
     {
@@ -245,10 +260,12 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->deleteProperty(RecordFileTP.getName());
         currentDevice->deleteProperty(RecordStreamSP.getName());
         currentDevice->deleteProperty(RecordOptionsNP.getName());
+        currentDevice->deleteProperty(RecordStatsNP.getName());
         currentDevice->deleteProperty(StreamFrameNP.getName());
         currentDevice->deleteProperty(EncoderSP.getName());
         currentDevice->deleteProperty(RecorderSP.getName());
         currentDevice->deleteProperty(LimitsNP.getName());
+        currentDevice->deleteProperty(PreviewCurveSP.getName());
     }
 
     return true;
@@ -266,13 +283,23 @@ bool StreamManager::updateProperties()
  * Therefore nbytes is expected to be SubW/BinX * SubH/BinY * Bytes_Per_Pixels * Number_Color_Components
  * Binned frame must be sent from the camera driver for this to work consistentaly for all drivers.*/
 void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t timestamp)
+{
+    uint8_t *frame = acquireFrame(nbytes);
+    if (frame == nullptr)
+        return;
+
+    memcpy(frame, buffer, nbytes); // the only copy, into the reused slot buffer
+    publishFrame(timestamp);
+}
+
+uint8_t *StreamManagerPrivate::acquireFrame(uint32_t nbytes)
 {
     // close the data stream on the same thread as the data stream
     // manually triggered to stop recording.
     if (isRecordingAboutToClose)
     {
         stopRecording();
-        return;
+        return nullptr;
     }
 
     // Discard every N frame.
@@ -284,7 +311,7 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uin
         (frameCountDivider % static_cast<int>(StreamExposureNP[STREAM_DIVISOR].getValue())) == 0
     )
     {
-        return;
+        return nullptr;
     }
 
     if (FPSAverage.newFrame())
@@ -303,20 +330,38 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uin
         }).detach();
     }
 
-    if (isStreaming || (isRecording && !isRecordingAboutToClose))
-    {
-        size_t allocatedSize = nbytes * framesIncoming.size() / 1024 / 1024; // allocated size in MB
-        if (allocatedSize > LimitsNP[LIMITS_BUFFER_MAX].getValue())
-        {
-            LOG_WARN("Frame buffer is full, skipping frame...");
-            return;
-        }
+    if (!(isStreaming || (isRecording && !isRecordingAboutToClose)))
+        return nullptr;
 
-        std::vector<uint8_t> copyBuffer(buffer, buffer + nbytes); // copy the frame
+    size_t allocatedSize = nbytes * framesIncoming.size() / 1024 / 1024; // allocated size in MB
+    if (allocatedSize > LimitsNP[LIMITS_BUFFER_MAX].getValue())
+    {
+        LOG_WARN("Frame buffer is full, skipping frame...");
+        return nullptr;
+    }
 
-        framesIncoming.push(TimeFrame{FPSFast.deltaTime(), timestamp, std::move(copyBuffer)}); // push it into the queue
+    acquiredFrame = framesIncoming.acquire();
+    if (acquiredFrame == nullptr)
+    {
+        LOG_WARN("Frame buffer is full, skipping frame...");
+        return nullptr;
     }
 
+    acquiredFrame->time = FPSFast.deltaTime();
+    framesSpare.take(acquiredFrame->frame, nbytes); // reuses a processed frame buffer
+    acquiredFrame->frame.resize(nbytes);
+    return acquiredFrame->frame.data();
+}
+
+void StreamManagerPrivate::publishFrame(uint64_t timestamp)
+{
+    if (acquiredFrame == nullptr)
+        return;
+
+    acquiredFrame->timestamp = timestamp;
+    acquiredFrame = nullptr;
+    framesIncoming.publish(); // hand it over to the stream thread
+
     if (isRecording && !isRecordingAboutToClose)
     {
         FPSRecorder.newFrame(); // count frames and total time
@@ -353,6 +398,18 @@ void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t t
     d->newFrame(buffer, nbytes, timestamp);
 }
 
+uint8_t *StreamManager::acquireFrame(uint32_t nbytes)
+{
+    D_PTR(StreamManager);
+    return d->acquireFrame(nbytes);
+}
+
+void StreamManager::publishFrame(uint64_t timestamp)
+{
+    D_PTR(StreamManager);
+    d->publishFrame(timestamp);
+}
+
 
 StreamManagerPrivate::FrameInfo StreamManagerPrivate::updateSourceFrameInfo()
 {
@@ -416,88 +473,123 @@ void StreamManagerPrivate::subframe(
 
 void StreamManagerPrivate::asyncStreamThread()
 {
-    TimeFrame sourceTimeFrame;
-    sourceTimeFrame.time = 0;
-
-    std::vector<uint8_t> subframeBuffer;  // Subframe buffer for recording/streaming
-    std::vector<uint8_t> downscaleBuffer; // Downscale buffer for streaming
+    std::vector<uint8_t> subframeBuffer;     // Subframe buffer for recording
+    std::vector<uint8_t> previewBuffers[2];  // Preview buffers, the preview thread may still upload one of them
+    size_t previewIndex = 0;
 
     INDI::SingleThreadPool previewThreadPool;
-    INDI::ElapsedTimer previewElapsed;
 
     while(!framesThreadTerminate)
     {
-        if (framesIncoming.pop(sourceTimeFrame) == false)
+        TimeFrame *sourceTimeFrame = framesIncoming.front(100);
+        if (sourceTimeFrame == nullptr)
             continue;
 
         FrameInfo srcFrameInfo = updateSourceFrameInfo();
 
-        std::vector<uint8_t> *sourceBuffer = &sourceTimeFrame.frame;
+        const std::vector<uint8_t> *sourceBuffer = &sourceTimeFrame->frame;
 
         if (PixelFormat != INDI_JPG && sourceBuffer->size() != srcFrameInfo.totalSize())
         {
             LOG_ERROR("Invalid source buffer size, skipping frame...");
+            framesSpare.give(sourceTimeFrame->frame);
+            framesIncoming.release();
             continue;
         }
 
-        // Check if we need to subframe
-        if (
-            PixelFormat != INDI_JPG &&
-            dstFrameInfo.pixels() != 0 &&
-            dstFrameInfo != srcFrameInfo
-        )
+        // Rows of the streamed frame in the source buffer, the whole buffer for JPEG
+        const uint8_t *frameData = sourceBuffer->data();
+        size_t frameStride = sourceBuffer->size();
+        size_t frameLine = frameStride;
+        size_t frameRows = 1;
+        bool isSubframe = false;
+
+        if (PixelFormat != INDI_JPG)
         {
-            subframeBuffer.resize(dstFrameInfo.totalSize());
-            subframe(sourceBuffer->data(), srcFrameInfo, subframeBuffer.data(), dstFrameInfo);
+            frameStride = frameLine = srcFrameInfo.lineSize();
+            frameRows = srcFrameInfo.h;
 
-            sourceBuffer = &subframeBuffer;
+            // Check if we need to subframe
+            if (dstFrameInfo.pixels() != 0 && dstFrameInfo != srcFrameInfo)
+            {
+                frameData += srcFrameInfo.bytesPerColor * (dstFrameInfo.y * srcFrameInfo.w + dstFrameInfo.x);
+                frameLine = dstFrameInfo.lineSize();
+                frameRows = dstFrameInfo.h;
+                isSubframe = true;
+            }
         }
 
         // For recording, save immediately.
         {
             std::lock_guard<std::mutex> lock(recordMutex);
-            if (
-                isRecording && !isRecordingAboutToClose &&
-                recordStream(sourceBuffer->data(), sourceBuffer->size(), sourceTimeFrame.time, sourceTimeFrame.timestamp) == false
-            )
+            if (isRecording && !isRecordingAboutToClose)
             {
-                LOG_ERROR("Recording failed.");
-                isRecordingAboutToClose = true;
+                // Recorders take packed frames
+                if (isSubframe)
+                {
+                    subframeBuffer.resize(dstFrameInfo.totalSize());
+                    subframe(sourceBuffer->data(), srcFrameInfo, subframeBuffer.data(), dstFrameInfo);
+                    sourceBuffer = &subframeBuffer;
+                }
+
+                if (recordStream(sourceBuffer->data(), sourceBuffer->size(), sourceTimeFrame->time, sourceTimeFrame->timestamp) == false)
+                {
+                    LOG_ERROR("Recording failed.");
+                    isRecordingAboutToClose = true;
+                }
             }
+
+            if (isRecording && recordStatsElapsed.hasExpired(1000))
+                updateRecordStatistics(IPS_BUSY);
         }
 
         // For streaming, downscale to 8bit if higher than 8bit to reduce bandwidth
         // You can reduce the number of frames by setting a frame limit.
         if (isStreaming && FPSPreview.newFrame())
         {
+            std::vector<uint8_t> &previewBuffer = previewBuffers[previewIndex];
+
             // Downscale to 8bit always for streaming to reduce bandwidth
             if (PixelFormat != INDI_JPG && PixelDepth > 8)
             {
-                // Allocale new buffer if size changes
-                downscaleBuffer.resize(dstFrameInfo.pixels());
-
-                // Apply gamma
-                gammaLut16.apply(
-                    reinterpret_cast<const uint16_t*>(sourceBuffer->data()),
-                    downscaleBuffer.size(),
-                    downscaleBuffer.data()
-                );
+                // Convert the rows of the frame straight into the preview buffer, reallocated if the size changes
+                const uint16_t *samples = reinterpret_cast<const uint16_t*>(frameData);
+                size_t lineSamples = frameLine / 2;
+                previewBuffer.resize(lineSamples * frameRows);
 
-                sourceBuffer = &downscaleBuffer;
+                if (isPreviewLinear)
+                    GammaLut16::shift(samples, lineSamples, frameRows, frameStride / 2, previewBuffer.data(), PixelDepth);
+                else
+                    gammaLut16.apply(samples, lineSamples, frameRows, frameStride / 2, previewBuffer.data());
+            }
+            else if (frameLine == frameStride)
+            {
+                previewBuffer.assign(frameData, frameData + frameLine * frameRows);
+            }
+            else
+            {
+                previewBuffer.resize(frameLine * frameRows);
+                for (size_t row = 0; row < frameRows; ++row)
+                    memcpy(previewBuffer.data() + row * frameLine, frameData + row * frameStride, frameLine);
             }
 
-            //uploadStream(sourceBuffer->data(), sourceBuffer->size());
-            previewThreadPool.start(std::bind([this, &previewElapsed](const std::atomic_bool & isAboutToQuit,
-                                              std::vector<uint8_t> frame)
+            // Skip the preview if the previous one is still uploading, do not hold up recording.
+            //uploadStream(previewBuffer.data(), previewBuffer.size());
+            bool started = previewThreadPool.tryStart([this, &previewBuffer](const std::atomic_bool & isAboutToQuit)
             {
                 INDI_UNUSED(isAboutToQuit);
                 previewElapsed.start();
-                uploadStream(frame.data(), frame.size());
+                uploadStream(previewBuffer.data(), previewBuffer.size());
                 StreamTimeNP[0].setValue(previewElapsed.nsecsElapsed() / 1000000000.0);
                 StreamTimeNP.apply();
+            });
 
-            }, std::placeholders::_1, std::move(*sourceBuffer)));
+            if (started)
+                previewIndex ^= 1;
         }
+
+        framesSpare.give(sourceTimeFrame->frame);
+        framesIncoming.release(); // give the slot back to newFrame
     }
 }
 
@@ -597,6 +689,22 @@ bool StreamManagerPrivate::recordStream(const uint8_t * buffer, uint32_t nbytes,
     return recorder->writeFrame(buffer, nbytes, timestamp);
 }
 
+void StreamManagerPrivate::updateRecordStatistics(IPState state)
+{
+    RecorderInterface::Statistics stats = recorder->getStatistics();
+    double seconds = recordStatsElapsed.restart() / 1000.0;
+
+    RecordStatsNP[RECORD_STATS_WRITTEN].setValue(stats.bytesWritten / 1048576.0);
+    if (seconds > 0)
+        RecordStatsNP[RECORD_STATS_RATE].setValue((stats.bytesWritten - recordStatsBytes) / 1048576.0 / seconds);
+    RecordStatsNP[RECORD_STATS_QUEUED].setValue(stats.bytesQueued / 1048576.0);
+    RecordStatsNP[RECORD_STATS_LATENCY].setValue(stats.maxWriteLatency);
+    RecordStatsNP.setState(state);
+    RecordStatsNP.apply();
+
+    recordStatsBytes = stats.bytesWritten;
+}
+
 std::string StreamManagerPrivate::expand(const std::string &fname, const std::map<std::string, std::string> &patterns)
 {
     std::string result = fname;
@@ -666,6 +774,14 @@ bool StreamManagerPrivate::startRecording()
                   strerror(errno));
         return false;
     }
+    // Let the recorder reserve the file when the size of the record is known
+    uint32_t expectedFrames = 0;
+    if (RecordStreamSP[RECORD_FRAME].getState() == ISS_ON)
+        expectedFrames = RecordOptionsNP[1].getValue();
+    else if (RecordStreamSP[RECORD_TIME].getState() == ISS_ON)
+        expectedFrames = std::min<double>(RecordOptionsNP[0].getValue() * FpsNP[FPS_AVERAGE].getValue(), UINT32_MAX);
+    recorder->setExpectedFrames(expectedFrames);
+
     if (!recorder->open(filename.c_str(), errmsg))
     {
         RecordStreamSP.setState(IPS_ALERT);
@@ -695,6 +811,9 @@ bool StreamManagerPrivate::startRecording()
     FPSRecorder.reset();
     frameCountDivider = 0;
 
+    recordStatsBytes = 0;
+    recordStatsElapsed.start();
+
     if (isStreaming == false)
     {
         FPSAverage.reset();
@@ -750,6 +869,7 @@ bool StreamManagerPrivate::stopRecording(bool force)
     {
         std::lock_guard<std::mutex> lock(recordMutex);
         recorder->close();
+        updateRecordStatistics(IPS_OK);
     }
 
     if (force)
@@ -870,6 +990,16 @@ bool StreamManagerPrivate::ISNewSwitch(const char * dev, const char * name, ISSt
         return true;
     }
 
+    // Preview Curve
+    if (PreviewCurveSP.isNameMatch(name))
+    {
+        PreviewCurveSP.update(states, names, n);
+        isPreviewLinear = PreviewCurveSP[PREVIEW_CURVE_LINEAR].getState() == ISS_ON;
+        PreviewCurveSP.setState(IPS_OK);
+        PreviewCurveSP.apply();
+        return true;
+    }
+
     // Recorder Selection
     if (RecorderSP.isNameMatch(name))
     {
@@ -1140,6 +1270,7 @@ bool StreamManager::saveConfigItems(FILE * fp)
     d->RecordOptionsNP.save(fp);
     d->RecorderSP.save(fp);
     d->LimitsNP.save(fp);
+    d->PreviewCurveSP.save(fp);
     return true;
 }
 
@@ -117,6 +117,21 @@ class StreamManager
          */
         void newFrame(const uint8_t *buffer, uint32_t nbytes, uint64_t timestamp = 0);
 
+        /**
+         * @brief acquireFrame Same as newFrame, but the driver writes the frame directly into the stream frame pool.
+         * Use it when the frame has to be converted or cropped anyway, the conversion then produces the streamed frame
+         * without an intermediate buffer. Every buffer returned must be handed over with publishFrame before the
+         * next frame is acquired.
+         * @param nbytes size of the frame.
+         * @return Buffer of nbytes to fill, or nullptr when the frame is not needed, skip publishFrame then.
+         */
+        uint8_t *acquireFrame(uint32_t nbytes);
+
+        /**
+         * @brief publishFrame Stream or record the frame filled since acquireFrame.
+         */
+        void publishFrame(uint64_t timestamp = 0);
+
         bool close();
 
     public:
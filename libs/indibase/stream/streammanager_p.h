@@ -27,8 +27,9 @@
 #include "recorder/recordermanager.h"
 #include "encoder/encodermanager.h"
 #include "fpsmeter.h"
-#include "uniquequeue.h"
+#include "framering.h"
 #include "gammalut16.h"
+#include "indielapsedtimer.h"
 
 #include <atomic>
 #include <string>
@@ -111,6 +112,8 @@ class StreamManagerPrivate
         bool ISNewNumber(const char * dev, const char * name, double values[], char * names[], int n);
 
         void newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t timestamp);
+        uint8_t *acquireFrame(uint32_t nbytes);
+        void publishFrame(uint64_t timestamp);
 
         bool updateProperties();
         bool setStream(bool enable);
@@ -147,6 +150,7 @@ class StreamManagerPrivate
          * @param deltams time in milliseconds since last frame
          */
         bool recordStream(const uint8_t *buffer, uint32_t nbytes, double deltams, uint64_t timestamp);
+        void updateRecordStatistics(IPState state);
 
         void getStreamFrame(uint16_t * x, uint16_t * y, uint16_t * w, uint16_t * h) const;
         void setStreamFrame(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
@@ -198,6 +202,10 @@ class StreamManagerPrivate
         /* Record Options */
         INDI::PropertyNumber RecordOptionsNP {2};
 
+        /* Record I/O */
+        INDI::PropertyNumber RecordStatsNP {4};
+        enum { RECORD_STATS_WRITTEN, RECORD_STATS_RATE, RECORD_STATS_QUEUED, RECORD_STATS_LATENCY };
+
         // Stream Frame
         INDI::PropertyNumber StreamFrameNP {4};
 
@@ -216,9 +224,14 @@ class StreamManagerPrivate
         INDI::PropertyNumber LimitsNP {2};
         enum { LIMITS_BUFFER_MAX, LIMITS_PREVIEW_FPS };
 
+        // Conversion of frames deeper than 8 bits for the preview
+        INDI::PropertySwitch PreviewCurveSP {2};
+        enum { PREVIEW_CURVE_GAMMA, PREVIEW_CURVE_LINEAR };
+
         std::atomic<bool> isStreaming { false };
         std::atomic<bool> isRecording { false };
         std::atomic<bool> isRecordingAboutToClose { false };
+        std::atomic<bool> isPreviewLinear { false };
         bool hasStreamingExposure { true };
 
         // Recorder
@@ -252,14 +265,24 @@ class StreamManagerPrivate
             std::vector<uint8_t> frame;
         } TimeFrame;
 
+        // Incoming frames are copied into preallocated slots, the number of queued bytes is limited by LIMITS_BUFFER_MAX.
+        // The slot buffers go back to the driver through a few spares, a slot does not keep its buffer.
+        static constexpr size_t  FRAMES_INCOMING_SLOTS = 1024;
+        static constexpr size_t  FRAMES_SPARE_BUFFERS  = 4;
+
         std::thread              framesThread;   // async incoming frames processing
         std::atomic<bool>        framesThreadTerminate {false};
-        UniqueQueue<TimeFrame>   framesIncoming;
+        FrameRing<TimeFrame>     framesIncoming {FRAMES_INCOMING_SLOTS};
+        FrameBufferPool          framesSpare {FRAMES_SPARE_BUFFERS};
+        TimeFrame               *acquiredFrame = nullptr; // slot filled by the driver between acquireFrame and publishFrame
 
         std::mutex               fastFPSUpdate;
         std::mutex               recordMutex;
 
         GammaLut16               gammaLut16;
+        INDI::ElapsedTimer       previewElapsed; // used by the preview thread only
+        INDI::ElapsedTimer       recordStatsElapsed; // under recordMutex
+        uint64_t                 recordStatsBytes = 0;
 };
 
 }
@@ -371,6 +371,7 @@ int V4L2_Base::connectCam(const char * devpath, char * errmsg, int pixelFormat,
     cancrop               = true;
     cansetrate            = true;
     streamedonce          = false;
+    io                    = requestedIO;
     frameRate.numerator   = 1;
     frameRate.denominator = 25;
 
@@ -449,19 +450,18 @@ bool V4L2_Base::isLXmodCapable()
  * method for the device, and forward the frame read to the configured
  * decoder and/or recorder.
  *
- * With the MMAP method, the first available buffer is dequeued to read
- * the embedded frame. If the frame is marked erroneous by the driver, or
- * the frame is known to be uncompressed but its length doesn't match the
- * expected size, the buffer is re-enqueued immediately.
+ * With the MMAP and USERPTR methods, the first available buffer is dequeued
+ * to read the embedded frame. If the frame is marked erroneous by the driver,
+ * or the frame is known to be uncompressed but its length doesn't match the
+ * expected size, the buffer is re-enqueued immediately. Otherwise the buffer
+ * stays dequeued while the callback runs, so that the callback may use the
+ * frame in place with getFrameView(), and is decoded only if it did not.
+ * USERPTR buffers are page-aligned cached memory allocated by us, which is
+ * faster to read than the MMAP buffers of some drivers.
  *
- * Although only the MMAP method is actually supported, two other methods
- * are also implemented:
- * - With the READ method, the frame is read directly from the device
+ * With the READ method, the frame is read directly from the device
  * descriptor, using the first buffer characteristics are address and
  * length. But no processing is done actually.
- * - With the USERPTR method, the first available buffer is dequeued, then
- * verified against the buffer list. No processing is done actually, and
- * the buffer is immediately requeued.
  *
  * @param errmsg is the error message updated in case of error.
  * @return 0 if frame read is processed, or -1 with error message updated.
@@ -469,6 +469,7 @@ bool V4L2_Base::isLXmodCapable()
 int V4L2_Base::read_frame(char * errmsg)
 {
     unsigned int i;
+    bool requeue = true;
     //cerr << "in read Frame" << endl;
 
     switch (io)
@@ -492,11 +493,13 @@ int V4L2_Base::read_frame(char * errmsg)
             break;
 
         case IO_METHOD_MMAP:
-            DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: using MMAP to recover frame buffer", __FUNCTION__);
+        case IO_METHOD_USERPTR:
+            DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: using %s to recover frame buffer", __FUNCTION__,
+                         io == IO_METHOD_MMAP ? "MMAP" : "USERPTR");
             CLEAR(buf);
 
             buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
+            buf.memory = io == IO_METHOD_MMAP ? V4L2_MEMORY_MMAP : V4L2_MEMORY_USERPTR;
 
             /* For debugging purposes */
             if (false)
@@ -629,12 +632,10 @@ int V4L2_Base::read_frame(char * errmsg)
             /* TODO: there is probably a better error handling than asserting the buffer index */
             assert(buf.index < n_buffers);
 
+            /* Decoding is deferred until the callback asks for the frame, it may rather use it in place with
+             * getFrameView() while the buffer is dequeued */
             if (dodecode)
-            {
-                DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: [%p] decoding %d-byte buffer %p cropset %c",
-                             __FUNCTION__, decoder, buf.bytesused, buffers[buf.index].start, cropset ? 'Y' : 'N');
-                decoder->decode((unsigned char *)(buffers[buf.index].start), &buf, m_Native);
-            }
+                pendingFrame = (unsigned char *)(buffers[buf.index].start);
 
             /*
             if (dorecord)
@@ -647,54 +648,32 @@ int V4L2_Base::read_frame(char * errmsg)
 
             //DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG,"lxstate is %d, dropFrame %c\n", lxstate, (dropFrame?'Y':'N'));
 
-            /* Requeue buffer */
-            if (-1 == XIOCTL(fd, VIDIOC_QBUF, &buf))
-                return errno_exit("ReadFrame IO_METHOD_MMAP: VIDIOC_QBUF", errmsg);
-
             if (lxstate == LX_ACTIVE)
             {
+                unsigned int starts = streamStarts;
+
                 /* Call provided callback function if any */
                 //if (callback && !dorecord)
                 if (callback)
                     (*callback)(uptr);
-            }
 
-            if (lxstate == LX_TRIGGERED)
-                lxstate = LX_ACTIVE;
-
-            break;
-
-        case IO_METHOD_USERPTR:
-            cerr << "in read Frame method userptr" << endl;
-            CLEAR(buf);
-
-            buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_USERPTR;
-
-            if (-1 == XIOCTL(fd, VIDIOC_DQBUF, &buf))
-            {
-                switch (errno)
-                {
-                    case EAGAIN:
-                        return 0;
-                    case EIO:
-                    /* Could ignore EIO, see spec. */
-                    /* fall through */
-                    default:
-                        errno_exit("VIDIOC_DQBUF", errmsg);
-                }
+                /* The callback stopped the stream, STREAMOFF dequeued all buffers, or restarted it and queued them all */
+                if (!streamactive || streamStarts != starts)
+                    requeue = false;
             }
 
-            for (i = 0; i < n_buffers; ++i)
-                if (buf.m.userptr == (unsigned long)buffers[i].start && buf.length == buffers[i].length)
-                    break;
+            /* The decoder buffers always hold the last frame, unless the callback used it in place */
+            if (!frameViewUsed)
+                decodePending();
+            pendingFrame  = nullptr;
+            frameViewUsed = false;
 
-            assert(i < n_buffers);
-
-            //process_image ((void *) buf.m.userptr);
+            /* Requeue buffer */
+            if (requeue && -1 == XIOCTL(fd, VIDIOC_QBUF, &buf))
+                return errno_exit("ReadFrame: VIDIOC_QBUF", errmsg);
 
-            if (-1 == XIOCTL(fd, VIDIOC_QBUF, &buf))
-                errno_exit("ReadFrame IO_METHOD_USERPTR: VIDIOC_QBUF", errmsg);
+            if (lxstate == LX_TRIGGERED)
+                lxstate = LX_ACTIVE;
 
             break;
     }
@@ -785,23 +764,37 @@ int V4L2_Base::start_capturing(char * errmsg)
 
                 buf.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                 buf.memory    = V4L2_MEMORY_USERPTR;
+                buf.index     = i;
                 buf.m.userptr = (unsigned long)buffers[i].start;
                 buf.length    = buffers[i].length;
 
                 if (-1 == XIOCTL(fd, VIDIOC_QBUF, &buf))
-                    return errno_exit("StartCapturing IO_METHOD_USERPTR: VIDIOC_QBUF", errmsg);
+                    break;
             }
 
             type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-            if (-1 == XIOCTL(fd, VIDIOC_STREAMON, &type))
-                return errno_exit("VIDIOC_STREAMON", errmsg);
+            /* Some drivers accept REQBUFS for user pointers but not the buffers themselves */
+            if (i < n_buffers || -1 == XIOCTL(fd, VIDIOC_STREAMON, &type))
+            {
+                DEBUGFDEVICE(deviceName, INDI::Logger::DBG_SESSION,
+                             "%.*s failed to stream user pointer buffers (%s), using memory mapping",
+                             (int)sizeof(dev_name), dev_name, strerror(errno));
+                if (userp_to_mmap(errmsg) == -1)
+                    return -1;
+                streamedonce = true;
+                return start_capturing(errmsg);
+            }
+
+            selectCallBackID = IEAddCallback(fd, newFrame, this);
+            streamactive     = true;
 
             break;
     }
     //if (dropFrameEnabled)
     //dropFrame = dropFrameCount;
     streamedonce = true;
+    streamStarts++;
     return 0;
 }
 
@@ -922,10 +915,9 @@ int V4L2_Base::init_mmap(char * errmsg)
     return 0;
 }
 
-void V4L2_Base::init_userp(unsigned int buffer_size)
+int V4L2_Base::init_userp(unsigned int buffer_size, char * errmsg)
 {
     struct v4l2_requestbuffers req;
-    char errmsg[ERRMSGSIZ];
 
     CLEAR(req);
 
@@ -937,34 +929,64 @@ void V4L2_Base::init_userp(unsigned int buffer_size)
     {
         if (EINVAL == errno)
         {
-            fprintf(stderr, "%.*s does not support user pointer i/o\n", (int)sizeof(dev_name), dev_name);
-            exit(EXIT_FAILURE);
+            DEBUGFDEVICE(deviceName, INDI::Logger::DBG_SESSION,
+                         "%.*s does not support user pointer i/o, using memory mapping", (int)sizeof(dev_name), dev_name);
+            io = IO_METHOD_MMAP;
+            return init_mmap(errmsg);
         }
         else
         {
-            errno_exit("VIDIOC_REQBUFS", errmsg);
+            return errno_exit("VIDIOC_REQBUFS", errmsg);
         }
     }
 
-    buffers = (buffer *)calloc(4, sizeof(*buffers));
+    buffers = (buffer *)calloc(req.count, sizeof(*buffers));
 
     if (!buffers)
     {
-        fprintf(stderr, "Out of memory\n");
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "buffers. Out of memory\n");
+        strncpy(errmsg, "buffers. Out of memory\n", ERRMSGSIZ);
+        return -1;
     }
 
-    for (n_buffers = 0; n_buffers < 4; ++n_buffers)
-    {
-        buffers[n_buffers].length = buffer_size;
-        buffers[n_buffers].start  = malloc(buffer_size);
+    /* Page-aligned, so that the driver can pin the pages for DMA */
+    long const page_size = sysconf(_SC_PAGESIZE);
+    size_t const length  = (buffer_size + page_size - 1) & ~(page_size - 1);
 
-        if (!buffers[n_buffers].start)
+    for (n_buffers = 0; n_buffers < req.count; ++n_buffers)
+    {
+        buffers[n_buffers].length = length;
+        if (posix_memalign(&buffers[n_buffers].start, page_size, length) != 0)
         {
-            fprintf(stderr, "Out of memory\n");
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "buffers. Out of memory\n");
+            strncpy(errmsg, "buffers. Out of memory\n", ERRMSGSIZ);
+            return -1;
         }
     }
+
+    return 0;
+}
+
+/* Release the user pointer buffers and map the driver buffers instead */
+int V4L2_Base::userp_to_mmap(char * errmsg)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    struct v4l2_requestbuffers req;
+
+    XIOCTL(fd, VIDIOC_STREAMOFF, &type);
+
+    CLEAR(req);
+    req.count  = 0;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_USERPTR;
+    XIOCTL(fd, VIDIOC_REQBUFS, &req);
+
+    uninit_device(errmsg);
+    buffers   = nullptr;
+    n_buffers = 0;
+
+    io = IO_METHOD_MMAP;
+    return init_mmap(errmsg);
 }
 
 int V4L2_Base::check_device(char * errmsg)
@@ -1326,7 +1348,7 @@ int V4L2_Base::init_device(char * errmsg)
             break;
 
         case IO_METHOD_USERPTR:
-            init_userp(fmt.fmt.pix.sizeimage);
+            return init_userp(fmt.fmt.pix.sizeimage, errmsg);
             break;
     }
     return 0;
@@ -1940,33 +1962,59 @@ void V4L2_Base::setColorProcessing(bool quantization, bool colorconvert, bool li
     bpp = decoder->getBpp();
 }
 
+void V4L2_Base::decodePending()
+{
+    if (pendingFrame == nullptr)
+        return;
+
+    DEBUGFDEVICE(deviceName, INDI::Logger::DBG_DEBUG, "%s: [%p] decoding %d-byte buffer %p cropset %c",
+                 __FUNCTION__, decoder, buf.bytesused, pendingFrame, cropset ? 'Y' : 'N');
+    decoder->decode(pendingFrame, &buf, m_Native);
+    pendingFrame = nullptr;
+}
+
+bool V4L2_Base::getFrameView(V4L2_FrameView &view)
+{
+    if (pendingFrame == nullptr || !decoder->getYView(pendingFrame, &buf, view))
+        return false;
+
+    frameViewUsed = true;
+    return true;
+}
+
 unsigned char * V4L2_Base::getY()
 {
+    decodePending();
     return decoder->getY();
 }
 
 unsigned char * V4L2_Base::getU()
 {
+    decodePending();
     return decoder->getU();
 }
 
 unsigned char * V4L2_Base::getV()
 {
+    decodePending();
     return decoder->getV();
 }
 
 unsigned char * V4L2_Base::getMJPEGBuffer(int &size)
 {
+    decodePending();
     return decoder->getMJPEGBuffer(size);
 }
 
 unsigned char * V4L2_Base::getRGBBuffer()
 {
+    decodePending();
     return decoder->getRGBBuffer();
 }
 
 float * V4L2_Base::getLinearY()
 {
+    decodePending();
     return decoder->getLinearY();
 }
 
@@ -89,6 +89,8 @@ class V4L2_Base
         int getHeight();
         int getBpp();
         void setNative(bool value) {m_Native = value;}
+        /* Memory of the capture buffers, IO_METHOD_MMAP or IO_METHOD_USERPTR, used from the next connection */
+        void setIOMethod(io_method method) {requestedIO = method;}
         virtual int setSize(int x, int y);
         virtual void getMaxMinSize(int &x_max, int &y_max, int &x_min, int &y_min);
 
@@ -102,6 +104,9 @@ class V4L2_Base
         unsigned char * getMJPEGBuffer(int &size);
         unsigned char *getRGBBuffer();
         float *getLinearY();
+        /* From the frame callback only: the Y plane of the frame still in the capture buffer, cropped, for
+         * formats that need no decoding. The decoder buffers are then not updated for this frame. */
+        bool getFrameView(V4L2_FrameView &view);
 
         void registerCallback(WPF *fp, void *ud);
 
@@ -166,7 +171,9 @@ class V4L2_Base
         int errno_exit(const char *s, char *errmsg);
 
         void close_device();
-        void init_userp(unsigned int buffer_size);
+        int init_userp(unsigned int buffer_size, char *errmsg);
+        int userp_to_mmap(char *errmsg);
+        void decodePending();
         void init_read(unsigned int buffer_size);
 
         void findMinMax();
@@ -206,6 +213,10 @@ class V4L2_Base
         const char *path;
         bool m_Native {false};
         io_method io;
+        io_method requestedIO {IO_METHOD_MMAP};
+        unsigned char *pendingFrame {nullptr}; /* dequeued frame not decoded yet */
+        bool frameViewUsed {false};
+        unsigned int streamStarts {0}; /* start_capturing() calls, a restarted stream queued all buffers again */
         int fd;
         struct buffer *buffers;
         unsigned int n_buffers;
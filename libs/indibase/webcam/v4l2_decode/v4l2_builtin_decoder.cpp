@@ -487,6 +487,38 @@ void V4L2_Builtin_Decoder::decode(unsigned char *frame, struct v4l2_buffer *buf,
     }
 }
 
+bool V4L2_Builtin_Decoder::getYView(unsigned char *frame, struct v4l2_buffer *buf, V4L2_FrameView &view)
+{
+    (void)buf;
+
+    if (doLinearization)
+        return false;
+
+    switch (fmt.fmt.pix.pixelformat)
+    {
+        case V4L2_PIX_FMT_GREY:
+            if (doQuantization && getQuantization(&fmt) == QUANTIZATION_LIM_RANGE)
+                return false;
+            view.bpp = 8;
+            break;
+
+        case V4L2_PIX_FMT_Y16:
+            view.bpp = 16;
+            break;
+
+        default:
+            return false;
+    }
+
+    view.stride = fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : fmt.fmt.pix.width * (view.bpp / 8);
+    view.data   = frame;
+    if (useSoftCrop && doCrop)
+        view.data += crop.c.left * (view.bpp / 8) + crop.c.top * view.stride;
+    view.width  = bufwidth;
+    view.height = bufheight;
+    return true;
+}
+
 bool V4L2_Builtin_Decoder::setcrop(struct v4l2_crop c)
 {
     crop = c;
@@ -48,6 +48,7 @@ class V4L2_Builtin_Decoder : public V4L2_Decoder
         virtual bool issupportedformat(unsigned int format);
         virtual const std::vector<unsigned int> &getsupportedformats();
         virtual void decode(unsigned char *frame, struct v4l2_buffer *buf, bool native);
+        virtual bool getYView(unsigned char *frame, struct v4l2_buffer *buf, V4L2_FrameView &view);
         virtual unsigned char *getY();
         virtual unsigned char *getU();
         virtual unsigned char *getV();
@@ -31,6 +31,16 @@
 
 #include <linux/videodev2.h>
 
+/* Y plane of a captured buffer used in place, the crop is an offset and a stride */
+struct V4L2_FrameView
+{
+    const unsigned char *data; /* first pixel of the cropped frame */
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;       /* bytes from one row to the next */
+    unsigned int bpp;          /* 8 or 16 (little endian) bits per pixel */
+};
+
 class V4L2_Decoder
 {
     public:
@@ -46,6 +56,14 @@ class V4L2_Decoder
         virtual bool issupportedformat(unsigned int format)                   = 0;
         virtual const std::vector<unsigned int> &getsupportedformats()        = 0;
         virtual void decode(unsigned char *frame, struct v4l2_buffer *buf, bool native)    = 0;
+        /* Describe the Y plane of frame without decoding it, false if the format needs decode() */
+        virtual bool getYView(unsigned char *frame, struct v4l2_buffer *buf, V4L2_FrameView &view)
+        {
+            (void)frame;
+            (void)buf;
+            (void)view;
+            return false;
+        }
         virtual unsigned char *getY()                                         = 0;
         virtual unsigned char *getU()                                         = 0;
         virtual unsigned char *getV()                                         = 0;
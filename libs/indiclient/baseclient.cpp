@@ -219,6 +219,10 @@ void TcpSocketSharedBlobs::readyRead()
 BaseClientPrivate::BaseClientPrivate(BaseClient *parent)
     : AbstractBaseClientPrivate(parent)
 {
+    // BLOB contents are copied as is by BaseDevicePrivate::setBLOB, no need for base64 on the wire
+    binaryBlobs = true;
+    xmlParser.setRawContent(true);
+
     clientSocket.onData([this](const char *data, size_t size)
     {
         char msg[MAXRBUF];
@@ -36,6 +36,7 @@
 
 #include <ctype.h>
 #include <stdint.h>
+#include <string.h>
 #include "base64.h"
 #include "base64_luts.h"
 #include <stdio.h>
@@ -56,30 +57,286 @@
 
 #define  IS_LITTLE_ENDIAN  (!IS_BIG_ENDIAN)
 
-/* convert inlen raw bytes at in to base64 string (NUL-terminated) at out. 
- * out size should be at least 4*inlen/3 + 4.
- * return length of out (sans trailing NUL).
+/*
+ * SIMD kernels, selected at runtime on x86 (SSSE3 or AVX2) and always used on
+ * 64-bit ARM (NEON). They handle the bulk of the data, the scalar code does the rest.
+ *
+ * Encoders return the number of input bytes converted (a multiple of 3).
+ * Decoders return the number of 4 characters groups converted, stopping before any
+ * block holding something else than base64 digits (line break, padding...), that
+ * the scalar code handles with its usual semantic. They may write up to 8 bytes
+ * past their output, so they leave enough groups for the caller to overwrite them.
  */
-int to64frombits_s(unsigned char *out, const unsigned char *in, int inlen, size_t outlen)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef BASE64_X86
+
+/* split the 3 bytes groups in each 128 bits lane into 6 bits values, one per byte */
+#define ENC_RESHUFFLE(in, mulhi, mullo, and, or, set1) \
+    or(mulhi(and(in, set1(0x0fc0fc00)), set1(0x04000040)), mullo(and(in, set1(0x003f03f0)), set1(0x01000010)))
+
+__attribute__((target("ssse3")))
+static __m128i enc_translate_ssse3(__m128i in)
 {
-    size_t dlen = (((size_t)inlen + 2) / 3) * 4; /* 4/3, rounded up */
+    const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i idx  = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i mask = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
+    idx = _mm_or_si128(idx, _mm_and_si128(mask, _mm_set1_epi8(13)));
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+}
 
-    if (dlen > outlen) {
-        return 0;
+__attribute__((target("ssse3")))
+static int encode_ssse3(unsigned char *out, const unsigned char *in, int inlen)
+{
+    int done = 0;
+
+    /* reads 16 bytes for 12 converted */
+    for (; inlen - done >= 16; done += 12, out += 16)
+    {
+        __m128i str = _mm_loadu_si128((const __m128i *)(in + done));
+        str = _mm_shuffle_epi8(str, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        str = ENC_RESHUFFLE(str, _mm_mulhi_epu16, _mm_mullo_epi16,
+                            _mm_and_si128, _mm_or_si128, _mm_set1_epi32);
+        _mm_storeu_si128((__m128i *)out, enc_translate_ssse3(str));
     }
+    return done;
+}
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-    return to64frombits(out, in, inlen);
-#pragma GCC diagnostic pop
+__attribute__((target("avx2")))
+static int encode_avx2(unsigned char *out, const unsigned char *in, int inlen)
+{
+    const __m256i lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                         'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    int done = 0;
+
+    /* reads 28 bytes for 24 converted */
+    for (; inlen - done >= 28; done += 24, out += 32)
+    {
+        __m256i str = _mm256_inserti128_si256(
+                          _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + done))),
+                          _mm_loadu_si128((const __m128i *)(in + done + 12)), 1);
+        str = _mm256_shuffle_epi8(str, shuffle);
+        str = ENC_RESHUFFLE(str, _mm256_mulhi_epu16, _mm256_mullo_epi16,
+                            _mm256_and_si256, _mm256_or_si256, _mm256_set1_epi32);
+
+        __m256i idx  = _mm256_subs_epu8(str, _mm256_set1_epi8(51));
+        __m256i mask = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), str);
+        idx = _mm256_or_si256(idx, _mm256_and_si256(mask, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(str, _mm256_shuffle_epi8(lut, idx)));
+    }
+    return done + encode_ssse3(out, in + done, inlen - done);
 }
 
-int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
+/* tables to validate and translate base64 digits (see aklomp/base64) */
+#define LUT_LO   0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define LUT_HI   0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define LUT_ROLL 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+
+__attribute__((target("ssse3")))
+static int decode_ssse3(unsigned char *out, const char *in, int ngroups)
+{
+    const __m128i lut_lo   = _mm_setr_epi8(LUT_LO);
+    const __m128i lut_hi   = _mm_setr_epi8(LUT_HI);
+    const __m128i lut_roll = _mm_setr_epi8(LUT_ROLL);
+    const __m128i mask_2F  = _mm_set1_epi8(0x2F);
+    int done = 0;
+
+    /* writes 16 bytes for 12 converted, keep 2 groups after */
+    for (; ngroups - done >= 4 + 2; done += 4, in += 16, out += 12)
+    {
+        __m128i str = _mm_loadu_si128((const __m128i *)in);
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2F);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2F);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+            break;
+
+        __m128i eq_2F = _mm_cmpeq_epi8(str, mask_2F);
+        str = _mm_add_epi8(str, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2F, hi_nibbles)));
+
+        str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+        str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)out, str);
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+static int decode_avx2(unsigned char *out, const char *in, int ngroups)
+{
+    const __m256i lut_lo   = _mm256_setr_epi8(LUT_LO, LUT_LO);
+    const __m256i lut_hi   = _mm256_setr_epi8(LUT_HI, LUT_HI);
+    const __m256i lut_roll = _mm256_setr_epi8(LUT_ROLL, LUT_ROLL);
+    const __m256i mask_2F  = _mm256_set1_epi8(0x2F);
+    int done = 0;
+
+    /* writes 32 bytes for 24 converted, keep 3 groups after */
+    for (; ngroups - done >= 8 + 3; done += 8, in += 32, out += 24)
+    {
+        __m256i str = _mm256_loadu_si256((const __m256i *)in);
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2F);
+        __m256i lo_nibbles = _mm256_and_si256(str, mask_2F);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+
+        __m256i eq_2F = _mm256_cmpeq_epi8(str, mask_2F);
+        str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2F, hi_nibbles)));
+
+        str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+        str = _mm256_shuffle_epi8(str, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        str = _mm256_permutevar8x32_epi32(str, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm256_storeu_si256((__m256i *)out, str);
+    }
+    return done + decode_ssse3(out, in, ngroups - done);
+}
+
+#endif
+
+#ifdef BASE64_NEON
+
+static int encode_neon(unsigned char *out, const unsigned char *in, int inlen)
+{
+    const uint8x16_t mask = vdupq_n_u8(0x3F);
+    int done = 0;
+
+    for (; inlen - done >= 48; done += 48, out += 64)
+    {
+        uint8x16x3_t str = vld3q_u8(in + done);
+        uint8x16x4_t idx;
+
+        idx.val[0] = vshrq_n_u8(str.val[0], 2);
+        idx.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(str.val[0], 4), vshrq_n_u8(str.val[1], 4)), mask);
+        idx.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(str.val[1], 2), vshrq_n_u8(str.val[2], 6)), mask);
+        idx.val[3] = vandq_u8(str.val[2], mask);
+
+        for (int i = 0; i < 4; i++)
+        {
+            /* same offset lookup as the x86 code */
+            const uint8x16_t lut = { 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                     '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 };
+            uint8x16_t sel = vqsubq_u8(idx.val[i], vdupq_n_u8(51));
+            sel = vorrq_u8(sel, vandq_u8(vcltq_u8(idx.val[i], vdupq_n_u8(26)), vdupq_n_u8(13)));
+            idx.val[i] = vaddq_u8(idx.val[i], vqtbl1q_u8(lut, sel));
+        }
+        vst4q_u8(out, idx);
+    }
+    return done;
+}
+
+static int decode_neon(unsigned char *out, const char *in, int ngroups)
+{
+    const uint8x16x4_t lut_lo = { { vld1q_u8(base64values), vld1q_u8(base64values + 16),
+                                    vld1q_u8(base64values + 32), vld1q_u8(base64values + 48) } };
+    const uint8x16x4_t lut_hi = { { vld1q_u8(base64values + 64), vld1q_u8(base64values + 80),
+                                    vld1q_u8(base64values + 96), vld1q_u8(base64values + 112) } };
+    int done = 0;
+
+    for (; ngroups - done >= 16; done += 16, in += 64, out += 48)
+    {
+        uint8x16x4_t str = vld4q_u8((const uint8_t *)in);
+        uint8x16_t bad = vdupq_n_u8(0);
+
+        for (int i = 0; i < 4; i++)
+        {
+            /* characters above 127 give 0 in both tables, flag them apart */
+            uint8x16_t c = str.val[i];
+            str.val[i] = vorrq_u8(vqtbl4q_u8(lut_lo, c), vqtbl4q_u8(lut_hi, vsubq_u8(c, vdupq_n_u8(64))));
+            bad = vorrq_u8(bad, vorrq_u8(str.val[i], vandq_u8(c, vdupq_n_u8(0x80))));
+        }
+        if (vmaxvq_u8(bad) > 63)
+            break;
+
+        uint8x16x3_t res;
+        res.val[0] = vorrq_u8(vshlq_n_u8(str.val[0], 2), vshrq_n_u8(str.val[1], 4));
+        res.val[1] = vorrq_u8(vshlq_n_u8(str.val[1], 4), vshrq_n_u8(str.val[2], 2));
+        res.val[2] = vorrq_u8(vshlq_n_u8(str.val[2], 6), str.val[3]);
+        vst3q_u8(out, res);
+    }
+    return done;
+}
+
+#endif
+
+static int encode_none(unsigned char *out, const unsigned char *in, int inlen)
+{
+    (void)out;
+    (void)in;
+    (void)inlen;
+    return 0;
+}
+
+static int decode_none(unsigned char *out, const char *in, int ngroups)
+{
+    (void)out;
+    (void)in;
+    (void)ngroups;
+    return 0;
+}
+
+static int (*encode_simd)(unsigned char *out, const unsigned char *in, int inlen) = NULL;
+static int (*decode_simd)(unsigned char *out, const char *in, int ngroups) = NULL;
+
+/* pick the best kernels for this cpu */
+static void select_simd()
+{
+    int (*enc)(unsigned char *, const unsigned char *, int) = encode_none;
+    int (*dec)(unsigned char *, const char *, int) = decode_none;
+
+#if defined(BASE64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        enc = encode_avx2;
+        dec = decode_avx2;
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        enc = encode_ssse3;
+        dec = decode_ssse3;
+    }
+#elif defined(BASE64_NEON)
+    enc = encode_neon;
+    dec = decode_neon;
+#endif
+    decode_simd = dec;
+    encode_simd = enc;
+}
+
+/* raw bytes to base64, without trailing NUL */
+static int encode_bits(unsigned char *out, const unsigned char *in, int inlen)
 {
     uint16_t *b64lut = (uint16_t *)base64lut;
     int dlen         = ((inlen + 2) / 3) * 4; /* 4/3, rounded up */
-    uint16_t *wbuf   = (uint16_t *)out;
+    uint16_t *wbuf;
+    int done;
+
+    if (!encode_simd)
+        select_simd();
+    done = encode_simd(out, in, inlen);
+    out += done / 3 * 4;
+    in += done;
+    inlen -= done;
 
+    wbuf = (uint16_t *)out;
     for (; inlen > 2; inlen -= 3)
     {
         uint32_t n = in[0] << 16 | in[1] << 8 | in[2];
@@ -103,7 +360,32 @@ int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
         *out++ = (inlen < 2) ? '=' : base64digits[(in[1] << 2) & 0x3c];
         *out++ = '=';
     }
-    *out = 0; // NULL terminate
+    return dlen;
+}
+
+/* convert inlen raw bytes at in to base64 string (NUL-terminated) at out. 
+ * out size should be at least 4*inlen/3 + 4.
+ * return length of out (sans trailing NUL).
+ */
+int to64frombits_s(unsigned char *out, const unsigned char *in, int inlen, size_t outlen)
+{
+    size_t dlen = (((size_t)inlen + 2) / 3) * 4; /* 4/3, rounded up */
+
+    if (dlen > outlen) {
+        return 0;
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    return to64frombits(out, in, inlen);
+#pragma GCC diagnostic pop
+}
+
+int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
+{
+    int dlen = encode_bits(out, in, inlen);
+
+    out[dlen] = 0; // NULL terminate
     return dlen;
 }
 
@@ -129,10 +411,24 @@ int from64tobits_fast(char *out, const char *in, int inlen)
     int n         = (inlen / 4) - 1;
     uint16_t *inp = (uint16_t *)in;
 
+    if (!decode_simd)
+        select_simd();
+
     for (j = 0; j < n; j++)
     {
         if (in[0] == '\n')
             in++;
+
+        /* as many groups as possible at once, up to the next line break */
+        int done = decode_simd((unsigned char *)out, in, n - j);
+        in += 4 * done;
+        out += 3 * done;
+        j += done;
+        if (j == n)
+            break;
+        if (done && in[0] == '\n')
+            in++;
+
         inp = (uint16_t *)in;
 
         if IS_BIG_ENDIAN {
@@ -265,6 +561,177 @@ int from64tobits_fast_with_bug(char *out, const char *in, int inlen)
     return outlen;
 }
 
+void base64_stream_init(base64_stream *st, int linelen)
+{
+    memset(st, 0, sizeof(*st));
+    st->linelen = linelen > 0 ? linelen / 4 * 4 : 0;
+}
+
+/* encode n bytes (a multiple of 3) at in, breaking lines as configured */
+static unsigned char *stream_put(base64_stream *st, unsigned char *out, const unsigned char *in, int n)
+{
+    while (n > 0)
+    {
+        int len = n;
+
+        if (st->linelen > 0 && len > (st->linelen - st->column) / 4 * 3)
+            len = (st->linelen - st->column) / 4 * 3;
+
+        out += encode_bits(out, in, len);
+        st->column += len / 3 * 4;
+        in += len;
+        n -= len;
+
+        if (st->linelen > 0 && st->column >= st->linelen)
+        {
+            *out++     = '\n';
+            st->column = 0;
+        }
+    }
+    return out;
+}
+
+int to64frombits_stream(base64_stream *st, unsigned char *out, const unsigned char *in, int inlen)
+{
+    unsigned char *start = out;
+    int whole;
+
+    /* complete the group started by the previous call */
+    if (st->ncarry > 0)
+    {
+        while (st->ncarry < 3 && inlen > 0)
+        {
+            st->carry[st->ncarry++] = *in++;
+            inlen--;
+        }
+        if (st->ncarry < 3)
+            return 0;
+        out        = stream_put(st, out, st->carry, 3);
+        st->ncarry = 0;
+    }
+
+    whole = inlen - inlen % 3;
+    out   = stream_put(st, out, in, whole);
+
+    /* keep the rest for the next call */
+    st->ncarry = inlen - whole;
+    memcpy(st->carry, in + whole, st->ncarry);
+
+    return (int)(out - start);
+}
+
+int to64frombits_stream_end(base64_stream *st, unsigned char *out)
+{
+    unsigned char *start = out;
+
+    if (st->ncarry > 0)
+    {
+        out += encode_bits(out, st->carry, st->ncarry);
+        st->column += 4;
+        st->ncarry = 0;
+    }
+    if (st->linelen > 0 && st->column > 0)
+    {
+        *out++     = '\n';
+        st->column = 0;
+    }
+    return (int)(out - start);
+}
+
+/* convert whole groups of base64 digits, stop at the first group holding anything else.
+ * return the number of groups converted.
+ */
+static int decode_groups(unsigned char *out, const char *in, int ngroups)
+{
+    int done = decode_simd(out, in, ngroups);
+
+    for (in += 4 * done, out += 3 * done; done < ngroups; done++, in += 4, out += 3)
+    {
+        uint8_t a = base64values[(uint8_t)in[0]];
+        uint8_t b = base64values[(uint8_t)in[1]];
+        uint8_t c = base64values[(uint8_t)in[2]];
+        uint8_t d = base64values[(uint8_t)in[3]];
+
+        if ((a | b | c | d) > 63)
+            break;
+
+        out[0] = (a << 2) | (b >> 4);
+        out[1] = (b << 4) | (c >> 2);
+        out[2] = (c << 6) | d;
+    }
+    return done;
+}
+
+/* output the bytes of an incomplete group */
+static char *stream_flush(base64_stream *st, char *out)
+{
+    if (st->ncarry > 1)
+        *out++ = (st->carry[0] << 2) | (st->carry[1] >> 4);
+    if (st->ncarry > 2)
+        *out++ = (st->carry[1] << 4) | (st->carry[2] >> 2);
+    st->ncarry = 0;
+    return out;
+}
+
+int from64tobits_stream(base64_stream *st, char *out, const char *in, int inlen)
+{
+    const char *end = in + inlen;
+    char *start     = out;
+
+    if (!decode_simd)
+        select_simd();
+
+    while (in < end)
+    {
+        uint8_t c, v;
+
+        /* the bulk, between line breaks */
+        if (st->ncarry == 0 && !st->ended)
+        {
+            int done = decode_groups((unsigned char *)out, in, (int)(end - in) / 4);
+            in += 4 * done;
+            out += 3 * done;
+            if (in == end)
+                break;
+        }
+
+        c = (uint8_t)*in++;
+        v = base64values[c];
+        if (v < 64)
+        {
+            if (st->ended)
+                return -1;
+            st->carry[st->ncarry++] = v;
+            if (st->ncarry == 4)
+            {
+                *out++ = (st->carry[0] << 2) | (st->carry[1] >> 4);
+                *out++ = (st->carry[1] << 4) | (st->carry[2] >> 2);
+                *out++ = (st->carry[2] << 6) | st->carry[3];
+                st->ncarry = 0;
+            }
+        }
+        else if (c == '=')
+        {
+            if (!st->ended && st->ncarry < 2)
+                return -1;
+            out       = stream_flush(st, out);
+            st->ended = 1;
+        }
+        else if (!isspace(c))
+            return -1;
+    }
+    return (int)(out - start);
+}
+
+int from64tobits_stream_end(base64_stream *st, char *out)
+{
+    char *start = out;
+
+    if (st->ncarry == 1)
+        return -1;
+    out = stream_flush(st, out);
+    return (int)(out - start);
+}
 
 #ifdef BASE64_PROGRAM
 /* standalone program that converts to/from base64.
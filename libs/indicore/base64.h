@@ -59,6 +59,54 @@ extern int from64tobits(char *out, const char *in);
 extern int from64tobits_fast(char *out, const char *in, int inlen);
 extern int from64tobits_fast_with_bug(char *out, const char *in, int inlen);
 
+/** \brief State of an incremental base64 conversion, see base64_stream_init(). */
+typedef struct base64_stream
+{
+    unsigned char carry[4]; /* bytes (or digits) waiting for a complete group */
+    int ncarry;
+    int linelen;            /* encoding: break lines every linelen characters, 0 for none */
+    int column;             /* encoding: characters on the current line */
+    int ended;              /* decoding: padding seen */
+} base64_stream;
+
+/** \brief Prepare an incremental conversion, to or from base64.
+    \param st conversion state
+    \param linelen when encoding, add a '\\n' every linelen characters (rounded down to a multiple of 4). 0 for a single line.
+ */
+extern void base64_stream_init(base64_stream *st, int linelen);
+
+/** \brief Convert the next chunk of bytes to base64. Input can be split anywhere, the output is the same as a single conversion.
+    \param st conversion state
+    \param out output buffer. Must hold at least 4 * (inlen + 2) / 3 characters, plus the line breaks.
+    \param in input binary buffer
+    \param inlen number of bytes to convert
+    \return number of characters written to out (not NUL terminated).
+ */
+extern int to64frombits_stream(base64_stream *st, unsigned char *out, const unsigned char *in, int inlen);
+
+/** \brief Terminate a conversion to base64: pad the last group and end the last line.
+    \param st conversion state
+    \param out output buffer, at least 5 bytes.
+    \return number of characters written to out.
+ */
+extern int to64frombits_stream_end(base64_stream *st, unsigned char *out);
+
+/** \brief Convert the next chunk of base64 to bytes. Input can be split anywhere, whitespaces are ignored.
+    \param st conversion state
+    \param out output buffer. Must hold at least 3 * inlen / 4 + 3 bytes.
+    \param in input base64 buffer
+    \param inlen number of characters to convert
+    \return number of bytes written to out, -1 on invalid input.
+ */
+extern int from64tobits_stream(base64_stream *st, char *out, const char *in, int inlen);
+
+/** \brief Terminate a conversion from base64, output the bytes of a last group without padding.
+    \param st conversion state
+    \param out output buffer, at least 2 bytes.
+    \return number of bytes written to out, -1 on truncated input.
+ */
+extern int from64tobits_stream_end(base64_stream *st, char *out);
+
 /*@}*/
 
 #ifdef __cplusplus
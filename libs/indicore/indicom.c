@@ -107,6 +107,145 @@ static int tty_generic_udp_format = 0;
 static int tty_sequence_number = 1;
 static int tty_clear_trailing_lf = 0;
 
+#ifndef _WIN32
+/* Bytes read past a section terminator, kept for the next read on the same fd.
+ * Only fds enabled with tty_set_read_ahead have a buffer, the others are read one byte at a time. */
+#define TTY_READ_BUFFER_SIZE 4096
+#define TTY_READ_BUFFER_FDS  1024
+
+struct tty_read_buffer
+{
+    int start;
+    int end;
+    char data[TTY_READ_BUFFER_SIZE];
+};
+
+static struct tty_read_buffer *tty_read_buffers[TTY_READ_BUFFER_FDS];
+
+/* Buffered reads are only done on serial and stream sockets, UDP formats read whole datagrams */
+static struct tty_read_buffer *tty_get_read_buffer(int fd)
+{
+    if (fd < 0 || fd >= TTY_READ_BUFFER_FDS || tty_gemini_udp_format || tty_generic_udp_format)
+        return NULL;
+
+    return tty_read_buffers[fd];
+}
+
+/* Whatever was read ahead belongs to the previous exchange, drop it like tcflush would */
+static void tty_clear_read_buffer(int fd)
+{
+    if (fd >= 0 && fd < TTY_READ_BUFFER_FDS && tty_read_buffers[fd] != NULL)
+        tty_read_buffers[fd]->start = tty_read_buffers[fd]->end = 0;
+}
+
+static void tty_free_read_buffer(int fd)
+{
+    if (fd >= 0 && fd < TTY_READ_BUFFER_FDS)
+    {
+        free(tty_read_buffers[fd]);
+        tty_read_buffers[fd] = NULL;
+    }
+}
+
+/* Wait for data then read everything available in one call, or a single byte without a buffer */
+static int tty_fill_read_buffer(int fd, struct tty_read_buffer *rb, char *one, long timeout_seconds,
+                                long timeout_microseconds)
+{
+    int err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds);
+    if (err)
+        return err;
+
+    int bytesRead = rb ? read(fd, rb->data, TTY_READ_BUFFER_SIZE) : read(fd, one, 1);
+
+    /* A closed socket stays readable, report it instead of polling it forever */
+    if (bytesRead <= 0)
+        return TTY_READ_ERROR;
+
+    if (rb)
+    {
+        rb->start = 0;
+        rb->end   = bytesRead;
+    }
+
+    return TTY_OK;
+}
+
+/* Read until stop_char, or nsize bytes when nsize > 0, through the read buffer of fd */
+static int tty_read_section_buffered(int fd, char *buf, int nsize, char stop_char, long timeout_seconds,
+                                     long timeout_microseconds, int *nbytes_read)
+{
+    struct tty_read_buffer *rb = tty_get_read_buffer(fd);
+    char one = 0;
+
+    for (;;)
+    {
+        const char *data;
+        int available;
+
+        if (rb == NULL || rb->start == rb->end)
+        {
+            int err = tty_fill_read_buffer(fd, rb, &one, timeout_seconds, timeout_microseconds);
+            if (err)
+                return err;
+        }
+
+        if (rb)
+        {
+            data      = rb->data + rb->start;
+            available = rb->end - rb->start;
+        }
+        else
+        {
+            data      = &one;
+            available = 1;
+        }
+
+        if (tty_clear_trailing_lf && *nbytes_read == 0 && *data == 0x0A)
+        {
+            if (tty_debug)
+            {
+                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, 0, 0x0A, 0x0A);
+                IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
+            }
+
+            /* The LF was left in buf before, the next byte overwrites it */
+            buf[0] = 0x0A;
+            if (rb)
+                rb->start++;
+            if (stop_char == 0x0A)
+                return TTY_OK;
+            continue;
+        }
+
+        int count = available;
+        if (nsize > 0 && count > nsize - *nbytes_read)
+            count = nsize - *nbytes_read;
+
+        const char *stop = memchr(data, stop_char, count);
+        if (stop)
+            count = (int)(stop - data) + 1;
+
+        memcpy(buf + *nbytes_read, data, count);
+        if (rb)
+            rb->start += count;
+
+        if (tty_debug)
+        {
+            int i = 0;
+            for (i = *nbytes_read; i < *nbytes_read + count; i++)
+                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, i, (unsigned char)buf[i], buf[i]);
+        }
+
+        *nbytes_read += count;
+
+        if (stop)
+            return TTY_OK;
+        if (nsize > 0 && *nbytes_read >= nsize)
+            return TTY_OVERFLOW;
+    }
+}
+#endif
+
 #if defined(HAVE_LIBNOVA)
 int extractISOTime(const char *timestr, struct ln_date *iso_date)
 {
@@ -377,6 +516,31 @@ void tty_clr_trailing_read_lf(int enabled)
     tty_clear_trailing_lf = enabled;
 }
 
+int tty_set_read_ahead(int fd, int enabled)
+{
+#ifdef _WIN32
+    INDI_UNUSED(fd);
+    INDI_UNUSED(enabled);
+    return TTY_ERRNO;
+#else
+    if (fd < 0 || fd >= TTY_READ_BUFFER_FDS)
+        return TTY_PARAM_ERROR;
+
+    if (enabled == 0)
+    {
+        tty_free_read_buffer(fd);
+        return TTY_OK;
+    }
+
+    if (tty_read_buffers[fd] == NULL)
+        tty_read_buffers[fd] = (struct tty_read_buffer *)calloc(1, sizeof(struct tty_read_buffer));
+    else
+        tty_clear_read_buffer(fd);
+
+    return tty_read_buffers[fd] ? TTY_OK : TTY_ERRNO;
+#endif
+}
+
 int tty_timeout(int fd, int timeout)
 {
     return tty_timeout_microseconds(fd, timeout, 0);
@@ -442,6 +606,8 @@ int tty_write(int fd, const char *buf, int nbytes, int *nbytes_written)
     if (fd == -1)
         return TTY_ERRNO;
 
+    tty_clear_read_buffer(fd);
+
     int bytes_w     = 0;
     *nbytes_written = 0;
 
@@ -513,15 +679,29 @@ int tty_read_expanded(int fd, char *buf, int nbytes, long timeout_seconds, long
         buffer = geminiBuffer;
     }
 
+    struct tty_read_buffer *rb = tty_get_read_buffer(fd);
+
     while (numBytesToRead > 0)
     {
-        if ((err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds)))
-            return err;
+        if (rb && rb->start < rb->end)
+        {
+            // Serve what a section read left behind first
+            bytesRead = rb->end - rb->start;
+            if (bytesRead > numBytesToRead)
+                bytesRead = numBytesToRead;
+            memcpy(buffer + (*nbytes_read), rb->data + rb->start, bytesRead);
+            rb->start += bytesRead;
+        }
+        else
+        {
+            if ((err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds)))
+                return err;
 
-        bytesRead = read(fd, buffer + (*nbytes_read), ((uint32_t)numBytesToRead));
+            bytesRead = read(fd, buffer + (*nbytes_read), ((uint32_t)numBytesToRead));
 
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
+            if (bytesRead < 0)
+                return TTY_READ_ERROR;
+        }
 
         if (tty_debug)
         {
@@ -580,11 +760,8 @@ int tty_read_section_expanded(int fd, char *buf, char stop_char, long timeout_se
         return TTY_ERRNO;
 
     int bytesRead = 0;
-    int err       = TTY_OK;
     *nbytes_read  = 0;
 
-    uint8_t *read_char = 0;
-
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %ld s %ld us timeout for fd %d\n", __FUNCTION__, stop_char, timeout_seconds, timeout_microseconds, fd);
 
@@ -631,31 +808,7 @@ int tty_read_section_expanded(int fd, char *buf, char stop_char, long timeout_se
     }
     else
     {
-        for (;;)
-        {
-            if ((err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds)))
-                return err;
-
-            read_char = (uint8_t*)(buf + *nbytes_read);
-            bytesRead = read(fd, read_char, 1);
-
-            if (bytesRead < 0)
-                return TTY_READ_ERROR;
-
-            if (tty_debug)
-                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
-
-            if (!(tty_clear_trailing_lf && *read_char == 0X0A && *nbytes_read == 0))
-                (*nbytes_read)++;
-            else {
-                if (tty_debug)
-                    IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
-            }
-
-            if (*read_char == stop_char) {
-                return TTY_OK;
-            }
-        }
+        return tty_read_section_buffered(fd, buf, 0, stop_char, timeout_seconds, timeout_microseconds, nbytes_read);
     }
 
     return TTY_TIME_OUT;
@@ -676,41 +829,16 @@ int tty_nread_section(int fd, char *buf, int nsize, char stop_char, int timeout,
     if (tty_gemini_udp_format || tty_generic_udp_format)
         return tty_read_section(fd, buf, stop_char, timeout, nbytes_read);
 
-    int bytesRead = 0;
-    int err       = TTY_OK;
     *nbytes_read  = 0;
-    uint8_t *read_char = 0;
     memset(buf, 0, nsize);
 
+    if (nsize <= 0)
+        return TTY_PARAM_ERROR;
+
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %d timeout for fd %d\n", __FUNCTION__, stop_char, timeout, fd);
 
-    for (;;)
-    {
-        if ((err = tty_timeout(fd, timeout)))
-            return err;
-
-        read_char = (uint8_t*)(buf + *nbytes_read);
-        bytesRead = read(fd, read_char, 1);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
-
-        if (tty_debug)
-            IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
-
-        if (!(tty_clear_trailing_lf && *read_char == 0X0A && *nbytes_read == 0))
-            (*nbytes_read)++;
-        else {
-            if (tty_debug)
-                IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
-        }
-
-        if (*read_char == stop_char)
-            return TTY_OK;
-        else if (*nbytes_read >= nsize)
-            return TTY_OVERFLOW;
-    }
+    return tty_read_section_buffered(fd, buf, nsize, stop_char, timeout, 0, nbytes_read);
 
 #endif
 }
@@ -928,6 +1056,8 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
     }
 #endif
 
+    /* The fd may have been closed without tty_disconnect, start again without read-ahead */
+    tty_free_read_buffer(t_fd);
     *fd = t_fd;
     /* return success */
     return TTY_OK;
@@ -1136,6 +1266,8 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
         return TTY_PORT_FAILURE;
     }
 
+    /* The fd may have been closed without tty_disconnect, start again without read-ahead */
+    tty_free_read_buffer(t_fd);
     *fd = t_fd;
     /* return success */
     return TTY_OK;
@@ -1154,6 +1286,7 @@ int tty_disconnect(int fd)
     return TTY_ERRNO;
 #else
     int err;
+    tty_free_read_buffer(fd);
     tcflush(fd, TCIOFLUSH);
     err = close(fd);
 
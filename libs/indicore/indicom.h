@@ -201,6 +201,8 @@ int tty_read_expanded(int fd, char *buf, int nbytes, long timeout_seconds, long
  *  \param timeout number of seconds to wait for terminal before a timeout error is issued.
  *  \param nbytes_read the number of bytes read.
  *  \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+ *  \note Available data is read in bulk. Bytes received after \e stop_char are returned by the next
+ *  tty_read or section read on \e fd, and dropped by the next tty_write on \e fd.
  */
 int tty_read_section(int fd, char *buf, char stop_char, int timeout, int *nbytes_read);
 
@@ -282,6 +284,16 @@ void tty_set_gemini_udp_format(int enabled);
 void tty_set_generic_udp_format(int enabled);
 void tty_clr_trailing_read_lf(int enabled);
 
+/** \brief tty_set_read_ahead Let section reads on fd read everything available at once instead of one byte per read.
+ *  Bytes past the stop char are kept for the next tty_read, tty_read_section or tty_nread_section on fd, they are
+ *  invisible to select, tty_timeout, read and tcflush on fd and are dropped by tty_write. Only enable it when every
+ *  read of fd goes through these functions. It is disabled again by tty_connect and tty_disconnect.
+ *  \param fd file descriptor.
+ *  \param enabled 1 to enable, 0 to disable and drop the bytes read ahead.
+ *  \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+ */
+int tty_set_read_ahead(int fd, int enabled);
+
 int tty_timeout(int fd, int timeout);
 
 int tty_timeout_microseconds(int fd, long timeout_seconds, long timeout_microseconds);
@@ -0,0 +1,282 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "indiconfigcache.h"
+#include "indidevapi.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAXRBUF 2048
+
+namespace
+{
+
+struct ParsedConfig
+{
+    XMLEle *root = nullptr;
+
+    // Identity of the parsed file on disk
+    dev_t device = 0;
+    ino_t inode = 0;
+    off_t size = 0;
+    time_t mtimeSec = 0;
+    long mtimeNsec = 0;
+
+    // "device\0property" to the first element of the property
+    std::unordered_map<std::string, XMLEle *> index;
+
+    // Element iteration keeps its state in the tree, readers take turns
+    std::mutex readLock;
+
+    ~ParsedConfig()
+    {
+        delXMLEle(root);
+    }
+};
+
+std::mutex cacheLock;
+std::unordered_map<std::string, std::shared_ptr<ParsedConfig>> cacheFiles;
+
+std::string indexKey(const char *device, const char *property)
+{
+    std::string key(device);
+    key += '\0';
+    key += property;
+    return key;
+}
+
+long modificationNsec(const struct stat &st)
+{
+#if defined(__APPLE__)
+    return st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    (void)st;
+    return 0;
+#else
+    return st.st_mtim.tv_nsec;
+#endif
+}
+
+bool sameFile(const ParsedConfig &file, const struct stat &st)
+{
+    return file.device == st.st_dev && file.inode == st.st_ino && file.size == st.st_size &&
+           file.mtimeSec == st.st_mtime && file.mtimeNsec == modificationNsec(st);
+}
+
+// Same checks as IUGetConfigFP, the config directory is created if needed
+bool checkConfigFile(const char *configDir, const char *configFileName, struct stat &st, char errmsg[])
+{
+    if (stat(configDir, &st) != 0)
+    {
+#ifdef _WIN32
+        if (mkdir(configDir) != 0)
+#else
+        if (mkdir(configDir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0)
+#endif
+        {
+            snprintf(errmsg, MAXRBUF, "Unable to create config directory. Error %s: %s", configDir, strerror(errno));
+            return false;
+        }
+    }
+
+    if (stat(configFileName, &st) != 0)
+    {
+        snprintf(errmsg, MAXRBUF, "Unable to open config file. Error loading file %s: %s", configFileName,
+                 strerror(errno));
+        return false;
+    }
+
+#ifdef _WIN32
+    BOOL isAdmin = FALSE;
+    SID_IDENTIFIER_AUTHORITY NtAuthority = SECURITY_NT_AUTHORITY;
+    PSID AdministratorsGroup;
+    if (AllocateAndInitializeSid(&NtAuthority, 2, SECURITY_BUILTIN_DOMAIN_RID, DOMAIN_ALIAS_RID_ADMINS, 0, 0, 0, 0, 0, 0, &AdministratorsGroup))
+    {
+        if (CheckTokenMembership(NULL, AdministratorsGroup, &isAdmin) == FALSE)
+            isAdmin = FALSE;
+        FreeSid(AdministratorsGroup);
+    }
+    if ((st.st_uid == 0 && st.st_mode & S_IFDIR) || (st.st_gid == 0 && isAdmin == TRUE))
+#else
+    /* If file is owned by root and current user is NOT root then abort */
+    if ( (st.st_uid == 0 && getuid() != 0) || (st.st_gid == 0 && getgid() != 0) )
+#endif
+    {
+        strncpy(errmsg,
+                "Config file is owned by root! This will lead to serious errors. To fix this, run: sudo chown -R $USER:$USER ~/.indi",
+                MAXRBUF);
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<ParsedConfig> parseConfigFile(const char *configFileName, const struct stat &st, char errmsg[])
+{
+    FILE *fp = fopen(configFileName, "r");
+    if (fp == nullptr)
+    {
+        snprintf(errmsg, MAXRBUF, "Unable to open config file. Error loading file %s: %s", configFileName,
+                 strerror(errno));
+        return nullptr;
+    }
+
+    char whynot[MAXRBUF] = {0};
+    LilXML *lp = newLilXML();
+    XMLEle *root = readXMLFile(fp, lp, whynot);
+    delLilXML(lp);
+    fclose(fp);
+
+    if (root == nullptr)
+    {
+        snprintf(errmsg, MAXRBUF, "Unable to parse config XML: %s", whynot);
+        return nullptr;
+    }
+
+    auto file = std::make_shared<ParsedConfig>();
+    file->root      = root;
+    file->device    = st.st_dev;
+    file->inode     = st.st_ino;
+    file->size      = st.st_size;
+    file->mtimeSec  = st.st_mtime;
+    file->mtimeNsec = modificationNsec(st);
+
+    for (XMLEle *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+    {
+        char *rdev, *rname;
+        if (crackDN(ep, &rdev, &rname, whynot) < 0)
+            continue;
+
+        // Readers used the first match of a linear scan, keep it
+        file->index.emplace(indexKey(rdev, rname), ep);
+    }
+
+    return file;
+}
+
+}
+
+// Handle given to readers, the parsed file outlives its invalidation until released
+struct ConfigCacheFile
+{
+    explicit ConfigCacheFile(const std::shared_ptr<ParsedConfig> &config)
+        : config(config), lock(config->readLock)
+    { }
+
+    std::shared_ptr<ParsedConfig> config;
+    std::unique_lock<std::mutex> lock;
+};
+
+extern "C" {
+
+ConfigCacheFile *configCacheAcquire(const char *filename, const char *device, char errmsg[])
+{
+    char configFileName[MAXRBUF];
+    char configDir[MAXRBUF];
+    struct stat st;
+
+    snprintf(configDir, MAXRBUF, "%s/.indi/", getenv("HOME"));
+
+    if (filename)
+        snprintf(configFileName, MAXRBUF, "%s", filename);
+    else if (getenv("INDICONFIG"))
+        snprintf(configFileName, MAXRBUF, "%s", getenv("INDICONFIG"));
+    else
+        snprintf(configFileName, MAXRBUF, "%s%s_config.xml", configDir, device);
+
+    if (!checkConfigFile(configDir, configFileName, st, errmsg))
+        return nullptr;
+
+    std::shared_ptr<ParsedConfig> config;
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        auto it = cacheFiles.find(configFileName);
+        if (it != cacheFiles.end())
+        {
+            if (sameFile(*it->second, st))
+                config = it->second;
+            else
+                cacheFiles.erase(it);
+        }
+    }
+
+    if (!config)
+    {
+        // Parse without holding the lock, a concurrent reader may parse the same file too
+        config = parseConfigFile(configFileName, st, errmsg);
+        if (!config)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(cacheLock);
+        cacheFiles[configFileName] = config;
+    }
+
+    return new ConfigCacheFile(config);
+}
+
+void configCacheRelease(ConfigCacheFile *file)
+{
+    delete file;
+}
+
+XMLEle *configCacheRoot(const ConfigCacheFile *file)
+{
+    return file->config->root;
+}
+
+XMLEle *configCacheFind(const ConfigCacheFile *file, const char *device, const char *property)
+{
+    if (property)
+    {
+        auto it = file->config->index.find(indexKey(device, property));
+        return it != file->config->index.end() ? it->second : nullptr;
+    }
+
+    XMLEle *root = file->config->root;
+    for (XMLEle *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+    {
+        if (!strcmp(findXMLAttValu(ep, "device"), device))
+            return ep;
+    }
+    return nullptr;
+}
+
+void configCacheInvalidate(const char *filename)
+{
+    std::lock_guard<std::mutex> lock(cacheLock);
+    if (filename)
+        cacheFiles.erase(filename);
+    else
+        cacheFiles.clear();
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#pragma once
+
+#include "lilxml.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parsed configuration file shared by all readers.
+ * Files are parsed once and kept until saved, purged or modified on disk.
+ * An acquired file stays valid until released, even if it is invalidated meanwhile.
+ * Only one thread at a time holds a file: release it before calling anything that may
+ * acquire it again, clone the elements that must outlive the release. */
+typedef struct ConfigCacheFile ConfigCacheFile;
+
+/** Get the parsed configuration file of a device.
+ *  filename overrides the default $INDICONFIG or ~/.indi/<device>_config.xml file.
+ *  Returns NULL and fills errmsg (MAXRBUF) if the file can't be read or parsed. */
+ConfigCacheFile *configCacheAcquire(const char *filename, const char *device, char errmsg[]);
+
+/** Release a file returned by configCacheAcquire. */
+void configCacheRelease(ConfigCacheFile *file);
+
+/** Root element of the file, holding the property vectors. */
+XMLEle *configCacheRoot(const ConfigCacheFile *file);
+
+/** Find the first element of a property, or the first element of the device if property is NULL. */
+XMLEle *configCacheFind(const ConfigCacheFile *file, const char *device, const char *property);
+
+/** Drop a file from the cache before it is written, or all files if filename is NULL. */
+void configCacheInvalidate(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,16 +5,11 @@
 #include "userio.h"
 #include "indiuserio.h"
 #include "indiutility.h"
+#include "indiconfigcache.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <sys/stat.h>
-
-#ifdef _WIN32
-#include <direct.h>
-#include <Windows.h>
-#endif
 
 #define MAXRBUF 2048
 
@@ -58,202 +53,90 @@ int IUSaveBLOB(IBLOB *bp, int size, int blobsize, char *blob, char *format)
     return 0;
 }
 
-/** Get configuration root XML pointer
- *  N.B. Must be freed by the caller */
-XMLEle *configRootFP(const char *device)
-{
-    char configFileName[MAXRBUF];
-    char configDir[MAXRBUF];
-    char errmsg[MAXRBUF];
-    struct stat st;
-    FILE *fp = NULL;
-
-    snprintf(configDir, MAXRBUF-1, "%s/.indi/", getenv("HOME"));
-
-        if (getenv("INDICONFIG"))
-            strncpy(configFileName, getenv("INDICONFIG"), MAXRBUF-1);
-        else
-            snprintf(configFileName, MAXRBUF-1, "%s%s_config.xml", configDir, device);
-
-
-    if (stat(configDir, &st) != 0)
-    {
-#ifdef _WIN32
-        if (mkdir(configDir) != 0)
-#else
-        if (mkdir(configDir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0)
-#endif
-            return NULL;
-    }
-
-    stat(configFileName, &st);
-    
-#ifdef _WIN32
-    BOOL isAdmin = FALSE;
-    SID_IDENTIFIER_AUTHORITY NtAuthority = SECURITY_NT_AUTHORITY;
-    PSID AdministratorsGroup;
-    if (AllocateAndInitializeSid(&NtAuthority, 2, SECURITY_BUILTIN_DOMAIN_RID, DOMAIN_ALIAS_RID_ADMINS, 0, 0, 0, 0, 0, 0, &AdministratorsGroup))
-    {
-        if (CheckTokenMembership(NULL, AdministratorsGroup, &isAdmin) == FALSE)
-            isAdmin = FALSE;
-        FreeSid(AdministratorsGroup);
-    }
-    if ((st.st_uid == 0 && st.st_mode & S_IFDIR) || (st.st_gid == 0 && isAdmin == TRUE))
-        return NULL;
-#else
-    /* If file is owned by root and current user is NOT root then abort */
-    if ( (st.st_uid == 0 && getuid() != 0) || (st.st_gid == 0 && getgid() != 0) )
-        return NULL;
-#endif
-
-    fp = fopen(configFileName, "r");
-    if (fp == NULL)
-        return NULL;
-
-    LilXML *lp = newLilXML();
-
-    XMLEle *root = readXMLFile(fp, lp, errmsg);
-
-    delLilXML(lp);
-    fclose(fp);
-
-    return root;
-}
 /** \section IULoad */
 
 int IULoadConfigNumber(const INumberVectorProperty *nvp)
 {
-    char errmsg[1024];
-    char *rdev, *rname;
+    char errmsg[MAXRBUF];
     int foundCounter = 0;
-    XMLEle *root = configRootFP(nvp->device);
-    if (root == NULL)
+    ConfigCacheFile *file = configCacheAcquire(NULL, nvp->device, errmsg);
+    if (file == NULL)
         return -1;
 
-    XMLEle *ep = NULL;
-
-    for (ep = nextXMLEle(root, 1); ep != NULL; ep = nextXMLEle(root, 0))
+    XMLEle *ep = configCacheFind(file, nvp->device, nvp->name);
+    if (ep != NULL)
     {
-        /* pull out device and name */
-        if (crackDN(ep, &rdev, &rname, errmsg) < 0)
-        {
-            delXMLEle(root);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(nvp->device, rdev))
-            continue;
-
-        if (!strcmp(nvp->name, rname))
+        XMLEle *element = NULL;
+        for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
         {
-            XMLEle *element = NULL;
-            for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
+            INumber *member = IUFindNumber(nvp, findXMLAttValu(element, "name"));
+            if (member)
             {
-                INumber *member = IUFindNumber(nvp, findXMLAttValu(element, "name"));
-                if (member)
-                {
-                    member->value = atof(pcdataXMLEle(element));
-                    foundCounter++;
-                }
+                member->value = atof(pcdataXMLEle(element));
+                foundCounter++;
             }
-            break;
         }
     }
 
-    delXMLEle(root);
+    configCacheRelease(file);
     return foundCounter;
 }
 
 int IULoadConfigText(const ITextVectorProperty *tvp)
 {
-    char errmsg[1024];
-    char *rdev, *rname;
+    char errmsg[MAXRBUF];
     int foundCounter = 0;
-    XMLEle *root = configRootFP(tvp->device);
-    if (root == NULL)
+    ConfigCacheFile *file = configCacheAcquire(NULL, tvp->device, errmsg);
+    if (file == NULL)
         return -1;
 
-    XMLEle *ep = NULL;
-
-    for (ep = nextXMLEle(root, 1); ep != NULL; ep = nextXMLEle(root, 0))
+    XMLEle *ep = configCacheFind(file, tvp->device, tvp->name);
+    if (ep != NULL)
     {
-        /* pull out device and name */
-        if (crackDN(ep, &rdev, &rname, errmsg) < 0)
-        {
-            delXMLEle(root);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(tvp->device, rdev))
-            continue;
-
-        if (!strcmp(tvp->name, rname))
+        XMLEle *element = NULL;
+        for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
         {
-            XMLEle *element = NULL;
-            for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
+            IText *member = IUFindText(tvp, findXMLAttValu(element, "name"));
+            if (member)
             {
-                IText *member = IUFindText(tvp, findXMLAttValu(element, "name"));
-                if (member)
-                {
-                    IUSaveText(member, pcdataXMLEle(element));
-                    foundCounter++;
-                }
+                IUSaveText(member, pcdataXMLEle(element));
+                foundCounter++;
             }
-            break;
         }
     }
 
-    delXMLEle(root);
+    configCacheRelease(file);
     return foundCounter;
 }
 
 int IULoadConfigSwitch(const ISwitchVectorProperty *svp)
 {
-    char errmsg[1024];
-    char *rdev, *rname;
+    char errmsg[MAXRBUF];
     int foundCounter = 0;
-    XMLEle *root = configRootFP(svp->device);
-    if (root == NULL)
+    ConfigCacheFile *file = configCacheAcquire(NULL, svp->device, errmsg);
+    if (file == NULL)
         return -1;
 
-    XMLEle *ep = NULL;
-
-    for (ep = nextXMLEle(root, 1); ep != NULL; ep = nextXMLEle(root, 0))
+    XMLEle *ep = configCacheFind(file, svp->device, svp->name);
+    if (ep != NULL)
     {
-        /* pull out device and name */
-        if (crackDN(ep, &rdev, &rname, errmsg) < 0)
+        XMLEle *element = NULL;
+        for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
         {
-            delXMLEle(root);
-            return -1;
-        }
-
-        // It doesn't belong to our device??
-        if (strcmp(svp->device, rdev))
-            continue;
-
-        if (!strcmp(svp->name, rname))
-        {
-            XMLEle *element = NULL;
-            for (element = nextXMLEle(ep, 1); element != NULL; element = nextXMLEle(ep, 0))
+            ISwitch *member = IUFindSwitch(svp, findXMLAttValu(element, "name"));
+            if (member)
             {
-                ISwitch *member = IUFindSwitch(svp, findXMLAttValu(element, "name"));
-                if (member)
+                ISState state;
+                if (crackISState(pcdataXMLEle(element), &state) == 0)
                 {
-                    ISState state;
-                    if (crackISState(pcdataXMLEle(element), &state) == 0)
-                    {
-                        member->s = state;
-                        foundCounter++;
-                    }
+                    member->s = state;
+                    foundCounter++;
                 }
             }
-            break;
         }
     }
 
-    delXMLEle(root);
+    configCacheRelease(file);
     return foundCounter;
 }
 
@@ -189,6 +189,9 @@ class LilXmlParser
     public:
         std::list<LilXmlDocument> parseChunk(const char *data, size_t size);
 
+        /** @brief Keep BLOB contents marked with a rawlen attribute as raw bytes, see setLilXMLRawContent */
+        void setRawContent(bool enabled);
+
     public:
         bool hasErrorMessage() const;
         const char *errorMessage() const;
@@ -456,7 +459,14 @@ inline LilXmlElement LilXmlDocument::root() const
 
 inline LilXmlParser::LilXmlParser()
     : mHandle(newLilXML(), [](LilXML *handle) { delLilXML(handle); })
-{ }
+{
+    setLilXMLArena(mHandle.get(), 1);
+}
+
+inline void LilXmlParser::setRawContent(bool enabled)
+{
+    setLilXMLRawContent(mHandle.get(), enabled ? 1 : 0);
+}
 
 inline LilXmlDocument LilXmlParser::readFromFile(FILE *file)
 {
@@ -103,9 +103,6 @@ void IUUserIOBLOBContextOne(
     const char *name, unsigned int size, unsigned int bloblen, const void *blob, const char *format
 )
 {
-    unsigned char *encblob;
-    int l;
-
     userio_prints    (io, user, "  <oneBLOB\n"
                                 "    name='");
     userio_xml_escape(io, user, name);
@@ -130,37 +127,34 @@ void IUUserIOBLOBContextOne(
 
             io->joinbuff(user, "    attached='true'>\n", (void*)blob, bloblen);
         } else {
-            size_t sz = 4 * bloblen / 3 + 4;
-            assert_mem(encblob = (unsigned char *)malloc(sz)); // #PS: TODO
-            l = to64frombits_s(encblob, blob, bloblen, sz);
-            if (l == 0) {
-                fprintf(stderr, "%s: Not enough memory for decoding.\n", __func__);
-                exit(1);
-            }
-            userio_printf    (io, user, "    enclen='%d'\n", l); // safe
+            // Encode by chunks of whole lines, no full-size copy of the blob
+            const unsigned int chunk = 1024 * 54;
+            unsigned char *encblob;
+            base64_stream st;
+
+            assert_mem(encblob = (unsigned char *)malloc(chunk / 3 * 4 + chunk / 54 + 8));
+            base64_stream_init(&st, 72);
+
+            userio_printf    (io, user, "    enclen='%u'\n", (bloblen + 2) / 3 * 4); // safe
             userio_prints    (io, user, "    format='");
             userio_xml_escape(io, user, format);
             userio_prints    (io, user, "'>\n");
-            size_t written = 0;
-            // FIXME: this is not efficient. The CR/LF imply one more copy... Do we need them ?
-            while ((int)written < l)
+
+            for (unsigned int pos = 0; pos < bloblen; pos += chunk)
             {
-                size_t towrite = ((l - written) > 72) ? 72 : l - written;
-                size_t wr      = userio_write(io, user, encblob + written, towrite);
+                unsigned int len = (bloblen - pos < chunk) ? bloblen - pos : chunk;
+                int l = to64frombits_stream(&st, encblob, (const unsigned char *)blob + pos, len);
 
-                if (wr == 0)
+                if (l > 0 && userio_write(io, user, encblob, l) == 0)
                 {
                     free(encblob);
                     return;
                 }
-
-                written += wr;
-                if ((written % 72) == 0)
-                    userio_putc(io, user, '\n');
             }
 
-            if ((written % 72) != 0)
-                userio_putc(io, user, '\n');
+            int l = to64frombits_stream_end(&st, encblob);
+            if (l > 0)
+                userio_write(io, user, encblob, l);
 
             free(encblob);
         }
@@ -338,9 +332,9 @@ static const char *s_BLOBHandlingtoString(BLOBHandling bh)
     }
 }
 
-void IUUserIOEnableBLOB(
+static void s_UserIOEnableBLOB(
     const userio *io, void *user,
-    const char *dev, const char *name, BLOBHandling blobH
+    const char *dev, const char *name, BLOBHandling blobH, int binary
 )
 {
     userio_prints(io, user, "<enableBLOB device='");
@@ -350,11 +344,29 @@ void IUUserIOEnableBLOB(
         userio_prints(io, user, "' name='");
         userio_xml_escape(io, user, name);
     }
+    if (binary)
+        userio_prints(io, user, "' binary='true");
     userio_prints(io, user, "'>");
     userio_prints(io, user, s_BLOBHandlingtoString(blobH));
     userio_prints(io, user, "</enableBLOB>\n");
 }
 
+void IUUserIOEnableBLOB(
+    const userio *io, void *user,
+    const char *dev, const char *name, BLOBHandling blobH
+)
+{
+    s_UserIOEnableBLOB(io, user, dev, name, blobH, 0);
+}
+
+void IUUserIOEnableBLOBBinary(
+    const userio *io, void *user,
+    const char *dev, const char *name, BLOBHandling blobH
+)
+{
+    s_UserIOEnableBLOB(io, user, dev, name, blobH, 1);
+}
+
 void IDUserIOMessageVA(
     const userio *io, void *user,
     const char *dev, const char *fmt, va_list ap
@@ -62,6 +62,14 @@ void IUUserIOEnableBLOB(
     const char *dev, const char *name, BLOBHandling blobH
 );
 
+/** @brief Same as IUUserIOEnableBLOB, also asks for BLOB contents as raw bytes instead of base64.
+ *  The reader must parse setBLOBVector messages with setLilXMLRawContent enabled.
+ */
+void IUUserIOEnableBLOBBinary(
+    const userio *io, void *user,
+    const char *dev, const char *name, BLOBHandling blobH
+);
+
 // Define
 void IUUserIODefTextVA(const userio *io, void *user, const struct _ITextVectorProperty *tvp, const char *fmt, va_list ap);
 void IUUserIODefNumberVA(const userio *io, void *user, const struct _INumberVectorProperty *n, const char *fmt, va_list ap);
@@ -26,6 +26,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
  * only handles elements, attributes and pcdata content.
  * <! ... > and <? ... > are silently ignored.
  * pcdata is collected into one string, sans leading whitespace first line.
+ * in arena mode, each parsed tree is allocated from its own bump arena that
+ * is released at once when the root is deleted.
  *
  * #define MAIN_TST to create standalone test program
  */
@@ -34,6 +36,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #if defined(_MSC_VER)
@@ -45,29 +48,65 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 
 #include "lilxml.h"
 
+typedef struct XMLArena_ XMLArena;
+
 /* used to efficiently manage growing malloced string space */
 typedef struct
 {
-    char *s; /* malloced memory for string */
-    int sl;  /* string length, sans trailing \0 */
-    int sm;  /* total malloced bytes */
+    char *s;         /* malloced memory for string */
+    int sl;          /* string length, sans trailing \0 */
+    int sm;          /* total malloced bytes */
+    XMLArena *arena; /* arena holding s, NULL if s is malloced */
 } String;
 #define MINMEM 64 /* starting string length */
 
+/* one chunk of arena memory, chained to the previous ones */
+typedef struct XMLArenaBlock_
+{
+    struct XMLArenaBlock_ *prev;
+} XMLArenaBlock;
+
+/* bump allocator for all the parts of one tree */
+struct XMLArena_
+{
+    XMLArenaBlock *last; /* block being filled */
+    char *next;          /* first free byte in last */
+    size_t left;         /* free bytes in last */
+    size_t blksz;        /* size of the next block */
+    XMLEle *root;        /* element whose deletion frees the arena */
+};
+#define ARENA_ALIGN    (2 * sizeof(void *))
+#define ARENA_HDRSZ    ((sizeof(XMLArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_MINBLK   4096  /* first block, enough for most INDI messages */
+#define ARENA_MAXBLK   65536 /* blocks double up to this size */
+#define ARENA_MINSTR   32    /* starting string length in an arena */
+#define ARENA_MAXSTR   1024  /* longer strings (BLOB pcdata) move to malloced memory */
+
 static int oneXMLchar(LilXML *lp, int c, char ynot[]);
 static void initParser(LilXML *lp);
+static void delParserTree(LilXML *lp);
+static void freeXMLEle(XMLEle *ep);
 static void pushXMLEle(LilXML *lp);
 static void popXMLEle(LilXML *lp);
 static void resetEndTag(LilXML *lp);
+static void startContent(LilXML *lp);
+static int rawContent(LilXML *lp, const char *buf, int size);
 static XMLAtt *growAtt(XMLEle *e);
-static XMLEle *growEle(XMLEle *pe);
+static XMLEle *growEle(XMLEle *pe, XMLArena *arena);
+static void *growList(XMLArena *arena, void *list, int n, int *m);
 static void freeAtt(XMLAtt *a);
 static int isTokenChar(int start, int c);
 static void growString(String *sp, int c);
 static void appendString(String *sp, const char *str);
+static void appendBytes(String *sp, const char *str, int n);
+static void reserveString(String *sp, int n);
 static void freeString(String *sp);
 static void newString(String *sp);
+static void initString(String *sp, XMLArena *arena);
 static void *moremem(void *old, size_t n);
+static XMLArena *newArena();
+static void *arenaAlloc(XMLArena *ap, size_t n);
+static void freeArena(XMLArena *ap);
 static void appXMLEle(XMLEle *ep, XMLEle *newep);
 
 typedef enum
@@ -86,7 +125,8 @@ typedef enum
     ENTINCON,       /* in entity in pcdata */
     SAWLTINCON,     /* saw < in content */
     LOOK4CLOSETAG,  /* looking for closing tag after < */
-    INCLOSETAG      /* reading closing tag */
+    INCLOSETAG,     /* reading closing tag */
+    INRAW           /* reading rawlen bytes of content as is */
 } State;            /* parsing states */
 
 /* maintain state while parsing */
@@ -100,7 +140,9 @@ struct LilXML_
     int delim;     /* attribute value delimiter */
     int lastc;     /* last char (just used with skipping)*/
     int skipping;  /* in comment or declaration */
-    int inblob;    /* in oneBLOB element */
+    int arena;     /* allocate each new tree in its own arena */
+    int raw;       /* honour rawlen attributes */
+    long rawleft;  /* bytes of raw content still to read */
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -108,11 +150,14 @@ struct xml_ele_
 {
     String tag;        /* element tag */
     XMLEle *pe;        /* parent element, or NULL if root */
+    XMLArena *arena;   /* arena holding this element, NULL if malloced */
     XMLAtt **at;       /* list of attributes */
     int nat;           /* number of attributes */
+    int mat;           /* room in at[] */
     int ait;           /* used to iterate over at[] */
     XMLEle **el;       /* list of child elements */
     int nel;           /* number of child elements */
+    int mel;           /* room in el[] */
     int eit;           /* used to iterate over el[] */
     String pcdata;     /* character data in this element */
     int pcdata_hasent; /* 1 if pcdata contains an entity char*/
@@ -158,11 +203,23 @@ LilXML *newLilXML()
 /* discard */
 void delLilXML(LilXML *lp)
 {
-    delXMLEle(lp->ce);
+    delParserTree(lp);
     freeString(&lp->endtag);
     (*myfree)(lp);
 }
 
+/* allocate each tree parsed by lp from a single arena, freed by delXMLEle on its root */
+void setLilXMLArena(LilXML *lp, int on)
+{
+    lp->arena = on;
+}
+
+/* read the content of elements with a rawlen attribute as that many bytes, unescaped */
+void setLilXMLRawContent(LilXML *lp, int on)
+{
+    lp->raw = on;
+}
+
 /* delete ep and all its children and remove from parent's list if known */
 void delXMLEle(XMLEle *ep)
 {
@@ -172,27 +229,6 @@ void delXMLEle(XMLEle *ep)
     if (!ep)
         return;
 
-    /* delete all parts of ep */
-    freeString(&ep->tag);
-    freeString(&ep->pcdata);
-    if (ep->at)
-    {
-        for (i = 0; i < ep->nat; i++)
-            freeAtt(ep->at[i]);
-        (*myfree)(ep->at);
-    }
-    if (ep->el)
-    {
-        for (i = 0; i < ep->nel; i++)
-        {
-            /* forget parent so deleting doesn't modify _this_ el[] */
-            ep->el[i]->pe = NULL;
-
-            delXMLEle(ep->el[i]);
-        }
-        (*myfree)(ep->el);
-    }
-
     /* remove from parent's list if known */
     if (ep->pe)
     {
@@ -207,11 +243,55 @@ void delXMLEle(XMLEle *ep)
         }
     }
 
+    freeXMLEle(ep);
+}
+
+/* free ep and all its children, ignoring the parent.
+ * an arena is freed with the root it was created for.
+ */
+static void freeXMLEle(XMLEle *ep)
+{
+    int i;
+
+    /* delete all parts of ep */
+    freeString(&ep->tag);
+    freeString(&ep->pcdata);
+    for (i = 0; i < ep->nat; i++)
+        freeAtt(ep->at[i]);
+    for (i = 0; i < ep->nel; i++)
+        freeXMLEle(ep->el[i]);
+
+    if (ep->arena)
+    {
+        if (ep->arena->root == ep)
+            freeArena(ep->arena);
+        return;
+    }
+
     /* delete ep itself */
+    (*myfree)(ep->at);
+    (*myfree)(ep->el);
     (*myfree)(ep);
 }
 
-//#define WITH_MEMCHR
+/* length of the plain content at str, up to the next markup, entity or \0.
+ * count the new lines in *ln.
+ */
+static int contentSpan(const char *str, int size, int *ln)
+{
+    int n;
+
+    for (n = 0; n < size; n++)
+    {
+        char c = str[n];
+        if (c == '<' || c == '&' || c == '\0')
+            break;
+        if (c == '\n')
+            (*ln)++;
+    }
+    return (n);
+}
+
 XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
 {
     unsigned int nnodes     = 1;
@@ -221,81 +301,30 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
     int s;
     ynot[0] = '\0';
 
-    if (lp->inblob)
+    while (curr - buf < size)
     {
-#ifdef WITH_ENCLEN
-        if (size < lp->ce->pcdata.sm - lp->ce->pcdata.sl)
-        {
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
-        }
-        else
-            lp->inblob = 0;
-#endif
-#ifdef WITH_MEMCHR
-        char *ltpos = memchr(buf, '<', size);
-        if (!ltpos)
+        char newc = *curr;
+
+        /* raw content is taken as is, whatever the bytes */
+        if (lp->cs == INRAW)
         {
-            lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-            lp->ce->pcdata.sm += size;
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
+            curr += rawContent(lp, curr, size - (int)(curr - buf));
+            continue;
         }
-        else
-            lp->inblob = 0;
-#endif
-    }
-    else
-    {
-        if (lp->ce)
+
+        /* copy plain content in one go, this is most of a BLOB */
+        if (lp->cs == INCON && !lp->skipping && lp->lastc != '<')
         {
-            char *ctag = tagXMLEle(lp->ce);
-            if (ctag && !(strcmp(ctag, "oneBLOB")) && (lp->cs == INCON))
+            int n = contentSpan(curr, size - (int)(curr - buf), &lp->ln);
+            if (n > 0)
             {
-#ifdef WITH_ENCLEN
-                XMLAtt *blenatt = findXMLAtt(lp->ce, "enclen");
-                if (blenatt)
-                {
-                    int blen;
-                    sscanf(valuXMLAtt(blenatt), "%d", &blen);
-
-                    // Add room for those '\n' on every 72 character line + extra half-full line.
-                    blen += (blen / 72) + 1;
-
-                    lp->ce->pcdata.s  = (char *)moremem(lp->ce->pcdata.s, blen);
-                    lp->ce->pcdata.sm = blen; // always set sm
-
-                    if (size <= blen - lp->ce->pcdata.sl)
-                    {
-                        memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                        lp->ce->pcdata.sl += size;
-                        lp->inblob = 1;
-                        return nodes;
-                    }
-                }
-#endif
-#ifdef WITH_MEMCHR
-                char *ltpos = memchr(buf, '<', size);
-                if (!ltpos)
-                {
-                    lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-                    lp->ce->pcdata.sm += size;
-                    memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                    lp->ce->pcdata.sl += size;
-                    lp->inblob = 1;
-                    return nodes;
-                }
-                else
-                    lp->inblob = 0;
-#endif
+                appendBytes(&lp->ce->pcdata, curr, n);
+                lp->lastc = curr[n - 1];
+                curr += n;
+                continue;
             }
         }
-    }
-    while (curr - buf < size)
-    {
-        char newc = *curr;
+
         /* EOF? */
         if (newc == 0)
         {
@@ -390,6 +419,13 @@ XMLEle *readXMLEle(LilXML *lp, int newc, char ynot[])
     /* start optimistic */
     ynot[0] = '\0';
 
+    if (lp->cs == INRAW)
+    {
+        char c = (char)newc;
+        rawContent(lp, &c, 1);
+        return (NULL);
+    }
+
     /* EOF? */
     if (newc == 0)
     {
@@ -669,7 +705,7 @@ XMLEle *readXMLFile(FILE *fp, LilXML *lp, char ynot[])
  */
 XMLEle *addXMLEle(XMLEle *parent, const char *tag)
 {
-    XMLEle *ep = growEle(parent);
+    XMLEle *ep = growEle(parent, NULL);
     appendString(&ep->tag, tag);
     return (ep);
 }
@@ -679,7 +715,7 @@ XMLEle *addXMLEle(XMLEle *parent, const char *tag)
  */
 static void appXMLEle(XMLEle *ep, XMLEle *newep)
 {
-    ep->el            = (XMLEle **)moremem(ep->el, (ep->nel + 1) * sizeof(XMLEle *));
+    ep->el            = (XMLEle **)growList(ep->arena, ep->el, ep->nel, &ep->mel);
     ep->el[ep->nel++] = newep;
 }
 
@@ -1092,7 +1128,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             if (isTokenChar(0, c))
                 growString(&lp->ce->tag, c);
             else if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else
@@ -1101,7 +1137,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case LOOK4ATTRN: /* looking for attr name, > or / */
             if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else if (isTokenChar(1, c))
@@ -1191,6 +1227,14 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 lp->cs = SAWLTINCON;
             else if (!isspace(c))
             {
+                /* make room at once for a whole BLOB, with its line breaks */
+                XMLAtt *enclen = strcmp(lp->ce->tag.s, "oneBLOB") ? NULL : findXMLAtt(lp->ce, "enclen");
+                if (enclen)
+                {
+                    long l = atol(enclen->valu.s);
+                    if (l > 0 && l < INT_MAX / 2)
+                        reserveString(&lp->ce->pcdata, (int)(l + l / 72 + 2));
+                }
                 growString(&lp->ce->pcdata, c);
                 lp->cs = INCON;
             }
@@ -1271,6 +1315,9 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             }
             break;
 
+        case INRAW: /* handled by rawContent() */
+            break;
+
         case INCLOSETAG: /* reading closing tag */
             if (isTokenChar(0, c))
                 growString(&lp->endtag, c);
@@ -1300,25 +1347,77 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
     return (0);
 }
 
+/* opening tag is complete, its content follows */
+static void startContent(LilXML *lp)
+{
+    XMLAtt *rawlen = lp->raw ? findXMLAtt(lp->ce, "rawlen") : NULL;
+
+    lp->cs = LOOK4CON;
+    if (rawlen)
+    {
+        long l = atol(rawlen->valu.s);
+        if (l > 0 && l < INT_MAX)
+        {
+            reserveString(&lp->ce->pcdata, (int)l + 1);
+            lp->rawleft = l;
+            lp->cs      = INRAW;
+        }
+    }
+}
+
+/* append up to size bytes of raw content, return how many were used.
+ * the closing tag is expected right after the last byte.
+ */
+static int rawContent(LilXML *lp, const char *buf, int size)
+{
+    int n = size < lp->rawleft ? size : (int)lp->rawleft;
+
+    appendBytes(&lp->ce->pcdata, buf, n);
+    lp->rawleft -= n;
+    if (lp->rawleft == 0)
+    {
+        lp->cs    = LOOK4CON;
+        lp->lastc = 0;
+    }
+    return (n);
+}
+
 /* set up for a fresh start again */
 static void initParser(LilXML *lp)
 {
-    delXMLEle(lp->ce);
+    int arena = lp->arena;
+    int raw   = lp->raw;
+
+    delParserTree(lp);
     freeString(&lp->endtag);
     memset(lp, 0, sizeof(*lp));
     newString(&lp->endtag);
-    lp->cs = LOOK4START;
-    lp->ln = 1;
+    lp->cs    = LOOK4START;
+    lp->ln    = 1;
+    lp->arena = arena;
+    lp->raw   = raw;
+}
+
+/* delete the whole tree being built, ce may be a nested element */
+static void delParserTree(LilXML *lp)
+{
+    XMLEle *root = lp->ce;
+
+    while (root && root->pe)
+        root = root->pe;
+    delXMLEle(root);
+    lp->ce = NULL;
 }
 
 /* start a new XMLEle.
  * point ce to a new XMLEle.
  * if ce already set up, add to its list of child elements too.
+ * a new root gets its own arena in arena mode.
  * endtag no longer valid.
  */
 static void pushXMLEle(LilXML *lp)
 {
-    lp->ce = growEle(lp->ce);
+    lp->ce = growEle(lp->ce, (!lp->ce && lp->arena) ? newArena() : NULL);
     resetEndTag(lp);
 }
 
@@ -1331,21 +1430,29 @@ static void popXMLEle(LilXML *lp)
     resetEndTag(lp);
 }
 
-/* return one new XMLEle, added to the given element if given */
-static XMLEle *growEle(XMLEle *pe)
+/* return one new XMLEle, added to the given element if given.
+ * a child lives in the arena of its parent, a new root in the given arena if any.
+ */
+static XMLEle *growEle(XMLEle *pe, XMLArena *arena)
 {
-    XMLEle *newe = (XMLEle *)moremem(NULL, sizeof(XMLEle));
+    if (pe)
+        arena = pe->arena;
+
+    XMLEle *newe = (XMLEle *)(arena ? arenaAlloc(arena, sizeof(XMLEle)) : moremem(NULL, sizeof(XMLEle)));
 
     memset(newe, 0, sizeof(XMLEle));
-    newString(&newe->tag);
-    newString(&newe->pcdata);
+    newe->arena = arena;
+    initString(&newe->tag, arena);
+    initString(&newe->pcdata, arena);
     newe->pe = pe;
 
     if (pe)
     {
-        pe->el            = (XMLEle **)moremem(pe->el, (pe->nel + 1) * sizeof(XMLEle *));
+        pe->el            = (XMLEle **)growList(arena, pe->el, pe->nel, &pe->mel);
         pe->el[pe->nel++] = newe;
     }
+    else if (arena)
+        arena->root = newe;
 
     return (newe);
 }
@@ -1353,19 +1460,37 @@ static XMLEle *growEle(XMLEle *pe)
 /* add room for and return one new XMLAtt to the given element */
 static XMLAtt *growAtt(XMLEle *ep)
 {
-    XMLAtt *newa = (XMLAtt *)moremem(NULL, sizeof * newa);
+    XMLAtt *newa = (XMLAtt *)(ep->arena ? arenaAlloc(ep->arena, sizeof * newa) : moremem(NULL, sizeof * newa));
 
     memset(newa, 0, sizeof(*newa));
-    newString(&newa->name);
-    newString(&newa->valu);
+    initString(&newa->name, ep->arena);
+    initString(&newa->valu, ep->arena);
     newa->ce = ep;
 
-    ep->at            = (XMLAtt **)moremem(ep->at, (ep->nat + 1) * sizeof(XMLAtt *));
+    ep->at            = (XMLAtt **)growList(ep->arena, ep->at, ep->nat, &ep->mat);
     ep->at[ep->nat++] = newa;
 
     return (newa);
 }
 
+/* return list, with n pointers, grown if needed to hold one more.
+ * *m is the room in list, updated.
+ */
+static void *growList(XMLArena *arena, void *list, int n, int *m)
+{
+    if (n < *m)
+        return (list);
+
+    *m = *m ? *m * 2 : 4;
+    if (!arena)
+        return (moremem(list, *m * sizeof(void *)));
+
+    void *newl = arenaAlloc(arena, *m * sizeof(void *));
+    if (n)
+        memcpy(newl, list, n * sizeof(void *));
+    return (newl);
+}
+
 /* free a and all it holds */
 static void freeAtt(XMLAtt *a)
 {
@@ -1373,7 +1498,8 @@ static void freeAtt(XMLAtt *a)
         return;
     freeString(&a->name);
     freeString(&a->valu);
-    (*myfree)(a);
+    if (!a->ce->arena)
+        (*myfree)(a);
 }
 
 /* reset endtag */
@@ -1401,9 +1527,7 @@ static void growString(String *sp, int c)
         if (!sp->s)
             newString(sp);
         else
-        {
-            sp->s = (char *)moremem(sp->s, sp->sm *= 2);
-        }
+            reserveString(sp, sp->sm * 2);
     }
     sp->s[--l] = '\0';
     sp->s[--l] = (char)c;
@@ -1420,14 +1544,7 @@ static void appendString(String *sp, const char *str)
     int l    = sp->sl + strl + 1; /* need room for '\0' */
 
     if (l > sp->sm)
-    {
-        if (!sp->s)
-            newString(sp);
-        if (l > sp->sm)
-        {
-            sp->s = (char *)moremem(sp->s, (sp->sm = l));
-        }
-    }
+        reserveString(sp, l);
     if (sp->s)
     {
         strcpy(&sp->s[sp->sl], str);
@@ -1435,26 +1552,133 @@ static void appendString(String *sp, const char *str)
     }
 }
 
+/* append the n bytes at str to the String storage at *sp, growing it geometrically */
+static void appendBytes(String *sp, const char *str, int n)
+{
+    int l = sp->sl + n + 1; /* need room for '\0' */
+
+    if (l > sp->sm)
+        reserveString(sp, l > 2 * sp->sm ? l : 2 * sp->sm);
+    memcpy(&sp->s[sp->sl], str, n);
+    sp->sl += n;
+    sp->s[sp->sl] = '\0';
+}
+
+/* make room in the String storage at *sp for n bytes, including the '\0'.
+ * strings too long for an arena are moved to malloced memory.
+ */
+static void reserveString(String *sp, int n)
+{
+    if (!sp->s)
+        newString(sp);
+    if (n <= sp->sm)
+        return;
+
+    if (sp->arena)
+    {
+        char *s = (char *)(n <= ARENA_MAXSTR ? arenaAlloc(sp->arena, n) : moremem(NULL, n));
+        memcpy(s, sp->s, sp->sl + 1);
+        sp->s = s;
+        if (n > ARENA_MAXSTR)
+            sp->arena = NULL;
+    }
+    else
+        sp->s = (char *)moremem(sp->s, n);
+    sp->sm = n;
+}
+
 /* init a String with a malloced string containing just \0 */
 static void newString(String *sp)
 {
     if (!sp)
         return;
 
-    sp->s  = (char *)moremem(NULL, MINMEM);
-    sp->sm = MINMEM;
-    *sp->s = '\0';
-    sp->sl = 0;
+    sp->s     = (char *)moremem(NULL, MINMEM);
+    sp->sm    = MINMEM;
+    *sp->s    = '\0';
+    sp->sl    = 0;
+    sp->arena = NULL;
+}
+
+/* init a String with just \0, in the given arena if any */
+static void initString(String *sp, XMLArena *arena)
+{
+    if (!arena)
+    {
+        newString(sp);
+        return;
+    }
+
+    sp->s     = (char *)arenaAlloc(arena, ARENA_MINSTR);
+    sp->sm    = ARENA_MINSTR;
+    *sp->s    = '\0';
+    sp->sl    = 0;
+    sp->arena = arena;
 }
 
 /* free memory used by the given String */
 static void freeString(String *sp)
 {
-    if (sp->s)
+    if (sp->s && !sp->arena)
         (*myfree)(sp->s);
-    sp->s  = NULL;
-    sp->sl = 0;
-    sp->sm = 0;
+    sp->s     = NULL;
+    sp->sl    = 0;
+    sp->sm    = 0;
+    sp->arena = NULL;
+}
+
+/* return a new empty arena. it lives in its own first block */
+static XMLArena *newArena()
+{
+    XMLArenaBlock *b = (XMLArenaBlock *)moremem(NULL, ARENA_MINBLK);
+    XMLArena *ap     = (XMLArena *)((char *)b + ARENA_HDRSZ);
+    size_t used      = ARENA_HDRSZ + ((sizeof(XMLArena) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+
+    b->prev   = NULL;
+    ap->last  = b;
+    ap->next  = (char *)b + used;
+    ap->left  = ARENA_MINBLK - used;
+    ap->blksz = 2 * ARENA_MINBLK;
+    ap->root  = NULL;
+    return (ap);
+}
+
+/* return n bytes from the arena, adding a block if needed */
+static void *arenaAlloc(XMLArena *ap, size_t n)
+{
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (n > ap->left)
+    {
+        size_t bs = ap->blksz;
+        if (bs < ARENA_HDRSZ + n)
+            bs = ARENA_HDRSZ + n;
+        else if (ap->blksz < ARENA_MAXBLK)
+            ap->blksz *= 2;
+
+        XMLArenaBlock *b = (XMLArenaBlock *)moremem(NULL, bs);
+        b->prev  = ap->last;
+        ap->last = b;
+        ap->next = (char *)b + ARENA_HDRSZ;
+        ap->left = bs - ARENA_HDRSZ;
+    }
+
+    void *p = ap->next;
+    ap->next += n;
+    ap->left -= n;
+    return (p);
+}
+
+/* free all the blocks of an arena, including the arena itself */
+static void freeArena(XMLArena *ap)
+{
+    XMLArenaBlock *b = ap->last;
+
+    while (b)
+    {
+        XMLArenaBlock *prev = b->prev;
+        (*myfree)(b);
+        b = prev;
+    }
 }
 
 /* like malloc but knows to use realloc if already started */
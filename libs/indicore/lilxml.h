@@ -92,6 +92,25 @@ extern LilXML *newLilXML();
 */
 extern void delLilXML(LilXML *lp);
 
+/** \brief Allocate the trees parsed by a lilxml parser from arenas.
+
+    In arena mode, every element, attribute and short string of a parsed tree comes from a single arena,
+    released at once by delXMLEle() on the root. Long pcdata (BLOBs) is still held in its own buffer.
+    Trees can be edited as usual; memory of deleted children is only reclaimed with the root.
+    \param lp a pointer to a lilxml parser.
+    \param on 1 to enable arena mode, 0 to disable it.
+*/
+extern void setLilXMLArena(LilXML *lp, int on);
+
+/** \brief Read the content of elements carrying a rawlen attribute as raw bytes.
+
+    The content of such an element is exactly rawlen bytes, taken as is without entity decoding, followed
+    immediately by the closing tag. indiserver sends BLOBs this way to clients that sent enableBLOB with binary='true'.
+    \param lp a pointer to a lilxml parser.
+    \param on 1 to honour rawlen attributes, 0 to parse them as regular attributes.
+*/
+extern void setLilXMLRawContent(LilXML *lp, int on);
+
 /**
  * @brief delXMLEle Delete XML element.
  * @param e Pointer to XML element to delete. If nullptr, no action is taken.
@@ -23,16 +23,19 @@
 #define _GNU_SOURCE
 
 #ifdef __linux__
+#include <linux/memfd.h>
 #include <linux/unistd.h>
 #endif
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdio.h>
 
 #if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <pthread.h>
 #endif
 
@@ -44,63 +47,163 @@ static pthread_mutex_t shared_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
 // A shared buffer will be allocated by chunk of at least 1M (must be ^ 2)
 #define BLOB_SIZE_UNIT 0x100000
 
+// Buffers of at least this size are backed by huge pages when possible
+#define BLOB_HUGE_SIZE 0x400000
+
+// Buffers freed before being shared are kept for reuse, up to this total size
+#define BLOB_POOL_SIZE 0x10000000
+
+// The pool keeps buffers by power of 2 of their size in BLOB_SIZE_UNIT
+#define BLOB_POOL_CLASSES 16
+
 typedef struct shared_buffer
 {
     void * mapstart;
     size_t size;
     size_t allocated;
+    // allocation granularity: BLOB_SIZE_UNIT, or the huge page size
+    size_t unit;
     int fd;
     int sealed;
-    struct shared_buffer * prev, *next;
+    // next buffer in the same hash bucket or pool class
+    struct shared_buffer * next;
 } shared_buffer;
 
-/* Return the buffer size required for storage (rounded to next BLOB_SIZE_UNIT) */
-static size_t allocation(size_t storage)
+/* Return the buffer size required for storage (rounded to next unit) */
+static size_t allocation(size_t storage, size_t unit)
 {
     if (storage == 0)
     {
-        return BLOB_SIZE_UNIT;
+        return unit;
     }
-    return (storage + BLOB_SIZE_UNIT - 1) & ~(BLOB_SIZE_UNIT - 1);
+    return (storage + unit - 1) & ~(unit - 1);
 }
 
 #ifdef ENABLE_INDI_SHARED_MEMORY
 static void sharedBufferAdd(shared_buffer * sb);
 static shared_buffer * sharedBufferRemove(void * mapstart);
+static shared_buffer * poolTake(size_t size);
+static int poolPut(shared_buffer * sb);
+
+/* Allocate the pages of len bytes at addr, mapped read/write from offset in fd, so that writing them does not fault */
+static void prefault(void * addr, size_t len, int fd, off_t offset)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(addr, len, MADV_POPULATE_WRITE) == 0)
+    {
+        return;
+    }
 #endif
-static shared_buffer * sharedBufferFind(void * mapstart);
+#ifdef MAP_POPULATE
+    // Kernels before 5.14: map again in place
+    if (mmap(addr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | MAP_POPULATE, fd, offset) == MAP_FAILED)
+    {
+        perror("shared buffer populate");
+    }
+#else
+    (void)addr;
+    (void)len;
+    (void)fd;
+    (void)offset;
+#endif
+}
 
-void * IDSharedBlobAlloc(size_t size)
+/* Map len bytes of fd read/write, prefaulted */
+static void * mapBuffer(int fd, size_t len)
 {
-#ifdef ENABLE_INDI_SHARED_MEMORY
-    shared_buffer * sb = (shared_buffer*)malloc(sizeof(shared_buffer));
-    if (sb == NULL) goto ERROR;
+    void * mapstart = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapstart == MAP_FAILED) return mapstart;
 
-    sb->size = size;
-    sb->allocated = allocation(size);
-    sb->sealed = 0;
-    sb->fd = shm_open_anon();
-    if (sb->fd == -1)  goto ERROR;
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages for shmem, when enabled as "advise"
+    if (len >= BLOB_HUGE_SIZE)
+    {
+        madvise(mapstart, len, MADV_HUGEPAGE);
+    }
+#endif
+    prefault(mapstart, len, fd, 0);
+    return mapstart;
+}
 
-    int ret = ftruncate(sb->fd, sb->allocated);
-    if (ret == -1) goto ERROR;
+/* Whether large buffers use memfd on hugetlbfs, as requested by INDISHAREDHUGETLB=1. Clients of an older INDI can not
+ * unmap such buffers: they do not round their size to the huge page size. */
+static int useHugetlb(void)
+{
+    static int enabled = -1;
+    if (enabled == -1)
+    {
+        const char * env = getenv("INDISHAREDHUGETLB");
+        enabled = env != NULL && atoi(env) > 0;
+    }
+    return enabled;
+}
 
-    // FIXME: try to map far more than sb->allocated, to allow efficient mremap
-    sb->mapstart = mmap(0, sb->allocated, PROT_READ | PROT_WRITE, MAP_SHARED, sb->fd, 0);
-    if (sb->mapstart == MAP_FAILED) goto ERROR;
+/* Create the file of sb and map it read/write. Return -1 on error */
+static int createBuffer(shared_buffer * sb, size_t size, int huge)
+{
+    sb->unit = BLOB_SIZE_UNIT;
+#if defined(__linux__) && defined(MFD_HUGETLB) && defined(__NR_memfd_create)
+    if (huge)
+    {
+        struct stat st;
+        sb->fd = syscall(__NR_memfd_create, "shm_anon", (unsigned int)(MFD_CLOEXEC | MFD_HUGETLB));
+        if (sb->fd != -1 && fstat(sb->fd, &st) == 0 && (size_t)st.st_blksize > sb->unit)
+        {
+            sb->unit = st.st_blksize;
+        }
+    }
+    else
+#endif
+    {
+        (void)huge;
+        sb->fd = shm_open_anon();
+    }
+    if (sb->fd == -1) return -1;
 
-    sharedBufferAdd(sb);
+    sb->size = size;
+    sb->allocated = allocation(size, sb->unit);
 
-    return sb->mapstart;
-ERROR:
-    if (sb)
+    // Huge pages are reserved by mmap: it fails if the system has not enough of them
+    sb->mapstart = MAP_FAILED;
+    if (ftruncate(sb->fd, sb->allocated) != -1)
+    {
+        sb->mapstart = mapBuffer(sb->fd, sb->allocated);
+    }
+    if (sb->mapstart == MAP_FAILED)
     {
         int e = errno;
-        if (sb->fd != -1) close(sb->fd);
-        free(sb);
+        close(sb->fd);
         errno = e;
+        return -1;
     }
-    return NULL;
+    return 0;
+}
+#endif
+static shared_buffer * sharedBufferFind(void * mapstart);
+
+void * IDSharedBlobAlloc(size_t size)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    shared_buffer * sb = poolTake(size);
+    if (sb == NULL)
+    {
+        sb = (shared_buffer*)malloc(sizeof(shared_buffer));
+        if (sb == NULL) return NULL;
+
+        sb->sealed = 0;
+        if ((size < BLOB_HUGE_SIZE || !useHugetlb() || createBuffer(sb, size, 1) == -1)
+                && createBuffer(sb, size, 0) == -1)
+        {
+            int e = errno;
+            free(sb);
+            errno = e;
+            return NULL;
+        }
+    }
+
+    sharedBufferAdd(sb);
+
+    return sb->mapstart;
 #else
     return malloc(size);
 #endif
@@ -114,8 +217,18 @@ void * IDSharedBlobAttach(int fd, size_t size)
     sb->fd = fd;
     sb->size = size;
     sb->allocated = size;
+    sb->unit = BLOB_SIZE_UNIT;
     sb->sealed = 1;
 
+    // Buffers on hugetlbfs are mapped by whole huge pages
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_blksize > getpagesize()
+            && allocation(size, st.st_blksize) <= (size_t)st.st_size)
+    {
+        sb->allocated = allocation(size, st.st_blksize);
+    }
+
+    // Read faults on the pages of the driver are cheap (fault-around): no need to prefault
     sb->mapstart = mmap(0, sb->allocated, PROT_READ, MAP_SHARED, sb->fd, 0);
     if (sb->mapstart == MAP_FAILED) goto ERROR;
 
@@ -147,6 +260,12 @@ void IDSharedBlobFree(void * ptr)
         return;
     }
 
+    // Nobody else knows a buffer that was never shared
+    if (!sb->sealed && poolPut(sb))
+    {
+        return;
+    }
+
     if (munmap(sb->mapstart, sb->allocated) == -1)
     {
         perror("shared buffer munmap");
@@ -198,7 +317,7 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
         return realloc(ptr, size);
     }
 
-#if defined(_WIN32)
+#if defined(_WIN32) || !defined(ENABLE_INDI_SHARED_MEMORY)
     return NULL;
 #else
     if (sb->sealed)
@@ -208,26 +327,38 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
         return NULL;
     }
 
-    if (sb->size >= size)
+    // Shrinking is not implemented, and a recycled buffer may be larger than requested
+    if (size <= sb->allocated)
     {
-        // Shrinking is not implemented
         sb->size = size;
         return ptr;
     }
 
-    size_t reallocated = allocation(size);
-    if (reallocated == sb->allocated)
-    {
-        sb->size = size;
-        return ptr;
-    }
+    size_t reallocated = allocation(size, sb->unit);
 
     int ret = ftruncate(sb->fd, reallocated);
     if (ret == -1) return NULL;
 
+    // The buffer is hashed by its address
+    sharedBufferRemove(ptr);
+
 #ifdef MREMAP_MAYMOVE
     void * remaped = mremap(sb->mapstart, sb->allocated, reallocated, MREMAP_MAYMOVE);
-    if (remaped == MAP_FAILED) return NULL;
+    if (remaped == MAP_FAILED)
+    {
+        // Older kernels can not mremap huge pages, the content is in the file anyway
+        remaped = mmap(0, reallocated, PROT_READ | PROT_WRITE, MAP_SHARED, sb->fd, 0);
+        if (remaped != MAP_FAILED && munmap(sb->mapstart, sb->allocated) == -1)
+        {
+            perror("shared buffer munmap");
+            _exit(1);
+        }
+    }
+    if (remaped == MAP_FAILED)
+    {
+        sharedBufferAdd(sb);
+        return NULL;
+    }
 
 #else
     // compatibility path for MACOS
@@ -237,11 +368,26 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
         _exit(1);
     }
     void * remaped = mmap(0, reallocated, PROT_READ | PROT_WRITE, MAP_SHARED, sb->fd, 0);
-    if (remaped == MAP_FAILED) return NULL;
+    if (remaped == MAP_FAILED)
+    {
+        close(sb->fd);
+        free(sb);
+        return NULL;
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    if (reallocated >= BLOB_HUGE_SIZE)
+    {
+        madvise(remaped, reallocated, MADV_HUGEPAGE);
+    }
 #endif
+    // Only the new part was not touched yet
+    prefault((char*)remaped + sb->allocated, reallocated - sb->allocated, sb->fd, sb->allocated);
+
     sb->size = size;
     sb->allocated = reallocated;
     sb->mapstart = remaped;
+    sharedBufferAdd(sb);
 
     return remaped;
 #endif
@@ -250,8 +396,8 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
 static void seal(shared_buffer * sb)
 {
 #ifdef ENABLE_INDI_SHARED_MEMORY
-    void * ret = mmap(sb->mapstart, sb->allocated, PROT_READ, MAP_SHARED | MAP_FIXED, sb->fd, 0);
-    if (ret == MAP_FAILED)
+    // Keeps the pages mapped, unlike a new mapping
+    if (mprotect(sb->mapstart, sb->allocated, PROT_READ) == -1)
     {
         perror("remap readonly failed");
     }
@@ -291,28 +437,65 @@ void IDSharedBlobSeal(void * ptr)
 }
 
 #ifdef ENABLE_INDI_SHARED_MEMORY
-static shared_buffer * first = NULL, *last = NULL;
+// Buffers hashed by mapstart, chained by next
+static shared_buffer * initialBuckets[64];
+static shared_buffer ** buckets = initialBuckets;
+static size_t nbuckets = 64, nbuffers = 0;
 
-static void sharedBufferAdd(shared_buffer * sb)
+// Unshared buffers kept for reuse, by size class, chained by next
+static shared_buffer * pool[BLOB_POOL_CLASSES];
+static size_t poolSize = 0;
+
+static size_t bucketOf(void * mapstart, size_t count)
 {
-    pthread_mutex_lock(&shared_buffer_mutex);
-    // Chained insert at start
-    sb->prev = NULL;
-    sb->next = first;
-    if (first)
+    // Mappings are page aligned and often a multiple of BLOB_SIZE_UNIT apart
+    return (size_t)((((uint64_t)(uintptr_t)mapstart >> 12) * 0x9E3779B97F4A7C15ULL) >> 32) & (count - 1);
+}
+
+/* Double the hash table, keep it as is if out of memory */
+static void sharedBufferGrow(void)
+{
+    size_t count = nbuckets * 2;
+    shared_buffer ** grown = (shared_buffer**)calloc(count, sizeof(shared_buffer*));
+    if (grown == NULL) return;
+
+    for (size_t i = 0; i < nbuckets; ++i)
     {
-        first->prev = sb;
+        shared_buffer * sb = buckets[i];
+        while(sb)
+        {
+            shared_buffer * next = sb->next;
+            size_t bucket = bucketOf(sb->mapstart, count);
+            sb->next = grown[bucket];
+            grown[bucket] = sb;
+            sb = next;
+        }
     }
-    else
+    if (buckets != initialBuckets)
     {
-        last = sb;
+        free(buckets);
     }
-    first = sb;
+    buckets = grown;
+    nbuckets = count;
+}
+
+static void sharedBufferAdd(shared_buffer * sb)
+{
+    pthread_mutex_lock(&shared_buffer_mutex);
+    if (nbuffers >= nbuckets)
+    {
+        sharedBufferGrow();
+    }
+    size_t bucket = bucketOf(sb->mapstart, nbuckets);
+    sb->next = buckets[bucket];
+    buckets[bucket] = sb;
+    nbuffers++;
     pthread_mutex_unlock(&shared_buffer_mutex);
 }
+
 static shared_buffer * sharedBufferFindUnlocked(void * mapstart)
 {
-    shared_buffer * sb = first;
+    shared_buffer * sb = buckets[bucketOf(mapstart, nbuckets)];
     while(sb)
     {
         if (sb->mapstart == mapstart)
@@ -327,27 +510,74 @@ static shared_buffer * sharedBufferFindUnlocked(void * mapstart)
 static shared_buffer * sharedBufferRemove(void * mapstart)
 {
     pthread_mutex_lock(&shared_buffer_mutex);
-    shared_buffer * sb  = sharedBufferFindUnlocked(mapstart);
+    shared_buffer ** where = &buckets[bucketOf(mapstart, nbuckets)];
+    while(*where && (*where)->mapstart != mapstart)
+    {
+        where = &(*where)->next;
+    }
+    shared_buffer * sb = *where;
     if (sb != NULL)
     {
-        if (sb->prev)
-        {
-            sb->prev->next = sb->next;
-        }
-        else
-        {
-            first = sb->next;
-        }
-        if (sb->next)
+        *where = sb->next;
+        nbuffers--;
+    }
+    pthread_mutex_unlock(&shared_buffer_mutex);
+    return sb;
+}
+
+static int poolClass(size_t allocated)
+{
+    int c = 0;
+    for (size_t units = allocated / BLOB_SIZE_UNIT; units > 1 && c < BLOB_POOL_CLASSES - 1; units >>= 1)
+    {
+        c++;
+    }
+    return c;
+}
+
+/* Keep sb for reuse, return 0 if the pool is full */
+static int poolPut(shared_buffer * sb)
+{
+    int kept = 0;
+    pthread_mutex_lock(&shared_buffer_mutex);
+    if (poolSize + sb->allocated <= BLOB_POOL_SIZE)
+    {
+        int c = poolClass(sb->allocated);
+        sb->next = pool[c];
+        pool[c] = sb;
+        poolSize += sb->allocated;
+        kept = 1;
+    }
+    pthread_mutex_unlock(&shared_buffer_mutex);
+    return kept;
+}
+
+/* Return a pooled buffer for size bytes, of at most the next size class so that little memory is wasted */
+static shared_buffer * poolTake(size_t size)
+{
+    shared_buffer * sb = NULL;
+    int c = poolClass(allocation(size, BLOB_SIZE_UNIT));
+    pthread_mutex_lock(&shared_buffer_mutex);
+    for (int i = c; i <= c + 1 && i < BLOB_POOL_CLASSES && sb == NULL; ++i)
+    {
+        shared_buffer ** where = &pool[i];
+        while(*where && (*where)->allocated < size)
         {
-            sb->next->prev = sb->prev;
+            where = &(*where)->next;
         }
-        else
+        sb = *where;
+        if (sb != NULL)
         {
-            last = sb->prev;
+            *where = sb->next;
+            poolSize -= sb->allocated;
         }
     }
     pthread_mutex_unlock(&shared_buffer_mutex);
+
+    if (sb != NULL)
+    {
+        sb->size = size;
+    }
     return sb;
 }
 #endif
@@ -69,7 +69,7 @@ BaseDevicePrivate::BaseDevicePrivate()
 
 BaseDevicePrivate::~BaseDevicePrivate()
 {
-    pAll.clear();
+    clearProperties();
 }
 
 BaseDevice::BaseDevice()
@@ -139,21 +139,9 @@ void *BaseDevice::getRawProperty(const char *name, INDI_PROPERTY_TYPE type) cons
 INDI::Property BaseDevice::getProperty(const char *name, INDI_PROPERTY_TYPE type) const
 {
     D_PTR(const BaseDevice);
-    std::lock_guard<std::mutex> lock(d->m_Lock);
+    std::shared_lock<std::shared_mutex> lock(d->m_Lock);
 
-    for (const auto &oneProp : getProperties())
-    {
-        if (type != oneProp.getType() && type != INDI_UNKNOWN)
-            continue;
-
-        if (!oneProp.getRegistered())
-            continue;
-
-        if (oneProp.isNameMatch(name))
-            return oneProp;
-    }
-
-    return INDI::Property();
+    return d->findProperty(name, type);
 }
 
 BaseDevice::Properties BaseDevice::getProperties()
@@ -173,7 +161,20 @@ int BaseDevice::removeProperty(const char *name, char *errmsg)
     D_PTR(BaseDevice);
     int result = INDI_PROPERTY_INVALID;
 
-    std::lock_guard<std::mutex> lock(d->m_Lock);
+    std::lock_guard<std::shared_mutex> lock(d->m_Lock);
+
+    auto it = d->propertyIndex.find(name);
+    if (it != d->propertyIndex.end())
+    {
+        auto &indexed = it->second;
+        indexed.erase(std::remove_if(indexed.begin(), indexed.end(), [&name](INDI::Property & prop)
+        {
+            return prop.isNameMatch(name);
+        }), indexed.end());
+
+        if (indexed.empty())
+            d->propertyIndex.erase(it);
+    }
 
     d->pAll.erase_if([&name, &result](INDI::Property & prop) -> bool
     {
@@ -774,11 +775,22 @@ int BaseDevicePrivate::setBLOB(INDI::PropertyBlob property, const LilXmlElement
         if (sSharedToBlob(element, *widget) == false)
 #endif
         {
-            size_t base64_encoded_size = element.context().size();
-            size_t base64_decoded_size = 3 * base64_encoded_size / 4;
-            widget->setBlob(realloc(widget->getBlob(), base64_decoded_size));
-            int blobLen = from64tobits_fast(static_cast<char *>(widget->getBlob()), element.context(), base64_encoded_size);
-            widget->setBlobLen(blobLen);
+            if (auto rawlen = element.getAttribute("rawlen"))
+            {
+                // Binary framing, the parser already holds the bytes as sent by the driver
+                size_t raw_size = std::min(static_cast<size_t>(rawlen.toInt()), element.context().size());
+                widget->setBlob(realloc(widget->getBlob(), raw_size));
+                memcpy(widget->getBlob(), element.context().data(), raw_size);
+                widget->setBlobLen(raw_size);
+            }
+            else
+            {
+                size_t base64_encoded_size = element.context().size();
+                size_t base64_decoded_size = 3 * base64_encoded_size / 4;
+                widget->setBlob(realloc(widget->getBlob(), base64_decoded_size));
+                int blobLen = from64tobits_fast(static_cast<char *>(widget->getBlob()), element.context(), base64_encoded_size);
+                widget->setBlobLen(blobLen);
+            }
         }
 
         if (format.endsWith(".z"))
@@ -888,7 +900,7 @@ void BaseDevice::doMessage(XMLEle *msg)
 void BaseDevice::addMessage(const std::string &msg)
 {
     D_PTR(BaseDevice);
-    std::unique_lock<std::mutex> guard(d->m_Lock);
+    std::unique_lock<std::shared_mutex> guard(d->m_Lock);
     d->messageLog.push_back(msg);
     guard.unlock();
 
@@ -898,7 +910,7 @@ void BaseDevice::addMessage(const std::string &msg)
 const std::string &BaseDevice::messageQueue(size_t index) const
 {
     D_PTR(const BaseDevice);
-    std::lock_guard<std::mutex> lock(d->m_Lock);
+    std::shared_lock<std::shared_mutex> lock(d->m_Lock);
     assert(index < d->messageLog.size());
     return d->messageLog.at(index);
 }
@@ -906,7 +918,7 @@ const std::string &BaseDevice::messageQueue(size_t index) const
 const std::string &BaseDevice::lastMessage() const
 {
     D_PTR(const BaseDevice);
-    std::lock_guard<std::mutex> lock(d->m_Lock);
+    std::shared_lock<std::shared_mutex> lock(d->m_Lock);
     assert(d->messageLog.size() != 0);
     return d->messageLog.back();
 }
@@ -26,7 +26,10 @@
 #include <deque>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <functional>
 
 #include "indipropertyblob.h"
@@ -62,13 +65,48 @@ class BaseDevicePrivate
         void addProperty(const INDI::Property &property)
         {
             {
-                std::unique_lock<std::mutex> lock(m_Lock);
+                std::unique_lock<std::shared_mutex> lock(m_Lock);
                 pAll.push_back(property);
+                propertyIndex[property.getName()].push_back(property);
             }
 
             emitWatchProperty(property, true);
         }
 
+        /** @brief Find a property by name and type (INDI_UNKNOWN matches any type), m_Lock must be held */
+        INDI::Property findProperty(const char *name, INDI_PROPERTY_TYPE type) const
+        {
+            // Reuse the key buffer, names rarely fit the small string optimization
+            static thread_local std::string key;
+            key.assign(name);
+
+            auto it = propertyIndex.find(key);
+            if (it == propertyIndex.end())
+                return INDI::Property();
+
+            for (const auto &oneProp : it->second)
+            {
+                if (type != oneProp.getType() && type != INDI_UNKNOWN)
+                    continue;
+
+                if (!oneProp.getRegistered())
+                    continue;
+
+                // properties renamed after they were added are not indexed under their new name
+                if (oneProp.isNameMatch(name))
+                    return oneProp;
+            }
+
+            return INDI::Property();
+        }
+
+        void clearProperties()
+        {
+            std::unique_lock<std::shared_mutex> lock(m_Lock);
+            propertyIndex.clear();
+            pAll.clear();
+        }
+
     public: // mediator
         void mediateNewDevice(BaseDevice baseDevice)
         {
@@ -179,12 +217,14 @@ class BaseDevicePrivate
         BaseDevice self {make_shared_weak(this)}; // backward compatible (for operators as pointer)
         std::string deviceName;
         BaseDevice::Properties pAll;
+        // Properties of pAll by the name they were added with, in the order of pAll
+        std::unordered_map<std::string, std::vector<INDI::Property>> propertyIndex;
         std::map<std::string, WatchDetails> watchPropertyMap;
         LilXmlParser xmlParser;
 
         INDI::BaseMediator *mediator {nullptr};
         std::deque<std::string> messageLog;
-        mutable std::mutex m_Lock;
+        mutable std::shared_mutex m_Lock;
 
         bool valid {true};
 };
@@ -19,6 +19,8 @@
 #include "indipropertybasic.h"
 #include "indipropertybasic_p.h"
 #include <cassert>
+#include <cstring>
+#include <string_view>
 
 namespace INDI
 {
@@ -62,6 +64,48 @@ PropertyBasicPrivateTemplate<T>::~PropertyBasicPrivateTemplate()
 #endif
 }
 
+template <typename T>
+WidgetView<T> *PropertyBasicPrivateTemplate<T>::findWidgetByName(const char *name) const
+{
+    // Scanning a few names is cheaper than hashing
+    constexpr int INDEXED_WIDGETS = 8;
+
+    WidgetView<T> *base = this->typedProperty.widget();
+    int count = this->typedProperty.count();
+
+    if (count <= INDEXED_WIDGETS || base == nullptr)
+        return this->typedProperty.findWidgetByName(name);
+
+    size_t hash = std::hash<std::string_view>()(name);
+    {
+        std::lock_guard<std::mutex> lock(widgetIndexLock);
+        if (widgetIndexBase == base && widgetIndexCount == count)
+        {
+            auto range = widgetIndex.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second < count && base[it->second].isNameMatch(name))
+                    return &base[it->second];
+            }
+        }
+    }
+
+    WidgetView<T> *result = this->typedProperty.findWidgetByName(name);
+    if (result == nullptr)
+        return nullptr;
+
+    // Present but not indexed, the widgets changed since the index was built
+    std::lock_guard<std::mutex> lock(widgetIndexLock);
+    widgetIndex.clear();
+    widgetIndex.reserve(count);
+    for (int i = 0; i < count; ++i)
+        widgetIndex.emplace(std::hash<std::string_view>()(base[i].getName()), i);
+    widgetIndexBase  = base;
+    widgetIndexCount = count;
+
+    return result;
+}
+
 template <typename T>
 PropertyBasic<T>::~PropertyBasic()
 { }
@@ -338,7 +382,7 @@ template <typename T>
 WidgetView<T> *PropertyBasic<T>::findWidgetByName(const char *name) const
 {
     D_PTR(const PropertyBasic);
-    return d->typedProperty.findWidgetByName(name);
+    return d->findWidgetByName(name);
 }
 
 template <typename T>
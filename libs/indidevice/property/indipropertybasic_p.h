@@ -23,6 +23,8 @@
 
 #include <vector>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
 
 #define INDI_PROPERTY_RAW_CAST
 
@@ -52,11 +54,22 @@ class PropertyBasicPrivateTemplate: public PropertyContainer<T>, public Property
 #endif
         virtual ~PropertyBasicPrivateTemplate();
 
+    public:
+        /** @brief Hashed lookup for properties with many widgets, falls back to a scan */
+        WidgetView<T> *findWidgetByName(const char *name) const;
+
     public:
 #ifdef INDI_PROPERTY_RAW_CAST
         bool raw;
 #endif
         std::vector<WidgetView<T>>  widgets;
+
+        // Widget indexes by name hash. Widgets can be renamed or replaced through the raw
+        // property, so hits are verified and the index is rebuilt when a scan finds a miss.
+        mutable std::mutex widgetIndexLock;
+        mutable std::unordered_multimap<size_t, int> widgetIndex;
+        mutable const WidgetView<T> *widgetIndexBase {nullptr};
+        mutable int widgetIndexCount {0};
 };
 
 }
@@ -23,6 +23,8 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "base64.h"
 
@@ -79,6 +81,121 @@ TEST(CORE_BASE64, Test_from64tobits_fast)
     ASSERT_STREQ(out_msg, res_msg);
 }
 
+// Plain byte by byte encoder, to check the optimized ones
+static std::string referenceBase64(const std::vector<unsigned char> &data)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        uint32_t n = data[i] << 16;
+        if (i + 1 < data.size()) n |= data[i + 1] << 8;
+        if (i + 2 < data.size()) n |= data[i + 2];
+        result += digits[(n >> 18) & 63];
+        result += digits[(n >> 12) & 63];
+        result += i + 1 < data.size() ? digits[(n >> 6) & 63] : '=';
+        result += i + 2 < data.size() ? digits[n & 63] : '=';
+    }
+    return result;
+}
+
+static std::vector<unsigned char> randomBytes(size_t len)
+{
+    std::vector<unsigned char> result(len);
+    uint32_t seed = 12345;
+    for (auto &c : result)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = seed >> 16;
+    }
+    return result;
+}
+
+// Break lines every 72 characters, as drivers do
+static std::string lines72(const std::string &b64)
+{
+    std::string result;
+    for (size_t i = 0; i < b64.size(); i += 72)
+        result += b64.substr(i, 72) + "\n";
+    return result;
+}
+
+TEST(CORE_BASE64, Test_large_roundtrip)
+{
+    for (size_t len : {0, 1, 2, 3, 11, 12, 13, 47, 48, 49, 100, 1000, 100000, 100001, 100002})
+    {
+        auto data = randomBytes(len);
+        std::string expected = referenceBase64(data);
+
+        std::vector<unsigned char> b64(4 * len / 3 + 4);
+        int b64len = to64frombits_s(b64.data(), data.data(), int(len), b64.size());
+        ASSERT_EQ(size_t(b64len), expected.size());
+        ASSERT_EQ(expected, std::string(reinterpret_cast<char *>(b64.data()), b64len));
+
+        if (len == 0)
+            continue;
+
+        // With and without line breaks, the length given without them (enclen)
+        for (std::string input : {expected, lines72(expected)})
+        {
+            std::vector<char> back(len + 4), legacy(len + 4);
+            int backLen = from64tobits_fast(back.data(), input.data(), int(expected.size()));
+            int legacyLen = from64tobits_fast_with_bug(legacy.data(), input.data(), int(expected.size()));
+            ASSERT_EQ(size_t(backLen), len);
+            ASSERT_EQ(legacyLen, backLen);
+            ASSERT_EQ(0, memcmp(back.data(), data.data(), len));
+            ASSERT_EQ(0, memcmp(legacy.data(), data.data(), len));
+        }
+    }
+}
+
+TEST(CORE_BASE64, Test_stream)
+{
+    auto data = randomBytes(100000);
+    std::string expected = referenceBase64(data);
+
+    for (int chunk : {1, 2, 5, 54, 1000, 65536})
+    {
+        base64_stream st;
+        base64_stream_init(&st, 72);
+
+        std::string encoded;
+        std::vector<unsigned char> buf(4 * chunk / 3 + 16 + chunk / 54);
+        for (size_t pos = 0; pos < data.size(); pos += chunk)
+        {
+            int len = std::min(size_t(chunk), data.size() - pos);
+            int n = to64frombits_stream(&st, buf.data(), data.data() + pos, len);
+            encoded.append(reinterpret_cast<char *>(buf.data()), n);
+        }
+        int n = to64frombits_stream_end(&st, buf.data());
+        encoded.append(reinterpret_cast<char *>(buf.data()), n);
+        ASSERT_EQ(lines72(expected), encoded);
+
+        base64_stream_init(&st, 0);
+        std::string decoded;
+        std::vector<char> out(3 * chunk / 4 + 3);
+        for (size_t pos = 0; pos < encoded.size(); pos += chunk)
+        {
+            int len = std::min(size_t(chunk), encoded.size() - pos);
+            int n = from64tobits_stream(&st, out.data(), encoded.data() + pos, len);
+            ASSERT_GE(n, 0);
+            decoded.append(out.data(), n);
+        }
+        ASSERT_EQ(from64tobits_stream_end(&st, out.data()), 0);
+        ASSERT_EQ(decoded.size(), data.size());
+        ASSERT_EQ(0, memcmp(decoded.data(), data.data(), data.size()));
+    }
+
+    // Unpadded and invalid input
+    base64_stream st;
+    char out[16];
+    base64_stream_init(&st, 0);
+    ASSERT_EQ(from64tobits_stream(&st, out, "Rk9PQkE", 7), 3);
+    ASSERT_EQ(from64tobits_stream_end(&st, out), 2);
+    base64_stream_init(&st, 0);
+    ASSERT_EQ(from64tobits_stream(&st, out, "Rk9P*kE=", 8), -1);
+}
+
 TEST(CORE_BASE64, Test_from64tobits_fast_time)
 {
     const char   inp_msg[] = "Rk9PQkFSQkFa";
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "indiccdchip.h"
+#include "sharedblob.h"
+
+namespace INDI
+{
+
+// binFrame() and binBayerFrame() are compared with the per pixel loops they replace for whole bins
+class CCDChipBinningTest : public ::testing::Test
+{
+    protected:
+        static std::vector<uint8_t> randomFrame(uint32_t width, uint32_t height, int bpp, int bin)
+        {
+            static std::mt19937 generator(42);
+            int maxValue = bpp == 8 ? UINT8_MAX : UINT16_MAX;
+            std::uniform_int_distribution<int> distribution(0, maxValue);
+
+            // The per pixel mono loop reads up to a bin past the last row of partial bins
+            std::vector<uint8_t> frame((height + bin) * width * (bpp / 8));
+            for (uint32_t i = 0; i < width * height; i++)
+            {
+                // Some saturated pixels to check clamping
+                int value = distribution(generator) % 8 == 0 ? maxValue : distribution(generator);
+                if (bpp == 8)
+                    frame[i] = value;
+                else
+                    reinterpret_cast<uint16_t *>(frame.data())[i] = value;
+            }
+            return frame;
+        }
+
+        static std::vector<uint8_t> binned(const std::vector<uint8_t> &frame, uint32_t width, uint32_t height, int bpp,
+                                           int bin, bool bayer, bool perPixel)
+        {
+            CCDChip chip;
+            chip.SubW         = width;
+            chip.SubH         = height;
+            chip.BinX         = bin;
+            chip.BinY         = bin;
+            chip.BitsPerPixel = bpp;
+            chip.setFrameBufferSize(frame.size());
+            memcpy(chip.getFrameBuffer(), frame.data(), frame.size());
+
+            if (perPixel)
+            {
+                chip.BinFrame = static_cast<uint8_t *>(IDSharedBlobAlloc(frame.size()));
+                memset(chip.BinFrame, 0, frame.size());
+                EXPECT_TRUE(bayer ? chip.binBayerFramePerPixel() : chip.binFramePerPixel());
+                return std::vector<uint8_t>(chip.BinFrame, chip.BinFrame + frame.size());
+            }
+
+            if (bayer)
+                chip.binBayerFrame();
+            else
+                chip.binFrame();
+            return std::vector<uint8_t>(chip.getFrameBuffer(), chip.getFrameBuffer() + frame.size());
+        }
+
+        static void compare(bool bayer)
+        {
+            for (int bpp : { 8, 16 })
+                for (int bin : { 2, 3, 4, 5 })
+                {
+                    // Whole Bayer cells, whole bins only and partial bins at the right and bottom edges
+                    uint32_t cell = 2 * bin;
+                    const uint32_t sizes[][2] =
+                    {
+                        { cell * 17, cell * 9 }, { cell * 17 + bin, cell * 9 + bin }, { cell * 17 + 1, cell * 9 },
+                        { cell * 17, cell * 9 + 3 }, { cell * 17 + bin + 1, cell * 9 + bin - 1 },
+                        // Large enough to be split between threads
+                        { cell * 200, cell * 150 }
+                    };
+
+                    for (auto &size : sizes)
+                    {
+                        std::vector<uint8_t> frame    = randomFrame(size[0], size[1], bpp, bin);
+                        std::vector<uint8_t> expected = binned(frame, size[0], size[1], bpp, bin, bayer, true);
+                        std::vector<uint8_t> actual   = binned(frame, size[0], size[1], bpp, bin, bayer, false);
+
+                        auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+                        EXPECT_TRUE(mismatch.first == expected.end())
+                                << bpp << " bit " << size[0] << "x" << size[1] << " bin " << bin
+                                << " differs at byte " << (mismatch.first - expected.begin());
+                    }
+                }
+        }
+};
+
+TEST_F(CCDChipBinningTest, mono)
+{
+    compare(false);
+}
+
+TEST_F(CCDChipBinningTest, bayer)
+{
+    compare(true);
+}
+
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "libs/indibase/stream/ccvt.h"
+
+// Each vectorized conversion is compared with the scalar code on sizes that leave tails of every length
+static const int sizes[][2] = { { 2, 2 }, { 16, 4 }, { 34, 6 }, { 64, 8 }, { 98, 10 }, { 640, 6 }, { 37, 5 }, { 101, 9 } };
+
+static std::vector<uint8_t> randomBytes(size_t size)
+{
+    static std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    std::vector<uint8_t> bytes(size);
+
+    for (auto &byte : bytes)
+        byte = distribution(generator);
+    return bytes;
+}
+
+// Run convert with the scalar code and with each instruction set of this processor, return the largest difference
+static int compareLevels(const std::function<std::vector<uint8_t>()> &convert)
+{
+    int best = ccvt_set_simd(-1);
+
+    ccvt_set_simd(CCVT_SIMD_NONE);
+    std::vector<uint8_t> expected = convert();
+
+    int maxDiff = 0;
+    for (int level = CCVT_SIMD_SSSE3; level <= best; level++)
+    {
+        if (ccvt_set_simd(level) != level)
+            continue;
+
+        std::vector<uint8_t> actual = convert();
+        EXPECT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size() && i < actual.size(); i++)
+            maxDiff = std::max(maxDiff, std::abs(expected[i] - actual[i]));
+    }
+
+    ccvt_set_simd(-1);
+    return maxDiff;
+}
+
+TEST(CORE_CCVT, yuyv_rgb24)
+{
+    for (auto &size : sizes)
+    {
+        int width = size[0] & ~1, height = size[1];
+        std::vector<uint8_t> src = randomBytes(width * height * 2);
+
+        EXPECT_EQ(0, compareLevels([&]()
+        {
+            std::vector<uint8_t> dst(width * height * 3);
+            ccvt_yuyv_rgb24(width, height, src.data(), dst.data());
+            return dst;
+        })) << width << "x" << height;
+
+        EXPECT_EQ(0, compareLevels([&]()
+        {
+            std::vector<uint8_t> dst(width * height * 3);
+            ccvt_yuyv_bgr24(width, height, src.data(), dst.data());
+            return dst;
+        })) << width << "x" << height;
+    }
+}
+
+TEST(CORE_CCVT, yuv420p_rgb24)
+{
+    for (auto &size : sizes)
+    {
+        int width = size[0] & ~1, height = size[1] & ~1;
+        std::vector<uint8_t> src = randomBytes(width * height * 3 / 2);
+
+        EXPECT_EQ(0, compareLevels([&]()
+        {
+            std::vector<uint8_t> dst(width * height * 3);
+            ccvt_420p_rgb24(width, height, src.data(), dst.data());
+            return dst;
+        })) << width << "x" << height;
+
+        EXPECT_EQ(0, compareLevels([&]()
+        {
+            std::vector<uint8_t> dst(width * height * 3);
+            ccvt_420p_bgr24(width, height, src.data(), dst.data());
+            return dst;
+        })) << width << "x" << height;
+    }
+}
+
+TEST(CORE_CCVT, rgb_yuv)
+{
+    for (auto &size : sizes)
+    {
+        int width = size[0] & ~1, height = size[1] & ~1;
+        std::vector<uint8_t> src = randomBytes(width * height * 3);
+
+        for (int flip = 0; flip < 2; flip++)
+        {
+            // NEON may fuse the multiplications and additions, which rounds differently than the lookup tables
+            EXPECT_LE(compareLevels([&]()
+            {
+                std::vector<uint8_t> dst(width * height * 3 / 2);
+                RGB2YUV(width, height, src.data(), dst.data(), dst.data() + width * height,
+                        dst.data() + width * height * 5 / 4, flip);
+                return dst;
+            }), 1) << width << "x" << height;
+
+            EXPECT_LE(compareLevels([&]()
+            {
+                std::vector<uint8_t> dst(width * height * 3 / 2);
+                BGR2YUV(width, height, src.data(), dst.data(), dst.data() + width * height,
+                        dst.data() + width * height * 5 / 4, flip);
+                return dst;
+            }), 1) << width << "x" << height;
+        }
+    }
+}
+
+TEST(CORE_CCVT, bayer_rgb24)
+{
+    for (auto &size : sizes)
+    {
+        // The scalar code reads one row before and after the image on the borders
+        int width = size[0], height = size[1] & ~1;
+        std::vector<uint8_t> padded = randomBytes(width * (height + 2));
+        uint8_t *src = padded.data() + width;
+
+        for (auto debayer : { bayer2rgb24, bayer_rggb_2rgb24 })
+        {
+            EXPECT_EQ(0, compareLevels([&]()
+            {
+                std::vector<uint8_t> dst(width * height * 3);
+                debayer(dst.data(), src, width, height);
+                return dst;
+            })) << width << "x" << height;
+        }
+
+        // The borders of this one are not computed for every size
+        std::vector<uint8_t> init = randomBytes(width * height * 3);
+        EXPECT_EQ(0, compareLevels([&]()
+        {
+            std::vector<uint8_t> dst = init;
+            bayer_grbg_to_rgb24(dst.data(), src, width, height);
+            return dst;
+        })) << width << "x" << height;
+    }
+}
@@ -0,0 +1,131 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "libs/eventloop/eventloop.h"
+#include "libs/indibase/connectionplugins/connectioncommandqueue.h"
+
+using Connection::CommandQueue;
+
+// The queue talks to one end of a socket pair, the test plays the device on the other end
+class CommandQueueTest : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        }
+
+        void TearDown() override
+        {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        // Bytes written by the queue so far
+        std::string received()
+        {
+            char buffer[256];
+            ssize_t n = recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+            return n > 0 ? std::string(buffer, n) : std::string();
+        }
+
+        void send(const std::string &response)
+        {
+            ASSERT_EQ(static_cast<ssize_t>(response.size()), write(fds[1], response.data(), response.size()));
+        }
+
+        // Run the event loop until count results are collected, or for ms milliseconds
+        void run(size_t count, int ms)
+        {
+            expected = count;
+            done = results.size() >= expected;
+            deferLoop(ms, &done);
+        }
+
+        CommandQueue::Callback collect()
+        {
+            return [this](CommandQueue::Status status, const std::string &response)
+            {
+                results.push_back({status, response});
+                done = results.size() >= expected;
+            };
+        }
+
+        int fds[2];
+        std::vector<std::pair<CommandQueue::Status, std::string>> results;
+        size_t expected {0};
+        int done {0};
+};
+
+TEST_F(CommandQueueTest, pipelined_responses)
+{
+    CommandQueue queue([this]() { return fds[0]; });
+    queue.setPipelineDepth(3);
+
+    queue.enqueue(":A#", '#', 1000, collect());
+    queue.enqueue(":B#", '#', 1000, collect());
+    EXPECT_EQ(":A#:B#", received());
+
+    send("a#b#");
+    run(2, 1000);
+
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(CommandQueue::COMMAND_OK, results[0].first);
+    EXPECT_EQ("a#", results[0].second);
+    EXPECT_EQ("b#", results[1].second);
+    EXPECT_EQ(0u, queue.pending());
+}
+
+TEST_F(CommandQueueTest, timeout_fails_pipelined_commands)
+{
+    CommandQueue queue([this]() { return fds[0]; });
+    queue.setPipelineDepth(3);
+    queue.setDrainTime(50);
+
+    queue.enqueue(":A#", '#', 100, collect());
+    queue.enqueue(":B#", '#', 100, collect());
+    queue.enqueue(":C#", '#', 100, collect());
+    EXPECT_EQ(":A#:B#:C#", received());
+
+    // The device does not answer in time, none of the responses could be matched to its command anymore
+    run(3, 1000);
+    ASSERT_EQ(3u, results.size());
+    for (auto &result : results)
+        EXPECT_EQ(CommandQueue::COMMAND_TIMEOUT, result.first);
+
+    // The late responses arrive while the next command waits for the device to be quiet
+    send("a#b#");
+    queue.enqueue(":D#", '#', 1000, collect());
+    EXPECT_EQ("", received());
+
+    run(4, 300);
+    EXPECT_EQ(":D#", received());
+
+    send("d#");
+    run(4, 1000);
+    ASSERT_EQ(4u, results.size());
+    EXPECT_EQ(CommandQueue::COMMAND_OK, results[3].first);
+    EXPECT_EQ("d#", results[3].second);
+    EXPECT_EQ(0u, queue.pending());
+}
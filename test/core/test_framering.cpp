@@ -0,0 +1,126 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "libs/indibase/stream/framering.h"
+
+// Slots and pool sized like the stream manager
+static const size_t slots = 1024;
+static const size_t spares = 4;
+static const size_t frameSize = 4 * 1024 * 1024;
+// Frames in flight, like LIMITS_BUFFER_MAX
+static const size_t maxQueued = 16;
+
+// Resident memory in bytes, 0 if unknown on this platform
+static size_t residentMemory()
+{
+    size_t pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    if (fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Stream frames of the given size through the ring like the stream manager, the consumer touches every frame
+static void stream(FrameRing<std::vector<uint8_t>> &ring, FrameBufferPool &pool, size_t count, size_t size)
+{
+    std::thread consumer([&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::vector<uint8_t> *frame;
+            while ((frame = ring.front(100)) == nullptr);
+            EXPECT_EQ(size, frame->size());
+            EXPECT_EQ(uint8_t(i), (*frame)[size - 1]);
+            pool.give(*frame);
+            ring.release();
+        }
+    });
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::vector<uint8_t> *frame;
+        while (ring.size() >= maxQueued || (frame = ring.acquire()) == nullptr)
+            std::this_thread::yield();
+        pool.take(*frame, size);
+        frame->resize(size);
+        memset(frame->data(), int(i), size);
+        ring.publish();
+    }
+
+    consumer.join();
+}
+
+TEST(CORE_FRAMERING, bounded_memory)
+{
+    FrameRing<std::vector<uint8_t>> ring(slots);
+    FrameBufferPool pool(spares);
+
+    size_t before = residentMemory();
+    if (before == 0)
+        GTEST_SKIP() << "resident memory is unknown on this platform";
+
+    // More frames than slots, each slot is used at least once
+    stream(ring, pool, 2 * slots, frameSize);
+
+    // The frames in flight and the spares, not one frame per slot
+    size_t after = residentMemory();
+    size_t grown = after - std::min(before, after);
+    EXPECT_LE(grown, (maxQueued + spares + 4) * frameSize) << grown / 1024 / 1024 << " MB";
+}
+
+TEST(CORE_FRAMERING, spare_buffers_follow_frame_size)
+{
+    FrameBufferPool pool(spares);
+
+    std::vector<uint8_t> buffer(frameSize);
+    const uint8_t *data = buffer.data();
+
+    // A spare is reused for frames of the same size
+    pool.give(buffer);
+    EXPECT_EQ(0u, buffer.capacity());
+    pool.take(buffer, frameSize);
+    EXPECT_EQ(data, buffer.data());
+
+    // A much larger spare is freed when the resolution drops
+    pool.give(buffer);
+    pool.take(buffer, frameSize / 4);
+    EXPECT_EQ(0u, buffer.capacity());
+
+    // Buffers given to a full pool are freed
+    std::vector<std::vector<uint8_t>> buffers(spares + 1, std::vector<uint8_t>(16));
+    for (auto &it : buffers)
+        pool.give(it);
+    size_t taken = 0;
+    for (auto &it : buffers)
+    {
+        pool.take(it, 16);
+        taken += it.capacity() != 0;
+    }
+    EXPECT_EQ(spares, taken);
+}
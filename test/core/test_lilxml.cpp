@@ -0,0 +1,195 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "lilxml.h"
+
+static std::string blobMessage(const std::string &pcdata, bool withEnclen)
+{
+    std::string enclen = withEnclen ? " enclen='" + std::to_string(pcdata.size()) + "'" : "";
+    return "<setBLOBVector device='Dev' name='B'>\n"
+           "  <oneBLOB name='B1' size='3' format='.fits'" + enclen + ">\n" + pcdata + "\n  </oneBLOB>\n"
+           "</setBLOBVector>\n";
+}
+
+static std::string base64Data(size_t len, size_t lineLength)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    for (size_t i = 0; i < len; ++i)
+    {
+        result += alphabet[(i * 7) % 64];
+        if (lineLength && (i + 1) % lineLength == 0 && i + 1 < len)
+            result += '\n';
+    }
+    return result;
+}
+
+// Feed the xml to the parser in chunks of the given size, return the parsed roots
+static std::vector<XMLEle *> parseInChunks(LilXML *lp, const std::string &xml, size_t chunk)
+{
+    std::vector<XMLEle *> result;
+    char err[1024];
+
+    for (size_t pos = 0; pos < xml.size(); pos += chunk)
+    {
+        size_t len = std::min(chunk, xml.size() - pos);
+        XMLEle **nodes = parseXMLChunk(lp, const_cast<char *>(xml.data() + pos), int(len), err);
+        EXPECT_NE(nodes, nullptr);
+        EXPECT_STREQ(err, "");
+        for (XMLEle **node = nodes; node && *node; ++node)
+            result.push_back(*node);
+        free(nodes);
+    }
+    return result;
+}
+
+TEST(CORE_LILXML, ParseBlobInChunks)
+{
+    for (int arena = 0; arena < 2; ++arena)
+    {
+        for (bool withEnclen : {false, true})
+        {
+            for (size_t lineLength : {0, 72})
+            {
+                std::string pcdata = base64Data(100000, lineLength);
+                std::string xml = blobMessage(pcdata, withEnclen) + blobMessage("QUJD", withEnclen);
+
+                for (size_t chunk : {1, 7, 4096, 1000000})
+                {
+                    LilXML *lp = newLilXML();
+                    setLilXMLArena(lp, arena);
+
+                    std::vector<XMLEle *> roots = parseInChunks(lp, xml, chunk);
+                    ASSERT_EQ(roots.size(), 2u);
+
+                    XMLEle *blob = nextXMLEle(roots[0], 1);
+                    ASSERT_NE(blob, nullptr);
+                    EXPECT_STREQ(tagXMLEle(blob), "oneBLOB");
+                    EXPECT_STREQ(findXMLAttValu(blob, "format"), ".fits");
+                    EXPECT_EQ(pcdatalenXMLEle(blob), int(pcdata.size()));
+                    EXPECT_EQ(pcdata, pcdataXMLEle(blob));
+
+                    EXPECT_STREQ(pcdataXMLEle(nextXMLEle(roots[1], 1)), "QUJD");
+
+                    for (auto root : roots)
+                        delXMLEle(root);
+                    delLilXML(lp);
+                }
+            }
+        }
+    }
+}
+
+TEST(CORE_LILXML, EditArenaTree)
+{
+    std::string xml =
+        "<defSwitchVector device='Dev' name='S' label='Some &amp; label'>\n"
+        "  <defSwitch name='S1'>On</defSwitch>\n"
+        "  <defSwitch name='S2'>Off</defSwitch>\n"
+        "</defSwitchVector>\n";
+
+    LilXML *lp = newLilXML();
+    setLilXMLArena(lp, 1);
+    std::vector<XMLEle *> roots = parseInChunks(lp, xml, xml.size());
+    ASSERT_EQ(roots.size(), 1u);
+
+    XMLEle *root = roots[0];
+    EXPECT_STREQ(findXMLAttValu(root, "label"), "Some & label");
+    ASSERT_EQ(nXMLEle(root), 2);
+
+    // Edits mix arena and malloced storage
+    std::string longValue(5000, 'x');
+    editXMLAtt(findXMLAtt(root, "label"), longValue.c_str());
+    rmXMLAtt(root, "name");
+    addXMLAtt(root, "state", "Ok");
+    for (int i = 0; i < 20; ++i)
+        editXMLEle(addXMLEle(root, "defSwitch"), "Off");
+    delXMLEle(findXMLEle(root, "defSwitch"));
+
+    EXPECT_EQ(longValue, findXMLAttValu(root, "label"));
+    EXPECT_STREQ(findXMLAttValu(root, "name"), "");
+    EXPECT_STREQ(findXMLAttValu(root, "state"), "Ok");
+    EXPECT_EQ(nXMLEle(root), 21);
+    EXPECT_STREQ(pcdataXMLEle(nextXMLEle(root, 1)), "Off");
+
+    XMLEle *clone = cloneXMLEle(root, nullptr, nullptr);
+    EXPECT_EQ(nXMLEle(clone), 21);
+
+    delXMLEle(root);
+    delXMLEle(clone);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, RecoverFromError)
+{
+    std::string xml = "<a><b>text</c></a><ok x='1'/>";
+
+    LilXML *lp = newLilXML();
+    setLilXMLArena(lp, 1);
+
+    char err[1024];
+    XMLEle **nodes = parseXMLChunk(lp, const_cast<char *>(xml.data()), int(xml.size()), err);
+    ASSERT_NE(nodes, nullptr);
+    EXPECT_STRNE(err, "");
+    ASSERT_NE(nodes[0], nullptr);
+    EXPECT_STREQ(tagXMLEle(nodes[0]), "ok");
+    EXPECT_EQ(nodes[1], nullptr);
+
+    delXMLEle(nodes[0]);
+    free(nodes);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, ParseRawContent)
+{
+    // Markup characters, nul and whitespace are kept as is
+    std::string payload("ab<\0c>\n  </oneBLOB> ", 20);
+    std::string message =
+        "<setBLOBVector device='Dev' name='B'>\n"
+        "  <oneBLOB name='b' size='20' format='.raw' rawlen='20'>" + payload + "\n  </oneBLOB>\n"
+        "</setBLOBVector>\n";
+    std::string xml = message + message;
+
+    for (int arena = 0; arena < 2; ++arena)
+    {
+        for (size_t chunk : {size_t(1), size_t(7), xml.size()})
+        {
+            LilXML *lp = newLilXML();
+            setLilXMLArena(lp, arena);
+            setLilXMLRawContent(lp, 1);
+
+            std::vector<XMLEle *> roots = parseInChunks(lp, xml, chunk);
+            ASSERT_EQ(roots.size(), 2u);
+
+            for (XMLEle *root : roots)
+            {
+                XMLEle *blob = findXMLEle(root, "oneBLOB");
+                ASSERT_NE(blob, nullptr);
+                ASSERT_EQ(pcdatalenXMLEle(blob), int(payload.size()));
+                EXPECT_EQ(std::string(pcdataXMLEle(blob), payload.size()), payload);
+                delXMLEle(root);
+            }
+            delLilXML(lp);
+        }
+    }
+}
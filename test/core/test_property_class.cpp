@@ -25,6 +25,7 @@
 #include <cstring>
 
 #include "basedevice.h"
+#include "parentdevice.h"
 
 #include "indiproperty.h"
 #include "indipropertynumber.h"
@@ -513,3 +514,56 @@ TEST(CORE_PROPERTY_CLASS, Test_PropertyBlob)
     ASSERT_EQ(INDI::PropertyLight(INDI::Property(p)).isValid(), false);
     ASSERT_EQ(INDI::PropertyBlob(INDI::Property(p)).isValid(), true);
 }
+
+TEST(CORE_PROPERTY_CLASS, Test_FindWidgetByName)
+{
+    INDI::PropertyNumber p{20};
+
+    for (size_t i = 0; i < p.size(); ++i)
+        p[i].setName("widget " + std::to_string(i));
+
+    for (size_t i = 0; i < p.size(); ++i)
+        ASSERT_EQ(p.findWidgetByName(("widget " + std::to_string(i)).c_str()), &p[i]);
+
+    ASSERT_EQ(p.findWidgetByName("widget 20"), nullptr);
+    ASSERT_EQ(p.findWidgetIndexByName("widget 7"), 7);
+
+    // renamed widgets are found under their new name only
+    p[7].setName("renamed");
+    ASSERT_EQ(p.findWidgetByName("widget 7"), nullptr);
+    ASSERT_EQ(p.findWidgetByName("renamed"), &p[7]);
+
+    p.resize(30);
+    p[25].setName("widget 25");
+    ASSERT_EQ(p.findWidgetByName("widget 25"), &p[25]);
+    ASSERT_EQ(p.findWidgetByName("widget 3"), &p[3]);
+}
+
+TEST(CORE_PROPERTY_CLASS, Test_DeviceGetProperty)
+{
+    INDI::ParentDevice device(INDI::ParentDevice::Valid);
+
+    INDI::PropertyNumber number{1};
+    number.setName("SAME_NAME");
+    INDI::PropertySwitch sw{1};
+    sw.setName("SAME_NAME");
+    INDI::PropertyText text{1};
+    text.setName("OTHER_NAME");
+
+    device.registerProperty(number);
+    device.registerProperty(sw);
+    device.registerProperty(text);
+
+    ASSERT_EQ(device.getProperty("SAME_NAME").getType(), INDI_NUMBER);
+    ASSERT_EQ(device.getProperty("SAME_NAME", INDI_SWITCH).getType(), INDI_SWITCH);
+    ASSERT_EQ(device.getText("OTHER_NAME").isValid(), true);
+    ASSERT_EQ(device.getNumber("OTHER_NAME").isValid(), false);
+    ASSERT_EQ(device.getProperty("MISSING").isValid(), false);
+
+    char errmsg[MAXRBUF];
+    ASSERT_EQ(device.removeProperty("SAME_NAME", errmsg), 0);
+    ASSERT_EQ(device.getProperty("SAME_NAME").isValid(), false);
+    ASSERT_EQ(device.getProperty("OTHER_NAME").isValid(), true);
+    ASSERT_EQ(device.getProperties().size(), 1u);
+    ASSERT_NE(device.removeProperty("SAME_NAME", errmsg), 0);
+}